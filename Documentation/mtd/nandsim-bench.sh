@@ -0,0 +1,163 @@
+#!/bin/sh
+#
+# Documentation/mtd/nandsim-bench.sh
+#
+# Benchmark flash file systems on the NAND simulator: write and read
+# throughput, write amplification and mount time. See
+# Documentation/mtd/nandsim.txt for the simulator model.
+#
+# Usage: nandsim-bench.sh [-f "yaffs2 jffs2 ubifs"] [-s MiB] [-n files]
+#                         [-r rounds] [-- nandsim parameters]
+#
+# Needs root, debugfs, mtdblock and nandsim as modules; ubifs also needs
+# ubiattach, ubimkvol and ubidetach from mtd-utils.
+
+FSLIST="yaffs2 jffs2 ubifs"
+SIZE_MB=16
+FILES=64
+ROUNDS=3
+MNT=/mnt/nandsim-bench
+DBG=/sys/kernel/debug
+SRC=/tmp/nandsim-bench.$$
+# 128MiB, 2KiB page Samsung chip, sleep off the simulated chip time
+NSPARAMS="first_id_byte=0xec second_id_byte=0xf1 third_id_byte=0x00 \
+fourth_id_byte=0x95 do_delays=2"
+
+while [ $# -gt 0 ]; do
+	case "$1" in
+	-f) FSLIST="$2"; shift 2 ;;
+	-s) SIZE_MB="$2"; shift 2 ;;
+	-n) FILES="$2"; shift 2 ;;
+	-r) ROUNDS="$2"; shift 2 ;;
+	--) shift; NSPARAMS="$NSPARAMS $*"; break ;;
+	*) echo "usage: $0 [-f fslist] [-s MiB] [-n files] [-r rounds]" \
+		"[-- nandsim parameters]" >&2; exit 1 ;;
+	esac
+done
+
+die() {
+	echo "$0: $*" >&2
+	exit 1
+}
+
+now_ms() {
+	echo $(( $(date +%s%N) / 1000000 ))
+}
+
+stat_get() {
+	awk -v k="$1" '$1 == k { print $2 }' $DBG/nandsim/stats
+}
+
+stat_reset() {
+	echo 0 > $DBG/nandsim/stats
+}
+
+# KiB/s from bytes and milliseconds
+rate() {
+	[ "$2" -gt 0 ] || { echo "-"; return; }
+	echo $(( $1 * 1000 / 1024 / $2 ))
+}
+
+load_nandsim() {
+	rmmod nandsim 2>/dev/null
+	modprobe nandsim $NSPARAMS || die "cannot load nandsim"
+	modprobe mtdblock 2>/dev/null
+	MTD=$(awk -F: '/NAND simulator/ { print substr($1, 4); exit }' \
+	      /proc/mtd)
+	[ -n "$MTD" ] || die "no nandsim mtd device"
+	[ -f $DBG/nandsim/stats ] || die "no $DBG/nandsim/stats"
+}
+
+fs_mount() {
+	case "$1" in
+	yaffs2|jffs2)
+		mount -t $1 /dev/mtdblock$MTD $MNT ;;
+	ubifs)
+		ubiattach /dev/ubi_ctrl -m $MTD >/dev/null || return 1
+		[ -e /dev/ubi0_0 ] ||
+			ubimkvol /dev/ubi0 -N bench -m >/dev/null || return 1
+		mount -t ubifs ubi0:bench $MNT ;;
+	esac
+}
+
+fs_umount() {
+	umount $MNT || return 1
+	[ "$1" = ubifs ] && ubidetach /dev/ubi_ctrl -m $MTD
+	return 0
+}
+
+bench_fs() {
+	fs=$1
+	fsize=$(( SIZE_MB * 1024 / FILES ))
+
+	load_nandsim
+	fs_mount $fs || { echo "$fs: cannot mount, skipped"; return; }
+
+	# write everything, then rewrite every other file to make the
+	# file system collect garbage
+	stat_reset
+	user=0
+	t0=$(now_ms)
+	r=1
+	while [ $r -le $ROUNDS ]; do
+		i=1
+		while [ $i -le $FILES ]; do
+			if [ $r -eq 1 ] || [ $(( (i + r) % 2 )) -eq 0 ]; then
+				rm -f $MNT/f$i
+				cp $SRC $MNT/f$i || break 2
+				user=$(( user + fsize * 1024 ))
+			fi
+			i=$(( i + 1 ))
+		done
+		sync
+		r=$(( r + 1 ))
+	done
+	t1=$(now_ms)
+	wr_ms=$(( t1 - t0 ))
+	wr_busy=$(( $(stat_get busy_us) / 1000 ))
+	flash=$(stat_get bytes_programmed)
+	wa=$(awk -v f=$flash -v u=$user 'BEGIN { printf "%.2f", f / u }')
+
+	fs_umount $fs || die "cannot unmount $fs"
+
+	stat_reset
+	t0=$(now_ms)
+	fs_mount $fs || die "cannot remount $fs"
+	t1=$(now_ms)
+	mnt_ms=$(( t1 - t0 ))
+	mnt_pages=$(stat_get pages_read)
+
+	echo 3 > /proc/sys/vm/drop_caches
+	stat_reset
+	t0=$(now_ms)
+	cat $MNT/f* > /dev/null
+	t1=$(now_ms)
+	rd_ms=$(( t1 - t0 ))
+	rd_bytes=$(( FILES * fsize * 1024 ))
+	flips=$(stat_get bitflips)
+	corr=$(stat_get ecc_corrected)
+
+	fs_umount $fs
+	rmmod nandsim
+
+	printf "%-7s %9s %9s %6s %8s %8s %9s %8s %9s\n" $fs \
+	       $(rate $user $wr_ms) $(rate $user $wr_busy) $wa \
+	       $mnt_ms $mnt_pages $(rate $rd_bytes $rd_ms) $flips $corr
+}
+
+[ $(id -u) -eq 0 ] || die "must be run as root"
+grep -q " $DBG debugfs" /proc/mounts || mount -t debugfs none $DBG ||
+	die "cannot mount debugfs"
+mkdir -p $MNT || die "cannot create $MNT"
+dd if=/dev/urandom of=$SRC bs=1024 count=$(( SIZE_MB * 1024 / FILES )) \
+   2>/dev/null || die "cannot create $SRC"
+
+echo "nandsim: $NSPARAMS"
+echo "$SIZE_MB MiB in $FILES files, $ROUNDS rounds"
+printf "%-7s %9s %9s %6s %8s %8s %9s %8s %9s\n" fs "wr KiB/s" \
+       "chip KiB/s" WA "mount ms" "mnt pgs" "rd KiB/s" bitflips corrected
+for fs in $FSLIST; do
+	bench_fs $fs
+done
+
+rm -f $SRC
@@ -32,16 +32,33 @@
 /*
  * TLB handling.  This allows us to remove pages from the page
  * tables, and efficiently handle the TLB issues.
+ *
+ * The range unmapped since the last TLB flush is collected over the
+ * adjacent vmas of a batch and flushed once, when the batch ends, before
+ * page tables are freed, or when the next vma is not adjacent.  tlb->vma
+ * stands in for the vmas in flush_tlb_range(): it carries the mm, the
+ * end of the last vma, and VM_EXEC if any of them may have been
+ * executable so that the I-TLB is flushed as well.
  */
 struct mmu_gather {
 	struct mm_struct	*mm;
 	unsigned int		fullmm;
+	struct vm_area_struct	vma;
 	unsigned long		range_start;
 	unsigned long		range_end;
 };
 
 DECLARE_PER_CPU(struct mmu_gather, mmu_gathers);
 
+static inline void tlb_flush(struct mmu_gather *tlb)
+{
+	if (!tlb->fullmm && tlb->range_end > 0) {
+		flush_tlb_range(&tlb->vma, tlb->range_start, tlb->range_end);
+		tlb->range_start = TASK_SIZE;
+		tlb->range_end = 0;
+	}
+}
+
 static inline struct mmu_gather *
 tlb_gather_mmu(struct mm_struct *mm, unsigned int full_mm_flush)
 {
@@ -50,6 +67,16 @@ tlb_gather_mmu(struct mm_struct *mm, unsigned int full_mm_flush)
 	tlb->mm = mm;
 	tlb->fullmm = full_mm_flush;
 
+	/*
+	 * unmap_vmas() may restart a batch in the middle of a vma without
+	 * calling tlb_start_vma() again, so assume VM_EXEC until told.
+	 */
+	tlb->vma.vm_mm = mm;
+	tlb->vma.vm_end = 0;
+	tlb->vma.vm_flags = VM_EXEC;
+	tlb->range_start = TASK_SIZE;
+	tlb->range_end = 0;
+
 	return tlb;
 }
 
@@ -58,6 +85,8 @@ tlb_finish_mmu(struct mmu_gather *tlb, unsigned long start, unsigned long end)
 {
 	if (tlb->fullmm)
 		flush_tlb_mm(tlb->mm);
+	else
+		tlb_flush(tlb);
 
 	/* keep the page table cache within bounds */
 	check_pgt_cache();
@@ -89,21 +118,35 @@ tlb_start_vma(struct mmu_gather *tlb, struct vm_area_struct *vma)
 {
 	if (!tlb->fullmm) {
 		flush_cache_range(vma, vma->vm_start, vma->vm_end);
-		tlb->range_start = TASK_SIZE;
-		tlb->range_end = 0;
+		/* don't stretch the flushed range over a hole */
+		if (vma->vm_start != tlb->vma.vm_end) {
+			tlb_flush(tlb);
+			tlb->vma.vm_flags = 0;
+		}
+		tlb->vma.vm_end = vma->vm_end;
+		tlb->vma.vm_flags |= vma->vm_flags & VM_EXEC;
 	}
 }
 
 static inline void
 tlb_end_vma(struct mmu_gather *tlb, struct vm_area_struct *vma)
 {
-	if (!tlb->fullmm && tlb->range_end > 0)
-		flush_tlb_range(vma, tlb->range_start, tlb->range_end);
 }
 
 #define tlb_remove_page(tlb,page)	free_page_and_swap_cache(page)
-#define pte_free_tlb(tlb, ptep, addr)	pte_free((tlb)->mm, ptep)
-#define pmd_free_tlb(tlb, pmdp, addr)	pmd_free((tlb)->mm, pmdp)
+
+/* stale entries must be gone before the page tables are reused */
+#define pte_free_tlb(tlb, ptep, addr)			\
+	do {						\
+		tlb_flush(tlb);				\
+		pte_free((tlb)->mm, ptep);		\
+	} while (0)
+
+#define pmd_free_tlb(tlb, pmdp, addr)			\
+	do {						\
+		tlb_flush(tlb);				\
+		pmd_free((tlb)->mm, pmdp);		\
+	} while (0)
 
 #define tlb_migrate_finish(mm)		do { } while (0)
 
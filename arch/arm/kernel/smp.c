@@ -635,23 +635,38 @@ void flush_tlb_all(void)
 		local_flush_tlb_all();
 }
 
+/*
+ * No other cpu can hold TLB entries of the mm when only this one is in
+ * its cpumask, so a local flush does and no IPI needs to be sent.
+ * Must be called with preemption disabled.
+ */
+static inline int mm_tlb_is_local(struct mm_struct *mm)
+{
+	return cpumask_any_but(mm_cpumask(mm), smp_processor_id()) >=
+		nr_cpu_ids;
+}
+
 void flush_tlb_mm(struct mm_struct *mm)
 {
-	if (tlb_ops_need_broadcast())
+	preempt_disable();
+	if (tlb_ops_need_broadcast() && !mm_tlb_is_local(mm))
 		on_each_cpu_mask(ipi_flush_tlb_mm, mm, 1, mm_cpumask(mm));
 	else
 		local_flush_tlb_mm(mm);
+	preempt_enable();
 }
 
 void flush_tlb_page(struct vm_area_struct *vma, unsigned long uaddr)
 {
-	if (tlb_ops_need_broadcast()) {
+	preempt_disable();
+	if (tlb_ops_need_broadcast() && !mm_tlb_is_local(vma->vm_mm)) {
 		struct tlb_args ta;
 		ta.ta_vma = vma;
 		ta.ta_start = uaddr;
 		on_each_cpu_mask(ipi_flush_tlb_page, &ta, 1, mm_cpumask(vma->vm_mm));
 	} else
 		local_flush_tlb_page(vma, uaddr);
+	preempt_enable();
 }
 
 void flush_tlb_kernel_page(unsigned long kaddr)
@@ -667,7 +682,8 @@ void flush_tlb_kernel_page(unsigned long kaddr)
 void flush_tlb_range(struct vm_area_struct *vma,
                      unsigned long start, unsigned long end)
 {
-	if (tlb_ops_need_broadcast()) {
+	preempt_disable();
+	if (tlb_ops_need_broadcast() && !mm_tlb_is_local(vma->vm_mm)) {
 		struct tlb_args ta;
 		ta.ta_vma = vma;
 		ta.ta_start = start;
@@ -675,6 +691,7 @@ void flush_tlb_range(struct vm_area_struct *vma,
 		on_each_cpu_mask(ipi_flush_tlb_range, &ta, 1, mm_cpumask(vma->vm_mm));
 	} else
 		local_flush_tlb_range(vma, start, end);
+	preempt_enable();
 }
 
 void flush_tlb_kernel_range(unsigned long start, unsigned long end)
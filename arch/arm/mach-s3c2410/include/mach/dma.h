@@ -15,6 +15,7 @@
 
 #include <plat/dma.h>
 #include <linux/sysdev.h>
+#include <linux/ktime.h>
 
 #define MAX_DMA_TRANSFER_SIZE   0x100000 /* Data Unit is half word  */
 
@@ -48,6 +49,7 @@ enum dma_ch {
 	DMACH_UART2_SRC2,
 	DMACH_UART3,		/* s3c2443 has extra uart */
 	DMACH_UART3_SRC2,
+	DMACH_NAND,		/* software triggered, no request line */
 	DMACH_MAX,		/* the end entry */
 };
 
@@ -123,6 +125,8 @@ struct s3c2410_dma_buf {
 	dma_addr_t		 data;		/* start of DMA data */
 	dma_addr_t		 ptr;		/* where the DMA got to [1] */
 	void			*id;		/* client's id */
+	int			 cb_size;	/* size passed to the callback,
+						 * 0 for no callback */
 };
 
 /* [1] is this updated for both recv/send modes? */
@@ -133,8 +137,20 @@ struct s3c2410_dma_stats {
 	unsigned long		timeout_shortest;
 	unsigned long		timeout_avg;
 	unsigned long		timeout_failed;
+
+	unsigned long		buffers;	/* buffers queued */
+	unsigned long		batches;	/* s3c2410_dma_enqueue_sg() calls */
+	unsigned long		callbacks;	/* buffer done callbacks made */
+	unsigned long		irqs;		/* buffer done interrupts */
+	unsigned long		pool_misses;	/* descriptors from the slab */
+	unsigned long long	bytes;		/* bytes queued */
+	u64			busy_ns;	/* time spent running */
 };
 
+/* descriptors preallocated for each channel, the slab cache is only
+ * used once these run out */
+#define S3C2410_DMA_NR_BUFS	32
+
 struct s3c2410_dma_map;
 
 /* struct s3c2410_dma_chan
@@ -184,12 +200,30 @@ struct s3c2410_dma_chan {
 	struct s3c2410_dma_buf	*next;		/* next buffer to load */
 	struct s3c2410_dma_buf	*end;		/* end of queue */
 
+	/* descriptor pool */
+	struct s3c2410_dma_buf	*free;		/* free pool descriptors */
+	struct s3c2410_dma_buf	 bufs[S3C2410_DMA_NR_BUFS];
+
+	ktime_t			 started;	/* when the channel last started */
+
 	/* system device */
 	struct sys_device	dev;
 };
 
 typedef unsigned long dma_device_t;
 
+struct scatterlist;
+
+/* s3c2410_dma_enqueue_sg
+ *
+ * queue all the segments of a dma mapped scatterlist in one call. The
+ * buffer done callback is made once, when the last segment is done,
+ * with the total size of the list.
+*/
+
+extern int s3c2410_dma_enqueue_sg(unsigned int channel, void *id,
+				  struct scatterlist *sg, int nents);
+
 static inline bool s3c_dma_has_circular(void)
 {
 	return false;
@@ -32,6 +32,7 @@
 #include <mach/regs-sdi.h>
 #include <plat/regs-iis.h>
 #include <plat/regs-spi.h>
+#include <plat/regs-nand.h>
 
 /*dma通道映射*/
 static struct s3c24xx_dma_map __initdata s3c2440_dma_mappings[] = {
@@ -134,6 +135,15 @@ static struct s3c24xx_dma_map __initdata s3c2440_dma_mappings[] = {
 		.name		= "usb-ep4",
 		.channels[3]	= S3C2410_DCON_CH3_USBEP4 | DMA_CH_VALID,
 	},
+	[DMACH_NAND] = {
+		.name		= "nand",
+		.channels[0]	= DMA_CH_VALID,
+		.channels[1]	= DMA_CH_VALID,
+		.channels[2]	= DMA_CH_VALID,
+		.channels[3]	= DMA_CH_VALID,
+		.hw_addr.to	= S3C2410_PA_NAND + S3C2440_NFDATA,
+		.hw_addr.from	= S3C2410_PA_NAND + S3C2440_NFDATA,
+	},
 };
 
 /*s3c2410_dma_select:选择dma通道*/
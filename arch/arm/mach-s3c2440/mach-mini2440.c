@@ -67,6 +67,7 @@
 #include <plat/nand.h>
 #include <plat/pm.h>
 #include <plat/mci.h>
+#include <plat/ts.h>
 
 
 #include <sound/s3c24xx_uda134x.h>
@@ -457,6 +458,12 @@ static struct s3c24xx_mci_pdata mini2440_mmc_cfg = {
    .gpio_wprotect = S3C2410_GPH(8),
    .set_power     = NULL,
    .ocr_avail     = MMC_VDD_32_33|MMC_VDD_33_34,
+   .use_dma       = 1,
+};
+
+static struct s3c2410_ts_mach_info mini2440_ts_cfg = {
+	.delay			= 10000,
+	.oversampling_shift	= 3,
 };
 
 static struct i2c_board_info const  info_i2c_devices[] = {
@@ -476,6 +483,7 @@ static struct platform_device *mini2440_devices[] __initdata = {
 	&s3c_device_i2c0,
 	&s3c_device_iis,
 	&s3c_device_adc,
+	&s3c_device_ts,
 	&mini2440_device_eth,
 	&s3c24xx_uda134x,
 	&s3c_device_nand,
@@ -503,6 +511,7 @@ static void __init mini2440_machine_init(void)
 
 	s3c_device_nand.dev.platform_data = &friendly_arm_nand_info;
 	s3c_device_sdi.dev.platform_data = &mini2440_mmc_cfg;
+	s3c_device_ts.dev.platform_data = &mini2440_ts_cfg;
 	platform_add_devices(mini2440_devices, ARRAY_SIZE(mini2440_devices));
 	s3c_pm_init();
 }
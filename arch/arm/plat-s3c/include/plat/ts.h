@@ -0,0 +1,28 @@
+/* arch/arm/plat-s3c/include/plat/ts.h
+ *
+ * S3C24XX touchscreen driver information
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+*/
+
+#ifndef __ASM_PLAT_TS_H
+#define __ASM_PLAT_TS_H __FILE__
+
+struct platform_device;
+
+/**
+ * struct s3c2410_ts_mach_info - touchscreen platform data
+ * @delay: ADCDLY value, the settling time before each conversion.
+ * @oversampling_shift: log2 of the number of samples filtered into
+ *	one reported position, at most 4.
+ * @cfg_gpio: optional hook to configure the touchscreen pins.
+ */
+struct s3c2410_ts_mach_info {
+	int	delay;
+	int	oversampling_shift;
+	void	(*cfg_gpio)(struct platform_device *dev);
+};
+
+#endif /* __ASM_PLAT_TS_H */
@@ -26,6 +26,10 @@
 #include <linux/slab.h>
 #include <linux/errno.h>
 #include <linux/io.h>
+#include <linux/scatterlist.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/math64.h>
 
 #include <asm/system.h>
 #include <asm/irq.h>
@@ -281,8 +285,13 @@ static inline void
 s3c2410_dma_buffdone(struct s3c2410_dma_chan *chan, struct s3c2410_dma_buf *buf,
 		     enum s3c2410_dma_buffresult result)
 {
+	/* only the last buffer of a batch reports back */
+	if (buf->cb_size == 0)
+		return;
+
 	if (chan->callback_fn != NULL) {
-		(chan->callback_fn)(chan, buf->id, buf->size, result);
+		chan->stats->callbacks++;
+		(chan->callback_fn)(chan, buf->id, buf->cb_size, result);
 	}
 }
 
@@ -304,6 +313,7 @@ static int s3c2410_dma_start(struct s3c2410_dma_chan *chan)
 	}
 
 	chan->state = S3C2410_DMA_RUNNING;
+	chan->started = ktime_get();
 
     /*查看是否有传输请求*/
 	if (chan->load_state == S3C2410_DMALOAD_NONE) {
@@ -333,6 +343,11 @@ static int s3c2410_dma_start(struct s3c2410_dma_chan *chan)
 	tmp |= S3C2410_DMASKTRIG_ON;
 	dma_wrreg(chan, S3C2410_DMA_DMASKTRIG, tmp);
 
+	/* channels without a request line are kicked off by software */
+	if (!(chan->dcon & S3C2410_DCON_HWTRIG))
+		dma_wrreg(chan, S3C2410_DMA_DMASKTRIG,
+			  tmp | S3C2410_DMASKTRIG_SWTRIG);
+
 	pr_debug("dma%d: %08lx to DMASKTRIG\n", chan->number, tmp);
 
 	s3c2410_dma_call_op(chan, S3C2410_DMAOP_START);
@@ -381,22 +396,63 @@ s3c2410_dma_canload(struct s3c2410_dma_chan *chan)
 	return 0;
 }
 
-/* s3c2410_dma_enqueue: 加载dma传输请求*/
-int s3c2410_dma_enqueue(unsigned int channel, void *id,
-			dma_addr_t data, int size)
+/* s3c2410_dma_allocbuf
+ *
+ * take a descriptor from the channel's pool, or from the slab cache if
+ * the pool is empty. Called with interrupts disabled.
+*/
+
+static struct s3c2410_dma_buf *
+s3c2410_dma_allocbuf(struct s3c2410_dma_chan *chan)
 {
-	struct s3c2410_dma_chan *chan = s3c_dma_lookup_channel(channel);
-	struct s3c2410_dma_buf *buf;
-	unsigned long flags;
+	struct s3c2410_dma_buf *buf = chan->free;
 
-	if (chan == NULL)
-		return -EINVAL;
+	if (buf != NULL) {
+		chan->free = buf->next;
+	} else {
+		buf = kmem_cache_alloc(dma_kmem, GFP_ATOMIC);
+		if (buf == NULL)
+			return NULL;
+		chan->stats->pool_misses++;
+	}
 
-	pr_debug("%s: id=%p, data=%08x, size=%d\n",
-		 __func__, id, (unsigned int)data, size);
+	buf->next = NULL;
+	return buf;
+}
+
+/*s3c2410_dma_freebuf:释放dma传输请求结构*/
+static inline void
+s3c2410_dma_freebuf(struct s3c2410_dma_chan *chan, struct s3c2410_dma_buf *buf)
+{
+	int magicok = (buf->magic == BUF_MAGIC);
+
+	buf->magic = -1;
+
+	if (!magicok) {
+		printk("s3c2410_dma_freebuf: buff %p with bad magic\n", buf);
+		return;
+	}
+
+	if (buf >= chan->bufs && buf < chan->bufs + S3C2410_DMA_NR_BUFS) {
+		buf->next = chan->free;
+		chan->free = buf;
+	} else {
+		kmem_cache_free(dma_kmem, buf);
+	}
+}
 
-	/*初始化传输请求*/
-	buf = kmem_cache_alloc(dma_kmem, GFP_ATOMIC);
+/* s3c2410_dma_queuebuf
+ *
+ * add a buffer to the end of the channel's queue without loading it.
+ * Called with interrupts disabled.
+*/
+
+static int s3c2410_dma_queuebuf(struct s3c2410_dma_chan *chan, void *id,
+				dma_addr_t data, int size, int cb_size)
+{
+	struct s3c2410_dma_buf *buf;
+
+	buf = s3c2410_dma_allocbuf(chan);
 	if (buf == NULL) {
 		pr_debug("%s: out of memory (%ld alloc)\n",
 			 __func__, (long)sizeof(*buf));
@@ -407,8 +463,7 @@ int s3c2410_dma_enqueue(unsigned int channel, void *id,
 	buf->size  = size;
 	buf->id    = id;
 	buf->magic = BUF_MAGIC;
-
-	local_irq_save(flags);
+	buf->cb_size = cb_size;
 
 	/*加载到传输队列中*/
 	if (chan->curr == NULL) {
@@ -435,6 +490,20 @@ int s3c2410_dma_enqueue(unsigned int channel, void *id,
 	if (chan->next == NULL)
 		chan->next = buf;
 
+	chan->stats->buffers++;
+	chan->stats->bytes += size;
+
+	return 0;
+}
+
+/* s3c2410_dma_kick
+ *
+ * load newly queued buffers onto a running channel, or start an idle
+ * one if it is set to autostart. Called with interrupts disabled.
+*/
+
+static int s3c2410_dma_kick(struct s3c2410_dma_chan *chan)
+{
 	/* check to see if we can load a buffer */
 	if (chan->state == S3C2410_DMA_RUNNING) {
 		if (chan->load_state == S3C2410_DMALOAD_1LOADED && 1) {
@@ -443,7 +512,6 @@ int s3c2410_dma_enqueue(unsigned int channel, void *id,
 				       "timeout loading buffer\n",
 				       chan->number);
 				dbg_showchan(chan);
-				local_irq_restore(flags);
 				return -EINVAL;
 			}
 		}
@@ -458,27 +526,110 @@ int s3c2410_dma_enqueue(unsigned int channel, void *id,
 		}
 	}
 
-	local_irq_restore(flags);
 	return 0;
 }
 
+/* s3c2410_dma_enqueue: 加载dma传输请求*/
+int s3c2410_dma_enqueue(unsigned int channel, void *id,
+			dma_addr_t data, int size)
+{
+	struct s3c2410_dma_chan *chan = s3c_dma_lookup_channel(channel);
+	unsigned long flags;
+	int ret;
+
+	if (chan == NULL)
+		return -EINVAL;
+
+	pr_debug("%s: id=%p, data=%08x, size=%d\n",
+		 __func__, id, (unsigned int)data, size);
+
+	local_irq_save(flags);
+
+	ret = s3c2410_dma_queuebuf(chan, id, data, size, size);
+	if (ret == 0)
+		ret = s3c2410_dma_kick(chan);
+
+	local_irq_restore(flags);
+	return ret;
+}
+
 EXPORT_SYMBOL(s3c2410_dma_enqueue);
 
-/*s3c2410_dma_freebuf:释放dma传输请求结构slab缓存*/
-static inline void
-s3c2410_dma_freebuf(struct s3c2410_dma_buf *buf)
+/* s3c2410_dma_enqueue_sg
+ *
+ * queue every segment of a dma mapped scatterlist with interrupts
+ * disabled once, and have the callback made only for the last one.
+ * If a descriptor cannot be had, or the channel times out loading the
+ * buffer ahead of them, the segments already queued are taken off again
+ * and nothing is started.
+*/
+
+int s3c2410_dma_enqueue_sg(unsigned int channel, void *id,
+			   struct scatterlist *sg, int nents)
 {
-	int magicok = (buf->magic == BUF_MAGIC);
+	struct s3c2410_dma_chan *chan = s3c_dma_lookup_channel(channel);
+	struct s3c2410_dma_buf *old_end, *old_next, *buf, *tmp;
+	struct scatterlist *s;
+	unsigned long flags;
+	int total = 0;
+	int ret = 0;
+	int i;
 
-	buf->magic = -1;
+	if (chan == NULL || nents <= 0)
+		return -EINVAL;
 
-	if (magicok) {
-		kmem_cache_free(dma_kmem, buf);
-	} else {
-		printk("s3c2410_dma_freebuf: buff %p with bad magic\n", buf);
+	for_each_sg(sg, s, nents, i)
+		total += sg_dma_len(s);
+
+	pr_debug("%s: id=%p, %d segments, %d bytes\n",
+		 __func__, id, nents, total);
+
+	local_irq_save(flags);
+
+	/* chan->end is stale once the queue has run empty */
+	old_end = (chan->curr != NULL) ? chan->end : NULL;
+	old_next = chan->next;
+
+	for_each_sg(sg, s, nents, i) {
+		ret = s3c2410_dma_queuebuf(chan, id, sg_dma_address(s),
+					   sg_dma_len(s),
+					   (i == nents - 1) ? total : 0);
+		if (ret)
+			goto unwind;
+	}
+
+	/* a failed kick gives up before loading any of the new buffers */
+	ret = s3c2410_dma_kick(chan);
+	if (ret)
+		goto unwind;
+
+	chan->stats->batches++;
+	local_irq_restore(flags);
+	return 0;
+
+ unwind:
+	/* nothing new can have been loaded with interrupts off */
+	buf = (old_end != NULL) ? old_end->next : chan->curr;
+	for (; buf != NULL; buf = tmp) {
+		tmp = buf->next;
+		chan->stats->buffers--;
+		chan->stats->bytes -= buf->size;
+		s3c2410_dma_freebuf(chan, buf);
 	}
+
+	if (old_end != NULL)
+		old_end->next = NULL;
+	else
+		chan->curr = NULL;
+	chan->end = old_end;
+	chan->next = old_next;
+
+	local_irq_restore(flags);
+	return ret;
 }
 
+EXPORT_SYMBOL(s3c2410_dma_enqueue_sg);
+
 /*s3c2410_dma_lasttcfer:最后传输请求管理*/
 static inline void
 s3c2410_dma_lastxfer(struct s3c2410_dma_chan *chan)
@@ -525,6 +676,8 @@ s3c2410_dma_irq(int irq, void *devpw)
 
 	buf = chan->curr;
 
+	chan->stats->irqs++;
+
 	dbg_showchan(chan);
 
 	/* modify the channel state */
@@ -585,7 +738,7 @@ s3c2410_dma_irq(int irq, void *devpw)
 		s3c2410_dma_buffdone(chan, buf, S3C2410_RES_OK);
 
 		/* free resouces */
-		s3c2410_dma_freebuf(buf);
+		s3c2410_dma_freebuf(chan, buf);
 	} else {
 	}
     /*加载下一个传输请求(dma通道未被关闭的情况下)*/
@@ -760,6 +913,10 @@ static int s3c2410_dma_dostop(struct s3c2410_dma_chan *chan)
 
 	s3c2410_dma_call_op(chan,  S3C2410_DMAOP_STOP);
 
+	if (chan->state == S3C2410_DMA_RUNNING)
+		chan->stats->busy_ns +=
+			ktime_to_ns(ktime_sub(ktime_get(), chan->started));
+
 	/*注:只设置了stop位，真正的停止由on/off位控制
 	 * 这样可以得到一次刷新的机会，可以防止数据的
 	 * 丢失*/
@@ -825,7 +982,7 @@ static int s3c2410_dma_flush(struct s3c2410_dma_chan *chan)
 			       __func__, buf, buf->next);
 
 			s3c2410_dma_buffdone(chan, buf, S3C2410_RES_ABORT);
-			s3c2410_dma_freebuf(buf);
+			s3c2410_dma_freebuf(chan, buf);
 		}
 	}
 
@@ -955,6 +1112,12 @@ int s3c2410_dma_config(unsigned int channel,
 		dcon |= S3C2410_DCON_HANDSHAKE;
 		dcon |= S3C2410_DCON_SYNC_HCLK;
 		break;
+
+	case DMACH_NAND:
+		/* no request line: one software trigger moves the lot */
+		dcon |= S3C2410_DCON_SYNC_HCLK;
+		dcon |= S3C2410_DCON_WHOLESERV;
+		break;
 	}
 
 	/*配置传输单元大小*/
@@ -977,7 +1140,8 @@ int s3c2410_dma_config(unsigned int channel,
 	}
 
 	/*dma配置为硬件触发,中断模式*/
-	dcon |= S3C2410_DCON_HWTRIG;
+	if (chan->req_ch != DMACH_NAND)
+		dcon |= S3C2410_DCON_HWTRIG;
 	dcon |= S3C2410_DCON_INTREQ;
 
 	pr_debug("%s: dcon now %08x\n", __func__, dcon);
@@ -1020,6 +1184,7 @@ int s3c2410_dma_devconfig(int channel,
 	switch (chan->req_ch) {
 	case DMACH_XD0:
 	case DMACH_XD1:
+	case DMACH_NAND:
 		hwcfg = 0; /* AHB */
 		break;
 
@@ -1199,6 +1364,106 @@ static int __init s3c24xx_dma_sysdev_register(void)
 
 late_initcall(s3c24xx_dma_sysdev_register);
 
+#ifdef CONFIG_DEBUG_FS
+
+/* per channel utilisation, in <debugfs>/s3c24xx-dma. Writing to the
+ * file resets the counters. */
+
+static ktime_t dma_stats_since;
+
+static int s3c24xx_dma_stats_show(struct seq_file *seq, void *v)
+{
+	struct s3c2410_dma_chan *cp;
+	struct s3c2410_dma_stats st;
+	unsigned long flags;
+	ktime_t now = ktime_get();
+	u64 window, busy;
+	unsigned int permille;
+	int channel;
+
+	window = ktime_to_ns(ktime_sub(now, dma_stats_since));
+	if (window == 0)
+		window = 1;
+
+	seq_printf(seq, "ch client     buffers  batches callbacks     irqs "
+		   "pool_miss        bytes  busy%%\n");
+
+	for (channel = 0; channel < dma_channels; channel++) {
+		cp = &s3c2410_chans[channel];
+
+		local_irq_save(flags);
+		st = *cp->stats;
+		busy = st.busy_ns;
+		if (cp->state == S3C2410_DMA_RUNNING)
+			busy += ktime_to_ns(ktime_sub(now, cp->started));
+		local_irq_restore(flags);
+
+		permille = div64_u64(busy * 1000, window);
+		seq_printf(seq, "%2d %-10s %8lu %8lu %9lu %8lu %9lu %12llu "
+			   "%3u.%u\n", channel,
+			   cp->client ? cp->client->name : "-",
+			   st.buffers, st.batches, st.callbacks, st.irqs,
+			   st.pool_misses, st.bytes,
+			   permille / 10, permille % 10);
+	}
+
+	return 0;
+}
+
+static int s3c24xx_dma_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, s3c24xx_dma_stats_show, NULL);
+}
+
+static ssize_t s3c24xx_dma_stats_write(struct file *file,
+				       const char __user *buf,
+				       size_t count, loff_t *ppos)
+{
+	struct s3c2410_dma_chan *cp;
+	unsigned long flags;
+	int channel;
+
+	local_irq_save(flags);
+
+	dma_stats_since = ktime_get();
+
+	for (channel = 0; channel < dma_channels; channel++) {
+		cp = &s3c2410_chans[channel];
+
+		memset(cp->stats, 0, sizeof(*cp->stats));
+		cp->stats->timeout_shortest = LONG_MAX;
+		cp->started = dma_stats_since;
+	}
+
+	local_irq_restore(flags);
+
+	return count;
+}
+
+static const struct file_operations s3c24xx_dma_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= s3c24xx_dma_stats_open,
+	.read		= seq_read,
+	.write		= s3c24xx_dma_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static int __init s3c24xx_dma_debugfs_init(void)
+{
+	if (dma_base == NULL)
+		return 0;
+
+	dma_stats_since = ktime_get();
+	debugfs_create_file("s3c24xx-dma", S_IRUGO | S_IWUSR, NULL, NULL,
+			    &s3c24xx_dma_stats_fops);
+	return 0;
+}
+
+late_initcall(s3c24xx_dma_debugfs_init);
+
+#endif /* CONFIG_DEBUG_FS */
+
 /* s3c24xx_dma_init:初始化s3c24xx dma*/
 int __init s3c24xx_dma_init(unsigned int channels, unsigned int irq,
 			    unsigned int stride)
@@ -1206,6 +1471,7 @@ int __init s3c24xx_dma_init(unsigned int channels, unsigned int irq,
 	struct s3c2410_dma_chan *cp;
 	int channel;
 	int ret;
+	int i;
 
 	printk("S3C24XX DMA Driver, (c) 2003-2004,2006 Simtec Electronics\n");
 
@@ -1249,6 +1515,12 @@ int __init s3c24xx_dma_init(unsigned int channels, unsigned int irq,
 
 		cp->load_timeout = 1<<18;
 
+		/* descriptor pool */
+		for (i = 0; i < S3C2410_DMA_NR_BUFS; i++) {
+			cp->bufs[i].next = cp->free;
+			cp->free = &cp->bufs[i];
+		}
+
 		printk("DMA channel %d at %p, irq %d\n",
 		       cp->number, cp->regs, cp->irq);
 	}
@@ -72,6 +72,7 @@
 #define S3C2410_DCON_AUTORELOAD		(0<<22)
 #define S3C2410_DCON_NORELOAD		(1<<22)
 #define S3C2410_DCON_HWTRIG		(1<<23)
+#define S3C2410_DCON_WHOLESERV		(1<<27)
 
 #ifdef CONFIG_CPU_S3C2440
 #define S3C2440_DIDSTC_CHKINT		(1<<2)
@@ -182,4 +182,34 @@ static inline unsigned long __cmpxchg_local(volatile void *ptr,
 	cmpxchg_local((ptr), (o), (n));					\
 })
 
+/*
+ * Compare the two adjacent words at ptr with o1 and o2 and, if both
+ * match, replace them with n1 and n2. This is atomic with respect to
+ * interrupts on the local cpu only. Returns 1 on success.
+ */
+#define cmpxchg16b_local(ptr, o1, o2, n1, n2)				\
+({									\
+	char __ret;							\
+	__typeof__(o2) __junk;						\
+	__typeof__(*(ptr)) __old1 = (o1);				\
+	__typeof__(o2) __old2 = (o2);					\
+	__typeof__(*(ptr)) __new1 = (n1);				\
+	__typeof__(o2) __new2 = (n2);					\
+	asm volatile("cmpxchg16b %2; setz %1"				\
+		     : "=d" (__junk), "=a" (__ret), "+m" (*(ptr))	\
+		     : "a" (__old1), "d" (__old2),			\
+		       "b" (__new1), "c" (__new2)			\
+		     : "memory");					\
+	__ret;								\
+})
+
+#define cmpxchg_double_local(ptr, o1, o2, n1, n2)			\
+({									\
+	BUILD_BUG_ON(sizeof(*(ptr)) != 8);				\
+	VM_BUG_ON((unsigned long)(ptr) % 16);				\
+	cmpxchg16b_local((ptr), (o1), (o2), (n1), (n2));		\
+})
+
+#define system_has_cmpxchg_double() boot_cpu_has(X86_FEATURE_CX16)
+
 #endif /* _ASM_X86_CMPXCHG_64_H */
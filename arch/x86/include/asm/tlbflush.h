@@ -76,6 +76,7 @@ static inline void __flush_tlb_one(unsigned long addr)
  *  - flush_tlb_mm(mm) flushes the specified mm context TLB's
  *  - flush_tlb_page(vma, vmaddr) flushes one page
  *  - flush_tlb_range(vma, start, end) flushes a range of pages
+ *  - flush_tlb_mm_range(mm, start, end) flushes a range of the mm's pages
  *  - flush_tlb_kernel_range(start, end) flushes a range of kernel pages
  *  - flush_tlb_others(cpumask, mm, va) flushes TLBs on other cpus
  *
@@ -83,8 +84,8 @@ static inline void __flush_tlb_one(unsigned long addr)
  * and page-granular flushes are available only on i486 and up.
  *
  * x86-64 can only flush individual pages or full VMs. For a range flush
- * we always do the full VM. Might be worth trying if for a small
- * range a few INVLPGs in a row are a win.
+ * we do the full VM unless the range is a single page. Might be worth
+ * trying if for a small range a few INVLPGs in a row are a win.
  */
 
 #ifndef CONFIG_SMP
@@ -106,11 +107,21 @@ static inline void flush_tlb_page(struct vm_area_struct *vma,
 		__flush_tlb_one(addr);
 }
 
+static inline void flush_tlb_mm_range(struct mm_struct *mm,
+				      unsigned long start, unsigned long end)
+{
+	if (mm != current->active_mm)
+		return;
+	if (end - start == PAGE_SIZE)
+		__flush_tlb_one(start);
+	else
+		__flush_tlb();
+}
+
 static inline void flush_tlb_range(struct vm_area_struct *vma,
 				   unsigned long start, unsigned long end)
 {
-	if (vma->vm_mm == current->active_mm)
-		__flush_tlb();
+	flush_tlb_mm_range(vma->vm_mm, start, end);
 }
 
 static inline void native_flush_tlb_others(const struct cpumask *cpumask,
@@ -133,13 +144,15 @@ extern void flush_tlb_all(void);
 extern void flush_tlb_current_task(void);
 extern void flush_tlb_mm(struct mm_struct *);
 extern void flush_tlb_page(struct vm_area_struct *, unsigned long);
+extern void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
+			       unsigned long end);
 
 #define flush_tlb()	flush_tlb_current_task()
 
 static inline void flush_tlb_range(struct vm_area_struct *vma,
 				   unsigned long start, unsigned long end)
 {
-	flush_tlb_mm(vma->vm_mm);
+	flush_tlb_mm_range(vma->vm_mm, start, end);
 }
 
 void native_flush_tlb_others(const struct cpumask *cpumask,
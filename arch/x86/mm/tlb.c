@@ -256,9 +256,19 @@ void flush_tlb_mm(struct mm_struct *mm)
 	preempt_enable();
 }
 
-void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
+/*
+ * Only a single page is worth flushing on its own, see
+ * asm/tlbflush.h; larger ranges flush the whole mm.
+ */
+void flush_tlb_mm_range(struct mm_struct *mm, unsigned long start,
+			unsigned long end)
 {
-	struct mm_struct *mm = vma->vm_mm;
+	unsigned long va = start;
+
+	if (end - start != PAGE_SIZE) {
+		flush_tlb_mm(mm);
+		return;
+	}
 
 	preempt_disable();
 
@@ -275,6 +285,11 @@ void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
 	preempt_enable();
 }
 
+void flush_tlb_page(struct vm_area_struct *vma, unsigned long va)
+{
+	flush_tlb_mm_range(vma->vm_mm, va, va + PAGE_SIZE);
+}
+
 static void do_flush_tlb_all(void *info)
 {
 	unsigned long cpu = smp_processor_id();
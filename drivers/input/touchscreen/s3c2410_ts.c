@@ -57,6 +57,23 @@
 
 #define FEAT_PEN_IRQ	(1 << 0)	/* HAS ADCCLRINTPNDNUP */
 
+#define MAX_SHIFT	4
+#define MAX_SAMPLES	(1 << MAX_SHIFT)
+
+static unsigned int report_rate = 100;
+module_param(report_rate, uint, 0644);
+MODULE_PARM_DESC(report_rate, "Maximum position reports per second while "
+		 "the pen is down");
+
+static unsigned int max_spread = 30;
+module_param(max_spread, uint, 0644);
+MODULE_PARM_DESC(max_spread, "Drop sample sets spreading wider than this "
+		 "(ADC units, 0 to keep all)");
+
+static unsigned int fuzz = 4;
+module_param(fuzz, uint, 0444);
+MODULE_PARM_DESC(fuzz, "Position changes below this are treated as noise");
+
 /* Per-touchscreen data. */
 
 /**
@@ -66,12 +83,13 @@
  * @input: The input device we registered with the input subsystem.
  * @clock: The clock for the adc.
  * @io: Pointer to the IO base.
- * @xp: The accumulated X position data.
- * @yp: The accumulated Y position data.
+ * @xs: The X samples of the current set.
+ * @ys: The Y samples of the current set.
  * @irq_tc: The interrupt number for pen up/down interrupt
  * @count: The number of samples collected.
  * @shift: The log2 of the maximum count to read in one go.
  * @features: The features supported by the TSADC MOdule.
+ * @down: The pen is down, sample sets are being converted.
  */
 struct s3c2410ts {
 	struct s3c_adc_client *client;
@@ -79,12 +97,13 @@ struct s3c2410ts {
 	struct input_dev *input;
 	struct clk *clock;
 	void __iomem *io;
-	unsigned long xp;
-	unsigned long yp;
+	unsigned xs[MAX_SAMPLES];
+	unsigned ys[MAX_SAMPLES];
 	int irq_tc;
 	int count;
 	int shift;
 	int features;
+	bool down;
 };
 
 static struct s3c2410ts ts;
@@ -103,47 +122,70 @@ static inline bool get_down(unsigned long data0, unsigned long data1)
 		!(data1 & S3C2410_ADCDAT0_UPDOWN));
 }
 
-static void touch_timer_fire(unsigned long data)
+/**
+ * filter_samples - reduce a sample set to one coordinate
+ * @v: The samples, sorted in place.
+ * @n: The number of samples.
+ * @spread: Returns the spread of the samples that were used.
+ *
+ * This does the median and averaging filtering tslib would otherwise do
+ * in userspace: the samples are sorted, the lowest and highest quarter
+ * are dropped as outliers and the rest is averaged.
+ */
+static unsigned filter_samples(unsigned *v, int n, unsigned *spread)
 {
-	unsigned long data0;
-	unsigned long data1;
-	bool down;
+	unsigned sum = 0;
+	int lo, hi, i, j;
 
-	data0 = readl(ts.io + S3C2410_ADCDAT0);
-	data1 = readl(ts.io + S3C2410_ADCDAT1);
+	for (i = 1; i < n; i++) {
+		unsigned tmp = v[i];
 
-	down = get_down(data0, data1);
+		for (j = i; j > 0 && v[j - 1] > tmp; j--)
+			v[j] = v[j - 1];
+		v[j] = tmp;
+	}
 
-	if (down) {
-		if (ts.count == (1 << ts.shift)) {
-			ts.xp >>= ts.shift;
-			ts.yp >>= ts.shift;
+	lo = n / 4;
+	hi = n - lo;
 
-			dev_dbg(ts.dev, "%s: X=%lu, Y=%lu, count=%d\n",
-				__func__, ts.xp, ts.yp, ts.count);
+	for (i = lo; i < hi; i++)
+		sum += v[i];
 
-			input_report_abs(ts.input, ABS_X, ts.xp);
-			input_report_abs(ts.input, ABS_Y, ts.yp);
+	*spread = v[hi - 1] - v[lo];
+	return sum / (hi - lo);
+}
 
-			input_report_key(ts.input, BTN_TOUCH, 1);
-			input_sync(ts.input);
+/**
+ * report_pen_up - report the pen being lifted and wait for the next touch
+ *
+ * Called with interrupts disabled.
+ */
+static void report_pen_up(void)
+{
+	ts.down = false;
+	ts.count = 0;
 
-			ts.xp = 0;
-			ts.yp = 0;
-			ts.count = 0;
-		}
+	input_report_key(ts.input, BTN_TOUCH, 0);
+	input_sync(ts.input);
 
-		s3c_adc_start(ts.client, 0, 1 << ts.shift);
-	} else {
-		ts.xp = 0;
-		ts.yp = 0;
-		ts.count = 0;
+	writel(WAIT4INT | INT_DOWN, ts.io + S3C2410_ADCTSC);
+}
 
-		input_report_key(ts.input, BTN_TOUCH, 0);
-		input_sync(ts.input);
+/**
+ * touch_timer_fire - start the next sample set
+ * @data: Unused.
+ *
+ * The timer only paces the sample sets to report_rate while the pen is
+ * down, pen up is signalled by the touchscreen interrupt.
+ */
+static void touch_timer_fire(unsigned long data)
+{
+	unsigned long flags;
 
-		writel(WAIT4INT | INT_DOWN, ts.io + S3C2410_ADCTSC);
-	}
+	local_irq_save(flags);
+	if (ts.down)
+		s3c_adc_start(ts.client, 0, 1 << ts.shift);
+	local_irq_restore(flags);
 }
 
 static DEFINE_TIMER(touch_timer, touch_timer_fire, 0, 0);
@@ -166,14 +208,18 @@ static irqreturn_t stylus_irq(int irq, void *dev_id)
 
 	down = get_down(data0, data1);
 
-	/* TODO we should never get an interrupt with down set while
-	 * the timer is running, but maybe we ought to verify that the
-	 * timer isn't running anyways. */
-
-	if (down)
+	if (down && !ts.down) {
+		ts.down = true;
+		ts.count = 0;
 		s3c_adc_start(ts.client, 0, 1 << ts.shift);
-	else
-		dev_dbg(ts.dev, "%s: count=%d\n", __func__, ts.count);
+	} else if (!down && ts.down) {
+		dev_dbg(ts.dev, "%s: pen up\n", __func__);
+
+		/* a set still being converted is dropped when it is done,
+		 * otherwise stop the timer from starting the next one */
+		del_timer(&touch_timer);
+		report_pen_up();
+	}
 
 	if (ts.features & FEAT_PEN_IRQ) {
 		/* Clear pen down/up interrupt */
@@ -198,10 +244,11 @@ static void s3c24xx_ts_conversion(struct s3c_adc_client *client,
 {
 	dev_dbg(ts.dev, "%s: %d,%d\n", __func__, data0, data1);
 
-	ts.xp += data0;
-	ts.yp += data1;
-
-	ts.count++;
+	if (ts.count < MAX_SAMPLES) {
+		ts.xs[ts.count] = data0;
+		ts.ys[ts.count] = data1;
+		ts.count++;
+	}
 
 	/* From tests, it seems that it is unlikely to get a pen-up
 	 * event during the conversion process which means we can
@@ -213,6 +260,37 @@ static void s3c24xx_ts_conversion(struct s3c_adc_client *client,
 	 */
 }
 
+/**
+ * s3c24xx_ts_report - report a finished sample set
+ *
+ * Called from the ADC interrupt once the last sample of a set is in.
+ * Sets that are too noisy, usually because the pen was landing or
+ * lifting, are dropped.
+ */
+static void s3c24xx_ts_report(void)
+{
+	unsigned x, y, xspread, yspread;
+
+	if (!ts.count)
+		return;
+
+	x = filter_samples(ts.xs, ts.count, &xspread);
+	y = filter_samples(ts.ys, ts.count, &yspread);
+	ts.count = 0;
+
+	dev_dbg(ts.dev, "%s: X=%u, Y=%u, spread=%u,%u\n",
+		__func__, x, y, xspread, yspread);
+
+	if (max_spread && (xspread > max_spread || yspread > max_spread))
+		return;
+
+	input_report_abs(ts.input, ABS_X, x);
+	input_report_abs(ts.input, ABS_Y, y);
+
+	input_report_key(ts.input, BTN_TOUCH, 1);
+	input_sync(ts.input);
+}
+
 /**
  * s3c24xx_ts_select - ADC selection callback.
  * @client: The client that was registered with the ADC core.
@@ -222,13 +300,36 @@ static void s3c24xx_ts_conversion(struct s3c_adc_client *client,
  */
 static void s3c24xx_ts_select(struct s3c_adc_client *client, unsigned select)
 {
+	unsigned long delay;
+
 	if (select) {
 		writel(S3C2410_ADCTSC_PULL_UP_DISABLE | AUTOPST,
 		       ts.io + S3C2410_ADCTSC);
-	} else {
-		mod_timer(&touch_timer, jiffies+1);
-		writel(WAIT4INT | INT_UP, ts.io + S3C2410_ADCTSC);
+		return;
+	}
+
+	/* the pen went up while this set was waiting for the adc */
+	if (!ts.down) {
+		ts.count = 0;
+		writel(WAIT4INT | INT_DOWN, ts.io + S3C2410_ADCTSC);
+		return;
+	}
+
+	/* the set is complete, check the pen is still down */
+
+	if (!get_down(readl(ts.io + S3C2410_ADCDAT0),
+		      readl(ts.io + S3C2410_ADCDAT1))) {
+		report_pen_up();
+		return;
 	}
+
+	s3c24xx_ts_report();
+
+	/* wait for pen up, or the next set when report_rate allows */
+	writel(WAIT4INT | INT_UP, ts.io + S3C2410_ADCTSC);
+
+	delay = report_rate ? HZ / report_rate : 0;
+	mod_timer(&touch_timer, jiffies + max(delay, 1UL));
 }
 
 /**
@@ -316,8 +417,8 @@ static int __devinit s3c2410ts_probe(struct platform_device *pdev)
 	ts.input = input_dev;
 	ts.input->evbit[0] = BIT_MASK(EV_KEY) | BIT_MASK(EV_ABS);
 	ts.input->keybit[BIT_WORD(BTN_TOUCH)] = BIT_MASK(BTN_TOUCH);
-	input_set_abs_params(ts.input, ABS_X, 0, 0x3FF, 0, 0);
-	input_set_abs_params(ts.input, ABS_Y, 0, 0x3FF, 0, 0);
+	input_set_abs_params(ts.input, ABS_X, 0, 0x3FF, fuzz, 0);
+	input_set_abs_params(ts.input, ABS_Y, 0, 0x3FF, fuzz, 0);
 
 	ts.input->name = "S3C24XX TouchScreen";
 	ts.input->id.bustype = BUS_HOST;
@@ -326,6 +427,11 @@ static int __devinit s3c2410ts_probe(struct platform_device *pdev)
 	ts.input->id.version = 0x0102;
 
 	ts.shift = info->oversampling_shift;
+	if (ts.shift > MAX_SHIFT) {
+		dev_warn(dev, "oversampling shift %d too large, using %d\n",
+			 ts.shift, MAX_SHIFT);
+		ts.shift = MAX_SHIFT;
+	}
 	ts.features = platform_get_device_id(pdev)->driver_data;
 
 	ret = request_irq(ts.irq_tc, stylus_irq, IRQF_DISABLED,
@@ -382,6 +488,9 @@ static int __devexit s3c2410ts_remove(struct platform_device *pdev)
 #ifdef CONFIG_PM
 static int s3c2410ts_suspend(struct device *dev)
 {
+	del_timer_sync(&touch_timer);
+	ts.down = false;
+
 	writel(TSC_SLEEP, ts.io + S3C2410_ADCTSC);
 	disable_irq(ts.irq_tc);
 	clk_disable(ts.clock);
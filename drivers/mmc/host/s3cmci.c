@@ -183,6 +183,11 @@ static inline bool s3cmci_host_usedma(struct s3cmci_host *host)
 #endif
 }
 
+static inline enum dma_data_direction s3cmci_dma_dir(struct mmc_data *data)
+{
+	return (data->flags & MMC_DATA_WRITE) ? DMA_TO_DEVICE : DMA_FROM_DEVICE;
+}
+
 /**
  * s3cmci_host_canpio - return true if host has pio code available
  *
@@ -790,22 +795,20 @@ static void s3cmci_dma_done_callback(struct s3c2410_dma_chan *dma_ch,
 	}
 
 	host->dmatogo--;
-	if (host->dmatogo) {
-		dbg(host, dbg_dma, "DMA DONE  Size:%i DSTA:[%08x] "
-			"DCNT:[%08x] toGo:%u\n",
-			size, mci_dsta, mci_dcnt, host->dmatogo);
-
-		goto out;
-	}
 
 	dbg(host, dbg_dma, "DMA FINISHED Size:%i DSTA:%08x DCNT:%08x\n",
 		size, mci_dsta, mci_dcnt);
 
 	host->dma_complete = 1;
-	host->complete_what = COMPLETION_FINALIZE;
 
-out:
-	tasklet_schedule(&host->pio_tasklet);
+	/* The last buffer leaving memory (write) or the fifo (read) does
+	 * not mean the card is done: the data may still be in the fifo
+	 * and the crc status is not in yet. The transfer is closed by the
+	 * data finish interrupt, we only need to kick the tasklet if that
+	 * came first and finalize_request() found the dma missing. */
+	if (host->complete_what == COMPLETION_FINALIZE)
+		tasklet_schedule(&host->pio_tasklet);
+
 	spin_unlock_irqrestore(&host->complete_lock, iflags);
 	return;
 
@@ -814,7 +817,8 @@ fail_request:
 	host->complete_what = COMPLETION_FINALIZE;
 	clear_imask(host);
 
-	goto out;
+	tasklet_schedule(&host->pio_tasklet);
+	spin_unlock_irqrestore(&host->complete_lock, iflags);
 }
 
 static void finalize_request(struct s3cmci_host *host)
@@ -903,6 +907,10 @@ static void finalize_request(struct s3cmci_host *host)
 		}
 	}
 
+	if (s3cmci_host_usedma(host))
+		dma_unmap_sg(mmc_dev(host->mmc), mrq->data->sg,
+			     mrq->data->sg_len, s3cmci_dma_dir(mrq->data));
+
 request_done:
 	host->complete_what = COMPLETION_NONE;
 	host->mrq = NULL;
@@ -914,23 +922,20 @@ request_done:
 static void s3cmci_dma_setup(struct s3cmci_host *host,
 			     enum s3c2410_dmasrc source)
 {
-	static enum s3c2410_dmasrc last_source = -1;
-	static int setup_ok;
-
-	if (last_source == source)
+	if (host->dma_setup && host->dma_source == source)
 		return;
 
-	last_source = source;
+	host->dma_source = source;
 
 	s3c2410_dma_devconfig(host->dma, source,
 			      host->mem->start + host->sdidata);
 
-	if (!setup_ok) {
+	if (!host->dma_setup) {
 		s3c2410_dma_config(host->dma, 4);
 		s3c2410_dma_set_buffdone_fn(host->dma,
 					    s3cmci_dma_done_callback);
 		s3c2410_dma_setflags(host->dma, S3C2410_DMAF_AUTOSTART);
-		setup_ok = 1;
+		host->dma_setup = 1;
 	}
 }
 
@@ -1079,9 +1084,17 @@ static int s3cmci_prepare_pio(struct s3cmci_host *host, struct mmc_data *data)
 	return 0;
 }
 
+/*
+ * Map the whole scatterlist and queue it on the dma channel in one go
+ * before the command is sent. The s3c24xx dma core loads the next
+ * segment by itself as each one completes and calls back once, when the
+ * last one is done, so the blocks of a multiblock transfer stream
+ * without the cpu in between. The channel is flushed first, so that
+ * nothing left over from an earlier request is queued ahead of it.
+ */
 static int s3cmci_prepare_dma(struct s3cmci_host *host, struct mmc_data *data)
 {
-	int dma_len, i;
+	int dma_len, res;
 	int rw = data->flags & MMC_DATA_WRITE;
 
 	BUG_ON((data->flags & BOTH_DIR) == BOTH_DIR);
@@ -1090,29 +1103,23 @@ static int s3cmci_prepare_dma(struct s3cmci_host *host, struct mmc_data *data)
 	s3c2410_dma_ctrl(host->dma, S3C2410_DMAOP_FLUSH);
 
 	dma_len = dma_map_sg(mmc_dev(host->mmc), data->sg, data->sg_len,
-			     rw ? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+			     s3cmci_dma_dir(data));
 
 	if (dma_len == 0)
 		return -ENOMEM;
 
 	host->dma_complete = 0;
-	host->dmatogo = dma_len;
-
-	for (i = 0; i < dma_len; i++) {
-		int res;
+	host->dmatogo = 1;
 
-		dbg(host, dbg_dma, "enqueue %i: %08x@%u\n", i,
-		    sg_dma_address(&data->sg[i]),
-		    sg_dma_len(&data->sg[i]));
+	dbg(host, dbg_dma, "enqueue %i segments, %u bytes\n", dma_len,
+	    data->blocks * data->blksz);
 
-		res = s3c2410_dma_enqueue(host->dma, host,
-					  sg_dma_address(&data->sg[i]),
-					  sg_dma_len(&data->sg[i]));
-
-		if (res) {
-			s3c2410_dma_ctrl(host->dma, S3C2410_DMAOP_FLUSH);
-			return -EBUSY;
-		}
+	res = s3c2410_dma_enqueue_sg(host->dma, host, data->sg, dma_len);
+	if (res) {
+		s3c2410_dma_ctrl(host->dma, S3C2410_DMAOP_FLUSH);
+		dma_unmap_sg(mmc_dev(host->mmc), data->sg,
+			     data->sg_len, s3cmci_dma_dir(data));
+		return -EBUSY;
 	}
 
 	s3c2410_dma_ctrl(host->dma, S3C2410_DMAOP_START);
@@ -1599,7 +1606,7 @@ static int __devinit s3cmci_probe(struct platform_device *pdev)
 	host->pio_active 	= XFER_NONE;
 
 #ifdef CONFIG_MMC_S3C_PIODMA
-	host->dodma		= host->pdata->dma;
+	host->dodma		= host->pdata->use_dma;
 #endif
 
 	host->mem = platform_get_resource(pdev, IORESOURCE_MEM, 0);
@@ -38,6 +38,8 @@ struct s3cmci_host {
 	unsigned		sdidata;
 	int			dodma;
 	int			dmatogo;
+	int			dma_setup;
+	enum s3c2410_dmasrc	dma_source;
 
 	bool			irq_disabled;
 	bool			irq_enabled;
@@ -567,6 +567,116 @@ int default_mtd_writev(struct mtd_info *mtd, const struct kvec *vecs,
 	return ret;
 }
 
+/*
+ * mtd_pages_check - validate a multi-page transfer for the per-page
+ *		     fallback, returns the number of pages
+ */
+static int mtd_pages_check(struct mtd_info *mtd, loff_t ofs,
+			   struct mtd_oob_ops *ops)
+{
+	uint32_t npages;
+
+	if (!ops->datbuf || !ops->len || mtd_mod_by_ws(ofs, mtd) ||
+	    mtd_mod_by_ws(ops->len, mtd))
+		return -EINVAL;
+
+	npages = mtd_div_by_ws(ops->len, mtd);
+	if (ops->oobbuf && ops->ooblen % npages)
+		return -EINVAL;
+
+	return npages;
+}
+
+/* mtd_read_pages - read whole pages and their oob, using the device's
+ *		    read_pages method when it has one
+ *
+ * ECC errors do not stop the fallback loop, like a plain mtd->read they
+ * are reported once all pages have been read. If @fixed is not NULL, the
+ * bit of each page that needed correction is set in it.
+ */
+
+int mtd_read_pages(struct mtd_info *mtd, loff_t from, struct mtd_oob_ops *ops,
+		   unsigned long *fixed)
+{
+	struct mtd_oob_ops page_ops;
+	int i, npages, ret, err = 0;
+
+	if (mtd->read_pages)
+		return mtd->read_pages(mtd, from, ops, fixed);
+
+	if (!mtd->read_oob)
+		return -EOPNOTSUPP;
+
+	npages = mtd_pages_check(mtd, from, ops);
+	if (npages < 0)
+		return npages;
+
+	page_ops = *ops;
+	page_ops.len = mtd->writesize;
+	page_ops.ooblen = ops->oobbuf ? ops->ooblen / npages : 0;
+	ops->retlen = 0;
+	ops->oobretlen = 0;
+
+	for (i = 0; i < npages; i++) {
+		page_ops.datbuf = ops->datbuf + ops->retlen;
+		if (ops->oobbuf)
+			page_ops.oobbuf = ops->oobbuf + ops->oobretlen;
+
+		ret = mtd->read_oob(mtd, from + ops->retlen, &page_ops);
+		if (ret == -EUCLEAN && fixed)
+			__set_bit(i, fixed);
+		if (ret == -EUCLEAN || ret == -EBADMSG) {
+			if (err != -EBADMSG)
+				err = ret;
+		} else if (ret)
+			return ret;
+
+		ops->retlen += page_ops.retlen;
+		ops->oobretlen += page_ops.oobretlen;
+	}
+	return err;
+}
+
+/* mtd_write_pages - write whole pages and their oob, using the device's
+ *		     write_pages method when it has one
+ */
+
+int mtd_write_pages(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops)
+{
+	struct mtd_oob_ops page_ops;
+	int i, npages, ret;
+
+	if (mtd->write_pages)
+		return mtd->write_pages(mtd, to, ops);
+
+	if (!mtd->write_oob)
+		return -EROFS;
+
+	npages = mtd_pages_check(mtd, to, ops);
+	if (npages < 0)
+		return npages;
+
+	page_ops = *ops;
+	page_ops.len = mtd->writesize;
+	page_ops.ooblen = ops->oobbuf ? ops->ooblen / npages : 0;
+	ops->retlen = 0;
+	ops->oobretlen = 0;
+
+	for (i = 0; i < npages; i++) {
+		page_ops.datbuf = ops->datbuf + ops->retlen;
+		if (ops->oobbuf)
+			page_ops.oobbuf = ops->oobbuf + ops->oobretlen;
+
+		ret = mtd->write_oob(mtd, to + ops->retlen, &page_ops);
+		if (ret)
+			return ret;
+
+		ops->retlen += page_ops.retlen;
+		ops->oobretlen += page_ops.oobretlen;
+	}
+	return 0;
+}
+
 EXPORT_SYMBOL_GPL(add_mtd_device);
 EXPORT_SYMBOL_GPL(del_mtd_device);
 EXPORT_SYMBOL_GPL(get_mtd_device);
@@ -575,6 +685,8 @@ EXPORT_SYMBOL_GPL(put_mtd_device);
 EXPORT_SYMBOL_GPL(register_mtd_user);
 EXPORT_SYMBOL_GPL(unregister_mtd_user);
 EXPORT_SYMBOL_GPL(default_mtd_writev);
+EXPORT_SYMBOL_GPL(mtd_read_pages);
+EXPORT_SYMBOL_GPL(mtd_write_pages);
 
 #ifdef CONFIG_PROC_FS
 
@@ -120,6 +120,26 @@ static int part_read_oob(struct mtd_info *mtd, loff_t from,
 	return res;
 }
 
+static int part_read_pages(struct mtd_info *mtd, loff_t from,
+		struct mtd_oob_ops *ops, unsigned long *fixed)
+{
+	struct mtd_part *part = PART(mtd);
+	int res;
+
+	if (from >= mtd->size || from + ops->len > mtd->size)
+		return -EINVAL;
+	res = part->master->read_pages(part->master, from + part->offset, ops,
+				       fixed);
+
+	if (unlikely(res)) {
+		if (res == -EUCLEAN)
+			mtd->ecc_stats.corrected++;
+		if (res == -EBADMSG)
+			mtd->ecc_stats.failed++;
+	}
+	return res;
+}
+
 static int part_read_user_prot_reg(struct mtd_info *mtd, loff_t from,
 		size_t len, size_t *retlen, u_char *buf)
 {
@@ -193,6 +213,19 @@ static int part_write_oob(struct mtd_info *mtd, loff_t to,
 	return part->master->write_oob(part->master, to + part->offset, ops);
 }
 
+static int part_write_pages(struct mtd_info *mtd, loff_t to,
+		struct mtd_oob_ops *ops)
+{
+	struct mtd_part *part = PART(mtd);
+
+	if (!(mtd->flags & MTD_WRITEABLE))
+		return -EROFS;
+
+	if (to >= mtd->size || to + ops->len > mtd->size)
+		return -EINVAL;
+	return part->master->write_pages(part->master, to + part->offset, ops);
+}
+
 static int part_write_user_prot_reg(struct mtd_info *mtd, loff_t from,
 		size_t len, size_t *retlen, u_char *buf)
 {
@@ -386,6 +419,10 @@ static struct mtd_part *add_one_partition(struct mtd_info *master,
 		slave->mtd.read_oob = part_read_oob;
 	if (master->write_oob)
 		slave->mtd.write_oob = part_write_oob;
+	if (master->read_pages)
+		slave->mtd.read_pages = part_read_pages;
+	if (master->write_pages)
+		slave->mtd.write_pages = part_write_pages;
 	if (master->read_user_prot_reg)
 		slave->mtd.read_user_prot_reg = part_read_user_prot_reg;
 	if (master->read_fact_prot_reg)
@@ -42,6 +42,7 @@
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
 #include <linux/mtd/nand_ecc.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/mtd/compatmac.h>
 #include <linux/interrupt.h>
 #include <linux/bitops.h>
@@ -837,12 +838,19 @@ static int nand_read_page_swecc(struct mtd_info *mtd, struct nand_chip *chip,
 
 	chip->ecc.read_page_raw(mtd, chip, buf, page);
 
-	for (i = 0; eccsteps; eccsteps--, i += eccbytes, p += eccsize)
-		chip->ecc.calculate(mtd, p, &ecc_calc[i]);
+	if (chip->ecc.calculate == nand_calculate_ecc)
+		nand_calculate_ecc_steps(mtd, p, eccsteps, ecc_calc);
+	else
+		for (i = 0; eccsteps; eccsteps--, i += eccbytes, p += eccsize)
+			chip->ecc.calculate(mtd, p, &ecc_calc[i]);
 
 	for (i = 0; i < chip->ecc.total; i++)
 		ecc_code[i] = chip->oob_poi[eccpos[i]];
 
+	/* Nothing to correct, the usual case */
+	if (!memcmp(ecc_code, ecc_calc, chip->ecc.total))
+		return 0;
+
 	eccsteps = chip->ecc.steps;
 	p = buf;
 
@@ -1144,28 +1152,39 @@ static uint8_t *nand_transfer_oob(struct nand_chip *chip, uint8_t *oob,
  * @mtd:	MTD device structure
  * @from:	offset to read from
  * @ops:	oob ops structure
+ * @oobpage:	oob bytes per page, 0 for the free oob size
+ * @fixed:	if not NULL, bit n is set when page n needed ECC correction
  *
  * Internal function. Called with chip held.
  */
 static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
-			    struct mtd_oob_ops *ops)
+			    struct mtd_oob_ops *ops, uint32_t oobpage,
+			    unsigned long *fixed)
 {
 	int chipnr, page, realpage, col, bytes, aligned;
 	struct nand_chip *chip = mtd->priv;
 	struct mtd_ecc_stats stats;
+	uint32_t corrected;
+	int firstpage;
 	int blkcheck = (1 << (chip->phys_erase_shift - chip->page_shift)) - 1;
 	int sndcmd = 1;
 	int ret = 0;
 	uint32_t readlen = ops->len;
 	uint32_t oobreadlen = ops->ooblen;
 	uint8_t *bufpoi, *oob, *buf;
+	/* OOB first ecc has to reissue READ0, which ends a cache read */
+	int cacheok = NAND_HAS_CACHEREAD(chip) &&
+		chip->ecc.mode != NAND_ECC_HW_OOB_FIRST;
+	int cacheread = 0;
 
 	stats = mtd->ecc_stats;
+	corrected = stats.corrected;
 
 	chipnr = (int)(from >> chip->chip_shift);
 	chip->select_chip(mtd, chipnr);
 
 	realpage = (int)(from >> chip->page_shift);
+	firstpage = realpage;
 	page = realpage & chip->pagemask;
 
 	col = (int)(from & (mtd->writesize - 1));
@@ -1179,7 +1198,17 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 
 		/* Is the current page in the buffer ?
 		 * 检查当前读取的页的编号是否为读缓存的页号*/
-		if (realpage != chip->pagebuf || oob) {
+		if (realpage != chip->pagebuf || oob || cacheread) {
+			/*
+			 * Use a cache read when the next page is wanted in
+			 * full as well and lies in the same block: the chip
+			 * then loads it while this one is transferred out.
+			 */
+			int cachenext = cacheok && aligned &&
+				(sndcmd || cacheread) &&
+				readlen >= 2 * mtd->writesize &&
+				((page + 1) & blkcheck);
+
 			/*是否为页对齐，如果不是页对齐，则读取的内容临时存放于
 			 * chip->buffers->databuf处*/
 			bufpoi = aligned ? buf : chip->buffers->databuf;
@@ -1189,6 +1218,14 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 				sndcmd = 0;
 			}
 
+			if (cachenext) {
+				chip->cmdfunc(mtd, NAND_CMD_READCACHESEQ, -1, -1);
+				cacheread = 1;
+			} else if (cacheread) {
+				chip->cmdfunc(mtd, NAND_CMD_READCACHEEND, -1, -1);
+				cacheread = 0;
+			}
+
 			/* Now read the page into the buffer 
 			 * 将读取的内容存放于bufpoi处*/
 			if (unlikely(ops->mode == MTD_OOB_RAW))
@@ -1202,6 +1239,12 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 			if (ret < 0)
 				break;
 
+			if (mtd->ecc_stats.corrected != corrected) {
+				corrected = mtd->ecc_stats.corrected;
+				if (fixed)
+					__set_bit(realpage - firstpage, fixed);
+			}
+
 			/* Transfer not aligned data 
 			 * 将由于不是页对齐临时存放读取内容，复制到buf中*/
 			if (!aligned) {
@@ -1215,8 +1258,8 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 			if (unlikely(oob)) {
 				/* Raw mode does data:oob:data:oob */
 				if (ops->mode != MTD_OOB_RAW) {
-					int toread = min(oobreadlen,
-						chip->ecc.layout->oobavail);
+					int toread = min(oobreadlen, oobpage ?
+						oobpage : chip->ecc.layout->oobavail);
 					if (toread) {
 						oob = nand_transfer_oob(chip,
 							oob, ops, toread);
@@ -1266,10 +1309,14 @@ static int nand_do_read_ops(struct mtd_info *mtd, loff_t from,
 		/* Check, if the chip supports auto page increment
 		 * or if we have hit a block boundary.
 		 */
-		if (!NAND_CANAUTOINCR(chip) || !(page & blkcheck))
+		if (!cacheread && (!NAND_CANAUTOINCR(chip) || !(page & blkcheck)))
 			sndcmd = 1;
 	}
 
+	/* Don't leave the chip in the middle of a cache read on error */
+	if (cacheread)
+		chip->cmdfunc(mtd, NAND_CMD_READCACHEEND, -1, -1);
+
 	ops->retlen = ops->len - (size_t) readlen;
 	if (oob)
 		ops->oobretlen = ops->ooblen - oobreadlen;
@@ -1311,7 +1358,7 @@ static int nand_read(struct mtd_info *mtd, loff_t from, size_t len,
 	chip->ops.datbuf = buf;
 	chip->ops.oobbuf = NULL;
 
-	ret = nand_do_read_ops(mtd, from, &chip->ops);
+	ret = nand_do_read_ops(mtd, from, &chip->ops, 0, NULL);
 
 	*retlen = chip->ops.retlen;
 
@@ -1592,13 +1639,82 @@ static int nand_read_oob(struct mtd_info *mtd, loff_t from,
 	if (!ops->datbuf)
 		ret = nand_do_read_oob(mtd, from, ops);
 	else
-		ret = nand_do_read_ops(mtd, from, ops);
+		ret = nand_do_read_ops(mtd, from, ops, 0, NULL);
 
  out:
 	nand_release_device(mtd);
 	return ret;
 }
 
+/**
+ * nand_pages_ooblen - [Internal] Check a whole page transfer
+ * @mtd:	MTD device structure
+ * @ofs:	offset of the first page
+ * @ops:	oob operation description structure
+ *
+ * Returns the oob length of each page or -EINVAL. Raw mode is refused,
+ * it interleaves the oob with the data buffer.
+ */
+static int nand_pages_ooblen(struct mtd_info *mtd, loff_t ofs,
+			     struct mtd_oob_ops *ops)
+{
+	struct nand_chip *chip = mtd->priv;
+	uint32_t npages, oobmax;
+
+	if (!ops->datbuf || !ops->len || (ofs & (mtd->writesize - 1)) ||
+	    (ops->len & (mtd->writesize - 1)) || ofs + ops->len > mtd->size)
+		return -EINVAL;
+
+	if (!ops->oobbuf)
+		return 0;
+
+	switch(ops->mode) {
+	case MTD_OOB_AUTO:
+		oobmax = chip->ecc.layout->oobavail;
+		break;
+	case MTD_OOB_PLACE:
+		oobmax = mtd->oobsize;
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	npages = ops->len >> chip->page_shift;
+	if ((ops->ooblen % npages) ||
+	    ops->ooboffs + ops->ooblen / npages > oobmax)
+		return -EINVAL;
+
+	return ops->ooblen / npages;
+}
+
+/**
+ * nand_read_pages - [MTD Interface] Read whole pages with their oob
+ * @mtd:	MTD device structure
+ * @from:	offset of the first page
+ * @ops:	oob operation description structure
+ * @fixed:	optional bitmap of the pages that needed ECC correction
+ *
+ * Takes the chip once for the whole run, which lets chips with
+ * NAND_CACHE_READ stream it with a cache read.
+ */
+static int nand_read_pages(struct mtd_info *mtd, loff_t from,
+			   struct mtd_oob_ops *ops, unsigned long *fixed)
+{
+	struct nand_chip *chip = mtd->priv;
+	int oobpage = nand_pages_ooblen(mtd, from, ops);
+	int ret;
+
+	ops->retlen = 0;
+	ops->oobretlen = 0;
+	if (oobpage < 0)
+		return oobpage;
+
+	nand_get_device(chip, mtd, FL_READING);
+	ret = nand_do_read_ops(mtd, from, ops, oobpage, fixed);
+	nand_release_device(mtd);
+	return ret;
+}
+
 
 /**
  * nand_write_page_raw - [Intern] raw page write function
@@ -1670,8 +1786,11 @@ static void nand_write_page_swecc(struct mtd_info *mtd, struct nand_chip *chip,
 	uint32_t *eccpos = chip->ecc.layout->eccpos;
 
 	/* Software ecc calculation */
-	for (i = 0; eccsteps; eccsteps--, i += eccbytes, p += eccsize)
-		chip->ecc.calculate(mtd, p, &ecc_calc[i]);
+	if (chip->ecc.calculate == nand_calculate_ecc)
+		nand_calculate_ecc_steps(mtd, p, eccsteps, ecc_calc);
+	else
+		for (i = 0; eccsteps; eccsteps--, i += eccbytes, p += eccsize)
+			chip->ecc.calculate(mtd, p, &ecc_calc[i]);
 
 	for (i = 0; i < chip->ecc.total; i++)
 		chip->oob_poi[eccpos[i]] = ecc_calc[i];
@@ -1774,13 +1893,12 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 	else
 		chip->ecc.write_page(mtd, chip, buf);
 
-	/*
-	 * Cached progamming disabled for now, Not sure if its worth the
-	 * trouble. The speed gain is not very impressive. (2.3->2.6Mib/s)
-	 */
+#ifdef CONFIG_MTD_NAND_VERIFY_WRITE
+	/* The read back below would abort a running cache program */
 	cached = 0;
+#endif
 
-	if (!cached || !(chip->options & NAND_CACHEPRG)) {
+	if (!cached || !NAND_USE_CACHEPROG(chip)) {
 
 		chip->cmdfunc(mtd, NAND_CMD_PAGEPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
@@ -1797,6 +1915,15 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
 	} else {
 		chip->cmdfunc(mtd, NAND_CMD_CACHEDPROG, -1, -1);
 		status = chip->waitfunc(mtd, chip);
+		/*
+		 * The chip only waits for the cache register here. FAIL_N1
+		 * reports the previous page, FAIL is valid for this one
+		 * only once the array is idle as well.
+		 */
+		if ((status & NAND_STATUS_FAIL_N1) ||
+		    ((status & NAND_STATUS_TRUE_READY) &&
+		     (status & NAND_STATUS_FAIL)))
+			return -EIO;
 	}
 
 #ifdef CONFIG_MTD_NAND_VERIFY_WRITE
@@ -1813,13 +1940,12 @@ static int nand_write_page(struct mtd_info *mtd, struct nand_chip *chip,
  * nand_fill_oob - [Internal] Transfer client buffer to oob
  * @chip:	nand chip structure
  * @oob:	oob data buffer
+ * @len:	oob data length for this page
  * @ops:	oob ops structure
  */
 static uint8_t *nand_fill_oob(struct nand_chip *chip, uint8_t *oob,
-				  struct mtd_oob_ops *ops)
+			      size_t len, struct mtd_oob_ops *ops)
 {
-	size_t len = ops->ooblen;
-
 	switch(ops->mode) {
 
 	case MTD_OOB_PLACE:
@@ -1865,18 +1991,22 @@ static uint8_t *nand_fill_oob(struct nand_chip *chip, uint8_t *oob,
  * @mtd:	MTD device structure
  * @to:		offset to write to
  * @ops:	oob operations description structure
+ * @oobpage:	oob bytes per page, 0 for the whole oob area of the mode
  *
  * NAND write with ECC
  */
 static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
-			     struct mtd_oob_ops *ops)
+			     struct mtd_oob_ops *ops, uint32_t oobpage)
 {
 	int chipnr, realpage, page, blockmask, column;
 	struct nand_chip *chip = mtd->priv;
 	uint32_t writelen = ops->len;
+	uint32_t oobwritelen = ops->ooblen;
+	uint32_t oobmaxlen = oobpage ? oobpage : ops->mode == MTD_OOB_AUTO ?
+		chip->ecc.layout->oobavail : mtd->oobsize;
 	uint8_t *oob = ops->oobbuf;
 	uint8_t *buf = ops->datbuf;
-	int ret, subpage;
+	int ret, subpage, cachedrun = 0;
 
 	ops->retlen = 0;
 	if (!writelen)
@@ -1919,7 +2049,7 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 
 	while(1) {
 		int bytes = mtd->writesize;
-		int cached = writelen > bytes && page != blockmask;
+		int cached = writelen > bytes && (page & blockmask) != blockmask;
 		uint8_t *wbuf = buf;
 
 		/* 部分页的编程 */
@@ -1932,14 +2062,35 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 			wbuf = chip->buffers->databuf;
 		}
 
-		if (unlikely(oob))
-			oob = nand_fill_oob(chip, oob, ops);
+		/* Each page takes the next slice of the client oob buffer */
+		if (unlikely(oob)) {
+			size_t len = min(oobwritelen, oobmaxlen);
+
+			memset(chip->oob_poi, 0xff, mtd->oobsize);
+			oob = nand_fill_oob(chip, oob, len, ops);
+			oobwritelen -= len;
+		}
 
 		ret = chip->write_page(mtd, chip, wbuf, page, cached,
 				       (ops->mode == MTD_OOB_RAW));
 		if (ret)
 			break;
 
+		/*
+		 * The last page of a cache program run is reported through
+		 * FAIL_N1 once the final PAGEPROG has completed.
+		 */
+		if (cached && NAND_USE_CACHEPROG(chip)) {
+			cachedrun = 1;
+		} else if (cachedrun) {
+			cachedrun = 0;
+			chip->cmdfunc(mtd, NAND_CMD_STATUS, -1, -1);
+			if (chip->read_byte(mtd) & NAND_STATUS_FAIL_N1) {
+				ret = -EIO;
+				break;
+			}
+		}
+
 		writelen -= bytes;
 		if (!writelen)
 			break;
@@ -1960,7 +2111,7 @@ static int nand_do_write_ops(struct mtd_info *mtd, loff_t to,
 
 	ops->retlen = ops->len - writelen;
 	if (unlikely(oob))
-		ops->oobretlen = ops->ooblen;
+		ops->oobretlen = ops->ooblen - oobwritelen;
 	return ret;
 }
 
@@ -1992,7 +2143,7 @@ static int nand_write(struct mtd_info *mtd, loff_t to, size_t len,
 	chip->ops.datbuf = (uint8_t *)buf;
 	chip->ops.oobbuf = NULL;
 
-	ret = nand_do_write_ops(mtd, to, &chip->ops);
+	ret = nand_do_write_ops(mtd, to, &chip->ops, 0);
 
 	/*返回 真实写入的长度信息*/
 	*retlen = chip->ops.retlen;
@@ -2072,7 +2223,7 @@ static int nand_do_write_oob(struct mtd_info *mtd, loff_t to,
 		chip->pagebuf = -1;
 
 	memset(chip->oob_poi, 0xff, mtd->oobsize);
-	nand_fill_oob(chip, ops->oobbuf, ops);
+	nand_fill_oob(chip, ops->oobbuf, ops->ooblen, ops);
 	status = chip->ecc.write_oob(mtd, chip, page & chip->pagemask);
 	memset(chip->oob_poi, 0xff, mtd->oobsize);
 
@@ -2120,13 +2271,40 @@ static int nand_write_oob(struct mtd_info *mtd, loff_t to,
 	if (!ops->datbuf)
 		ret = nand_do_write_oob(mtd, to, ops);
 	else
-		ret = nand_do_write_ops(mtd, to, ops);
+		ret = nand_do_write_ops(mtd, to, ops, 0);
 
  out:
 	nand_release_device(mtd);
 	return ret;
 }
 
+/**
+ * nand_write_pages - [MTD Interface] Write whole pages with their oob
+ * @mtd:	MTD device structure
+ * @to:		offset of the first page
+ * @ops:	oob operation description structure
+ *
+ * Takes the chip once for the whole run, which lets chips with
+ * NAND_CACHEPRG and NAND_CACHEPRG_ENABLE program it with cache programming.
+ */
+static int nand_write_pages(struct mtd_info *mtd, loff_t to,
+			    struct mtd_oob_ops *ops)
+{
+	struct nand_chip *chip = mtd->priv;
+	int oobpage = nand_pages_ooblen(mtd, to, ops);
+	int ret;
+
+	ops->retlen = 0;
+	ops->oobretlen = 0;
+	if (oobpage < 0)
+		return oobpage;
+
+	nand_get_device(chip, mtd, FL_WRITING);
+	ret = nand_do_write_ops(mtd, to, ops, oobpage);
+	nand_release_device(mtd);
+	return ret;
+}
+
 /**
  * single_erease_cmd - [GENERIC] NAND standard block erase command function
  * @mtd:	MTD device structure
@@ -2724,7 +2902,7 @@ int nand_scan_tail(struct mtd_info *mtd)
 	/*
 	 * If no default placement scheme is given, select an appropriate one
 	 */
-	if (!chip->ecc.layout) {
+	if (!chip->ecc.layout && (chip->ecc.mode != NAND_ECC_SOFT_BCH)) {
 		switch (mtd->oobsize) {
 		case 8:
 			chip->ecc.layout = &nand_oob_8;
@@ -2828,6 +3006,39 @@ int nand_scan_tail(struct mtd_info *mtd)
 		chip->ecc.bytes = 3;
 		break;
 
+	case NAND_ECC_SOFT_BCH:
+		if (!mtd_nand_has_bch()) {
+			printk(KERN_WARNING "CONFIG_MTD_NAND_ECC_BCH not enabled\n");
+			BUG();
+		}
+		chip->ecc.calculate = nand_bch_calculate_ecc;
+		chip->ecc.correct = nand_bch_correct_data;
+		chip->ecc.read_page = nand_read_page_swecc;
+		chip->ecc.read_subpage = nand_read_subpage;
+		chip->ecc.write_page = nand_write_page_swecc;
+		chip->ecc.read_page_raw = nand_read_page_raw;
+		chip->ecc.write_page_raw = nand_write_page_raw;
+		chip->ecc.read_oob = nand_read_oob_std;
+		chip->ecc.write_oob = nand_write_oob_std;
+		/*
+		 * Board driver should supply ecc.size and ecc.bytes values to
+		 * select how many bits are correctable; see nand_bch_init()
+		 * for details. Otherwise default to 4 bits per 512 bytes on
+		 * large page devices.
+		 */
+		if (!chip->ecc.size && (mtd->oobsize >= 64)) {
+			chip->ecc.size = 512;
+			chip->ecc.bytes = 7;
+		}
+		chip->ecc.priv = nand_bch_init(mtd, chip->ecc.size,
+					       chip->ecc.bytes,
+					       &chip->ecc.layout);
+		if (!chip->ecc.priv) {
+			printk(KERN_WARNING "BCH ECC initialization failed!\n");
+			BUG();
+		}
+		break;
+
 	case NAND_ECC_NONE:
 		printk(KERN_WARNING "NAND_ECC_NONE selected by board driver. "
 		       "This is not recommended !!\n");
@@ -2907,6 +3118,9 @@ int nand_scan_tail(struct mtd_info *mtd)
 	mtd->write = nand_write;
 	mtd->read_oob = nand_read_oob;
 	mtd->write_oob = nand_write_oob;
+	/* Batched reads are only worth having with a cache read */
+	mtd->read_pages = NAND_HAS_CACHEREAD(chip) ? nand_read_pages : NULL;
+	mtd->write_pages = nand_write_pages;
 	mtd->sync = nand_sync;
 	mtd->lock = NULL;
 	mtd->unlock = NULL;
@@ -2980,6 +3194,9 @@ void nand_release(struct mtd_info *mtd)
 	/* Deregister the device */
 	del_mtd_device(mtd);
 
+	if (chip->ecc.mode == NAND_ECC_SOFT_BCH)
+		nand_bch_free((struct nand_bch_control *)chip->ecc.priv);
+
 	/* Free bad block table memory */
 	kfree(chip->bbt);
 	if (!(chip->options & NAND_OWN_BUFFERS))
@@ -60,362 +60,227 @@ struct mtd_info;
 #endif
 
 /*
- * invparity is a 256 byte table that contains the odd parity
- * for each byte. So if the number of bits in a byte is even,
- * the array element is 1, and when the number of bits is odd
- * the array eleemnt is 0.
+ * The row parities rp4..rp10 select words by bits 0..3 of their index in a
+ * 64 byte block and are gathered while the data is read, four words at a
+ * time. rp12..rp16 and par select on the block index; for those only the
+ * parity of each block is kept and they are combined after the loop.
+ * This needs fewer xors than one running value per parity and leaves
+ * the loop free of conditionals, with few enough live values to stay in
+ * registers on ARM.
  */
-static const char invparity[256] = {
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	0, 1, 1, 0, 1, 0, 0, 1, 1, 0, 0, 1, 0, 1, 1, 0,
-	1, 0, 0, 1, 0, 1, 1, 0, 0, 1, 1, 0, 1, 0, 0, 1
-};
+static inline void nand_ecc_words(const uint32_t *bp, unsigned int eccsize,
+				  uint32_t *rp, uint32_t *blk)
+{
+	const uint32_t *end = bp + (eccsize >> 2);
+	uint32_t rp4 = 0, rp6 = 0, rp8 = 0, rp10 = 0;
+	uint32_t x0, x1, x2, x3, tmppar;
+
+	do {
+		/* words 0-3 count for rp8 and rp10 */
+		x0 = bp[0];
+		x1 = bp[1];
+		x2 = bp[2];
+		x3 = bp[3];
+		rp4 ^= x0 ^ x2;
+		x0 ^= x1;
+		rp6 ^= x0;
+		tmppar = x0 ^ x2 ^ x3;
+		rp8 ^= tmppar;
+
+		/* words 4-7 count for rp10 */
+		x0 = bp[4];
+		x1 = bp[5];
+		x2 = bp[6];
+		x3 = bp[7];
+		rp4 ^= x0 ^ x2;
+		x0 ^= x1;
+		rp6 ^= x0;
+		tmppar ^= x0 ^ x2 ^ x3;
+		rp10 ^= tmppar;
+
+		/* words 8-11 count for rp8 */
+		x0 = bp[8];
+		x1 = bp[9];
+		x2 = bp[10];
+		x3 = bp[11];
+		rp4 ^= x0 ^ x2;
+		x0 ^= x1;
+		rp6 ^= x0;
+		x0 ^= x2 ^ x3;
+		rp8 ^= x0;
+		tmppar ^= x0;
+
+		/* words 12-15 */
+		x0 = bp[12];
+		x1 = bp[13];
+		x2 = bp[14];
+		x3 = bp[15];
+		rp4 ^= x0 ^ x2;
+		x0 ^= x1;
+		rp6 ^= x0;
+		tmppar ^= x0 ^ x2 ^ x3;
+
+		*blk++ = tmppar;
+		bp += 16;
+	} while (bp < end);
+
+	rp[0] = rp4;
+	rp[1] = rp6;
+	rp[2] = rp8;
+	rp[3] = rp10;
+}
 
 /*
- * bitsperbyte contains the number of bits per byte
- * this is only used for testing and repairing parity
- * (a precalculated value slightly improves performance)
+ * Parity of four words, returned in bits 0, 2, 4 and 6. Each word is
+ * folded to a byte, the bytes are packed into one word and folded
+ * together, which leaves the parity of each in its lowest bit.
  */
-static const char bitsperbyte[256] = {
-	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
-	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-	1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5,
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6,
-	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-	3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
-	4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8,
-};
+static inline uint32_t nand_ecc_parity4(uint32_t a, uint32_t b,
+					uint32_t c, uint32_t d)
+{
+	uint32_t w;
+
+	a ^= a >> 16;
+	b ^= b >> 16;
+	c ^= c >> 16;
+	d ^= d >> 16;
+	a ^= a >> 8;
+	b ^= b >> 8;
+	c ^= c >> 8;
+	d ^= d >> 8;
+	w = (a & 0xff) | ((b & 0xff) << 8) | ((c & 0xff) << 16) | (d << 24);
+	w ^= w >> 4;
+	w ^= w >> 2;
+	w ^= w >> 1;
+	w &= 0x01010101;
+	return (w | (w >> 6) | (w >> 12) | (w >> 18)) & 0x55;
+}
 
 /*
- * addressbits is a lookup table to filter out the bits from the xor-ed
- * ecc data that identify the faulty location.
- * this is only used for repairing parity
- * see the comments in nand_correct_data for more details
+ * Every ecc byte holds pairs of line parities, e.g. rp4/rp5, where the
+ * odd one covers exactly the bits the even one leaves out. Its parity is
+ * therefore the even one's xor the parity of all data, and only the even
+ * parities need to be worked out. The ecc bits are inverted parities.
  */
-static const char addressbits[256] = {
-	0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x01,
-	0x02, 0x02, 0x03, 0x03, 0x02, 0x02, 0x03, 0x03,
-	0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x01,
-	0x02, 0x02, 0x03, 0x03, 0x02, 0x02, 0x03, 0x03,
-	0x04, 0x04, 0x05, 0x05, 0x04, 0x04, 0x05, 0x05,
-	0x06, 0x06, 0x07, 0x07, 0x06, 0x06, 0x07, 0x07,
-	0x04, 0x04, 0x05, 0x05, 0x04, 0x04, 0x05, 0x05,
-	0x06, 0x06, 0x07, 0x07, 0x06, 0x06, 0x07, 0x07,
-	0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x01,
-	0x02, 0x02, 0x03, 0x03, 0x02, 0x02, 0x03, 0x03,
-	0x00, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01, 0x01,
-	0x02, 0x02, 0x03, 0x03, 0x02, 0x02, 0x03, 0x03,
-	0x04, 0x04, 0x05, 0x05, 0x04, 0x04, 0x05, 0x05,
-	0x06, 0x06, 0x07, 0x07, 0x06, 0x06, 0x07, 0x07,
-	0x04, 0x04, 0x05, 0x05, 0x04, 0x04, 0x05, 0x05,
-	0x06, 0x06, 0x07, 0x07, 0x06, 0x06, 0x07, 0x07,
-	0x08, 0x08, 0x09, 0x09, 0x08, 0x08, 0x09, 0x09,
-	0x0a, 0x0a, 0x0b, 0x0b, 0x0a, 0x0a, 0x0b, 0x0b,
-	0x08, 0x08, 0x09, 0x09, 0x08, 0x08, 0x09, 0x09,
-	0x0a, 0x0a, 0x0b, 0x0b, 0x0a, 0x0a, 0x0b, 0x0b,
-	0x0c, 0x0c, 0x0d, 0x0d, 0x0c, 0x0c, 0x0d, 0x0d,
-	0x0e, 0x0e, 0x0f, 0x0f, 0x0e, 0x0e, 0x0f, 0x0f,
-	0x0c, 0x0c, 0x0d, 0x0d, 0x0c, 0x0c, 0x0d, 0x0d,
-	0x0e, 0x0e, 0x0f, 0x0f, 0x0e, 0x0e, 0x0f, 0x0f,
-	0x08, 0x08, 0x09, 0x09, 0x08, 0x08, 0x09, 0x09,
-	0x0a, 0x0a, 0x0b, 0x0b, 0x0a, 0x0a, 0x0b, 0x0b,
-	0x08, 0x08, 0x09, 0x09, 0x08, 0x08, 0x09, 0x09,
-	0x0a, 0x0a, 0x0b, 0x0b, 0x0a, 0x0a, 0x0b, 0x0b,
-	0x0c, 0x0c, 0x0d, 0x0d, 0x0c, 0x0c, 0x0d, 0x0d,
-	0x0e, 0x0e, 0x0f, 0x0f, 0x0e, 0x0e, 0x0f, 0x0f,
-	0x0c, 0x0c, 0x0d, 0x0d, 0x0c, 0x0c, 0x0d, 0x0d,
-	0x0e, 0x0e, 0x0f, 0x0f, 0x0e, 0x0e, 0x0f, 0x0f
-};
+static inline unsigned char nand_ecc_byte(uint32_t even, uint32_t pmask)
+{
+	return ~((even | (even << 1)) ^ pmask);
+}
 
 /**
- * nand_calculate_ecc - [NAND Interface] Calculate 3-byte ECC for 256/512-byte
+ * __nand_calculate_ecc - [NAND Interface] Calculate 3-byte ECC for 256/512-byte
  *			 block
- * @mtd:	MTD block structure
  * @buf:	input buffer with raw data
+ * @eccsize:	data bytes per ecc step (256 or 512)
  * @code:	output buffer with ECC
  */
-int nand_calculate_ecc(struct mtd_info *mtd, const unsigned char *buf,
+void __nand_calculate_ecc(const unsigned char *buf, unsigned int eccsize,
 		       unsigned char *code)
 {
-	int i;
-	const uint32_t *bp = (uint32_t *)buf;
-	/* 256 or 512 bytes/ecc  */
-	const uint32_t eccsize_mult =
-			(((struct nand_chip *)mtd->priv)->ecc.size) >> 8;
-	uint32_t cur;		/* current value in buffer */
-	/* rp0..rp15..rp17 are the various accumulated parities (per byte) */
-	uint32_t rp0, rp1, rp2, rp3, rp4, rp5, rp6, rp7;
-	uint32_t rp8, rp9, rp10, rp11, rp12, rp13, rp14, rp15, rp16;
-	uint32_t uninitialized_var(rp17);	/* to make compiler happy */
-	uint32_t par;		/* the cumulative parity for all data */
-	uint32_t tmppar;	/* the cumulative parity for this iteration;
-				   for rp12, rp14 and rp16 at the end of the
-				   loop */
-
-	par = 0;
-	rp4 = 0;
-	rp6 = 0;
-	rp8 = 0;
-	rp10 = 0;
-	rp12 = 0;
-	rp14 = 0;
-	rp16 = 0;
+	uint32_t rp[4];		/* rp4, rp6, rp8, rp10 */
+	uint32_t blk[8];	/* parity of each 64 byte block */
+	uint32_t rp12, rp14, rp16, par, pmask, lo, mid;
 
 	/*
-	 * The loop is unrolled a number of times;
-	 * This avoids if statements to decide on which rp value to update
-	 * Also we process the data by longwords.
 	 * Note: passing unaligned data might give a performance penalty.
 	 * It is assumed that the buffers are aligned.
-	 * tmppar is the cumulative sum of this iteration.
-	 * needed for calculating rp12, rp14, rp16 and par
-	 * also used as a performance improvement for rp6, rp8 and rp10
 	 */
-	for (i = 0; i < eccsize_mult << 2; i++) {
-		cur = *bp++;
-		tmppar = cur;
-		rp4 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp6 ^= tmppar;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp8 ^= tmppar;
-
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		rp6 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp6 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp10 ^= tmppar;
+	nand_ecc_words((const uint32_t *)buf, eccsize, rp, blk);
 
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		rp6 ^= cur;
-		rp8 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp6 ^= cur;
-		rp8 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		rp8 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp8 ^= cur;
-
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		rp6 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp6 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-		rp4 ^= cur;
-		cur = *bp++;
-		tmppar ^= cur;
-
-		par ^= tmppar;
-		if ((i & 0x1) == 0)
-			rp12 ^= tmppar;
-		if ((i & 0x2) == 0)
-			rp14 ^= tmppar;
-		if (eccsize_mult == 2 && (i & 0x4) == 0)
-			rp16 ^= tmppar;
+	rp14 = blk[0] ^ blk[1];
+	rp16 = rp14 ^ blk[2] ^ blk[3];
+	rp12 = blk[0] ^ blk[2];
+	par = rp16;
+	if (eccsize == 512) {
+		rp14 ^= blk[4] ^ blk[5];
+		rp12 ^= blk[4] ^ blk[6];
+		par ^= blk[4] ^ blk[5] ^ blk[6] ^ blk[7];
+	} else {
+		/* rp16/rp17 are not used, both ecc bits are set below */
+		rp16 = 0;
 	}
 
 	/*
-	 * handle the fact that we use longword operations
-	 * we'll bring rp4..rp14..rp16 back to single byte entities by
-	 * shifting and xoring first fold the upper and lower 16 bits,
-	 * then the upper and lower 8 bits.
+	 * par holds the column parity of every byte lane. rp0/rp2 select on
+	 * the byte address within a word, i.e. on the lanes of par; which
+	 * lanes those are depends on the byte order.
 	 */
-	rp4 ^= (rp4 >> 16);
-	rp4 ^= (rp4 >> 8);
-	rp4 &= 0xff;
-	rp6 ^= (rp6 >> 16);
-	rp6 ^= (rp6 >> 8);
-	rp6 &= 0xff;
-	rp8 ^= (rp8 >> 16);
-	rp8 ^= (rp8 >> 8);
-	rp8 &= 0xff;
-	rp10 ^= (rp10 >> 16);
-	rp10 ^= (rp10 >> 8);
-	rp10 &= 0xff;
-	rp12 ^= (rp12 >> 16);
-	rp12 ^= (rp12 >> 8);
-	rp12 &= 0xff;
-	rp14 ^= (rp14 >> 16);
-	rp14 ^= (rp14 >> 8);
-	rp14 &= 0xff;
-	if (eccsize_mult == 2) {
-		rp16 ^= (rp16 >> 16);
-		rp16 ^= (rp16 >> 8);
-		rp16 &= 0xff;
-	}
+	pmask = par ^ (par >> 16);
+	pmask ^= pmask >> 8;
+	pmask ^= pmask >> 4;
+	pmask ^= pmask >> 2;
+	pmask ^= pmask >> 1;
+	pmask = -(pmask & 1) & 0xaa;
 
-	/*
-	 * we also need to calculate the row parity for rp0..rp3
-	 * This is present in par, because par is now
-	 * rp3 rp3 rp2 rp2 in little endian and
-	 * rp2 rp2 rp3 rp3 in big endian
-	 * as well as
-	 * rp1 rp0 rp1 rp0 in little endian and
-	 * rp0 rp1 rp0 rp1 in big endian
-	 * First calculate rp2 and rp3
-	 */
 #ifdef __BIG_ENDIAN
-	rp2 = (par >> 16);
-	rp2 ^= (rp2 >> 8);
-	rp2 &= 0xff;
-	rp3 = par & 0xffff;
-	rp3 ^= (rp3 >> 8);
-	rp3 &= 0xff;
+	lo = nand_ecc_parity4(par & 0xff00ff00, par & 0xffff0000,
+			      rp[0], rp[1]);
 #else
-	rp3 = (par >> 16);
-	rp3 ^= (rp3 >> 8);
-	rp3 &= 0xff;
-	rp2 = par & 0xffff;
-	rp2 ^= (rp2 >> 8);
-	rp2 &= 0xff;
+	lo = nand_ecc_parity4(par & 0x00ff00ff, par & 0x0000ffff,
+			      rp[0], rp[1]);
 #endif
+	mid = nand_ecc_parity4(rp[2], rp[3], rp12, rp14);
 
-	/* reduce par to 16 bits then calculate rp1 and rp0 */
-	par ^= (par >> 16);
-#ifdef __BIG_ENDIAN
-	rp0 = (par >> 8) & 0xff;
-	rp1 = (par & 0xff);
+#ifdef CONFIG_MTD_NAND_ECC_SMC
+	code[0] = nand_ecc_byte(lo, pmask);
+	code[1] = nand_ecc_byte(mid, pmask);
 #else
-	rp1 = (par >> 8) & 0xff;
-	rp0 = (par & 0xff);
+	code[1] = nand_ecc_byte(lo, pmask);
+	code[0] = nand_ecc_byte(mid, pmask);
 #endif
+	code[2] = nand_ecc_byte(nand_ecc_parity4(rp16, par & 0x55555555,
+						 par & 0x33333333,
+						 par & 0x0f0f0f0f), pmask);
+	if (eccsize == 256)
+		code[2] |= 0x03;
+}
+EXPORT_SYMBOL(__nand_calculate_ecc);
 
-	/* finally reduce par to 8 bits */
-	par ^= (par >> 8);
-	par &= 0xff;
-
-	/*
-	 * and calculate rp5..rp15..rp17
-	 * note that par = rp4 ^ rp5 and due to the commutative property
-	 * of the ^ operator we can say:
-	 * rp5 = (par ^ rp4);
-	 * The & 0xff seems superfluous, but benchmarking learned that
-	 * leaving it out gives slightly worse results. No idea why, probably
-	 * it has to do with the way the pipeline in pentium is organized.
-	 */
-	rp5 = (par ^ rp4) & 0xff;
-	rp7 = (par ^ rp6) & 0xff;
-	rp9 = (par ^ rp8) & 0xff;
-	rp11 = (par ^ rp10) & 0xff;
-	rp13 = (par ^ rp12) & 0xff;
-	rp15 = (par ^ rp14) & 0xff;
-	if (eccsize_mult == 2)
-		rp17 = (par ^ rp16) & 0xff;
+/**
+ * nand_calculate_ecc - [NAND Interface] Calculate 3-byte ECC for 256/512-byte
+ *			 block
+ * @mtd:	MTD block structure
+ * @buf:	input buffer with raw data
+ * @code:	output buffer with ECC
+ */
+int nand_calculate_ecc(struct mtd_info *mtd, const unsigned char *buf,
+		       unsigned char *code)
+{
+	__nand_calculate_ecc(buf,
+			((struct nand_chip *)mtd->priv)->ecc.size, code);
 
-	/*
-	 * Finally calculate the ecc bits.
-	 * Again here it might seem that there are performance optimisations
-	 * possible, but benchmarks showed that on the system this is developed
-	 * the code below is the fastest
-	 */
-#ifdef CONFIG_MTD_NAND_ECC_SMC
-	code[0] =
-	    (invparity[rp7] << 7) |
-	    (invparity[rp6] << 6) |
-	    (invparity[rp5] << 5) |
-	    (invparity[rp4] << 4) |
-	    (invparity[rp3] << 3) |
-	    (invparity[rp2] << 2) |
-	    (invparity[rp1] << 1) |
-	    (invparity[rp0]);
-	code[1] =
-	    (invparity[rp15] << 7) |
-	    (invparity[rp14] << 6) |
-	    (invparity[rp13] << 5) |
-	    (invparity[rp12] << 4) |
-	    (invparity[rp11] << 3) |
-	    (invparity[rp10] << 2) |
-	    (invparity[rp9] << 1)  |
-	    (invparity[rp8]);
-#else
-	code[1] =
-	    (invparity[rp7] << 7) |
-	    (invparity[rp6] << 6) |
-	    (invparity[rp5] << 5) |
-	    (invparity[rp4] << 4) |
-	    (invparity[rp3] << 3) |
-	    (invparity[rp2] << 2) |
-	    (invparity[rp1] << 1) |
-	    (invparity[rp0]);
-	code[0] =
-	    (invparity[rp15] << 7) |
-	    (invparity[rp14] << 6) |
-	    (invparity[rp13] << 5) |
-	    (invparity[rp12] << 4) |
-	    (invparity[rp11] << 3) |
-	    (invparity[rp10] << 2) |
-	    (invparity[rp9] << 1)  |
-	    (invparity[rp8]);
-#endif
-	if (eccsize_mult == 1)
-		code[2] =
-		    (invparity[par & 0xf0] << 7) |
-		    (invparity[par & 0x0f] << 6) |
-		    (invparity[par & 0xcc] << 5) |
-		    (invparity[par & 0x33] << 4) |
-		    (invparity[par & 0xaa] << 3) |
-		    (invparity[par & 0x55] << 2) |
-		    3;
-	else
-		code[2] =
-		    (invparity[par & 0xf0] << 7) |
-		    (invparity[par & 0x0f] << 6) |
-		    (invparity[par & 0xcc] << 5) |
-		    (invparity[par & 0x33] << 4) |
-		    (invparity[par & 0xaa] << 3) |
-		    (invparity[par & 0x55] << 2) |
-		    (invparity[rp17] << 1) |
-		    (invparity[rp16] << 0);
 	return 0;
 }
 EXPORT_SYMBOL(nand_calculate_ecc);
 
+/**
+ * nand_calculate_ecc_steps - [NAND Interface] Calculate ECC for several
+ *			       consecutive blocks
+ * @mtd:	MTD block structure
+ * @buf:	input buffer with raw data
+ * @steps:	number of ecc blocks in @buf
+ * @code:	output buffer with 3 bytes of ECC per block
+ */
+void nand_calculate_ecc_steps(struct mtd_info *mtd, const unsigned char *buf,
+			      int steps, unsigned char *code)
+{
+	unsigned int eccsize = ((struct nand_chip *)mtd->priv)->ecc.size;
+
+	for (; steps; steps--, buf += eccsize, code += 3)
+		__nand_calculate_ecc(buf, eccsize, code);
+}
+EXPORT_SYMBOL(nand_calculate_ecc_steps);
+
+/*
+ * Gather the odd bits of an ecc byte (xor-ed with the calculated one) into
+ * a nibble; for a single bit error these name the faulty location.
+ */
+static inline unsigned int nand_ecc_addressbits(unsigned int b)
+{
+	return ((b >> 1) & 0x01) | ((b >> 2) & 0x02) |
+	       ((b >> 3) & 0x04) | ((b >> 4) & 0x08);
+}
+
 /**
  * __nand_correct_data - [NAND Interface] Detect and correct bit error(s)
  * @buf:	raw data read from the chip
@@ -430,7 +295,7 @@ int __nand_correct_data(unsigned char *buf,
 			unsigned int eccsize)
 {
 	unsigned char b0, b1, b2, bit_addr;
-	unsigned int byte_addr;
+	unsigned int byte_addr, diff;
 	/* 256 or 512 bytes/ecc  */
 	const uint32_t eccsize_mult = eccsize >> 8;
 
@@ -453,7 +318,8 @@ int __nand_correct_data(unsigned char *buf,
 	/* repeated if statements are slightly more efficient than switch ... */
 	/* ordered in order of likelihood */
 
-	if ((b0 | b1 | b2) == 0)
+	diff = b0 | (b1 << 8) | (b2 << 16);
+	if (diff == 0)
 		return 0;	/* no error */
 
 	if ((((b0 ^ (b0 >> 1)) & 0x55) == 0x55) &&
@@ -464,32 +330,23 @@ int __nand_correct_data(unsigned char *buf,
 		/*
 		 * rp17/rp15/13/11/9/7/5/3/1 indicate which byte is the faulty
 		 * byte, cp 5/3/1 indicate the faulty bit.
-		 * A lookup table (called addressbits) is used to filter
-		 * the bits from the byte they are in.
-		 * A marginal optimisation is possible by having three
-		 * different lookup tables.
-		 * One as we have now (for b0), one for b2
-		 * (that would avoid the >> 1), and one for b1 (with all values
-		 * << 4). However it was felt that introducing two more tables
-		 * hardly justify the gain.
-		 *
 		 * The b2 shift is there to get rid of the lowest two bits.
-		 * We could also do addressbits[b2] >> 1 but for the
-		 * performace it does not make any difference
 		 */
 		if (eccsize_mult == 1)
-			byte_addr = (addressbits[b1] << 4) + addressbits[b0];
+			byte_addr = (nand_ecc_addressbits(b1) << 4) +
+				    nand_ecc_addressbits(b0);
 		else
-			byte_addr = (addressbits[b2 & 0x3] << 8) +
-				    (addressbits[b1] << 4) + addressbits[b0];
-		bit_addr = addressbits[b2 >> 2];
+			byte_addr = (nand_ecc_addressbits(b2 & 0x3) << 8) +
+				    (nand_ecc_addressbits(b1) << 4) +
+				    nand_ecc_addressbits(b0);
+		bit_addr = nand_ecc_addressbits(b2 >> 2);
 		/* flip the bit */
 		buf[byte_addr] ^= (1 << bit_addr);
 		return 1;
 
 	}
-	/* count nr of bits; use table lookup, faster than calculating it */
-	if ((bitsperbyte[b0] + bitsperbyte[b1] + bitsperbyte[b2]) == 1)
+	/* a single flipped bit in the ecc itself */
+	if ((diff & (diff - 1)) == 0)
 		return 1;	/* error in ecc data; no action needed */
 
 	printk(KERN_ERR "uncorrectable error : ");
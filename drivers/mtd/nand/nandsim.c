@@ -34,6 +34,7 @@
 #include <linux/string.h>
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
+#include <linux/mtd/nand_bch.h>
 #include <linux/mtd/partitions.h>
 #include <linux/delay.h>
 #include <linux/list.h>
@@ -41,6 +42,10 @@
 #include <linux/sched.h>
 #include <linux/fs.h>
 #include <linux/pagemap.h>
+#include <linux/math64.h>
+#include <linux/jiffies.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 /* Default simulator parameters values */
 #if !defined(CONFIG_NANDSIM_FIRST_ID_BYTE)  || \
@@ -104,6 +109,10 @@ static char *gravepages = NULL;
 static unsigned int rptwear = 0;
 static unsigned int overridesize = 0;
 static char *cache_file = NULL;
+static unsigned int cache_ops = 0;
+static unsigned int bch = 0;
+static unsigned int wear_bitflips = 0;
+static unsigned int read_disturb = 0;
 
 module_param(first_id_byte,  uint, 0400);
 module_param(second_id_byte, uint, 0400);
@@ -127,6 +136,10 @@ module_param(gravepages,     charp, 0400);
 module_param(rptwear,        uint, 0400);
 module_param(overridesize,   uint, 0400);
 module_param(cache_file,     charp, 0400);
+module_param(cache_ops,      uint, 0400);
+module_param(bch,            uint, 0400);
+module_param(wear_bitflips,  uint, 0400);
+module_param(read_disturb,   uint, 0400);
 
 MODULE_PARM_DESC(first_id_byte,  "The first byte returned by NAND Flash 'read ID' command (manufacturer ID)");
 MODULE_PARM_DESC(second_id_byte, "The second byte returned by NAND Flash 'read ID' command (chip ID)");
@@ -138,7 +151,8 @@ MODULE_PARM_DESC(erase_delay,    "Sector erase delay (milliseconds)");
 MODULE_PARM_DESC(output_cycle,   "Word output (from flash) time (nanodeconds)");
 MODULE_PARM_DESC(input_cycle,    "Word input (to flash) time (nanodeconds)");
 MODULE_PARM_DESC(bus_width,      "Chip's bus width (8- or 16-bit)");
-MODULE_PARM_DESC(do_delays,      "Simulate NAND delays using busy-waits if not zero");
+MODULE_PARM_DESC(do_delays,      "Simulate NAND delays: 1 busy-waits every operation, 2 sleeps"
+				 " the accumulated delay in whole jiffies (zero by default)");
 MODULE_PARM_DESC(log,            "Perform logging if not zero");
 MODULE_PARM_DESC(dbg,            "Output debug information if not zero");
 MODULE_PARM_DESC(parts,          "Partition sizes (in erase blocks) separated by commas");
@@ -159,6 +173,15 @@ MODULE_PARM_DESC(overridesize,   "Specifies the NAND Flash size overriding the I
 				 "The size is specified in erase blocks and as the exponent of a power of two"
 				 " e.g. 5 means a size of 32 erase blocks");
 MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of memory");
+MODULE_PARM_DESC(cache_ops,      "Advertise cache read and cache program if not zero (large page chips only)");
+MODULE_PARM_DESC(bch,            "Enable BCH ecc and set how many bits should "
+				 "be correctable in 512-byte blocks");
+MODULE_PARM_DESC(wear_bitflips,  "Expected random bit flips per page read once its erase"
+				 " block has been erased 10000 times, grows linearly"
+				 " with the erase count (zero by default)");
+MODULE_PARM_DESC(read_disturb,   "Add one expected bit flip per page read for every"
+				 " this many reads of its erase block since the last"
+				 " erase (zero by default)");
 
 /* The largest possible page size */
 #define NS_LARGEST_PAGE_SIZE	2048
@@ -178,17 +201,12 @@ MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of mem
 #define NS_INFO(args...) \
 	do { printk(KERN_INFO NS_OUTPUT_PREFIX " " args); } while(0)
 
-/* Busy-wait delay macros (microseconds, milliseconds) */
-#define NS_UDELAY(us) \
-        do { if (do_delays) udelay(us); } while(0)
-#define NS_MDELAY(us) \
-        do { if (do_delays) mdelay(us); } while(0)
-
 /* Is the nandsim structure initialized ? */
 #define NS_IS_INITIALIZED(ns) ((ns)->geom.totsz != 0)
 
 /* Good operation completion status */
-#define NS_STATUS_OK(ns) (NAND_STATUS_READY | (NAND_STATUS_WP * ((ns)->lines.wp == 0)))
+#define NS_STATUS_OK(ns) (NAND_STATUS_READY | NAND_STATUS_TRUE_READY | \
+			  (NAND_STATUS_WP * ((ns)->lines.wp == 0)))
 
 /* Operation failed completion status */
 #define NS_STATUS_FAILED(ns) (NAND_STATUS_FAIL | NS_STATUS_OK(ns))
@@ -215,6 +233,7 @@ MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of mem
 #define STATE_CMD_RESET        0x0000000C /* reset */
 #define STATE_CMD_RNDOUT       0x0000000D /* random output command */
 #define STATE_CMD_RNDOUTSTART  0x0000000E /* random output start command */
+#define STATE_CMD_READCACHE    0x0000000F /* cache read, next or last page */
 #define STATE_CMD_MASK         0x0000000F /* command states mask */
 
 /* After an address is input, the simulator goes to one of these states */
@@ -247,9 +266,10 @@ MODULE_PARM_DESC(cache_file,     "File to use to cache nand pages instead of mem
 #define ACTION_ZEROOFF   0x00400000 /* don't add any offset to address */
 #define ACTION_HALFOFF   0x00500000 /* add to address half of page */
 #define ACTION_OOBOFF    0x00600000 /* add to address OOB offset */
+#define ACTION_CACHECPY  0x00700000 /* copy the next page of a cache read */
 #define ACTION_MASK      0x00700000 /* action mask */
 
-#define NS_OPER_NUM      13 /* Number of operations supported by the simulator */
+#define NS_OPER_NUM      14 /* Number of operations supported by the simulator */
 #define NS_OPER_STATES   6  /* Maximum number of states in operation */
 
 #define OPT_ANY          0xFFFFFFFF /* any chip supports this operation */
@@ -338,6 +358,7 @@ struct nandsim {
 		uint     count;   /* internal counter */
 		uint     num;     /* number of bytes which must be processed */
 		uint     off;     /* fixed page offset */
+		uint     cachenext; /* next page of a cache read + 1, 0 if none */
 	} regs;
 
 	/* NAND flash lines state */
@@ -354,6 +375,22 @@ struct nandsim {
 	void *file_buf;
 	struct page *held_pages[NS_MAX_HELD_PAGES];
 	int held_cnt;
+
+	/* Operation statistics, reset by writing to the debugfs file */
+	struct nandsim_stats {
+		uint64_t reads;     /* array to page register loads */
+		uint64_t progs;     /* page programs */
+		uint64_t erases;    /* erase block erases */
+		uint64_t bytes_out; /* bytes loaded from the array */
+		uint64_t bytes_in;  /* bytes programmed to the array */
+		uint64_t busy_ns;   /* simulated chip busy time */
+		uint64_t flips;     /* injected bit flips */
+	} stats;
+	struct mtd_ecc_stats ecc_base; /* mtd ecc statistics at the last reset */
+	uint64_t delay_debt;    /* busy time not slept yet (do_delays=2) */
+	int cache_op;           /* current load/program overlaps a transfer */
+	unsigned int *eb_reads; /* reads of each erase block since its erase */
+	struct dentry *dbg_dir;
 };
 
 /*
@@ -399,6 +436,8 @@ static struct nandsim_operations {
 	/* Large page devices random page read */
 	{OPT_LARGEPAGE, {STATE_CMD_RNDOUT, STATE_ADDR_COLUMN, STATE_CMD_RNDOUTSTART | ACTION_CPY,
 			       STATE_DATAOUT, STATE_READY}},
+	/* Large page devices cache read */
+	{OPT_LARGEPAGE, {STATE_CMD_READCACHE | ACTION_CACHECPY, STATE_DATAOUT, STATE_READY}},
 };
 
 struct weak_block {
@@ -700,6 +739,7 @@ error:
  */
 static void free_nandsim(struct nandsim *ns)
 {
+	kfree(ns->eb_reads);
 	kfree(ns->buf.byte);
 	free_device(ns);
 
@@ -905,12 +945,95 @@ static void free_lists(void)
 	kfree(erase_block_wear);
 }
 
+static int nandsim_stats_show(struct seq_file *m, void *private)
+{
+	struct nandsim *ns = m->private;
+	unsigned long wmax = 0, tot = 0;
+	unsigned int i;
+
+	for (i = 0; erase_block_wear && i < wear_eb_count; ++i) {
+		if (erase_block_wear[i] > wmax)
+			wmax = erase_block_wear[i];
+		tot += erase_block_wear[i];
+	}
+
+	seq_printf(m, "pages_read         %llu\n", ns->stats.reads);
+	seq_printf(m, "pages_programmed   %llu\n", ns->stats.progs);
+	seq_printf(m, "blocks_erased      %llu\n", ns->stats.erases);
+	seq_printf(m, "bytes_read         %llu\n", ns->stats.bytes_out);
+	seq_printf(m, "bytes_programmed   %llu\n", ns->stats.bytes_in);
+	seq_printf(m, "busy_us            %llu\n",
+		   div_u64(ns->stats.busy_ns, 1000));
+	seq_printf(m, "bitflips           %llu\n", ns->stats.flips);
+	seq_printf(m, "ecc_corrected      %u\n",
+		   nsmtd->ecc_stats.corrected - ns->ecc_base.corrected);
+	seq_printf(m, "ecc_failed         %u\n",
+		   nsmtd->ecc_stats.failed - ns->ecc_base.failed);
+	seq_printf(m, "erase_count_max    %lu\n", wmax);
+	seq_printf(m, "erase_count_avg    %lu\n",
+		   wear_eb_count ? tot / wear_eb_count : 0);
+	return 0;
+}
+
+static int nandsim_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, nandsim_stats_show, inode->i_private);
+}
+
+/* Any write resets the operation counters, erase counts are kept */
+static ssize_t nandsim_stats_write(struct file *file, const char __user *buf,
+				   size_t count, loff_t *ppos)
+{
+	struct seq_file *m = file->private_data;
+	struct nandsim *ns = m->private;
+
+	memset(&ns->stats, 0, sizeof(ns->stats));
+	ns->ecc_base = nsmtd->ecc_stats;
+	return count;
+}
+
+static const struct file_operations nandsim_stats_fops = {
+	.owner		= THIS_MODULE,
+	.open		= nandsim_stats_open,
+	.read		= seq_read,
+	.write		= nandsim_stats_write,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+/*
+ * Statistics for benchmarks in <debugfs>/nandsim/stats. Not fatal if
+ * debugfs is missing.
+ */
+static void nandsim_debugfs_create(struct nandsim *ns)
+{
+	struct dentry *dent;
+
+	dent = debugfs_create_dir("nandsim", NULL);
+	if (IS_ERR(dent) || !dent) {
+		NS_WARN("cannot create debugfs directory, no statistics\n");
+		return;
+	}
+	ns->dbg_dir = dent;
+	dent = debugfs_create_file("stats", S_IRUSR | S_IWUSR, ns->dbg_dir,
+				   ns, &nandsim_stats_fops);
+	if (IS_ERR(dent) || !dent)
+		NS_WARN("cannot create debugfs statistics file\n");
+}
+
+static void nandsim_debugfs_remove(struct nandsim *ns)
+{
+	debugfs_remove_recursive(ns->dbg_dir);
+}
+
+/*
+ * Erase counts are always kept: besides the wear report they drive the
+ * wear bit flip model and the statistics.
+ */
 static int setup_wear_reporting(struct mtd_info *mtd)
 {
 	size_t mem;
 
-	if (!rptwear)
-		return 0;
 	wear_eb_count = divide(mtd->size, mtd->erasesize);
 	mem = wear_eb_count * sizeof(unsigned long);
 	if (mem / sizeof(unsigned long) != wear_eb_count) {
@@ -925,6 +1048,21 @@ static int setup_wear_reporting(struct mtd_info *mtd)
 	return 0;
 }
 
+/*
+ * Reads since the last erase, per erase block, for the read disturb model.
+ */
+static int setup_read_disturb(struct nandsim *ns)
+{
+	if (!read_disturb)
+		return 0;
+	ns->eb_reads = kzalloc(wear_eb_count * sizeof(unsigned int), GFP_KERNEL);
+	if (!ns->eb_reads) {
+		NS_ERR("Too many erase blocks for read disturb\n");
+		return -ENOMEM;
+	}
+	return 0;
+}
+
 static void update_wear(unsigned int erase_block_no)
 {
 	unsigned long wmin = -1, wmax = 0, avg;
@@ -939,6 +1077,8 @@ static void update_wear(unsigned int erase_block_no)
 	erase_block_wear[erase_block_no] += 1;
 	if (erase_block_wear[erase_block_no] == 0)
 		NS_ERR("Erase counter overflow for erase block %u\n", erase_block_no);
+	if (!rptwear)
+		return;
 	rptwear_cnt += 1;
 	if (rptwear_cnt < rptwear)
 		return;
@@ -1021,6 +1161,8 @@ static char *get_state_name(uint32_t state)
 			return "STATE_CMD_RNDOUT";
 		case STATE_CMD_RNDOUTSTART:
 			return "STATE_CMD_RNDOUTSTART";
+		case STATE_CMD_READCACHE:
+			return "STATE_CMD_READCACHE";
 		case STATE_ADDR_PAGE:
 			return "STATE_ADDR_PAGE";
 		case STATE_ADDR_SEC:
@@ -1071,6 +1213,9 @@ static int check_command(int cmd)
 	case NAND_CMD_RESET:
 	case NAND_CMD_RNDOUT:
 	case NAND_CMD_RNDOUTSTART:
+	case NAND_CMD_CACHEDPROG:
+	case NAND_CMD_READCACHESEQ:
+	case NAND_CMD_READCACHEEND:
 		return 0;
 
 	case NAND_CMD_STATUS_MULTI:
@@ -1090,6 +1235,8 @@ static uint32_t get_state_by_command(unsigned command)
 		case NAND_CMD_READ1:
 			return STATE_CMD_READ1;
 		case NAND_CMD_PAGEPROG:
+		case NAND_CMD_CACHEDPROG:
+			/* Programming is synchronous, the cache is always free */
 			return STATE_CMD_PAGEPROG;
 		case NAND_CMD_READSTART:
 			return STATE_CMD_READSTART;
@@ -1113,6 +1260,9 @@ static uint32_t get_state_by_command(unsigned command)
 			return STATE_CMD_RNDOUT;
 		case NAND_CMD_RNDOUTSTART:
 			return STATE_CMD_RNDOUTSTART;
+		case NAND_CMD_READCACHESEQ:
+		case NAND_CMD_READCACHEEND:
+			return STATE_CMD_READCACHE;
 	}
 
 	NS_ERR("get_state_by_command: unknown command, BUG\n");
@@ -1411,6 +1561,7 @@ void do_bit_flips(struct nandsim *ns, int num)
 		int flips = 1;
 		if (bitflips > 1)
 			flips = (random32() % (int) bitflips) + 1;
+		ns->stats.flips += flips;
 		while (flips--) {
 			int pos = random32() % (num * 8);
 			ns->buf.byte[pos / 8] ^= (1 << (pos % 8));
@@ -1422,6 +1573,67 @@ void do_bit_flips(struct nandsim *ns, int num)
 	}
 }
 
+/*
+ * Bit flips that grow with the erase count of the erase block and with
+ * the number of reads since it was last erased. The expected number of
+ * flips for the bytes read is computed in 1/65536 units, its fractional
+ * part decides whether one more flip happens.
+ */
+static void do_wear_flips(struct nandsim *ns, int num)
+{
+	unsigned int eb = ns->regs.row >> (ns->geom.secshift - ns->geom.pgshift);
+	uint64_t expect = 0;
+	unsigned int flips;
+
+	if (wear_bitflips && erase_block_wear)
+		expect = div_u64(((uint64_t)wear_bitflips * erase_block_wear[eb]
+				  * num) << 16, 10000 * ns->geom.pgszoob);
+	if (read_disturb && ns->eb_reads)
+		expect += div_u64(((uint64_t)(ns->eb_reads[eb] / read_disturb)
+				   * num) << 16, ns->geom.pgszoob);
+	if (!expect)
+		return;
+
+	flips = expect >> 16;
+	if ((random32() & 0xffff) < (expect & 0xffff))
+		flips += 1;
+	ns->stats.flips += flips;
+	while (flips--) {
+		int pos = random32() % (num * 8);
+		ns->buf.byte[pos / 8] ^= (1 << (pos % 8));
+		NS_LOG("wear: flipping bit %d in page %d\n", pos, ns->regs.row);
+	}
+}
+
+/*
+ * Account 'nsec' nanoseconds of chip busy time. With do_delays=1 every
+ * operation busy-waits for its own time, with do_delays=2 the time is
+ * accumulated and slept off in whole jiffies, which keeps long runs close
+ * to real chip speed without burning the CPU.
+ */
+static void ns_delay(struct nandsim *ns, uint64_t nsec)
+{
+	ns->stats.busy_ns += nsec;
+
+	if (do_delays == 1) {
+		uint32_t rem;
+		uint64_t ms = div_u64_rem(nsec, 1000000, &rem);
+
+		if (ms)
+			mdelay(ms);
+		udelay(rem / 1000);
+	} else if (do_delays >= 2) {
+		uint64_t ticks;
+
+		ns->delay_debt += nsec;
+		ticks = div_u64(ns->delay_debt, TICK_NSEC);
+		if (ticks) {
+			ns->delay_debt -= ticks * TICK_NSEC;
+			schedule_timeout_uninterruptible(ticks);
+		}
+	}
+}
+
 /*
  * Fill the NAND buffer with data read from the specified page.
  */
@@ -1448,6 +1660,7 @@ static void read_page(struct nandsim *ns, int num)
 				return;
 			}
 			do_bit_flips(ns, num);
+			do_wear_flips(ns, num);
 		}
 		return;
 	}
@@ -1463,6 +1676,7 @@ static void read_page(struct nandsim *ns, int num)
 			return;
 		memcpy(ns->buf.byte, NS_PAGE_BYTE_OFF(ns), num);
 		do_bit_flips(ns, num);
+		do_wear_flips(ns, num);
 	}
 }
 
@@ -1578,6 +1792,7 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 	int num;
 	int busdiv = ns->busw == 8 ? 1 : 2;
 	unsigned int erase_block_no, page_no;
+	uint64_t load, xfer;
 
 	action &= ACTION_MASK;
 
@@ -1612,11 +1827,51 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 		else
 			NS_LOG("read OOB of page %d\n", ns->regs.row);
 
-		NS_UDELAY(access_delay);
-		NS_UDELAY(input_cycle * ns->geom.pgsz / 1000 / busdiv);
+		/*
+		 * Array load then data output. In a cache read the load of
+		 * the next page overlaps the output of this one.
+		 */
+		load = (uint64_t)access_delay * 1000;
+		xfer = (uint64_t)output_cycle * num / busdiv;
+		ns_delay(ns, ns->cache_op ? max(load, xfer) : load + xfer);
+		ns->cache_op = 0;
+
+		ns->stats.reads += 1;
+		ns->stats.bytes_out += num;
+		if (ns->eb_reads)
+			ns->eb_reads[ns->regs.row >>
+				     (ns->geom.secshift - ns->geom.pgshift)] += 1;
+
+		/* A page read may be followed by a cache read of it */
+		if (NS_STATE(ns->state) == STATE_CMD_READSTART)
+			ns->regs.cachenext = ns->regs.row + 1;
 
 		break;
 
+	case ACTION_CACHECPY:
+		/*
+		 * Cache read - output the page the chip has been loading and,
+		 * unless this ends the sequence, start loading the next one.
+		 */
+		if (!ns->regs.cachenext) {
+			NS_WARN("do_state_action: cache read without a page read\n");
+			return -1;
+		}
+
+		ns->regs.row = ns->regs.cachenext - 1;
+		ns->regs.column = 0;
+		ns->regs.off = 0;
+		if (ns->regs.command == NAND_CMD_READCACHESEQ
+			&& ns->regs.row + 1 < ns->geom.pgnum)
+			ns->regs.cachenext += 1;
+		else
+			ns->regs.cachenext = 0;
+
+		NS_DBG("do_state_action: cache read of page %#x\n", ns->regs.row);
+
+		ns->cache_op = 1;
+		return do_state_action(ns, ACTION_CPY);
+
 	case ACTION_SECERASE:
 		/*
 		 * Erase sector.
@@ -1645,7 +1900,10 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 
 		erase_sector(ns);
 
-		NS_MDELAY(erase_delay);
+		ns_delay(ns, (uint64_t)erase_delay * 1000000);
+		ns->stats.erases += 1;
+		if (ns->eb_reads)
+			ns->eb_reads[erase_block_no] = 0;
 
 		if (erase_block_wear)
 			update_wear(erase_block_no);
@@ -1683,8 +1941,18 @@ static int do_state_action(struct nandsim *ns, uint32_t action)
 			num, ns->regs.row, ns->regs.column, NS_RAW_OFFSET(ns) + ns->regs.off);
 		NS_LOG("programm page %d\n", ns->regs.row);
 
-		NS_UDELAY(programm_delay);
-		NS_UDELAY(output_cycle * ns->geom.pgsz / 1000 / busdiv);
+		/*
+		 * Data input then program. A cache program returns as soon
+		 * as the data is in the cache register, so the program of
+		 * this page overlaps the input of the next one.
+		 */
+		load = (uint64_t)programm_delay * 1000;
+		xfer = (uint64_t)input_cycle * num / busdiv;
+		ns_delay(ns, ns->regs.command == NAND_CMD_CACHEDPROG ?
+			 max(load, xfer) : load + xfer);
+
+		ns->stats.progs += 1;
+		ns->stats.bytes_in += num;
 
 		if (write_error(page_no)) {
 			NS_WARN("simulating write failure in page %u\n", page_no);
@@ -1963,6 +2231,7 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 
 		if (byte == NAND_CMD_RESET) {
 			NS_LOG("reset chip\n");
+			ns->regs.cachenext = 0;
 			switch_to_ready_state(ns, NS_STATUS_OK(ns));
 			return;
 		}
@@ -1978,7 +2247,14 @@ static void ns_nand_write_byte(struct mtd_info *mtd, u_char byte)
 			|| NS_STATE(ns->state) == STATE_DATAOUT) {
 			int row = ns->regs.row;
 
-			switch_state(ns);
+			/*
+			 * A cache read command may come before the page is
+			 * output at all, the data stays in the cache register.
+			 */
+			if (byte == NAND_CMD_READCACHESEQ || byte == NAND_CMD_READCACHEEND)
+				switch_to_ready_state(ns, NS_STATUS_OK(ns));
+			else
+				switch_state(ns);
 			if (byte == NAND_CMD_RNDOUT)
 				ns->regs.row = row;
 		}
@@ -2289,7 +2565,47 @@ static int __init ns_init_module(void)
 	if ((retval = parse_gravepages()) != 0)
 		goto error;
 
-	if ((retval = nand_scan(nsmtd, 1)) != 0) {
+	retval = nand_scan_ident(nsmtd, 1);
+	if (retval) {
+		NS_ERR("cannot scan NAND Simulator device\n");
+		if (retval > 0)
+			retval = -ENXIO;
+		goto error;
+	}
+
+	if (bch) {
+		unsigned int eccsteps, eccbytes;
+		if (!mtd_nand_has_bch()) {
+			NS_ERR("BCH ECC support is disabled\n");
+			retval = -EINVAL;
+			goto error;
+		}
+		/* use 512-byte ecc blocks */
+		eccsteps = nsmtd->writesize / 512;
+		eccbytes = (bch * 13 + 7) / 8;
+		/* do not bother supporting small page devices */
+		if ((nsmtd->oobsize < 64) || !eccsteps) {
+			NS_ERR("bch not available on small page devices\n");
+			retval = -EINVAL;
+			goto error;
+		}
+		if ((eccbytes * eccsteps + 2) > nsmtd->oobsize) {
+			NS_ERR("invalid bch value %u\n", bch);
+			retval = -EINVAL;
+			goto error;
+		}
+		chip->ecc.mode = NAND_ECC_SOFT_BCH;
+		chip->ecc.size = 512;
+		chip->ecc.bytes = eccbytes;
+		NS_INFO("using %u-bit/%u bytes BCH ECC\n", bch, chip->ecc.size);
+	}
+
+	if (cache_ops && nsmtd->writesize > 512)
+		chip->options |= NAND_CACHEPRG | NAND_CACHEPRG_ENABLE |
+				 NAND_CACHE_READ;
+
+	retval = nand_scan_tail(nsmtd);
+	if (retval) {
 		NS_ERR("can't register NAND Simulator\n");
 		if (retval > 0)
 			retval = -ENXIO;
@@ -2315,12 +2631,17 @@ static int __init ns_init_module(void)
 	if ((retval = init_nandsim(nsmtd)) != 0)
 		goto err_exit;
 
+	if ((retval = setup_read_disturb(nand)) != 0)
+		goto err_exit;
+
 	if ((retval = parse_badblocks(nand, nsmtd)) != 0)
 		goto err_exit;
 
 	if ((retval = nand_default_bbt(nsmtd)) != 0)
 		goto err_exit;
 
+	nandsim_debugfs_create(nand);
+
 	/* Register NAND partitions */
 	if ((retval = add_mtd_partitions(nsmtd, &nand->partitions[0], nand->nbparts)) != 0)
 		goto err_exit;
@@ -2328,6 +2649,7 @@ static int __init ns_init_module(void)
         return 0;
 
 err_exit:
+	nandsim_debugfs_remove(nand);
 	free_nandsim(nand);
 	nand_release(nsmtd);
 	for (i = 0;i < ARRAY_SIZE(nand->partitions); ++i)
@@ -2349,6 +2671,7 @@ static void __exit ns_cleanup_module(void)
 	struct nandsim *ns = (struct nandsim *)(((struct nand_chip *)nsmtd->priv)->priv);
 	int i;
 
+	nandsim_debugfs_remove(ns);
 	free_nandsim(ns);    /* Free nandsim private resources */
 	nand_release(nsmtd); /* Unregister driver */
 	for (i = 0;i < ARRAY_SIZE(ns->partitions); ++i)
@@ -37,6 +37,9 @@
 #include <linux/slab.h>
 #include <linux/clk.h>
 #include <linux/cpufreq.h>
+#include <linux/dma-mapping.h>
+#include <linux/completion.h>
+#include <linux/interrupt.h>
 
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/nand.h>
@@ -48,6 +51,10 @@
 #include <plat/regs-nand.h>
 #include <plat/nand.h>
 
+#ifdef CONFIG_MTD_NAND_S3C2410_DMA
+#include <mach/dma.h>
+#endif
+
 #ifdef CONFIG_MTD_NAND_S3C2410_HWECC
 static int hardware_ecc = 1;
 #else
@@ -60,6 +67,12 @@ static int clock_stop = 1;
 static const int clock_stop = 0;
 #endif
 
+#ifdef CONFIG_MTD_NAND_S3C2410_DMA
+static int use_dma = 1;
+#else
+static const int use_dma = 0;
+#endif
+
 
 /* new oob placement block for use with hardware ecc generation
  */
@@ -81,6 +94,11 @@ struct s3c2410_nand_info;
  * @set: The platform information supplied for this set of NAND chips.
  * @info: Link back to the hardware information.
  * @scan_res: The result from calling nand_scan_ident().
+ * @cmdfunc: The command function chosen by nand_scan_ident(), when wrapped.
+ * @waitfunc: The wait function chosen by nand_scan_ident(), when wrapped.
+ * @column: The column the next data transfer starts at, or -1 if unknown.
+ * @page: The page of the last read or program command.
+ * @dma_failed: A DMA transfer failed and could not be redone by PIO.
 */
 struct s3c2410_nand_mtd {
 	struct mtd_info			mtd;
@@ -88,6 +106,15 @@ struct s3c2410_nand_mtd {
 	struct s3c2410_nand_set		*set;
 	struct s3c2410_nand_info	*info;
 	int				scan_res;
+
+#ifdef CONFIG_MTD_NAND_S3C2410_DMA
+	void	(*cmdfunc)(struct mtd_info *mtd, unsigned command,
+			   int column, int page_addr);
+	int	(*waitfunc)(struct mtd_info *mtd, struct nand_chip *this);
+	int				column;
+	int				page;
+	int				dma_failed;
+#endif
 };
 
 enum s3c_cpu_type {
@@ -112,6 +139,11 @@ enum s3c_cpu_type {
  * @save_sel: The contents of @sel_reg to be saved over suspend.
  * @clk_rate: The clock rate from @clk.
  * @cpu_type: The exact type of this controller.
+ * @dma_ch: The DMA channel for page data, or 0 if using PIO.
+ * @dma_nfdata: The physical address of the NFDATA register.
+ * @dma_source: The direction @dma_ch was last configured for.
+ * @dma_result: The result of the last DMA transfer.
+ * @dma_done: Completed when a DMA transfer finishes.
  */
 struct s3c2410_nand_info {
 	/* mtd info */
@@ -135,6 +167,14 @@ struct s3c2410_nand_info {
 #ifdef CONFIG_CPU_FREQ
 	struct notifier_block	freq_transition;
 #endif
+
+#ifdef CONFIG_MTD_NAND_S3C2410_DMA
+	int				dma_ch;
+	unsigned long			dma_nfdata;
+	int				dma_source;
+	enum s3c2410_dma_buffresult	dma_result;
+	struct completion		dma_done;
+#endif
 };
 
 /* conversion functions */
@@ -429,6 +469,13 @@ static int s3c2410_nand_correct_data(struct mtd_info *mtd, u_char *dat,
 
 	pr_debug("%s(%p,%p,%p,%p)\n", __func__, mtd, dat, read_ecc, calc_ecc);
 
+#ifdef CONFIG_MTD_NAND_S3C2410_DMA
+	if (s3c2410_nand_mtd_toours(mtd)->dma_failed) {
+		s3c2410_nand_mtd_toours(mtd)->dma_failed = 0;
+		return -1;
+	}
+#endif
+
 	diff0 = read_ecc[0] ^ calc_ecc[0];
 	diff1 = read_ecc[1] ^ calc_ecc[1];
 	diff2 = read_ecc[2] ^ calc_ecc[2];
@@ -570,6 +617,303 @@ static int s3c2440_nand_calculate_ecc(struct mtd_info *mtd, const u_char *dat, u
 	return 0;
 }
 
+/* DMA support
+ *
+ * The controller has no DMA request line, so a transfer is started by
+ * software and the DMA engine runs it through in one go. Accesses to
+ * NFDATA are stretched by the controller's wait states just as they are
+ * for the CPU, so the engine cannot overrun the chip.
+ *
+ * Short transfers such as the oob area or the 256 byte steps of a hardware
+ * ECC page are cheaper to do by PIO than to set up, as are buffers that
+ * are not word aligned or not in the kernel's linear map.
+*/
+
+#ifdef CONFIG_MTD_NAND_S3C2410_DMA
+
+#define S3C2410_NAND_DMA_MIN	512
+
+static struct s3c2410_dma_client s3c2410_nand_dma_client = {
+	.name		= "s3c2410-nand",
+};
+
+static void s3c2410_nand_dma_done(struct s3c2410_dma_chan *chan, void *buf_id,
+				  int size, enum s3c2410_dma_buffresult result)
+{
+	struct s3c2410_nand_info *info = buf_id;
+
+	info->dma_result = result;
+	complete(&info->dma_done);
+}
+
+static int s3c2410_nand_can_dma(struct s3c2410_nand_info *info,
+				const u_char *buf, int len)
+{
+	if (!info->dma_ch || len < S3C2410_NAND_DMA_MIN)
+		return 0;
+
+	if (((unsigned long)buf & 3) || (len & 3))
+		return 0;
+
+	if (in_interrupt() || oops_in_progress)
+		return 0;
+
+	return virt_addr_valid(buf) && virt_addr_valid(buf + len - 1);
+}
+
+/**
+ * s3c2410_nand_dma - move a buffer to or from NFDATA by DMA.
+ * @info: The controller instance.
+ * @buf: The buffer, which must have passed s3c2410_nand_can_dma().
+ * @len: The length of the transfer in bytes.
+ * @dir: DMA_FROM_DEVICE to read from the chip, DMA_TO_DEVICE to write.
+ *
+ * Sleeps until the transfer is done. Returns -EAGAIN if the transfer
+ * could not be started, in which case nothing has moved and the caller
+ * should fall back to PIO.
+ */
+static int s3c2410_nand_dma(struct s3c2410_nand_info *info, void *buf,
+			    int len, enum dma_data_direction dir)
+{
+	int source = (dir == DMA_FROM_DEVICE) ?
+		S3C2410_DMASRC_HW : S3C2410_DMASRC_MEM;
+	dma_addr_t addr;
+	int ret;
+
+	if (info->dma_source != source) {
+		s3c2410_dma_devconfig(info->dma_ch, source, info->dma_nfdata);
+		info->dma_source = source;
+	}
+
+	addr = dma_map_single(info->device, buf, len, dir);
+	INIT_COMPLETION(info->dma_done);
+
+	if (s3c2410_dma_enqueue(info->dma_ch, info, addr, len) != 0) {
+		dma_unmap_single(info->device, addr, len, dir);
+		return -EAGAIN;
+	}
+
+	s3c2410_dma_ctrl(info->dma_ch, S3C2410_DMAOP_START);
+
+	ret = 0;
+	if (!wait_for_completion_timeout(&info->dma_done, HZ)) {
+		dev_err(info->device, "dma timeout, %d bytes\n", len);
+		s3c2410_dma_ctrl(info->dma_ch, S3C2410_DMAOP_FLUSH);
+		ret = -ETIMEDOUT;
+	} else if (info->dma_result != S3C2410_RES_OK) {
+		dev_err(info->device, "dma failed (%d)\n", info->dma_result);
+		ret = -EIO;
+	}
+
+	dma_unmap_single(info->device, addr, len, dir);
+	return ret;
+}
+
+/* Track the column of the chip's data pointer so that a failed DMA
+ * transfer can be restarted from the beginning of its buffer.
+ */
+static void s3c2410_nand_command(struct mtd_info *mtd, unsigned command,
+				 int column, int page_addr)
+{
+	struct s3c2410_nand_mtd *nmtd = s3c2410_nand_mtd_toours(mtd);
+
+	switch (command) {
+	case NAND_CMD_READOOB:
+		nmtd->column = column + mtd->writesize;
+		nmtd->page = page_addr;
+		nmtd->dma_failed = 0;
+		break;
+
+	case NAND_CMD_READ0:
+	case NAND_CMD_SEQIN:
+		nmtd->column = column;
+		nmtd->page = page_addr;
+		nmtd->dma_failed = 0;
+		break;
+
+	case NAND_CMD_RNDOUT:
+	case NAND_CMD_RNDIN:
+		nmtd->column = column;
+		break;
+
+	case NAND_CMD_PAGEPROG:
+	case NAND_CMD_CACHEDPROG:
+	case NAND_CMD_STATUS:
+		break;
+
+	default:
+		nmtd->column = -1;
+		nmtd->dma_failed = 0;
+		break;
+	}
+
+	nmtd->cmdfunc(mtd, command, column, page_addr);
+}
+
+/* Report a page whose data could not be moved as a failed program */
+static int s3c2410_nand_wait(struct mtd_info *mtd, struct nand_chip *chip)
+{
+	struct s3c2410_nand_mtd *nmtd = s3c2410_nand_mtd_toours(mtd);
+	int status = nmtd->waitfunc(mtd, chip);
+
+	if (nmtd->dma_failed) {
+		nmtd->dma_failed = 0;
+		status |= NAND_STATUS_FAIL;
+	}
+	return status;
+}
+
+/**
+ * s3c2410_nand_rewind - move the chip's data pointer back to @column.
+ * @mtd: The MTD instance.
+ * @column: Where the failed transfer started, or -1 if unknown.
+ * @dir: The direction of the failed transfer.
+ *
+ * Large page chips can change column in either direction. Small page
+ * chips have no random data input, but a read from the start of the page
+ * can be issued again.
+ */
+static int s3c2410_nand_rewind(struct mtd_info *mtd, int column,
+			       enum dma_data_direction dir)
+{
+	struct s3c2410_nand_mtd *nmtd = s3c2410_nand_mtd_toours(mtd);
+	struct nand_chip *chip = &nmtd->chip;
+	int write = (dir == DMA_TO_DEVICE);
+
+	if (column < 0)
+		return -EIO;
+
+	if (mtd->writesize > 512)
+		nmtd->cmdfunc(mtd, write ? NAND_CMD_RNDIN : NAND_CMD_RNDOUT,
+			      column, -1);
+	else if (!write && column == 0 && nmtd->page >= 0)
+		nmtd->cmdfunc(mtd, NAND_CMD_READ0, 0, nmtd->page);
+	else
+		return -EIO;
+
+	/* The ECC engine has seen whatever the DMA moved, start it again */
+	if (chip->ecc.mode == NAND_ECC_HW)
+		chip->ecc.hwctl(mtd, write ? NAND_ECC_WRITE : NAND_ECC_READ);
+
+	return 0;
+}
+
+/**
+ * s3c2440_nand_dma_buf - try to move a page buffer by DMA.
+ * @mtd: The MTD instance.
+ * @buf: The buffer.
+ * @len: The length of the transfer in bytes.
+ * @dir: DMA_FROM_DEVICE to read from the chip, DMA_TO_DEVICE to write.
+ *
+ * Returns 1 if the transfer has been dealt with, or 0 if the caller should
+ * move the buffer by PIO. A transfer that fails part way is redone by PIO
+ * from the start of the buffer. If the column cannot be reset, the page
+ * is failed: reads through the ECC check, programs through the status.
+ */
+static int s3c2440_nand_dma_buf(struct mtd_info *mtd, void *buf, int len,
+				enum dma_data_direction dir)
+{
+	struct s3c2410_nand_mtd *nmtd = s3c2410_nand_mtd_toours(mtd);
+	struct s3c2410_nand_info *info = nmtd->info;
+	int column = nmtd->column;
+	int ret;
+
+	if (column >= 0)
+		nmtd->column += len;
+
+	if (!s3c2410_nand_can_dma(info, buf, len))
+		return 0;
+
+	ret = s3c2410_nand_dma(info, buf, len, dir);
+	if (ret == 0)
+		return 1;
+	if (ret == -EAGAIN)
+		return 0;
+
+	if (s3c2410_nand_rewind(mtd, column, dir) == 0) {
+		dev_warn(info->device, "redoing %d bytes by pio\n", len);
+		return 0;
+	}
+
+	dev_err(info->device, "cannot redo %d bytes at column %d by pio\n",
+		len, column);
+	nmtd->dma_failed = 1;
+	return 1;
+}
+
+/* Wrap the command and wait functions chosen by nand_scan_ident() */
+static void s3c2410_nand_dma_hook(struct s3c2410_nand_info *info,
+				  struct s3c2410_nand_mtd *nmtd)
+{
+	struct nand_chip *chip = &nmtd->chip;
+
+	nmtd->column = -1;
+	nmtd->page = -1;
+
+	if (!info->dma_ch)
+		return;
+
+	nmtd->cmdfunc = chip->cmdfunc;
+	nmtd->waitfunc = chip->waitfunc;
+	chip->cmdfunc = s3c2410_nand_command;
+	chip->waitfunc = s3c2410_nand_wait;
+}
+
+static void s3c2410_nand_dma_init(struct s3c2410_nand_info *info,
+				  struct resource *res)
+{
+	int ch;
+
+	if (!use_dma || info->cpu_type != TYPE_S3C2440)
+		return;
+
+	ch = s3c2410_dma_request(DMACH_NAND, &s3c2410_nand_dma_client, NULL);
+	if (ch < 0) {
+		dev_info(info->device, "no dma channel, using pio\n");
+		return;
+	}
+
+	init_completion(&info->dma_done);
+	info->dma_nfdata = res->start + S3C2440_NFDATA;
+	info->dma_source = -1;
+
+	s3c2410_dma_config(ch, 4);
+	s3c2410_dma_set_buffdone_fn(ch, s3c2410_nand_dma_done);
+
+	info->dma_ch = ch;
+	dev_info(info->device, "using dma for page data\n");
+}
+
+static void s3c2410_nand_dma_exit(struct s3c2410_nand_info *info)
+{
+	if (info->dma_ch) {
+		s3c2410_dma_free(info->dma_ch, &s3c2410_nand_dma_client);
+		info->dma_ch = 0;
+	}
+}
+
+#else
+static inline int s3c2440_nand_dma_buf(struct mtd_info *mtd, void *buf,
+				       int len, enum dma_data_direction dir)
+{
+	return 0;
+}
+
+static inline void s3c2410_nand_dma_hook(struct s3c2410_nand_info *info,
+					 struct s3c2410_nand_mtd *nmtd)
+{
+}
+
+static inline void s3c2410_nand_dma_init(struct s3c2410_nand_info *info,
+					 struct resource *res)
+{
+}
+
+static inline void s3c2410_nand_dma_exit(struct s3c2410_nand_info *info)
+{
+}
+#endif
+
 /* over-ride the standard functions for a little more speed. We can
  * use read/write block to move the data buffers to/from the controller
 */
@@ -584,6 +928,9 @@ static void s3c2440_nand_read_buf(struct mtd_info *mtd, u_char *buf, int len)
 {
 	struct s3c2410_nand_info *info = s3c2410_nand_mtd_toinfo(mtd);
 
+	if (s3c2440_nand_dma_buf(mtd, buf, len, DMA_FROM_DEVICE))
+		return;
+
 	readsl(info->regs + S3C2440_NFDATA, buf, len >> 2);
 
 	/* cleanup if we've got less than a word to do */
@@ -605,6 +952,9 @@ static void s3c2440_nand_write_buf(struct mtd_info *mtd, const u_char *buf, int
 {
 	struct s3c2410_nand_info *info = s3c2410_nand_mtd_toinfo(mtd);
 
+	if (s3c2440_nand_dma_buf(mtd, (void *)buf, len, DMA_TO_DEVICE))
+		return;
+
 	writesl(info->regs + S3C2440_NFDATA, buf, len >> 2);
 
 	/* cleanup any fractional write */
@@ -674,6 +1024,7 @@ static int s3c24xx_nand_remove(struct platform_device *pdev)
 		return 0;
 
 	s3c2410_nand_cpufreq_deregister(info);
+	s3c2410_nand_dma_exit(info);
 
 	/* Release all our mtds  and their partitions, then go through
 	 * freeing the resources used
@@ -986,6 +1337,8 @@ static int s3c24xx_nand_probe(struct platform_device *pdev)
 	if (err != 0)
 		goto exit_error;
 
+	s3c2410_nand_dma_init(info, res);
+
 	sets = (plat != NULL) ? plat->sets : NULL;
 	nr_sets = (plat != NULL) ? plat->nr_sets : 1;
 
@@ -1017,6 +1370,7 @@ static int s3c24xx_nand_probe(struct platform_device *pdev)
 
 		if (nmtd->scan_res == 0) {
 			s3c2410_nand_update_chip(info, nmtd);
+			s3c2410_nand_dma_hook(info, nmtd);
 			nand_scan_tail(&nmtd->mtd);
 			s3c2410_nand_add_partition(info, nmtd, sets);
 		}
@@ -0,0 +1,390 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Check how many bit errors the NAND ECC of an MTD device corrects, and
+ * measure read and write speed with bit errors present.
+ *
+ * Bit errors are injected by rewriting a page in raw mode with some bits
+ * cleared, which a real chip and nandsim both allow since programming
+ * only turns ones into zeroes. Meant for nandsim (e.g. with bch=4), the
+ * eraseblock used is erased before and after the test.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/err.h>
+#include <linux/mtd/mtd.h>
+#include <linux/sched.h>
+#include <linux/random.h>
+#include <linux/time.h>
+
+#define PRINT_PREF KERN_INFO "mtd_nandbiterrs: "
+
+static int dev;
+module_param(dev, int, S_IRUGO);
+MODULE_PARM_DESC(dev, "MTD device number to use");
+
+static int max_flips = 32;
+module_param(max_flips, int, S_IRUGO);
+MODULE_PARM_DESC(max_flips, "Stop the incremental test after this many "
+		 "bit errors");
+
+static int flips = 1;
+module_param(flips, int, S_IRUGO);
+MODULE_PARM_DESC(flips, "Bit errors per 512 bytes for the speed test");
+
+static int count = 10;
+module_param(count, int, S_IRUGO);
+MODULE_PARM_DESC(count, "Number of times the eraseblock is read in the "
+		 "speed test");
+
+static struct mtd_info *mtd;
+static unsigned char *wbuf;
+static unsigned char *rbuf;
+
+static int pgsize;
+static int pgcnt;
+static int ebnum;
+
+static struct timeval start, finish;
+
+static int erase_eraseblock(void)
+{
+	int err;
+	struct erase_info ei;
+	loff_t addr = (loff_t)ebnum * mtd->erasesize;
+
+	memset(&ei, 0, sizeof(struct erase_info));
+	ei.mtd  = mtd;
+	ei.addr = addr;
+	ei.len  = mtd->erasesize;
+
+	err = mtd->erase(mtd, &ei);
+	if (err) {
+		printk(PRINT_PREF "error %d while erasing EB %d\n", err, ebnum);
+		return err;
+	}
+
+	if (ei.state == MTD_ERASE_FAILED) {
+		printk(PRINT_PREF "some erase error occurred at EB %d\n",
+		       ebnum);
+		return -EIO;
+	}
+
+	return 0;
+}
+
+static loff_t page_addr(int pg)
+{
+	return (loff_t)ebnum * mtd->erasesize + (loff_t)pg * pgsize;
+}
+
+static int write_page(int pg, const unsigned char *buf)
+{
+	size_t written = 0;
+	int err;
+
+	err = mtd->write(mtd, page_addr(pg), pgsize, &written, buf);
+	if (err || written != pgsize) {
+		printk(PRINT_PREF "error: write failed at %#llx\n",
+		       (long long)page_addr(pg));
+		return err ? err : -EINVAL;
+	}
+	return 0;
+}
+
+/* Returns 0, -EUCLEAN if bits were corrected, or the read error */
+static int read_page(int pg, unsigned char *buf)
+{
+	size_t read = 0;
+	int err;
+
+	err = mtd->read(mtd, page_addr(pg), pgsize, &read, buf);
+	if (err && err != -EUCLEAN)
+		return err;
+	if (read != pgsize)
+		return -EINVAL;
+	return err;
+}
+
+/*
+ * A raw read with a data buffer puts the OOB straight after the page
+ * data, so rbuf holds both and the OOB that was read, ecc included, is
+ * what gets written back.
+ */
+static int rw_page_raw(int pg, int write)
+{
+	struct mtd_oob_ops ops;
+	int err;
+
+	ops.mode      = MTD_OOB_RAW;
+	ops.len       = pgsize;
+	ops.retlen    = 0;
+	ops.ooblen    = mtd->oobsize;
+	ops.oobretlen = 0;
+	ops.ooboffs   = 0;
+	ops.datbuf    = rbuf;
+	ops.oobbuf    = rbuf + pgsize;
+	if (write)
+		err = mtd->write_oob(mtd, page_addr(pg), &ops);
+	else
+		err = mtd->read_oob(mtd, page_addr(pg), &ops);
+	if (err || ops.retlen != pgsize) {
+		printk(PRINT_PREF "error: raw %s failed at %#llx\n",
+		       write ? "write" : "read", (long long)page_addr(pg));
+		return err ? err : -EINVAL;
+	}
+	return 0;
+}
+
+/* Clear one set bit at or after byte offs of rbuf, returns its number */
+static int clear_bit_from(int offs, int limit)
+{
+	int i, b;
+
+	for (i = 0; i < limit; i++) {
+		unsigned char *p = &rbuf[(offs + i) % limit];
+
+		if (!*p)
+			continue;
+		b = ffs(*p) - 1;
+		*p &= ~(1 << b);
+		return ((offs + i) % limit) * 8 + b;
+	}
+	return -1;
+}
+
+/*
+ * Add one bit error at a time to the first 256 bytes of a page, which are
+ * covered by a single ecc step whatever the ecc step size, until the page
+ * no longer reads back correctly.
+ */
+static int incremental_errors_test(void)
+{
+	int err, i, bit, corrected = 0;
+
+	printk(PRINT_PREF "incremental bit errors test\n");
+
+	err = erase_eraseblock();
+	if (err)
+		return err;
+	get_random_bytes(wbuf, pgsize);
+	err = write_page(0, wbuf);
+	if (err)
+		return err;
+
+	for (i = 1; i <= max_flips; i++) {
+		err = rw_page_raw(0, 0);
+		if (err)
+			return err;
+		bit = clear_bit_from(i * 37, 256);
+		if (bit < 0)
+			break;
+		err = rw_page_raw(0, 1);
+		if (err)
+			return err;
+
+		err = read_page(0, rbuf);
+		if (err == -EBADMSG) {
+			printk(PRINT_PREF "%d bit errors reported as "
+			       "uncorrectable\n", i);
+			break;
+		}
+		if (err && err != -EUCLEAN)
+			return err;
+		if (memcmp(wbuf, rbuf, pgsize)) {
+			printk(PRINT_PREF "%d bit errors not reported and not "
+			       "corrected\n", i);
+			break;
+		}
+		corrected = i;
+	}
+
+	printk(PRINT_PREF "ecc corrects %d bit error%s per ecc step\n",
+	       corrected, corrected == 1 ? "" : "s");
+	if (!corrected) {
+		printk(PRINT_PREF "error: no bit error could be corrected\n");
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static long calc_speed(long kib)
+{
+	long ms;
+
+	ms = (finish.tv_sec - start.tv_sec) * 1000 +
+	     (finish.tv_usec - start.tv_usec) / 1000;
+	if (!ms)
+		ms = 1;
+	return kib * 1000 / ms;
+}
+
+/*
+ * Write the whole eraseblock, then add 'flips' bit errors to every 512
+ * bytes of every page and time reading it back. Random bit flips from
+ * nandsim's bitflips parameter come on top and show up in the ecc
+ * statistics.
+ */
+static int speed_test(void)
+{
+	struct mtd_ecc_stats old;
+	int err, pg, i, j, mismatch = 0;
+	long speed;
+
+	printk(PRINT_PREF "speed test with %d bit errors per 512 bytes\n",
+	       flips);
+
+	err = erase_eraseblock();
+	if (err)
+		return err;
+
+	get_random_bytes(wbuf, mtd->erasesize);
+	do_gettimeofday(&start);
+	for (pg = 0; pg < pgcnt; pg++) {
+		err = write_page(pg, wbuf + pg * pgsize);
+		if (err)
+			return err;
+		cond_resched();
+	}
+	do_gettimeofday(&finish);
+	speed = calc_speed(mtd->erasesize / 1024);
+	printk(PRINT_PREF "page write speed is %ld KiB/s\n", speed);
+
+	if (flips > 0) {
+		for (pg = 0; pg < pgcnt; pg++) {
+			err = rw_page_raw(pg, 0);
+			if (err)
+				return err;
+			for (i = 0; i < pgsize; i += 512)
+				for (j = 0; j < flips; j++)
+					clear_bit_from(i + (j * 509) % 512,
+						       pgsize);
+			err = rw_page_raw(pg, 1);
+			if (err)
+				return err;
+			cond_resched();
+		}
+	}
+
+	old = mtd->ecc_stats;
+	do_gettimeofday(&start);
+	for (i = 0; i < count; i++) {
+		for (pg = 0; pg < pgcnt; pg++) {
+			err = read_page(pg, rbuf);
+			if (err == -EBADMSG)
+				continue;
+			if (err && err != -EUCLEAN)
+				return err;
+			if (memcmp(wbuf + pg * pgsize, rbuf, pgsize))
+				mismatch += 1;
+		}
+		cond_resched();
+	}
+	do_gettimeofday(&finish);
+	speed = calc_speed(count * (mtd->erasesize / 1024));
+	printk(PRINT_PREF "page read speed is %ld KiB/s, %u bits corrected, "
+	       "%u uncorrectable reads\n", speed,
+	       mtd->ecc_stats.corrected - old.corrected,
+	       mtd->ecc_stats.failed - old.failed);
+
+	if (mismatch) {
+		printk(PRINT_PREF "error: %d pages read back wrong\n",
+		       mismatch);
+		return -EINVAL;
+	}
+	return 0;
+}
+
+static int __init mtd_nandbiterrs_init(void)
+{
+	uint64_t tmp;
+	int err, ebcnt;
+
+	printk(KERN_INFO "\n");
+	printk(KERN_INFO "=================================================\n");
+	printk(PRINT_PREF "MTD device: %d\n", dev);
+
+	mtd = get_mtd_device(NULL, dev);
+	if (IS_ERR(mtd)) {
+		err = PTR_ERR(mtd);
+		printk(PRINT_PREF "error: Cannot get MTD device\n");
+		return err;
+	}
+
+	if (mtd->type != MTD_NANDFLASH) {
+		printk(PRINT_PREF "this test requires NAND flash\n");
+		err = -ENODEV;
+		goto out_put;
+	}
+
+	pgsize = mtd->writesize;
+	pgcnt = mtd->erasesize / mtd->writesize;
+	tmp = mtd->size;
+	do_div(tmp, mtd->erasesize);
+	ebcnt = tmp;
+
+	for (ebnum = 0; ebnum < ebcnt; ebnum++)
+		if (!mtd->block_isbad(mtd, (loff_t)ebnum * mtd->erasesize))
+			break;
+	if (ebnum == ebcnt) {
+		printk(PRINT_PREF "error: no good eraseblock\n");
+		err = -EIO;
+		goto out_put;
+	}
+	printk(PRINT_PREF "using eraseblock %d, page size %u, OOB size %u\n",
+	       ebnum, pgsize, mtd->oobsize);
+
+	err = -ENOMEM;
+	wbuf = kmalloc(mtd->erasesize, GFP_KERNEL);
+	rbuf = kmalloc(pgsize + mtd->oobsize, GFP_KERNEL);
+	if (!wbuf || !rbuf) {
+		printk(PRINT_PREF "error: cannot allocate memory\n");
+		goto out;
+	}
+
+	err = incremental_errors_test();
+	if (err)
+		goto out;
+
+	err = speed_test();
+	if (err)
+		goto out;
+
+	err = erase_eraseblock();
+	if (err)
+		goto out;
+
+	printk(PRINT_PREF "finished\n");
+out:
+	kfree(rbuf);
+	kfree(wbuf);
+out_put:
+	put_mtd_device(mtd);
+	if (err)
+		printk(PRINT_PREF "error %d occurred\n", err);
+	printk(KERN_INFO "=================================================\n");
+	return err;
+}
+module_init(mtd_nandbiterrs_init);
+
+static void __exit mtd_nandbiterrs_exit(void)
+{
+	return;
+}
+module_exit(mtd_nandbiterrs_exit);
+
+MODULE_DESCRIPTION("NAND ECC bit error correction test");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,235 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License version 2 as published by
+ * the Free Software Foundation.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; see the file COPYING. If not, write to the Free Software
+ * Foundation, 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * Test the software Hamming ECC in nand_ecc.c against a plain bit by bit
+ * implementation, check single bit correction and measure its speed.
+ * Needs no MTD device.
+ */
+
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/jiffies.h>
+#include <linux/random.h>
+#include <linux/mtd/nand_ecc.h>
+
+#define PRINT_PREF KERN_INFO "mtd_nandecctest: "
+
+static int count = 1000;
+module_param(count, int, S_IRUGO);
+MODULE_PARM_DESC(count, "Number of random blocks to compare per ecc size");
+
+static int errcnt;
+
+/*
+ * The ecc as the textbook describes it: for every set bit, toggle one
+ * line parity of each pair depending on the byte address, the column
+ * parities come from the xor of all bytes. Ecc bits are inverted
+ * parities.
+ */
+static void ref_calculate_ecc(const unsigned char *buf, unsigned int eccsize,
+			      unsigned char *code)
+{
+	unsigned int addrbits = eccsize == 512 ? 9 : 8;
+	unsigned int rp = 0, i, k;
+	unsigned char par = 0, cp, lo, mid;
+
+	for (i = 0; i < eccsize; i++) {
+		par ^= buf[i];
+		if (hweight8(buf[i]) & 1)
+			for (k = 0; k < addrbits; k++)
+				rp ^= 1 << (2 * k + ((i >> k) & 1));
+	}
+
+	cp = ((hweight8(par & 0x55) & 1) << 2) |
+	     ((hweight8(par & 0xaa) & 1) << 3) |
+	     ((hweight8(par & 0x33) & 1) << 4) |
+	     ((hweight8(par & 0xcc) & 1) << 5) |
+	     ((hweight8(par & 0x0f) & 1) << 6) |
+	     ((hweight8(par & 0xf0) & 1) << 7);
+
+	lo = ~rp;
+	mid = ~(rp >> 8);
+#ifdef CONFIG_MTD_NAND_ECC_SMC
+	code[0] = lo;
+	code[1] = mid;
+#else
+	code[0] = mid;
+	code[1] = lo;
+#endif
+	code[2] = ~(cp | ((rp >> 16) & 0x03));
+	if (eccsize == 256)
+		code[2] |= 0x03;
+}
+
+static void check_ecc(const unsigned char *buf, unsigned int eccsize,
+		      const char *what)
+{
+	unsigned char ref[3], ecc[3];
+
+	ref_calculate_ecc(buf, eccsize, ref);
+	__nand_calculate_ecc(buf, eccsize, ecc);
+	if (memcmp(ref, ecc, 3)) {
+		printk(PRINT_PREF "error: %s, %u bytes: ecc %02x%02x%02x "
+		       "expected %02x%02x%02x\n", what, eccsize, ecc[0],
+		       ecc[1], ecc[2], ref[0], ref[1], ref[2]);
+		errcnt += 1;
+	}
+}
+
+static void test_calculate(unsigned char *buf, unsigned int eccsize)
+{
+	int i;
+
+	memset(buf, 0, eccsize);
+	check_ecc(buf, eccsize, "all zero");
+	memset(buf, 0xff, eccsize);
+	check_ecc(buf, eccsize, "erased");
+
+	/* every single bit, so each parity is exercised on its own */
+	memset(buf, 0, eccsize);
+	for (i = 0; i < eccsize * 8; i++) {
+		buf[i >> 3] = 1 << (i & 7);
+		check_ecc(buf, eccsize, "single bit");
+		buf[i >> 3] = 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		get_random_bytes(buf, eccsize);
+		check_ecc(buf, eccsize, "random");
+	}
+}
+
+static void test_correct(unsigned char *buf, unsigned char *copy,
+			 unsigned int eccsize)
+{
+	unsigned char ecc[3], calc[3];
+	int i, j, ret;
+
+	get_random_bytes(copy, eccsize);
+	__nand_calculate_ecc(copy, eccsize, ecc);
+
+	/* any one data bit flipped must be put back */
+	for (i = 0; i < eccsize * 8; i++) {
+		memcpy(buf, copy, eccsize);
+		buf[i >> 3] ^= 1 << (i & 7);
+		__nand_calculate_ecc(buf, eccsize, calc);
+		ret = __nand_correct_data(buf, ecc, calc, eccsize);
+		if (ret != 1 || memcmp(buf, copy, eccsize)) {
+			printk(PRINT_PREF "error: %u bytes: bit %d not "
+			       "corrected (%d)\n", eccsize, i, ret);
+			errcnt += 1;
+		}
+	}
+
+	/* one bit flipped in the stored ecc leaves the data alone */
+	for (i = 0; i < 24; i++) {
+		if (eccsize == 256 && i >= 16 && i < 18)
+			continue;
+		memcpy(buf, copy, eccsize);
+		memcpy(calc, ecc, 3);
+		calc[i >> 3] ^= 1 << (i & 7);
+		ret = __nand_correct_data(buf, calc, ecc, eccsize);
+		if (ret != 1 || memcmp(buf, copy, eccsize)) {
+			printk(PRINT_PREF "error: %u bytes: ecc bit %d flip "
+			       "mishandled (%d)\n", eccsize, i, ret);
+			errcnt += 1;
+		}
+	}
+
+	/* two data bits flipped are detected, not miscorrected */
+	for (i = 0; i < count; i++) {
+		int a = random32() % (eccsize * 8);
+		int b = random32() % (eccsize * 8);
+
+		if (a == b)
+			continue;
+		memcpy(buf, copy, eccsize);
+		buf[a >> 3] ^= 1 << (a & 7);
+		buf[b >> 3] ^= 1 << (b & 7);
+		__nand_calculate_ecc(buf, eccsize, calc);
+		ret = __nand_correct_data(buf, ecc, calc, eccsize);
+		for (j = 0; j < eccsize && ret == -1; j++)
+			if (j != a >> 3 && j != b >> 3 && buf[j] != copy[j])
+				ret = 0;
+		if (ret != -1) {
+			printk(PRINT_PREF "error: %u bytes: bits %d and %d "
+			       "not reported (%d)\n", eccsize, a, b, ret);
+			errcnt += 1;
+		}
+	}
+}
+
+static void test_speed(unsigned char *buf, unsigned int eccsize)
+{
+	unsigned char ecc[3];
+	unsigned long start, ms;
+	unsigned int i, n = (8 << 20) / eccsize;
+
+	get_random_bytes(buf, eccsize);
+	start = jiffies;
+	for (i = 0; i < n; i++)
+		__nand_calculate_ecc(buf, eccsize, ecc);
+	ms = jiffies_to_msecs(jiffies - start);
+	if (!ms)
+		ms = 1;
+	printk(PRINT_PREF "%u byte blocks: %lu KiB/s\n", eccsize,
+	       (8UL << 20) / ms * 1000 / 1024);
+}
+
+static int __init mtd_nandecctest_init(void)
+{
+	unsigned char *buf, *copy;
+	unsigned int eccsize;
+
+	printk(KERN_INFO "\n");
+	printk(KERN_INFO "=================================================\n");
+
+	buf = kmalloc(512, GFP_KERNEL);
+	copy = kmalloc(512, GFP_KERNEL);
+	if (!buf || !copy) {
+		printk(PRINT_PREF "error: cannot allocate memory\n");
+		kfree(copy);
+		kfree(buf);
+		return -ENOMEM;
+	}
+
+	for (eccsize = 256; eccsize <= 512; eccsize += 256) {
+		printk(PRINT_PREF "testing %u byte blocks\n", eccsize);
+		test_calculate(buf, eccsize);
+		test_correct(buf, copy, eccsize);
+		test_speed(buf, eccsize);
+	}
+
+	kfree(copy);
+	kfree(buf);
+
+	printk(PRINT_PREF "finished with %d errors\n", errcnt);
+	printk(KERN_INFO "=================================================\n");
+	return errcnt ? -EINVAL : 0;
+}
+module_init(mtd_nandecctest_init);
+
+static void __exit mtd_nandecctest_exit(void)
+{
+	return;
+}
+module_exit(mtd_nandecctest_exit);
+
+MODULE_DESCRIPTION("NAND software ECC test");
+MODULE_LICENSE("GPL");
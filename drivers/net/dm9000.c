@@ -33,6 +33,7 @@
 #include <linux/delay.h>
 #include <linux/platform_device.h>
 #include <linux/irq.h>
+#include <linux/highmem.h>
 
 #include <asm/delay.h>
 #include <asm/irq.h>
@@ -58,6 +59,15 @@ static int watchdog = 5000;
 module_param(watchdog, int, 0400);
 MODULE_PARM_DESC(watchdog, "transmit timeout in milliseconds");
 
+/*
+ * Packets taken from the RX FIFO per NAPI poll. The 13KiB RX SRAM holds
+ * about eight full sized frames, so the default empties a full FIFO of
+ * large frames in one poll.
+ */
+static int napi_weight = 16;
+module_param(napi_weight, int, 0400);
+MODULE_PARM_DESC(napi_weight, "RX packets handled per NAPI poll");
+
 /* DM9000 register address locking.
  *
  * The DM9000 uses an address register to control where data written
@@ -86,6 +96,21 @@ enum dm9000_type {
 	TYPE_DM9000B
 };
 
+/* Driver statistics, reported by ethtool -S in this order */
+struct dm9000_stats {
+	u64	irqs;			/* interrupts handled */
+	u64	rx_irqs;		/* interrupts with RX pending */
+	u64	polls;			/* NAPI poll calls */
+	u64	polls_complete;		/* polls that emptied the FIFO */
+	u64	polls_exhausted;	/* polls that used up their budget */
+	u64	packets;		/* FIFO entries taken by polls */
+	u64	max_per_poll;		/* most packets taken in one poll */
+	u64	hist[8];		/* polls by packets: 0, 1, 2-3 .. 64+ */
+	u64	tx_sg;			/* packets sent from fragments */
+	u64	tx_queue_stops;		/* queue stopped with both slots full */
+	u64	tx_early_done;		/* completions reaped by start_xmit */
+};
+
 /* Structure/enum declaration ------------------------------- */
 typedef struct board_info {
 
@@ -99,8 +124,10 @@ typedef struct board_info {
 	u16		queue_ip_summed;
 	u16		dbug_cnt;
 	u8		io_mode;		/* 0:word, 2:byte */
+	u8		io_width;		/* bytes per data port access */
 	u8		phy_addr;
 	u8		imr_all;
+	u8		rx_masked;	/* IMR_PRM off until the poll is done */
 
 	unsigned int	flags;
 	unsigned int	in_suspend :1;
@@ -124,6 +151,7 @@ typedef struct board_info {
 
 	struct delayed_work phy_poll;
 	struct net_device  *ndev;
+	struct napi_struct napi;
 
 	spinlock_t	lock;
 
@@ -133,6 +161,8 @@ typedef struct board_info {
 	int		rx_csum;
 	int		can_csum;
 	int		ip_summed;
+
+	struct dm9000_stats xstats;
 } board_info_t;
 
 /* debug code */
@@ -266,6 +296,7 @@ static void dm9000_set_io(struct board_info *db, int byte_width)
 
 	switch (byte_width) {
 	case 1:
+		db->io_width = 1;
 		db->dumpblk = dm9000_dumpblk_8bit;
 		db->outblk  = dm9000_outblk_8bit;
 		db->inblk   = dm9000_inblk_8bit;
@@ -275,6 +306,7 @@ static void dm9000_set_io(struct board_info *db, int byte_width)
 	case 3:
 		dev_dbg(db->dev, ": 3 byte IO, falling back to 16bit\n");
 	case 2:
+		db->io_width = 2;
 		db->dumpblk = dm9000_dumpblk_16bit;
 		db->outblk  = dm9000_outblk_16bit;
 		db->inblk   = dm9000_inblk_16bit;
@@ -282,6 +314,7 @@ static void dm9000_set_io(struct board_info *db, int byte_width)
 
 	case 4:
 	default:
+		db->io_width = 4;
 		db->dumpblk = dm9000_dumpblk_32bit;
 		db->outblk  = dm9000_outblk_32bit;
 		db->inblk   = dm9000_inblk_32bit;
@@ -572,6 +605,57 @@ static int dm9000_set_eeprom(struct net_device *dev,
 	return 0;
 }
 
+static const char dm9000_gstrings_stats[][ETH_GSTRING_LEN] = {
+	"irqs",
+	"rx_irqs",
+	"rx_polls",
+	"rx_polls_complete",
+	"rx_polls_exhausted",
+	"rx_poll_packets",
+	"rx_poll_max_packets",
+	"rx_polls_0",
+	"rx_polls_1",
+	"rx_polls_2_3",
+	"rx_polls_4_7",
+	"rx_polls_8_15",
+	"rx_polls_16_31",
+	"rx_polls_32_63",
+	"rx_polls_64_up",
+	"tx_sg",
+	"tx_queue_stops",
+	"tx_early_done",
+};
+
+#define DM9000_STATS_LEN	ARRAY_SIZE(dm9000_gstrings_stats)
+
+static int dm9000_get_sset_count(struct net_device *dev, int sset)
+{
+	switch (sset) {
+	case ETH_SS_STATS:
+		return DM9000_STATS_LEN;
+	default:
+		return -EOPNOTSUPP;
+	}
+}
+
+static void dm9000_get_strings(struct net_device *dev, u32 sset, u8 *data)
+{
+	if (sset == ETH_SS_STATS)
+		memcpy(data, dm9000_gstrings_stats,
+		       sizeof(dm9000_gstrings_stats));
+}
+
+static void dm9000_get_ethtool_stats(struct net_device *dev,
+				     struct ethtool_stats *stats, u64 *data)
+{
+	board_info_t *dm = to_dm9000_board(dev);
+
+	BUILD_BUG_ON(sizeof(struct dm9000_stats) !=
+		     DM9000_STATS_LEN * sizeof(u64));
+
+	memcpy(data, &dm->xstats, sizeof(dm->xstats));
+}
+
 static const struct ethtool_ops dm9000_ethtool_ops = {
 	.get_drvinfo		= dm9000_get_drvinfo,
 	.get_settings		= dm9000_get_settings,
@@ -587,6 +671,11 @@ static const struct ethtool_ops dm9000_ethtool_ops = {
 	.set_rx_csum		= dm9000_set_rx_csum,
 	.get_tx_csum		= ethtool_op_get_tx_csum,
 	.set_tx_csum		= dm9000_set_tx_csum,
+	.get_sg			= ethtool_op_get_sg,
+	.set_sg			= ethtool_op_set_sg,
+	.get_sset_count		= dm9000_get_sset_count,
+	.get_strings		= dm9000_get_strings,
+	.get_ethtool_stats	= dm9000_get_ethtool_stats,
 };
 
 static void dm9000_show_carrier(board_info_t *db,
@@ -760,6 +849,7 @@ dm9000_init_dm9000(struct net_device *dev)
 		imr |= IMR_LNKCHNG;
 
 	db->imr_all = imr;
+	db->rx_masked = 0;
 
 	/* Enable TX/RX interrupt mask */
 	iow(db, DM9000_IMR, imr);
@@ -816,6 +906,94 @@ static void dm9000_send_packet(struct net_device *dev,
 	iow(dm, DM9000_TCR, TCR_TXREQ);	/* Cleared after TX complete */
 }
 
+/*
+ * Reap a transmit completion, if any, and start the queued packet.
+ * Called with db->lock held, from the interrupt handler and from
+ * dm9000_start_xmit(). Returns 1 if a packet had completed.
+ */
+
+static int dm9000_tx_done(struct net_device *dev, board_info_t *db)
+{
+	int tx_status = ior(db, DM9000_NSR);	/* Got TX status */
+
+	if (tx_status & (NSR_TX2END | NSR_TX1END)) {
+		/* One packet sent complete */
+		db->tx_pkt_cnt--;
+		dev->stats.tx_packets++;
+
+		if (netif_msg_tx_done(db))
+			dev_dbg(db->dev, "tx done, NSR %02x\n", tx_status);
+
+		/* Queue packet check & send */
+		if (db->tx_pkt_cnt > 0)
+			dm9000_send_packet(dev, db->queue_ip_summed,
+					   db->queue_pkt_len);
+		netif_wake_queue(dev);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Copy one piece of a fragmented skb into the TX SRAM. Each data port
+ * access moves io_width bytes, so a piece whose length is not a multiple
+ * of that is joined to the start of the next one through a small bounce
+ * buffer instead of being padded.
+ */
+static void dm9000_outblk_piece(board_info_t *db, u8 *ptr, unsigned int len,
+				u8 *carry, unsigned int *ncarry)
+{
+	unsigned int width = db->io_width;
+	unsigned int n;
+
+	if (*ncarry) {
+		n = min(width - *ncarry, len);
+		memcpy(carry + *ncarry, ptr, n);
+		*ncarry += n;
+		ptr += n;
+		len -= n;
+		if (*ncarry < width)
+			return;
+		(db->outblk)(db->io_data, carry, width);
+		*ncarry = 0;
+	}
+
+	n = len & ~(width - 1);
+	if (n)
+		(db->outblk)(db->io_data, ptr, n);
+	*ncarry = len - n;
+	memcpy(carry, ptr + n, *ncarry);
+}
+
+/*
+ * Copy a fragmented skb into the TX SRAM. Fragment pages may be in
+ * highmem, so each one is mapped while it is copied; interrupts are off
+ * under db->lock, so the irq kmap slot is free.
+ */
+static void dm9000_outblk_skb(board_info_t *db, struct sk_buff *skb)
+{
+	unsigned int nr = skb_shinfo(skb)->nr_frags;
+	unsigned int i, ncarry = 0;
+	u8 carry[4];
+	u8 *vaddr;
+
+	dm9000_outblk_piece(db, skb->data, skb_headlen(skb), carry, &ncarry);
+
+	for (i = 0; i < nr; i++) {
+		skb_frag_t *frag = &skb_shinfo(skb)->frags[i];
+
+		vaddr = kmap_atomic(frag->page, KM_IRQ0);
+		dm9000_outblk_piece(db, vaddr + frag->page_offset, frag->size,
+				    carry, &ncarry);
+		kunmap_atomic(vaddr, KM_IRQ0);
+	}
+
+	if (ncarry) {
+		memset(carry + ncarry, 0, db->io_width - ncarry);
+		(db->outblk)(db->io_data, carry, db->io_width);
+	}
+}
+
 /*
  *  Hardware start transmission.
  *  Send a packet to media from the upper layer.
@@ -836,7 +1014,12 @@ dm9000_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	/* Move data to DM9000 TX RAM */
 	writeb(DM9000_MWCMD, db->io_addr);
 
-	(db->outblk)(db->io_data, skb->data, skb->len);
+	if (skb_is_nonlinear(skb)) {
+		dm9000_outblk_skb(db, skb);
+		db->xstats.tx_sg++;
+	} else {
+		(db->outblk)(db->io_data, skb->data, skb->len);
+	}
 	dev->stats.tx_bytes += skb->len;
 
 	db->tx_pkt_cnt++;
@@ -848,6 +1031,14 @@ dm9000_start_xmit(struct sk_buff *skb, struct net_device *dev)
 		db->queue_pkt_len = skb->len;
 		db->queue_ip_summed = skb->ip_summed;
 		netif_stop_queue(dev);
+
+		/* The first packet may have gone out while this one was
+		 * copied. Start this one now and keep the queue running
+		 * rather than waiting for the interrupt. */
+		if (dm9000_tx_done(dev, db))
+			db->xstats.tx_early_done++;
+		else
+			db->xstats.tx_queue_stops++;
 	}
 
 	spin_unlock_irqrestore(&db->lock, flags);
@@ -858,31 +1049,6 @@ dm9000_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	return NETDEV_TX_OK;
 }
 
-/*
- * DM9000 interrupt handler
- * receive the packet to upper layer, free the transmitted packet
- */
-
-static void dm9000_tx_done(struct net_device *dev, board_info_t *db)
-{
-	int tx_status = ior(db, DM9000_NSR);	/* Got TX status */
-
-	if (tx_status & (NSR_TX2END | NSR_TX1END)) {
-		/* One packet sent complete */
-		db->tx_pkt_cnt--;
-		dev->stats.tx_packets++;
-
-		if (netif_msg_tx_done(db))
-			dev_dbg(db->dev, "tx done, NSR %02x\n", tx_status);
-
-		/* Queue packet check & send */
-		if (db->tx_pkt_cnt > 0)
-			dm9000_send_packet(dev, db->queue_ip_summed,
-					   db->queue_pkt_len);
-		netif_wake_queue(dev);
-	}
-}
-
 struct dm9000_rxhdr {
 	u8	RxPktReady;
 	u8	RxStatus;
@@ -890,111 +1056,179 @@ struct dm9000_rxhdr {
 } __attribute__((__packed__));
 
 /*
- *  Received a packet and pass to upper layer
+ *  Take one packet out of the RX FIFO, called with db->lock held.
+ *  Returns 1 when a FIFO entry was consumed, with *skbp set to the
+ *  packet or to NULL if it was dropped, 0 when the FIFO is empty and
+ *  -1 when the chip reported a bad status and reception was stopped.
  */
-static void
-dm9000_rx(struct net_device *dev)
+static int
+dm9000_rx_one(struct net_device *dev, struct sk_buff **skbp)
 {
 	board_info_t *db = netdev_priv(dev);
 	struct dm9000_rxhdr rxhdr;
-	struct sk_buff *skb;
+	struct sk_buff *skb = NULL;
 	u8 rxbyte, *rdptr;
 	bool GoodPacket;
 	int RxLen;
 
 	/* Check packet ready or not */
-	do {
-		ior(db, DM9000_MRCMDX);	/* Dummy read */
+	ior(db, DM9000_MRCMDX);	/* Dummy read */
 
-		/* Get most updated data */
-		rxbyte = readb(db->io_data);
+	/* Get most updated data */
+	rxbyte = readb(db->io_data);
 
-		/* Status check: this byte must be 0 or 1 */
-		if (rxbyte & DM9000_PKT_ERR) {
-			dev_warn(db->dev, "status check fail: %d\n", rxbyte);
-			iow(db, DM9000_RCR, 0x00);	/* Stop Device */
-			iow(db, DM9000_ISR, IMR_PAR);	/* Stop INT request */
-			return;
-		}
+	/* Status check: this byte must be 0 or 1 */
+	if (rxbyte & DM9000_PKT_ERR) {
+		dev_warn(db->dev, "status check fail: %d\n", rxbyte);
+		iow(db, DM9000_RCR, 0x00);	/* Stop Device */
+		iow(db, DM9000_ISR, IMR_PAR);	/* Stop INT request */
+		return -1;
+	}
 
-		if (!(rxbyte & DM9000_PKT_RDY))
-			return;
+	if (!(rxbyte & DM9000_PKT_RDY))
+		return 0;
 
-		/* A packet ready now  & Get status/length */
-		GoodPacket = true;
-		writeb(DM9000_MRCMD, db->io_addr);
+	/* A packet ready now  & Get status/length */
+	GoodPacket = true;
+	writeb(DM9000_MRCMD, db->io_addr);
 
-		(db->inblk)(db->io_data, &rxhdr, sizeof(rxhdr));
+	(db->inblk)(db->io_data, &rxhdr, sizeof(rxhdr));
 
-		RxLen = le16_to_cpu(rxhdr.RxLen);
+	RxLen = le16_to_cpu(rxhdr.RxLen);
 
-		if (netif_msg_rx_status(db))
-			dev_dbg(db->dev, "RX: status %02x, length %04x\n",
-				rxhdr.RxStatus, RxLen);
+	if (netif_msg_rx_status(db))
+		dev_dbg(db->dev, "RX: status %02x, length %04x\n",
+			rxhdr.RxStatus, RxLen);
+
+	/* Packet Status check */
+	if (RxLen < 0x40) {
+		GoodPacket = false;
+		if (netif_msg_rx_err(db))
+			dev_dbg(db->dev, "RX: Bad Packet (runt)\n");
+	}
+
+	if (RxLen > DM9000_PKT_MAX) {
+		dev_dbg(db->dev, "RST: RX Len:%x\n", RxLen);
+	}
 
-		/* Packet Status check */
-		if (RxLen < 0x40) {
-			GoodPacket = false;
+	/* rxhdr.RxStatus is identical to RSR register. */
+	if (rxhdr.RxStatus & (RSR_FOE | RSR_CE | RSR_AE |
+			      RSR_PLE | RSR_RWTO |
+			      RSR_LCS | RSR_RF)) {
+		GoodPacket = false;
+		if (rxhdr.RxStatus & RSR_FOE) {
 			if (netif_msg_rx_err(db))
-				dev_dbg(db->dev, "RX: Bad Packet (runt)\n");
+				dev_dbg(db->dev, "fifo error\n");
+			dev->stats.rx_fifo_errors++;
 		}
-
-		if (RxLen > DM9000_PKT_MAX) {
-			dev_dbg(db->dev, "RST: RX Len:%x\n", RxLen);
+		if (rxhdr.RxStatus & RSR_CE) {
+			if (netif_msg_rx_err(db))
+				dev_dbg(db->dev, "crc error\n");
+			dev->stats.rx_crc_errors++;
 		}
+		if (rxhdr.RxStatus & RSR_RF) {
+			if (netif_msg_rx_err(db))
+				dev_dbg(db->dev, "length error\n");
+			dev->stats.rx_length_errors++;
+		}
+	}
 
-		/* rxhdr.RxStatus is identical to RSR register. */
-		if (rxhdr.RxStatus & (RSR_FOE | RSR_CE | RSR_AE |
-				      RSR_PLE | RSR_RWTO |
-				      RSR_LCS | RSR_RF)) {
-			GoodPacket = false;
-			if (rxhdr.RxStatus & RSR_FOE) {
-				if (netif_msg_rx_err(db))
-					dev_dbg(db->dev, "fifo error\n");
-				dev->stats.rx_fifo_errors++;
-			}
-			if (rxhdr.RxStatus & RSR_CE) {
-				if (netif_msg_rx_err(db))
-					dev_dbg(db->dev, "crc error\n");
-				dev->stats.rx_crc_errors++;
-			}
-			if (rxhdr.RxStatus & RSR_RF) {
-				if (netif_msg_rx_err(db))
-					dev_dbg(db->dev, "length error\n");
-				dev->stats.rx_length_errors++;
-			}
+	/* Move data from DM9000 */
+	if (GoodPacket
+	    && ((skb = dev_alloc_skb(RxLen + 4)) != NULL)) {
+		skb_reserve(skb, 2);
+		rdptr = (u8 *) skb_put(skb, RxLen - 4);
+
+		/* Read received packet from RX SRAM */
+
+		(db->inblk)(db->io_data, rdptr, RxLen);
+		dev->stats.rx_bytes += RxLen;
+
+		/* Pass to upper layer */
+		skb->protocol = eth_type_trans(skb, dev);
+		if (db->rx_csum) {
+			if ((((rxbyte & 0x1c) << 3) & rxbyte) == 0)
+				skb->ip_summed = CHECKSUM_UNNECESSARY;
+			else
+				skb->ip_summed = CHECKSUM_NONE;
 		}
+		dev->stats.rx_packets++;
 
-		/* Move data from DM9000 */
-		if (GoodPacket
-		    && ((skb = dev_alloc_skb(RxLen + 4)) != NULL)) {
-			skb_reserve(skb, 2);
-			rdptr = (u8 *) skb_put(skb, RxLen - 4);
+	} else {
+		/* need to dump the packet's data */
+
+		(db->dumpblk)(db->io_data, RxLen);
+	}
+
+	*skbp = skb;
+	return 1;
+}
 
-			/* Read received packet from RX SRAM */
+/*
+ *  NAPI poll: drain the RX FIFO one packet at a time, taking the lock
+ *  per packet so TX completion and link interrupts are not held off for
+ *  a whole burst, and hand the packets to the stack outside the lock.
+ *  The RX interrupt stays masked in IMR until the FIFO is empty.
+ */
+static int dm9000_poll(struct napi_struct *napi, int budget)
+{
+	board_info_t *db = container_of(napi, board_info_t, napi);
+	struct net_device *dev = db->ndev;
+	struct dm9000_stats *st = &db->xstats;
+	struct sk_buff *skb;
+	unsigned long flags;
+	u8 reg_save;
+	int work = 0;
+	int ret;
 
-			(db->inblk)(db->io_data, rdptr, RxLen);
-			dev->stats.rx_bytes += RxLen;
+	while (work < budget) {
+		spin_lock_irqsave(&db->lock, flags);
+		reg_save = readb(db->io_addr);
+		/* ack the RX status latched since the interrupt, packets
+		 * we do not drain here will raise it again */
+		if (!work)
+			iow(db, DM9000_ISR, ISR_PRS);
+		ret = dm9000_rx_one(dev, &skb);
+		writeb(reg_save, db->io_addr);
+		spin_unlock_irqrestore(&db->lock, flags);
+
+		if (ret <= 0)
+			break;
 
-			/* Pass to upper layer */
-			skb->protocol = eth_type_trans(skb, dev);
-			if (db->rx_csum) {
-				if ((((rxbyte & 0x1c) << 3) & rxbyte) == 0)
-					skb->ip_summed = CHECKSUM_UNNECESSARY;
-				else
-					skb->ip_summed = CHECKSUM_NONE;
-			}
-			netif_rx(skb);
-			dev->stats.rx_packets++;
+		/* dropped packets count too, a stream of bad frames
+		 * must not keep us here forever */
+		work++;
+		if (skb)
+			netif_receive_skb(skb);
+	}
 
-		} else {
-			/* need to dump the packet's data */
+	st->polls++;
+	st->packets += work;
+	if (work > st->max_per_poll)
+		st->max_per_poll = work;
+	st->hist[min(fls(work), 7)]++;
+
+	if (work < budget) {
+		st->polls_complete++;
+		napi_complete(napi);
+
+		spin_lock_irqsave(&db->lock, flags);
+		reg_save = readb(db->io_addr);
+		db->rx_masked = 0;
+		iow(db, DM9000_IMR, db->imr_all);
+		writeb(reg_save, db->io_addr);
+		spin_unlock_irqrestore(&db->lock, flags);
+	} else {
+		st->polls_exhausted++;
+	}
 
-			(db->dumpblk)(db->io_data, RxLen);
-		}
-	} while (rxbyte & DM9000_PKT_RDY);
+	return work;
 }
 
+/*
+ * DM9000 interrupt handler
+ * schedule the receive poll, free the transmitted packet
+ */
 static irqreturn_t dm9000_interrupt(int irq, void *dev_id)
 {
 	struct net_device *dev = dev_id;
@@ -1023,9 +1257,15 @@ static irqreturn_t dm9000_interrupt(int irq, void *dev_id)
 	if (netif_msg_intr(db))
 		dev_dbg(db->dev, "interrupt status %02x\n", int_status);
 
-	/* Received the coming packet */
-	if (int_status & ISR_PRS)
-		dm9000_rx(dev);
+	db->xstats.irqs++;
+
+	/* Received the coming packet, leave it to the poll and keep the
+	 * RX interrupt masked until the poll has emptied the FIFO */
+	if (int_status & ISR_PRS) {
+		db->xstats.rx_irqs++;
+		db->rx_masked = 1;
+		napi_schedule(&db->napi);
+	}
 
 	/* Trnasmit Interrupt check */
 	if (int_status & ISR_PTS)
@@ -1039,7 +1279,10 @@ static irqreturn_t dm9000_interrupt(int irq, void *dev_id)
 	}
 
 	/* Re-enable interrupt mask */
-	iow(db, DM9000_IMR, db->imr_all);
+	if (db->rx_masked)
+		iow(db, DM9000_IMR, db->imr_all & ~IMR_PRM);
+	else
+		iow(db, DM9000_IMR, db->imr_all);
 
 	/* Restore previous register address */
 	writeb(reg_save, db->io_addr);
@@ -1085,6 +1328,8 @@ dm9000_open(struct net_device *dev)
 	if (request_irq(dev->irq, &dm9000_interrupt, irqflags, dev->name, dev))
 		return -EAGAIN;
 
+	napi_enable(&db->napi);
+
 	/* Initialize DM9000 board */
 	dm9000_reset(db);
 	dm9000_init_dm9000(dev);
@@ -1231,6 +1476,7 @@ dm9000_stop(struct net_device *ndev)
 
 	netif_stop_queue(ndev);
 	netif_carrier_off(ndev);
+	napi_disable(&db->napi);
 
 	/* free interrupt */
 	free_irq(ndev->irq, ndev);
@@ -1420,7 +1666,7 @@ dm9000_probe(struct platform_device *pdev)
 	if (db->type == TYPE_DM9000A || db->type == TYPE_DM9000B) {
 		db->can_csum = 1;
 		db->rx_csum = 1;
-		ndev->features |= NETIF_F_IP_CSUM;
+		ndev->features |= NETIF_F_IP_CSUM | NETIF_F_SG;
 	}
 
 	/* from this point we assume that we have found a DM9000 */
@@ -1432,6 +1678,10 @@ dm9000_probe(struct platform_device *pdev)
 	ndev->watchdog_timeo	= msecs_to_jiffies(watchdog);
 	ndev->ethtool_ops	= &dm9000_ethtool_ops;
 
+	if (napi_weight <= 0)
+		napi_weight = 16;
+	netif_napi_add(ndev, &db->napi, dm9000_poll, napi_weight);
+
 	db->msg_enable       = NETIF_MSG_LINK;
 	db->mii.phy_id_mask  = 0x1f;
 	db->mii.reg_num_mask = 0x1f;
@@ -25,8 +25,10 @@
 #include <linux/platform_device.h>
 #include <linux/clk.h>
 #include <linux/cpufreq.h>
+#include <linux/wait.h>
 
 #include <asm/io.h>
+#include <asm/uaccess.h>
 #include <asm/div64.h>
 
 #include <asm/mach/map.h>
@@ -49,6 +51,11 @@ static int debug	= 0;
 
 #define dprintk(msg...)	if (debug) { printk(KERN_DEBUG "s3c2410fb: " msg); }
 
+/* number of screens worth of video memory, for panning */
+static int buffers = 2;
+module_param(buffers, int, 0444);
+MODULE_PARM_DESC(buffers, "Number of frame buffers (yres_virtual / yres)");
+
 /* useful functions */
 
 static int is_s3c2412(struct s3c2410fb_info *fbi)
@@ -56,6 +63,24 @@ static int is_s3c2412(struct s3c2410fb_info *fbi)
 	return (fbi->drv_type == DRV_S3C2412);
 }
 
+/* s3c2410fb_calc_lcdaddr
+ *
+ * calculate the start and end address registers for the screen at
+ * line yoffset of the video memory. The video memory is allocated as a
+ * naturally aligned block, so it never crosses a 4MB LCDBANK boundary.
+ */
+static void s3c2410fb_calc_lcdaddr(struct fb_info *info, unsigned int yoffset,
+				   unsigned long *saddr1, unsigned long *saddr2)
+{
+	unsigned long start;
+
+	start  = info->fix.smem_start;
+	start += info->fix.line_length * yoffset;
+
+	*saddr1 = start >> 1;
+	*saddr2 = (start + info->fix.line_length * info->var.yres) >> 1;
+}
+
 /* s3c2410fb_set_lcdaddr
  *
  * initialise lcd controller address pointers
@@ -65,15 +90,18 @@ static void s3c2410fb_set_lcdaddr(struct fb_info *info)
 	unsigned long saddr1, saddr2, saddr3;
 	struct s3c2410fb_info *fbi = info->par;
 	void __iomem *regs = fbi->io;
+	unsigned long flags;
 
-	saddr1  = info->fix.smem_start >> 1;
-	saddr2  = info->fix.smem_start;
-	saddr2 += info->fix.line_length * info->var.yres;
-	saddr2 >>= 1;
+	s3c2410fb_calc_lcdaddr(info, info->var.yoffset, &saddr1, &saddr2);
 
 	saddr3 = S3C2410_OFFSIZE(0) |
 		 S3C2410_PAGEWIDTH((info->fix.line_length / 2) & 0x3ff);
 
+	/* the new addresses supersede any pan still waiting for FRSYNC */
+	local_irq_save(flags);
+	fbi->pan_pending = 0;
+	local_irq_restore(flags);
+
 	dprintk("LCDSADDR1 = 0x%08lx\n", saddr1);
 	dprintk("LCDSADDR2 = 0x%08lx\n", saddr2);
 	dprintk("LCDSADDR3 = 0x%08lx\n", saddr3);
@@ -121,6 +149,7 @@ static int s3c2410fb_check_var(struct fb_var_screeninfo *var,
 	struct s3c2410fb_display *default_display = mach_info->displays +
 						    mach_info->default_display;
 	int type = default_display->type;
+	unsigned long line_length;
 	unsigned i;
 
 	dprintk("check_var(var=%p, info=%p)\n", var, info);
@@ -147,9 +176,23 @@ static int s3c2410fb_check_var(struct fb_var_screeninfo *var,
 		return -EINVAL;
 	}
 
-	/* it is always the size as the display */
+	/* the virtual width is always that of the display, the virtual
+	 * height may hold as many screens as the video memory does */
 	var->xres_virtual = display->xres;
-	var->yres_virtual = display->yres;
+	line_length = (display->xres * var->bits_per_pixel) / 8;
+
+	if (var->yres_virtual < display->yres)
+		var->yres_virtual = display->yres;
+	if (var->yres_virtual * line_length > info->fix.smem_len) {
+		dprintk("yres_virtual %d does not fit in video memory\n",
+			var->yres_virtual);
+		return -EINVAL;
+	}
+
+	var->xoffset = 0;
+	if (var->yoffset > var->yres_virtual - display->yres)
+		var->yoffset = var->yres_virtual - display->yres;
+
 	var->height = display->height;
 	var->width = display->width;
 
@@ -444,12 +487,25 @@ static int s3c2410fb_set_par(struct fb_info *info)
 	return 0;
 }
 
+/* s3c2410fb_enable_frsync
+ *
+ * unmask the frame sync interrupt, called with interrupts disabled.
+ * The interrupt handler masks it again once it has nothing left to do.
+ */
+static void s3c2410fb_enable_frsync(struct s3c2410fb_info *fbi)
+{
+	void __iomem *irq_base = fbi->irq_base;
+	unsigned long irqen;
+
+	irqen = readl(irq_base + S3C24XX_LCDINTMSK);
+	irqen &= ~S3C2410_LCDINT_FRSYNC;
+	writel(irqen, irq_base + S3C24XX_LCDINTMSK);
+}
+
 static void schedule_palette_update(struct s3c2410fb_info *fbi,
 				    unsigned int regno, unsigned int val)
 {
 	unsigned long flags;
-	unsigned long irqen;
-	void __iomem *irq_base = fbi->irq_base;
 
 	local_irq_save(flags);
 
@@ -457,16 +513,95 @@ static void schedule_palette_update(struct s3c2410fb_info *fbi,
 
 	if (!fbi->palette_ready) {
 		fbi->palette_ready = 1;
-
-		/* enable IRQ */
-		irqen = readl(irq_base + S3C24XX_LCDINTMSK);
-		irqen &= ~S3C2410_LCDINT_FRSYNC;
-		writel(irqen, irq_base + S3C24XX_LCDINTMSK);
+		s3c2410fb_enable_frsync(fbi);
 	}
 
 	local_irq_restore(flags);
 }
 
+/*
+ *	s3c2410fb_pan_display - Pan the display to var->yoffset
+ *
+ *	The start address registers are rewritten by the FRSYNC interrupt,
+ *	so the flip never happens in the middle of a frame. Applications
+ *	double buffering should FBIO_WAITFORVSYNC after the pan before they
+ *	draw into the buffer that was displayed until then.
+ */
+static int s3c2410fb_pan_display(struct fb_var_screeninfo *var,
+				 struct fb_info *info)
+{
+	struct s3c2410fb_info *fbi = info->par;
+	unsigned long saddr1, saddr2;
+	unsigned long flags;
+
+	if (var->xoffset != 0)
+		return -EINVAL;
+
+	s3c2410fb_calc_lcdaddr(info, var->yoffset, &saddr1, &saddr2);
+
+	local_irq_save(flags);
+
+	fbi->pan_saddr1 = saddr1;
+	fbi->pan_saddr2 = saddr2;
+	fbi->pan_pending = 1;
+	s3c2410fb_enable_frsync(fbi);
+
+	local_irq_restore(flags);
+
+	return 0;
+}
+
+/* s3c2410fb_wait_for_vsync
+ *
+ * sleep until the next frame sync interrupt. If a pan has not reached the
+ * screen yet, sleep until the frame showing it has started instead, so the
+ * old buffer is free once this returns. Times out if the display is not
+ * running.
+ */
+static int s3c2410fb_wait_for_vsync(struct s3c2410fb_info *fbi)
+{
+	unsigned long flags;
+	unsigned int target;
+	long ret;
+
+	local_irq_save(flags);
+	target = fbi->vsync_count + 1;
+	if (fbi->pan_pending)
+		target++;
+	else if ((int)(fbi->pan_shown - target) > 0)
+		target = fbi->pan_shown;
+	s3c2410fb_enable_frsync(fbi);
+	local_irq_restore(flags);
+
+	ret = wait_event_interruptible_timeout(fbi->vsync_wait,
+				(int)(fbi->vsync_count - target) >= 0,
+				HZ / 10);
+	if (ret < 0)
+		return ret;
+	if (ret == 0)
+		return -ETIMEDOUT;
+
+	return 0;
+}
+
+static int s3c2410fb_ioctl(struct fb_info *info, unsigned int cmd,
+			   unsigned long arg)
+{
+	struct s3c2410fb_info *fbi = info->par;
+	u32 crtc;
+
+	switch (cmd) {
+	case FBIO_WAITFORVSYNC:
+		if (get_user(crtc, (u32 __user *)arg))
+			return -EFAULT;
+		if (crtc != 0)
+			return -ENODEV;
+		return s3c2410fb_wait_for_vsync(fbi);
+	}
+
+	return -ENOTTY;
+}
+
 /* from pxafb.c */
 static inline unsigned int chan_to_field(unsigned int chan,
 					 struct fb_bitfield *bf)
@@ -616,6 +751,8 @@ static struct fb_ops s3c2410fb_ops = {
 	.owner		= THIS_MODULE,
 	.fb_check_var	= s3c2410fb_check_var,
 	.fb_set_par	= s3c2410fb_set_par,
+	.fb_pan_display	= s3c2410fb_pan_display,
+	.fb_ioctl	= s3c2410fb_ioctl,
 	.fb_blank	= s3c2410fb_blank,
 	.fb_setcolreg	= s3c2410fb_setcolreg,
 	.fb_fillrect	= cfb_fillrect,
@@ -748,12 +885,37 @@ static irqreturn_t s3c2410fb_irq(int irq, void *dev_id)
 {
 	struct s3c2410fb_info *fbi = dev_id;
 	void __iomem *irq_base = fbi->irq_base;
+	void __iomem *regs = fbi->io;
 	unsigned long lcdirq = readl(irq_base + S3C24XX_LCDINTPND);
+	unsigned long irqen;
 
 	if (lcdirq & S3C2410_LCDINT_FRSYNC) {
 		if (fbi->palette_ready)
 			s3c2410fb_write_palette(fbi);
 
+		/* the start addresses are latched at the start of the
+		 * next frame, so the pan is only on screen from the
+		 * FRSYNC after this one */
+		if (fbi->pan_pending) {
+			writel(fbi->pan_saddr1, regs + S3C2410_LCDSADDR1);
+			writel(fbi->pan_saddr2, regs + S3C2410_LCDSADDR2);
+			fbi->pan_pending = 0;
+			fbi->pan_shown = fbi->vsync_count + 2;
+		}
+
+		fbi->vsync_count++;
+		wake_up_interruptible(&fbi->vsync_wait);
+
+		/* keep running until the pan is shown, a waiter may be
+		 * between wakeups */
+		if (!fbi->palette_ready &&
+		    (int)(fbi->pan_shown - fbi->vsync_count) <= 0 &&
+		    !waitqueue_active(&fbi->vsync_wait)) {
+			irqen = readl(irq_base + S3C24XX_LCDINTMSK);
+			irqen |= S3C2410_LCDINT_FRSYNC;
+			writel(irqen, irq_base + S3C24XX_LCDINTMSK);
+		}
+
 		writel(S3C2410_LCDINT_FRSYNC, irq_base + S3C24XX_LCDINTPND);
 		writel(S3C2410_LCDINT_FRSYNC, irq_base + S3C24XX_LCDSRCPND);
 	}
@@ -894,7 +1056,7 @@ static int __init s3c24xxfb_probe(struct platform_device *pdev,
 	fbinfo->fix.type	    = FB_TYPE_PACKED_PIXELS;
 	fbinfo->fix.type_aux	    = 0;
 	fbinfo->fix.xpanstep	    = 0;
-	fbinfo->fix.ypanstep	    = 0;
+	fbinfo->fix.ypanstep	    = 1;
 	fbinfo->fix.ywrapstep	    = 0;
 	fbinfo->fix.accel	    = FB_ACCEL_NONE;
 
@@ -910,6 +1072,8 @@ static int __init s3c24xxfb_probe(struct platform_device *pdev,
 	for (i = 0; i < 256; i++)
 		info->palette_buffer[i] = PALETTE_BUFF_CLEAR;
 
+	init_waitqueue_head(&info->vsync_wait);
+
 	ret = request_irq(irq, s3c2410fb_irq, IRQF_DISABLED, pdev->name, info);
 	if (ret) {
 		dev_err(&pdev->dev, "cannot get irq %d - err %d\n", irq, ret);
@@ -942,6 +1106,9 @@ static int __init s3c24xxfb_probe(struct platform_device *pdev,
 			fbinfo->fix.smem_len = smem_len;
 	}
 
+	/* room for page flipping */
+	fbinfo->fix.smem_len *= max(buffers, 1);
+
 	/* Initialize video memory */
 	ret = s3c2410fb_map_video_memory(fbinfo);
 	if (ret) {
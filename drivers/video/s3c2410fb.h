@@ -32,6 +32,14 @@ struct s3c2410fb_info {
 	unsigned long		clk_rate;
 	unsigned int		palette_ready;
 
+	/* page flipping, the new addresses are written at the next FRSYNC */
+	unsigned int		pan_pending;
+	unsigned long		pan_saddr1;
+	unsigned long		pan_saddr2;
+	unsigned int		pan_shown;	/* vsync_count once on screen */
+	unsigned int		vsync_count;
+	wait_queue_head_t	vsync_wait;
+
 #ifdef CONFIG_CPU_FREQ
 	struct notifier_block	freq_transition;
 #endif
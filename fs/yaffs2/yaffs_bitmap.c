@@ -95,3 +95,86 @@ int yaffs_count_chunk_bits(struct yaffs_dev *dev, int blk)
 
 	return n;
 }
+
+/*
+ * Empty block bitmap manipulations
+ *
+ * One bit per block, set while the block is in the EMPTY state. This lets the
+ * allocator find the next erased block a word at a time rather than walking
+ * the block info array.
+ */
+
+void yaffs_set_empty_bit(struct yaffs_dev *dev, int blk)
+{
+	int i = blk - dev->internal_start_block;
+
+	if (!dev->empty_bits)
+		return;
+	dev->empty_bits[i / 32] |= (1U << (i & 31));
+}
+
+void yaffs_clear_empty_bit(struct yaffs_dev *dev, int blk)
+{
+	int i = blk - dev->internal_start_block;
+
+	if (!dev->empty_bits)
+		return;
+	dev->empty_bits[i / 32] &= ~(1U << (i & 31));
+}
+
+/*
+ * Find the first block marked empty at or after start_blk, wrapping around
+ * to internal_start_block. Returns -1 if no block is marked empty.
+ */
+int yaffs_find_empty_bit(struct yaffs_dev *dev, int start_blk)
+{
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+	int i;
+	int w;
+	int n;
+	u32 word;
+
+	if (!dev->empty_bits)
+		return -1;
+
+	if (start_blk < dev->internal_start_block ||
+	    start_blk > dev->internal_end_block)
+		start_blk = dev->internal_start_block;
+
+	i = start_blk - dev->internal_start_block;
+	w = i / 32;
+
+	/* Mask off the bits below the start in the first word */
+	word = dev->empty_bits[w] & (~0U << (i & 31));
+
+	/* Visit every word once, plus the start word again for wrap around */
+	for (n = 0; n <= dev->empty_bit_words; n++) {
+		if (word) {
+			i = w * 32 + __ffs(word);
+			if (i < n_blocks)
+				return i + dev->internal_start_block;
+		}
+		w++;
+		if (w >= dev->empty_bit_words)
+			w = 0;
+		word = dev->empty_bits[w];
+	}
+	return -1;
+}
+
+void yaffs_rebuild_empty_bits(struct yaffs_dev *dev)
+{
+	struct yaffs_block_info *bi = dev->block_info;
+	int blk;
+
+	if (!dev->empty_bits)
+		return;
+
+	memset(dev->empty_bits, 0, dev->empty_bit_words * sizeof(u32));
+
+	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
+	     blk++, bi++) {
+		if (bi->block_state == YAFFS_BLOCK_STATE_EMPTY)
+			yaffs_set_empty_bit(dev, blk);
+	}
+}
@@ -30,4 +30,12 @@ int yaffs_check_chunk_bit(struct yaffs_dev *dev, int blk, int chunk);
 int yaffs_still_some_chunks(struct yaffs_dev *dev, int blk);
 int yaffs_count_chunk_bits(struct yaffs_dev *dev, int blk);
 
+/*
+ * Empty block bitmap manipulations
+ */
+void yaffs_set_empty_bit(struct yaffs_dev *dev, int blk);
+void yaffs_clear_empty_bit(struct yaffs_dev *dev, int blk);
+int yaffs_find_empty_bit(struct yaffs_dev *dev, int start_blk);
+void yaffs_rebuild_empty_bits(struct yaffs_dev *dev);
+
 #endif
@@ -13,6 +13,13 @@
 
 #include "yaffs_checkptrw.h"
 #include "yaffs_getblockinfo.h"
+#include "yaffs_bitmap.h"
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+#include <linux/lzo.h>
+#include <linux/crc32.h>
+#include <linux/vmalloc.h>
+#endif
 
 struct yaffs_checkpt_chunk_hdr {
 	int version;
@@ -21,6 +28,37 @@ struct yaffs_checkpt_chunk_hdr {
 	u32 xor;
 } ;
 
+/* A compressed stream is marked in the version of every chunk header so
+ * that older code, or code built without lzo, rejects it and rescans.
+ */
+#define YAFFS_CHECKPOINT_LZO_FLAG	0x100
+
+/* Compressed streams are cut into segments, each compressed on its own
+ * and checked with a crc32 of the uncompressed data.
+ */
+#define YAFFS_CHECKPT_SEG_SIZE		16384
+#define YAFFS_CHECKPT_SEG_MAGIC		0x59434b5a
+
+struct yaffs_checkpt_seg_hdr {
+	u32 magic;
+	u32 raw_len;
+	u32 comp_len;
+	u32 crc;
+};
+
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+static int yaffs2_checkpt_lzo_alloc(struct yaffs_dev *dev);
+static int yaffs2_checkpt_rd_raw(struct yaffs_dev *dev, u8 *data,
+				 int n_bytes);
+#endif
+
+static int yaffs2_checkpt_version(struct yaffs_dev *dev)
+{
+	return dev->checkpt_lzo ?
+		(YAFFS_CHECKPOINT_VERSION | YAFFS_CHECKPOINT_LZO_FLAG) :
+		YAFFS_CHECKPOINT_VERSION;
+}
+
 
 static int apply_chunk_offset(struct yaffs_dev *dev, int chunk)
 {
@@ -36,7 +74,7 @@ static void yaffs2_checkpt_init_chunk_hdr(struct yaffs_dev *dev)
 {
 	struct yaffs_checkpt_chunk_hdr hdr;
 
-	hdr.version = YAFFS_CHECKPOINT_VERSION;
+	hdr.version = yaffs2_checkpt_version(dev);
 	hdr.seq = dev->checkpt_page_seq;
 	hdr.sum = dev->checkpt_sum;
 	hdr.xor = dev->checkpt_xor;
@@ -54,7 +92,12 @@ static int yaffs2_checkpt_check_chunk_hdr(struct yaffs_dev *dev)
 
 	dev->checkpt_byte_offs = sizeof(hdr);
 
-	return hdr.version == YAFFS_CHECKPOINT_VERSION &&
+	/* The first chunk tells us whether the stream is compressed */
+	if (dev->checkpt_page_seq == 0)
+		dev->checkpt_lzo =
+			(hdr.version & YAFFS_CHECKPOINT_LZO_FLAG) ? 1 : 0;
+
+	return hdr.version == yaffs2_checkpt_version(dev) &&
 		hdr.seq == dev->checkpt_page_seq &&
 		hdr.sum == dev->checkpt_sum &&
 		hdr.xor == dev->checkpt_xor;
@@ -94,6 +137,7 @@ static int yaffs_checkpt_erase(struct yaffs_dev *dev)
 			result = dev->drv.drv_erase_fn(dev, offset_i);
 			if(result) {
 				bi->block_state = YAFFS_BLOCK_STATE_EMPTY;
+				yaffs_set_empty_bit(dev, i);
 				dev->n_erased_blocks++;
 				dev->n_free_chunks +=
 				    dev->param.chunks_per_block;
@@ -109,6 +153,21 @@ static int yaffs_checkpt_erase(struct yaffs_dev *dev)
 	return 1;
 }
 
+/* The next block the writer will take. This is stored in the tags as a
+ * hint, so the reader can go straight to it without scanning.
+ */
+static int yaffs2_checkpt_next_empty(struct yaffs_dev *dev, int blk)
+{
+	int i;
+
+	for (i = blk; i <= dev->internal_end_block; i++) {
+		if (yaffs_get_block_info(dev, i)->block_state ==
+		    YAFFS_BLOCK_STATE_EMPTY)
+			return i;
+	}
+	return blk;
+}
+
 static void yaffs2_checkpt_find_erased_block(struct yaffs_dev *dev)
 {
 	int i;
@@ -129,7 +188,8 @@ static void yaffs2_checkpt_find_erased_block(struct yaffs_dev *dev)
 
 			bi = yaffs_get_block_info(dev, i);
 			if (bi->block_state == YAFFS_BLOCK_STATE_EMPTY) {
-				dev->checkpt_next_block = i + 1;
+				dev->checkpt_next_block =
+					yaffs2_checkpt_next_empty(dev, i + 1);
 				dev->checkpt_cur_block = i;
 				yaffs_trace(YAFFS_TRACE_CHECKPOINT,
 					"allocating checkpt block %d", i);
@@ -219,10 +279,22 @@ int yaffs2_checkpt_open(struct yaffs_dev *dev, int writing)
 	dev->checkpt_byte_count = 0;
 	dev->checkpt_sum = 0;
 	dev->checkpt_xor = 0;
+	dev->checkpt_lsum = 0;
+	dev->checkpt_lxor = 0;
+	dev->checkpt_seg_len = 0;
+	dev->checkpt_seg_pos = 0;
 	dev->checkpt_cur_block = -1;
 	dev->checkpt_cur_chunk = -1;
 	dev->checkpt_next_block = dev->internal_start_block;
 
+	/* Reading finds out from the first chunk header */
+	dev->checkpt_lzo = 0;
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	if (writing && dev->param.checkpt_lzo &&
+	    yaffs2_checkpt_lzo_alloc(dev))
+		dev->checkpt_lzo = 1;
+#endif
+
 	if (writing) {
 		memset(dev->checkpt_buffer, 0, dev->data_bytes_per_chunk);
 		yaffs2_checkpt_init_chunk_hdr(dev);
@@ -254,7 +326,16 @@ int yaffs2_get_checkpt_sum(struct yaffs_dev *dev, u32 * sum)
 {
 	u32 composite_sum;
 
-	composite_sum = (dev->checkpt_sum << 8) | (dev->checkpt_xor & 0xff);
+	/* A compressed stream is summed before compression, since the
+	 * writer and reader are at different places in the compressed
+	 * data when they take the sum.
+	 */
+	if (dev->checkpt_lzo)
+		composite_sum = (dev->checkpt_lsum << 8) |
+				(dev->checkpt_lxor & 0xff);
+	else
+		composite_sum = (dev->checkpt_sum << 8) |
+				(dev->checkpt_xor & 0xff);
 	*sum = composite_sum;
 	return 1;
 }
@@ -284,6 +365,7 @@ static int yaffs2_checkpt_flush_buffer(struct yaffs_dev *dev)
 		struct yaffs_block_info *bi =
 		    yaffs_get_block_info(dev, dev->checkpt_cur_block);
 		bi->block_state = YAFFS_BLOCK_STATE_CHECKPOINT;
+		yaffs_clear_empty_bit(dev, dev->checkpt_cur_block);
 		dev->blocks_in_checkpt++;
 	}
 
@@ -316,113 +398,329 @@ static int yaffs2_checkpt_flush_buffer(struct yaffs_dev *dev)
 	return 1;
 }
 
-int yaffs2_checkpt_wr(struct yaffs_dev *dev, const void *data, int n_bytes)
+static void yaffs2_checkpt_add_sum(u32 *sum, u32 *xor,
+				   const u8 *data, int n_bytes)
+{
+	u32 s = *sum;
+	u32 x = *xor;
+
+	while (n_bytes-- > 0) {
+		s += *data;
+		x ^= *data;
+		data++;
+	}
+	*sum = s;
+	*xor = x;
+}
+
+/* Copy into the chunk buffer a chunk's worth at a time, flushing each
+ * full chunk to NAND.
+ */
+static int yaffs2_checkpt_wr_raw(struct yaffs_dev *dev, const u8 *data,
+				 int n_bytes)
 {
 	int i = 0;
 	int ok = 1;
-	u8 *data_bytes = (u8 *) data;
+	int this_tx;
 
-	if (!dev->checkpt_buffer)
-		return 0;
+	while (i < n_bytes && ok) {
+		if (dev->checkpt_byte_offs < 0 ||
+		    dev->checkpt_byte_offs >= dev->data_bytes_per_chunk)
+			return i;
 
-	if (!dev->checkpt_open_write)
-		return -1;
+		this_tx = dev->data_bytes_per_chunk - dev->checkpt_byte_offs;
+		if (this_tx > n_bytes - i)
+			this_tx = n_bytes - i;
 
-	while (i < n_bytes && ok) {
-		dev->checkpt_buffer[dev->checkpt_byte_offs] = *data_bytes;
-		dev->checkpt_sum += *data_bytes;
-		dev->checkpt_xor ^= *data_bytes;
+		memcpy(dev->checkpt_buffer + dev->checkpt_byte_offs,
+		       data + i, this_tx);
+		yaffs2_checkpt_add_sum(&dev->checkpt_sum, &dev->checkpt_xor,
+				       data + i, this_tx);
 
-		dev->checkpt_byte_offs++;
-		i++;
-		data_bytes++;
-		dev->checkpt_byte_count++;
+		dev->checkpt_byte_offs += this_tx;
+		i += this_tx;
+		dev->checkpt_byte_count += this_tx;
 
-		if (dev->checkpt_byte_offs < 0 ||
-		    dev->checkpt_byte_offs >= dev->data_bytes_per_chunk)
+		if (dev->checkpt_byte_offs >= dev->data_bytes_per_chunk)
 			ok = yaffs2_checkpt_flush_buffer(dev);
 	}
 
 	return i;
 }
 
-int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+static void yaffs2_checkpt_lzo_free(struct yaffs_dev *dev)
+{
+	vfree(dev->checkpt_seg);
+	dev->checkpt_seg = NULL;
+	vfree(dev->checkpt_cseg);
+	dev->checkpt_cseg = NULL;
+	vfree(dev->checkpt_lzo_wrk);
+	dev->checkpt_lzo_wrk = NULL;
+}
+
+/* Checkpoints are saved with the gross lock held, so reclaim must not
+ * call back into the file system, as with the other buffers here.
+ */
+static void *yaffs2_checkpt_vmalloc(unsigned long size)
+{
+	return __vmalloc(size, GFP_NOFS | __GFP_HIGHMEM, PAGE_KERNEL);
+}
+
+static int yaffs2_checkpt_lzo_alloc(struct yaffs_dev *dev)
+{
+	if (!dev->checkpt_seg)
+		dev->checkpt_seg =
+			yaffs2_checkpt_vmalloc(YAFFS_CHECKPT_SEG_SIZE);
+	if (!dev->checkpt_cseg)
+		dev->checkpt_cseg = yaffs2_checkpt_vmalloc(
+			lzo1x_worst_compress(YAFFS_CHECKPT_SEG_SIZE));
+	if (!dev->checkpt_lzo_wrk)
+		dev->checkpt_lzo_wrk =
+			yaffs2_checkpt_vmalloc(LZO1X_1_MEM_COMPRESS);
+
+	if (dev->checkpt_seg && dev->checkpt_cseg && dev->checkpt_lzo_wrk)
+		return 1;
+
+	yaffs2_checkpt_lzo_free(dev);
+	return 0;
+}
+
+static int yaffs2_checkpt_seg_flush(struct yaffs_dev *dev)
+{
+	struct yaffs_checkpt_seg_hdr hdr;
+	size_t comp_len;
+
+	if (dev->checkpt_seg_len < 1)
+		return 1;
+
+	if (lzo1x_1_compress(dev->checkpt_seg, dev->checkpt_seg_len,
+			     dev->checkpt_cseg, &comp_len,
+			     dev->checkpt_lzo_wrk) != LZO_E_OK)
+		return 0;
+
+	hdr.magic = YAFFS_CHECKPT_SEG_MAGIC;
+	hdr.raw_len = dev->checkpt_seg_len;
+	hdr.comp_len = comp_len;
+	hdr.crc = crc32(~0, dev->checkpt_seg, dev->checkpt_seg_len);
+	dev->checkpt_seg_len = 0;
+
+	return yaffs2_checkpt_wr_raw(dev, (u8 *)&hdr, sizeof(hdr)) ==
+			sizeof(hdr) &&
+		yaffs2_checkpt_wr_raw(dev, dev->checkpt_cseg, comp_len) ==
+			comp_len;
+}
+
+static int yaffs2_checkpt_seg_fill(struct yaffs_dev *dev)
+{
+	struct yaffs_checkpt_seg_hdr hdr;
+	size_t raw_len;
+
+	if (!yaffs2_checkpt_lzo_alloc(dev))
+		return 0;
+
+	if (yaffs2_checkpt_rd_raw(dev, (u8 *)&hdr, sizeof(hdr)) !=
+			sizeof(hdr) ||
+	    hdr.magic != YAFFS_CHECKPT_SEG_MAGIC ||
+	    hdr.raw_len < 1 || hdr.raw_len > YAFFS_CHECKPT_SEG_SIZE ||
+	    hdr.comp_len > lzo1x_worst_compress(YAFFS_CHECKPT_SEG_SIZE))
+		return 0;
+
+	if (yaffs2_checkpt_rd_raw(dev, dev->checkpt_cseg, hdr.comp_len) !=
+			hdr.comp_len)
+		return 0;
+
+	raw_len = YAFFS_CHECKPT_SEG_SIZE;
+	if (lzo1x_decompress_safe(dev->checkpt_cseg, hdr.comp_len,
+				  dev->checkpt_seg, &raw_len) != LZO_E_OK ||
+	    raw_len != hdr.raw_len ||
+	    crc32(~0, dev->checkpt_seg, raw_len) != hdr.crc) {
+		yaffs_trace(YAFFS_TRACE_CHECKPOINT,
+			"checkpoint segment at page %d is corrupt",
+			dev->checkpt_page_seq);
+		return 0;
+	}
+
+	dev->checkpt_seg_len = raw_len;
+	dev->checkpt_seg_pos = 0;
+	return 1;
+}
+
+static int yaffs2_checkpt_lzo_wr(struct yaffs_dev *dev, const u8 *data,
+				 int n_bytes)
 {
 	int i = 0;
-	struct yaffs_ext_tags tags;
-	int chunk;
-	int offset_chunk;
-	u8 *data_bytes = (u8 *) data;
+	int this_tx;
+
+	while (i < n_bytes) {
+		if (dev->checkpt_seg_len >= YAFFS_CHECKPT_SEG_SIZE &&
+		    !yaffs2_checkpt_seg_flush(dev))
+			break;
+
+		this_tx = YAFFS_CHECKPT_SEG_SIZE - dev->checkpt_seg_len;
+		if (this_tx > n_bytes - i)
+			this_tx = n_bytes - i;
+
+		memcpy(dev->checkpt_seg + dev->checkpt_seg_len,
+		       data + i, this_tx);
+		yaffs2_checkpt_add_sum(&dev->checkpt_lsum, &dev->checkpt_lxor,
+				       data + i, this_tx);
+		dev->checkpt_seg_len += this_tx;
+		i += this_tx;
+	}
+
+	return i;
+}
+
+static int yaffs2_checkpt_lzo_rd(struct yaffs_dev *dev, u8 *data,
+				 int n_bytes)
+{
+	int i = 0;
+	int this_tx;
+
+	while (i < n_bytes) {
+		if (dev->checkpt_seg_pos >= dev->checkpt_seg_len &&
+		    !yaffs2_checkpt_seg_fill(dev))
+			break;
+
+		this_tx = dev->checkpt_seg_len - dev->checkpt_seg_pos;
+		if (this_tx > n_bytes - i)
+			this_tx = n_bytes - i;
+
+		memcpy(data + i, dev->checkpt_seg + dev->checkpt_seg_pos,
+		       this_tx);
+		yaffs2_checkpt_add_sum(&dev->checkpt_lsum, &dev->checkpt_lxor,
+				       data + i, this_tx);
+		dev->checkpt_seg_pos += this_tx;
+		i += this_tx;
+	}
+
+	return i;
+}
+#endif
 
+int yaffs2_checkpt_wr(struct yaffs_dev *dev, const void *data, int n_bytes)
+{
 	if (!dev->checkpt_buffer)
 		return 0;
 
-	if (dev->checkpt_open_write)
+	if (!dev->checkpt_open_write)
 		return -1;
 
-	while (i < n_bytes) {
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	if (dev->checkpt_lzo)
+		return yaffs2_checkpt_lzo_wr(dev, data, n_bytes);
+#endif
+	return yaffs2_checkpt_wr_raw(dev, data, n_bytes);
+}
 
-		if (dev->checkpt_byte_offs < 0 ||
-		    dev->checkpt_byte_offs >= dev->data_bytes_per_chunk) {
+/* Read the next chunk of the stream into the chunk buffer */
+static int yaffs2_checkpt_rd_chunk(struct yaffs_dev *dev)
+{
+	struct yaffs_ext_tags tags;
+	int chunk;
+	int offset_chunk;
 
-			if (dev->checkpt_cur_block < 0) {
-				yaffs2_checkpt_find_block(dev);
-				dev->checkpt_cur_chunk = 0;
-			}
+	if (dev->checkpt_cur_block < 0) {
+		yaffs2_checkpt_find_block(dev);
+		dev->checkpt_cur_chunk = 0;
+	}
 
-			/* Bail out if we can't find a checpoint block */
-			if (dev->checkpt_cur_block < 0)
-				break;
+	/* Bail out if we can't find a checpoint block */
+	if (dev->checkpt_cur_block < 0)
+		return 0;
 
-			chunk = dev->checkpt_cur_block *
-			    dev->param.chunks_per_block +
-			    dev->checkpt_cur_chunk;
+	chunk = dev->checkpt_cur_block * dev->param.chunks_per_block +
+	    dev->checkpt_cur_chunk;
 
-			offset_chunk = apply_chunk_offset(dev, chunk);
-			dev->n_page_reads++;
+	offset_chunk = apply_chunk_offset(dev, chunk);
+	dev->n_page_reads++;
 
-			/* Read in the next chunk */
-			dev->tagger.read_chunk_tags_fn(dev,
-						offset_chunk,
-						dev->checkpt_buffer,
-						&tags);
+	/* Read in the next chunk */
+	dev->tagger.read_chunk_tags_fn(dev, offset_chunk,
+				       dev->checkpt_buffer, &tags);
 
-			/* Bail out if the chunk is corrupted. */
-			if (tags.chunk_id != (dev->checkpt_page_seq + 1) ||
-			    tags.ecc_result > YAFFS_ECC_RESULT_FIXED ||
-			    tags.seq_number != YAFFS_SEQUENCE_CHECKPOINT_DATA)
-				break;
+	/* Bail out if the chunk is corrupted. */
+	if (tags.chunk_id != (dev->checkpt_page_seq + 1) ||
+	    tags.ecc_result > YAFFS_ECC_RESULT_FIXED ||
+	    tags.seq_number != YAFFS_SEQUENCE_CHECKPOINT_DATA)
+		return 0;
 
-			/* Bail out if it is not a checkpoint chunk. */
-			if(!yaffs2_checkpt_check_chunk_hdr(dev))
-				break;
+	/* Bail out if it is not a checkpoint chunk. */
+	if (!yaffs2_checkpt_check_chunk_hdr(dev))
+		return 0;
 
-			dev->checkpt_page_seq++;
-			dev->checkpt_cur_chunk++;
+	dev->checkpt_page_seq++;
+	dev->checkpt_cur_chunk++;
 
-			if (dev->checkpt_cur_chunk >=
-					dev->param.chunks_per_block)
-				dev->checkpt_cur_block = -1;
+	if (dev->checkpt_cur_chunk >= dev->param.chunks_per_block)
+		dev->checkpt_cur_block = -1;
 
-		}
+	return 1;
+}
+
+static int yaffs2_checkpt_rd_raw(struct yaffs_dev *dev, u8 *data,
+				 int n_bytes)
+{
+	int i = 0;
+	int this_tx;
 
-		*data_bytes = dev->checkpt_buffer[dev->checkpt_byte_offs];
-		dev->checkpt_sum += *data_bytes;
-		dev->checkpt_xor ^= *data_bytes;
-		dev->checkpt_byte_offs++;
-		i++;
-		data_bytes++;
-		dev->checkpt_byte_count++;
+	while (i < n_bytes) {
+		if ((dev->checkpt_byte_offs < 0 ||
+		     dev->checkpt_byte_offs >= dev->data_bytes_per_chunk) &&
+		    !yaffs2_checkpt_rd_chunk(dev))
+			break;
+
+		this_tx = dev->data_bytes_per_chunk - dev->checkpt_byte_offs;
+		if (this_tx > n_bytes - i)
+			this_tx = n_bytes - i;
+
+		memcpy(data + i, dev->checkpt_buffer + dev->checkpt_byte_offs,
+		       this_tx);
+		yaffs2_checkpt_add_sum(&dev->checkpt_sum, &dev->checkpt_xor,
+				       data + i, this_tx);
+
+		dev->checkpt_byte_offs += this_tx;
+		i += this_tx;
+		dev->checkpt_byte_count += this_tx;
 	}
 
 	return i; /* Number of bytes read */
 }
 
+int yaffs2_checkpt_rd(struct yaffs_dev *dev, void *data, int n_bytes)
+{
+	if (!dev->checkpt_buffer)
+		return 0;
+
+	if (dev->checkpt_open_write)
+		return -1;
+
+	/* Load the first chunk so we know what kind of stream this is */
+	if (dev->checkpt_page_seq == 0 && !yaffs2_checkpt_rd_chunk(dev))
+		return 0;
+
+	if (dev->checkpt_lzo) {
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+		return yaffs2_checkpt_lzo_rd(dev, data, n_bytes);
+#else
+		return 0;
+#endif
+	}
+	return yaffs2_checkpt_rd_raw(dev, data, n_bytes);
+}
+
 int yaffs_checkpt_close(struct yaffs_dev *dev)
 {
 	int i;
+	int ok = 1;
 
 	if (dev->checkpt_open_write) {
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+		/* A lost last segment leaves a truncated checkpoint */
+		if (dev->checkpt_lzo && !yaffs2_checkpt_seg_flush(dev))
+			ok = 0;
+#endif
 		if (dev->checkpt_byte_offs !=
 			sizeof(sizeof(struct yaffs_checkpt_chunk_hdr)))
 			yaffs2_checkpt_flush_buffer(dev);
@@ -436,8 +734,10 @@ int yaffs_checkpt_close(struct yaffs_dev *dev)
 			if (dev->internal_start_block <= blk &&
 			    blk <= dev->internal_end_block)
 				bi = yaffs_get_block_info(dev, blk);
-			if (bi && bi->block_state == YAFFS_BLOCK_STATE_EMPTY)
+			if (bi && bi->block_state == YAFFS_BLOCK_STATE_EMPTY) {
 				bi->block_state = YAFFS_BLOCK_STATE_CHECKPOINT;
+				yaffs_clear_empty_bit(dev, blk);
+			}
 		}
 	}
 
@@ -448,8 +748,12 @@ int yaffs_checkpt_close(struct yaffs_dev *dev)
 	yaffs_trace(YAFFS_TRACE_CHECKPOINT, "checkpoint byte count %d",
 		dev->checkpt_byte_count);
 
+#ifdef CONFIG_YAFFS_CHECKPOINT_LZO
+	yaffs2_checkpt_lzo_free(dev);
+#endif
+
 	if (dev->checkpt_buffer)
-		return 1;
+		return ok;
 	else
 		return 0;
 }
@@ -0,0 +1,258 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2011 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* The gc index keeps every FULL block on a list bucketed by the number of
+ * live pages it holds. The lists are updated as pages_in_use changes, so
+ * finding a gc victim does not need to walk the block info array.
+ * Blocks are added at the tail of a bucket, so the head holds the blocks
+ * that have sat unchanged the longest and the probes look at those first.
+ *
+ * Victims are chosen by cost-benefit:
+ *	score = age * free / (live + 1)
+ * where age is how many blocks have been allocated since this block was
+ * written (yaffs2 only, yaffs1 has no sequence numbers so it degrades to
+ * greedy). Old, mostly dead blocks go first; young blocks are left alone for
+ * a while because their remaining data is likely to be deleted soon anyway.
+ */
+
+#include "yaffs_gcindex.h"
+#include "yaffs_getblockinfo.h"
+#include "yaffs_yaffs2.h"
+#include "yaffs_trace.h"
+
+/* Cap ages so that age * free fits comfortably in a u32. */
+#define YAFFS_GC_INDEX_MAX_AGE		0xffff
+
+/* Number of entries to look at per bucket when selecting a victim. */
+#define YAFFS_GC_INDEX_PROBES		8
+
+#define YAFFS_GC_INDEX_NONE		(-1)
+
+int yaffs_gc_index_init(struct yaffs_dev *dev)
+{
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+	int n_buckets = dev->param.chunks_per_block + 1;
+	int n_ints = 3 * n_blocks + 2 * n_buckets;
+	int i;
+
+	dev->gc_idx = kmalloc(n_ints * sizeof(int), GFP_NOFS);
+	if (!dev->gc_idx) {
+		dev->gc_idx = vmalloc(n_ints * sizeof(int));
+		dev->gc_idx_alt = 1;
+	} else {
+		dev->gc_idx_alt = 0;
+	}
+
+	if (!dev->gc_idx)
+		return YAFFS_FAIL;
+
+	dev->gc_idx_next = dev->gc_idx;
+	dev->gc_idx_prev = dev->gc_idx_next + n_blocks;
+	dev->gc_idx_bucket = dev->gc_idx_prev + n_blocks;
+	dev->gc_idx_head = dev->gc_idx_bucket + n_blocks;
+	dev->gc_idx_tail = dev->gc_idx_head + n_buckets;
+
+	for (i = 0; i < n_ints; i++)
+		dev->gc_idx[i] = YAFFS_GC_INDEX_NONE;
+
+	return YAFFS_OK;
+}
+
+void yaffs_gc_index_deinit(struct yaffs_dev *dev)
+{
+	if (dev->gc_idx_alt && dev->gc_idx)
+		vfree(dev->gc_idx);
+	else
+		kfree(dev->gc_idx);
+
+	dev->gc_idx_alt = 0;
+	dev->gc_idx = NULL;
+	dev->gc_idx_next = NULL;
+	dev->gc_idx_prev = NULL;
+	dev->gc_idx_bucket = NULL;
+	dev->gc_idx_head = NULL;
+	dev->gc_idx_tail = NULL;
+}
+
+static void yaffs_gc_index_unlink(struct yaffs_dev *dev, int i)
+{
+	int bucket = dev->gc_idx_bucket[i];
+	int next = dev->gc_idx_next[i];
+	int prev = dev->gc_idx_prev[i];
+
+	if (prev != YAFFS_GC_INDEX_NONE)
+		dev->gc_idx_next[prev] = next;
+	else
+		dev->gc_idx_head[bucket] = next;
+
+	if (next != YAFFS_GC_INDEX_NONE)
+		dev->gc_idx_prev[next] = prev;
+	else
+		dev->gc_idx_tail[bucket] = prev;
+
+	dev->gc_idx_bucket[i] = YAFFS_GC_INDEX_NONE;
+	dev->gc_idx_next[i] = YAFFS_GC_INDEX_NONE;
+	dev->gc_idx_prev[i] = YAFFS_GC_INDEX_NONE;
+}
+
+static void yaffs_gc_index_link(struct yaffs_dev *dev, int i, int bucket)
+{
+	int tail = dev->gc_idx_tail[bucket];
+
+	dev->gc_idx_bucket[i] = bucket;
+	dev->gc_idx_next[i] = YAFFS_GC_INDEX_NONE;
+	dev->gc_idx_prev[i] = tail;
+	if (tail != YAFFS_GC_INDEX_NONE)
+		dev->gc_idx_next[tail] = i;
+	else
+		dev->gc_idx_head[bucket] = i;
+	dev->gc_idx_tail[bucket] = i;
+}
+
+/*
+ * yaffs_gc_index_update()
+ * Move a block to the bucket matching its current state and live page
+ * count. Must be called whenever either of those changes.
+ */
+void yaffs_gc_index_update(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi;
+	int i;
+	int bucket = YAFFS_GC_INDEX_NONE;
+
+	if (!dev->gc_idx)
+		return;
+
+	bi = yaffs_get_block_info(dev, blk);
+	i = blk - dev->internal_start_block;
+
+	if (bi->block_state == YAFFS_BLOCK_STATE_FULL) {
+		bucket = bi->pages_in_use - bi->soft_del_pages;
+		if (bucket < 0)
+			bucket = 0;
+		if (bucket > dev->param.chunks_per_block)
+			bucket = dev->param.chunks_per_block;
+	}
+
+	if (dev->gc_idx_bucket[i] == bucket)
+		return;
+
+	if (dev->gc_idx_bucket[i] != YAFFS_GC_INDEX_NONE)
+		yaffs_gc_index_unlink(dev, i);
+	if (bucket != YAFFS_GC_INDEX_NONE)
+		yaffs_gc_index_link(dev, i, bucket);
+}
+
+void yaffs_gc_index_rebuild(struct yaffs_dev *dev)
+{
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+	int n_ints = 3 * n_blocks + 2 * (dev->param.chunks_per_block + 1);
+	int blk;
+	int i;
+
+	if (!dev->gc_idx)
+		return;
+
+	for (i = 0; i < n_ints; i++)
+		dev->gc_idx[i] = YAFFS_GC_INDEX_NONE;
+
+	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
+	     blk++)
+		yaffs_gc_index_update(dev, blk);
+}
+
+static u32 yaffs_gc_index_age(struct yaffs_dev *dev,
+			      struct yaffs_block_info *bi)
+{
+	u32 age;
+
+	if (!dev->param.is_yaffs2)
+		return 1;
+
+	age = dev->seq_number - bi->seq_number + 1;
+	if (age > YAFFS_GC_INDEX_MAX_AGE)
+		age = YAFFS_GC_INDEX_MAX_AGE;
+	return age;
+}
+
+/*
+ * yaffs_gc_index_find()
+ * Select the best cost-benefit victim among the FULL blocks holding no more
+ * than threshold live pages. Returns the block number or 0 if none.
+ */
+int yaffs_gc_index_find(struct yaffs_dev *dev, int threshold,
+			int *pages_used_out)
+{
+	int chunks = dev->param.chunks_per_block;
+	int selected = 0;
+	int selected_used = 0;
+	u32 best = 0;
+	int live;
+
+	if (!dev->gc_idx)
+		return 0;
+
+	if (threshold >= chunks)
+		threshold = chunks - 1;
+
+	for (live = 0; live <= threshold; live++) {
+		u32 free = chunks - live;
+		int i = dev->gc_idx_head[live];
+		int probes = YAFFS_GC_INDEX_PROBES;
+
+		/* Nothing in this or any later bucket can beat the best. */
+		if (selected &&
+		    (YAFFS_GC_INDEX_MAX_AGE * free) / (live + 1) <= best)
+			break;
+
+		while (i != YAFFS_GC_INDEX_NONE && probes > 0) {
+			int blk = i + dev->internal_start_block;
+			int next = dev->gc_idx_next[i];
+			struct yaffs_block_info *bi =
+				yaffs_get_block_info(dev, blk);
+			u32 score;
+
+			if (bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+			    bi->pages_in_use - bi->soft_del_pages != live) {
+				/* Stale entry, put it where it belongs. */
+				yaffs_gc_index_update(dev, blk);
+				i = next;
+				continue;
+			}
+
+			probes--;
+			dev->gc_idx_probes++;
+
+			if (yaffs_block_ok_for_gc(dev, bi)) {
+				score = (yaffs_gc_index_age(dev, bi) * free) /
+					(live + 1);
+				if (!selected || score > best) {
+					selected = blk;
+					selected_used = live;
+					best = score;
+				}
+			}
+			i = next;
+		}
+	}
+
+	if (selected) {
+		yaffs_trace(YAFFS_TRACE_GC_DETAIL,
+			"gc index selected block %d live %d score %u",
+			selected, selected_used, best);
+		if (pages_used_out)
+			*pages_used_out = selected_used;
+	}
+
+	return selected;
+}
@@ -0,0 +1,28 @@
+/*
+ * YAFFS: Yet another Flash File System . A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2011 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Note: Only YAFFS headers are LGPL, YAFFS C code is covered by GPL.
+ */
+
+#ifndef __YAFFS_GCINDEX_H__
+#define __YAFFS_GCINDEX_H__
+
+#include "yaffs_guts.h"
+
+int yaffs_gc_index_init(struct yaffs_dev *dev);
+void yaffs_gc_index_deinit(struct yaffs_dev *dev);
+void yaffs_gc_index_update(struct yaffs_dev *dev, int blk);
+void yaffs_gc_index_rebuild(struct yaffs_dev *dev);
+int yaffs_gc_index_find(struct yaffs_dev *dev, int threshold,
+			int *pages_used_out);
+
+#endif
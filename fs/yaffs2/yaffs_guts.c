@@ -29,6 +29,8 @@
 #include "yaffs_allocator.h"
 #include "yaffs_attribs.h"
 #include "yaffs_summary.h"
+#include "yaffs_gcindex.h"
+#include "yaffs_scrub.h"
 
 /* Note YAFFS_GC_GOOD_ENOUGH must be <= YAFFS_GC_PASSIVE_THRESHOLD */
 #define YAFFS_GC_GOOD_ENOUGH 2
@@ -44,6 +46,8 @@ static int yaffs_wr_data_obj(struct yaffs_obj *in, int inode_chunk,
 static void yaffs_fix_null_name(struct yaffs_obj *obj, YCHAR *name,
 				int buffer_size);
 
+static int yaffs_load_file_map(struct yaffs_obj *in);
+
 /* Function to calculate chunk and offset */
 
 void yaffs_addr_to_chunk(struct yaffs_dev *dev, loff_t addr,
@@ -355,9 +359,25 @@ int yaffs_check_alloc_available(struct yaffs_dev *dev, int n_chunks)
 	return (dev->n_free_chunks > (reserved_chunks + n_chunks));
 }
 
+static int yaffs_take_alloc_block(struct yaffs_dev *dev, int blk,
+				  struct yaffs_block_info *bi)
+{
+	dev->alloc_block_finder = blk;
+	bi->block_state = YAFFS_BLOCK_STATE_ALLOCATING;
+	dev->seq_number++;
+	bi->seq_number = dev->seq_number;
+	dev->n_erased_blocks--;
+	yaffs_trace(YAFFS_TRACE_ALLOCATE,
+	  "Allocated block %d, seq  %d, %d left" ,
+	   dev->alloc_block_finder, dev->seq_number,
+	   dev->n_erased_blocks);
+	return dev->alloc_block_finder;
+}
+
 static int yaffs_find_alloc_block(struct yaffs_dev *dev)
 {
 	int i;
+	int blk;
 	struct yaffs_block_info *bi;
 
 	if (dev->n_erased_blocks < 1) {
@@ -370,27 +390,41 @@ static int yaffs_find_alloc_block(struct yaffs_dev *dev)
 		return -1;
 	}
 
-	/* Find an empty block. */
+	/* Find an empty block.
+	 * Use the empty block bitmap, continuing round-robin from the last
+	 * allocation block so that wear is spread as before. Bits are only
+	 * hints: a stale bit is dropped and the search carries on.
+	 */
 
-	for (i = dev->internal_start_block; i <= dev->internal_end_block; i++) {
-		dev->alloc_block_finder++;
-		if (dev->alloc_block_finder < dev->internal_start_block
-		    || dev->alloc_block_finder > dev->internal_end_block) {
-			dev->alloc_block_finder = dev->internal_start_block;
-		}
+	while ((blk = yaffs_find_empty_bit(dev,
+					dev->alloc_block_finder + 1)) >= 0) {
+		bi = yaffs_get_block_info(dev, blk);
+		yaffs_clear_empty_bit(dev, blk);
+
+		if (bi->block_state == YAFFS_BLOCK_STATE_EMPTY)
+			return yaffs_take_alloc_block(dev, blk, bi);
+	}
 
-		bi = yaffs_get_block_info(dev, dev->alloc_block_finder);
+	/*
+	 * The bitmap has no empty block but n_erased_blocks says there are
+	 * some: a state change was missed, or there is no bitmap. Walk the
+	 * block info array as before and bring the bitmap back in sync.
+	 */
+	blk = dev->alloc_block_finder;
+	for (i = dev->internal_start_block; i <= dev->internal_end_block; i++) {
+		blk++;
+		if (blk < dev->internal_start_block ||
+		    blk > dev->internal_end_block)
+			blk = dev->internal_start_block;
 
+		bi = yaffs_get_block_info(dev, blk);
 		if (bi->block_state == YAFFS_BLOCK_STATE_EMPTY) {
-			bi->block_state = YAFFS_BLOCK_STATE_ALLOCATING;
-			dev->seq_number++;
-			bi->seq_number = dev->seq_number;
-			dev->n_erased_blocks--;
-			yaffs_trace(YAFFS_TRACE_ALLOCATE,
-			  "Allocated block %d, seq  %d, %d left" ,
-			   dev->alloc_block_finder, dev->seq_number,
-			   dev->n_erased_blocks);
-			return dev->alloc_block_finder;
+			yaffs_trace(YAFFS_TRACE_ERROR,
+				"yaffs: empty block %d missing from bitmap",
+				blk);
+			yaffs_rebuild_empty_bits(dev);
+			yaffs_clear_empty_bit(dev, blk);
+			return yaffs_take_alloc_block(dev, blk, bi);
 		}
 	}
 
@@ -438,6 +472,7 @@ static int yaffs_alloc_chunk(struct yaffs_dev *dev, int use_reserver,
 		/* If the block is full set the state to full */
 		if (dev->alloc_page >= dev->param.chunks_per_block) {
 			bi->block_state = YAFFS_BLOCK_STATE_FULL;
+			yaffs_gc_index_update(dev, dev->alloc_block);
 			dev->alloc_block = -1;
 		}
 
@@ -478,6 +513,7 @@ void yaffs_skip_rest_of_block(struct yaffs_dev *dev)
 		bi = yaffs_get_block_info(dev, dev->alloc_block);
 		if (bi->block_state == YAFFS_BLOCK_STATE_ALLOCATING) {
 			bi->block_state = YAFFS_BLOCK_STATE_FULL;
+			yaffs_gc_index_update(dev, dev->alloc_block);
 			dev->alloc_block = -1;
 		}
 	}
@@ -623,6 +659,8 @@ static void yaffs_retire_block(struct yaffs_dev *dev, int flash_block)
 	}
 
 	bi->block_state = YAFFS_BLOCK_STATE_DEAD;
+	yaffs_clear_empty_bit(dev, flash_block);
+	yaffs_gc_index_update(dev, flash_block);
 	bi->gc_prioritise = 0;
 	bi->needs_retiring = 0;
 
@@ -785,6 +823,8 @@ struct yaffs_tnode *yaffs_get_tnode(struct yaffs_dev *dev)
 /* FreeTnode frees up a tnode and puts it back on the free list */
 static void yaffs_free_tnode(struct yaffs_dev *dev, struct yaffs_tnode *tn)
 {
+	if (!tn)
+		return;
 	yaffs_free_raw_tnode(dev, tn);
 	dev->n_tnodes--;
 	dev->checkpoint_blocks_required = 0;	/* force recalculation */
@@ -1067,6 +1107,10 @@ int yaffs_find_chunk_in_file(struct yaffs_obj *in, int inode_chunk,
 		tags = &local_tags;
 	}
 
+	/* A map that cannot be rebuilt is not a hole */
+	if (yaffs_load_file_map(in) != YAFFS_OK)
+		return -ENOMEM;
+
 	tn = yaffs_find_tnode_0(dev, &in->variant.file_variant, inode_chunk);
 
 	if (!tn)
@@ -1094,6 +1138,9 @@ static int yaffs_find_del_file_chunk(struct yaffs_obj *in, int inode_chunk,
 		tags = &local_tags;
 	}
 
+	if (yaffs_load_file_map(in) != YAFFS_OK)
+		return ret_val;
+
 	tn = yaffs_find_tnode_0(dev, &in->variant.file_variant, inode_chunk);
 
 	if (!tn)
@@ -1144,6 +1191,9 @@ int yaffs_put_chunk_in_file(struct yaffs_obj *in, int inode_chunk,
 		return YAFFS_OK;
 	}
 
+	if (yaffs_load_file_map(in) != YAFFS_OK)
+		return YAFFS_FAIL;
+
 	tn = yaffs_add_find_tnode_0(dev,
 				    &in->variant.file_variant,
 				    inode_chunk, NULL);
@@ -1257,6 +1307,7 @@ static void yaffs_soft_del_chunk(struct yaffs_dev *dev, int chunk)
 		the_block->soft_del_pages++;
 		dev->n_free_chunks++;
 		yaffs2_update_oldest_dirty_seq(dev, block_no, the_block);
+		yaffs_gc_index_update(dev, block_no);
 	}
 }
 
@@ -1512,6 +1563,99 @@ void yaffs_flush_whole_cache(struct yaffs_dev *dev, int discard)
 
 }
 
+int yaffs_cache_n_dirty(struct yaffs_dev *dev)
+{
+	int n_dirty = 0;
+	int i;
+
+	for (i = 0; i < dev->param.n_caches; i++) {
+		if (dev->cache[i].object && dev->cache[i].dirty)
+			n_dirty++;
+	}
+	return n_dirty;
+}
+
+/* Background writeback of the chunk cache.
+ *
+ * The writer calls yaffs_cache_wb_start() to begin a pass, then calls
+ * yaffs_cache_wb_next() once per chunk, and may drop the gross lock in
+ * between. Chunks are written in (obj_id, chunk_id) order, so the chunks
+ * of a file land in consecutive pages. Chunks used since the previous
+ * pass are still hot and are left for later, unless the cache is
+ * mostly dirty.
+ *
+ * Returns the number of chunks this pass may write.
+ */
+int yaffs_cache_wb_start(struct yaffs_dev *dev)
+{
+	int n_caches = dev->param.n_caches;
+	int n_dirty = 0;
+	int n_cold = 0;
+	int i;
+
+	if (n_caches < 1 || dev->read_only)
+		return 0;
+
+	for (i = 0; i < n_caches; i++) {
+		if (!dev->cache[i].object || !dev->cache[i].dirty)
+			continue;
+		n_dirty++;
+		if (dev->cache[i].last_use <= dev->cache_wb_mark)
+			n_cold++;
+	}
+
+	if (n_dirty * 4 >= n_caches * 3) {
+		dev->cache_wb_limit = dev->cache_last_use;
+		n_cold = n_dirty;
+	} else {
+		dev->cache_wb_limit = dev->cache_wb_mark;
+	}
+	dev->cache_wb_mark = dev->cache_last_use;
+	dev->cache_wb_obj = 0;
+	dev->cache_wb_chunk = 0;
+
+	return n_cold;
+}
+
+/* Write out the next chunk of the pass. Returns 1 if a chunk was
+ * written, 0 if the pass is done.
+ */
+int yaffs_cache_wb_next(struct yaffs_dev *dev)
+{
+	struct yaffs_cache *cache;
+	struct yaffs_cache *best = NULL;
+	u32 obj_id;
+	int i;
+
+	for (i = 0; i < dev->param.n_caches; i++) {
+		cache = &dev->cache[i];
+		if (!cache->object || !cache->dirty || cache->locked ||
+		    cache->last_use > dev->cache_wb_limit)
+			continue;
+
+		obj_id = cache->object->obj_id;
+		if (obj_id < dev->cache_wb_obj ||
+		    (obj_id == dev->cache_wb_obj &&
+		     cache->chunk_id <= dev->cache_wb_chunk))
+			continue;
+
+		if (!best || obj_id < best->object->obj_id ||
+		    (obj_id == best->object->obj_id &&
+		     cache->chunk_id < best->chunk_id))
+			best = cache;
+	}
+
+	if (!best)
+		return 0;
+
+	dev->cache_wb_obj = best->object->obj_id;
+	dev->cache_wb_chunk = best->chunk_id;
+	yaffs_flush_single_cache(best, 0);
+	dev->n_cache_wb++;
+
+	return 1;
+}
+
 /* Grab us an unused cache chunk for use.
  * First look for an empty one.
  * Then look for the least recently used non-dirty one.
@@ -1691,6 +1835,7 @@ static void yaffs_free_obj(struct yaffs_obj *obj)
 	}
 
 	yaffs_unhash_obj(obj);
+	list_del_init(&obj->map_lru);
 
 	yaffs_free_raw_obj(dev, obj);
 	dev->n_obj--;
@@ -1723,12 +1868,12 @@ static int yaffs_generic_obj_del(struct yaffs_obj *in)
 
 }
 
-static void yaffs_soft_del_file(struct yaffs_obj *obj)
+static int yaffs_soft_del_file(struct yaffs_obj *obj)
 {
 	if (!obj->deleted ||
 	    obj->variant_type != YAFFS_OBJECT_TYPE_FILE ||
 	    obj->soft_del)
-		return;
+		return YAFFS_OK;
 
 	if (obj->n_data_chunks <= 0) {
 		/* Empty file with no duplicate object headers,
@@ -1740,12 +1885,17 @@ static void yaffs_soft_del_file(struct yaffs_obj *obj)
 			obj->obj_id);
 		yaffs_generic_obj_del(obj);
 	} else {
+		/* Without a map the chunks cannot be released; leave the
+		 * object for a later delete to retry. */
+		if (yaffs_load_file_map(obj) != YAFFS_OK)
+			return YAFFS_FAIL;
 		yaffs_soft_del_worker(obj,
 				      obj->variant.file_variant.top,
 				      obj->variant.
 				      file_variant.top_level, 0);
 		obj->soft_del = 1;
 	}
+	return YAFFS_OK;
 }
 
 /* Pruning removes any part of the file structure tree that is beyond the
@@ -1850,6 +2000,240 @@ static int yaffs_prune_tree(struct yaffs_dev *dev,
 
 /*-------------------- End of File Structure functions.-------------------*/
 
+/*-------------------- File map eviction ---------------------------------
+ * With a tnode budget set, the chunk maps of cold files are freed and
+ * rebuilt on demand from the block summaries, or from the tags of blocks
+ * that have no summary. This only works for yaffs2: deleted chunks are
+ * never marked in NAND so a set chunk bit is the whole truth.
+ *
+ * Maps are only evicted on entry to file reads and writes, so a map never
+ * disappears under an operation that is walking it. Files being deleted
+ * are never evicted.
+ *
+ * To bound the rebuild, eviction records the range of blocks the map
+ * pointed into and gc widens it when it moves a chunk of an evicted file.
+ * The rebuild then only walks that range. Eviction also has hysteresis:
+ * once over budget, maps are freed down to 7/8 of it, and a map used in
+ * the last YAFFS_MAP_MIN_IDLE file accesses is kept even if that leaves
+ * the budget exceeded, so two hot files can't evict each other in turn.
+ */
+
+#define YAFFS_MAP_MIN_IDLE	32
+
+static void yaffs_map_blk_range(struct yaffs_dev *dev, struct yaffs_tnode *tn,
+				u32 level, int *lo, int *hi)
+{
+	int i;
+	u32 base;
+	int blk;
+
+	if (!tn)
+		return;
+
+	if (level > 0) {
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			yaffs_map_blk_range(dev, tn->internal[i], level - 1,
+					    lo, hi);
+		return;
+	}
+
+	for (i = 0; i < YAFFS_NTNODES_LEVEL0; i++) {
+		base = yaffs_get_group_base(dev, tn, i);
+		if (!base)
+			continue;
+		blk = base / dev->param.chunks_per_block;
+		if (blk < *lo)
+			*lo = blk;
+		blk = (base + dev->chunk_grp_size - 1) /
+		    dev->param.chunks_per_block;
+		if (blk > *hi)
+			*hi = blk;
+	}
+}
+
+/* gc moved a chunk of an evicted file into block blk */
+static void yaffs_map_blk_add(struct yaffs_obj *obj, int blk)
+{
+	if (blk < obj->map_blk_lo)
+		obj->map_blk_lo = blk;
+	if (blk > obj->map_blk_hi)
+		obj->map_blk_hi = blk;
+}
+
+static void yaffs_free_tnode_tree(struct yaffs_dev *dev,
+				  struct yaffs_tnode *tn, u32 level)
+{
+	int i;
+
+	if (!tn)
+		return;
+
+	if (level > 0) {
+		for (i = 0; i < YAFFS_NTNODES_INTERNAL; i++)
+			yaffs_free_tnode_tree(dev, tn->internal[i], level - 1);
+	}
+	yaffs_free_tnode(dev, tn);
+}
+
+void yaffs_evict_file_map(struct yaffs_obj *obj)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+	struct yaffs_file_var *file_struct = &obj->variant.file_variant;
+
+	obj->map_blk_lo = dev->internal_end_block + 1;
+	obj->map_blk_hi = dev->internal_start_block - 1;
+	yaffs_map_blk_range(dev, file_struct->top, file_struct->top_level,
+			    &obj->map_blk_lo, &obj->map_blk_hi);
+	if (obj->map_blk_lo > obj->map_blk_hi && obj->n_data_chunks > 0) {
+		/* The map was never loaded (restored from a checkpoint
+		 * as evicted), so the chunks could be anywhere. */
+		obj->map_blk_lo = dev->internal_start_block;
+		obj->map_blk_hi = dev->internal_end_block;
+	}
+
+	yaffs_free_tnode_tree(dev, file_struct->top,
+			      file_struct->top_level);
+	file_struct->top = NULL;
+	file_struct->top_level = 0;
+	obj->map_evicted = 1;
+	list_del_init(&obj->map_lru);
+}
+
+static int yaffs_load_file_map(struct yaffs_obj *in)
+{
+	struct yaffs_dev *dev = in->my_dev;
+	struct yaffs_file_var *file_struct = &in->variant.file_variant;
+	struct yaffs_block_info *bi;
+	struct yaffs_ext_tags tags;
+	struct yaffs_tnode *tn;
+	int blk;
+	int c;
+	int nand_chunk;
+	int use_summary;
+	int ok = 1;
+
+	if (!in->map_evicted)
+		return YAFFS_OK;
+
+	file_struct->top = yaffs_get_tnode(dev);
+	if (!file_struct->top)
+		return YAFFS_FAIL;
+	file_struct->top_level = 0;
+	in->map_evicted = 0;
+
+	for (blk = in->map_blk_lo; ok && blk <= in->map_blk_hi; blk++) {
+		bi = yaffs_get_block_info(dev, blk);
+		if (bi->block_state != YAFFS_BLOCK_STATE_FULL &&
+		    bi->block_state != YAFFS_BLOCK_STATE_ALLOCATING &&
+		    bi->block_state != YAFFS_BLOCK_STATE_COLLECTING)
+			continue;
+		if (bi->pages_in_use < 1)
+			continue;
+
+		use_summary = bi->has_summary && dev->gc_sum_tags &&
+		    yaffs_summary_read(dev, dev->gc_sum_tags, blk) == YAFFS_OK;
+
+		for (c = 0; c < dev->param.chunks_per_block; c++) {
+			if (!yaffs_check_chunk_bit(dev, blk, c))
+				continue;
+
+			nand_chunk = blk * dev->param.chunks_per_block + c;
+			if (use_summary) {
+				if (c >= dev->chunks_per_summary)
+					break;
+				yaffs_summary_fetch_from(dev, dev->gc_sum_tags,
+							 &tags, c);
+			} else {
+				yaffs_rd_chunk_tags_nand(dev, nand_chunk,
+							 NULL, &tags);
+				if (!tags.chunk_used)
+					continue;
+			}
+
+			if (tags.obj_id != in->obj_id || tags.chunk_id < 1)
+				continue;
+
+			/* Load the tnode directly: n_data_chunks is
+			 * already correct. */
+			tn = yaffs_add_find_tnode_0(dev, file_struct,
+						    tags.chunk_id, NULL);
+			if (!tn) {
+				ok = 0;
+				break;
+			}
+			yaffs_load_tnode_0(dev, tn, tags.chunk_id, nand_chunk);
+		}
+	}
+
+	if (!ok) {
+		yaffs_trace(YAFFS_TRACE_ERROR,
+			"yaffs: could not rebuild map of object %d",
+			in->obj_id);
+		/* Drop the partial tree but keep the block range: it still
+		 * has to cover every chunk of the file for the next try. */
+		yaffs_free_tnode_tree(dev, file_struct->top,
+				      file_struct->top_level);
+		file_struct->top = NULL;
+		file_struct->top_level = 0;
+		in->map_evicted = 1;
+		return YAFFS_FAIL;
+	}
+
+	dev->n_map_rebuilds++;
+	list_add_tail(&in->map_lru, &dev->file_map_lru);
+	return YAFFS_OK;
+}
+
+/* Mark in as the hottest file map then, if over budget, evict the
+ * coldest maps down to the low water mark. Small single tnode maps are not
+ * worth the cost of a rebuild, so they are left alone.
+ */
+static int yaffs_file_map_access(struct yaffs_obj *in)
+{
+	struct yaffs_dev *dev = in->my_dev;
+	struct yaffs_obj *obj;
+	struct list_head *lh;
+	struct list_head *save;
+	u32 low_water;
+
+	if (yaffs_load_file_map(in) != YAFFS_OK)
+		return YAFFS_FAIL;
+
+	list_move_tail(&in->map_lru, &dev->file_map_lru);
+	in->map_seq = ++dev->map_access_seq;
+
+	if (!dev->param.tnode_budget || !dev->param.is_yaffs2)
+		return YAFFS_OK;
+
+	if ((u32)dev->n_tnodes * dev->tnode_size <= dev->param.tnode_budget)
+		return YAFFS_OK;
+
+	low_water = dev->param.tnode_budget - dev->param.tnode_budget / 8;
+
+	list_for_each_safe(lh, save, &dev->file_map_lru) {
+		if ((u32)dev->n_tnodes * dev->tnode_size <= low_water)
+			break;
+
+		obj = list_entry(lh, struct yaffs_obj, map_lru);
+		if (obj->variant_type != YAFFS_OBJECT_TYPE_FILE) {
+			list_del_init(&obj->map_lru);
+			continue;
+		}
+		/* The rest of the list is hotter still */
+		if (dev->map_access_seq - obj->map_seq < YAFFS_MAP_MIN_IDLE)
+			break;
+		if (obj == in ||
+		    obj->deleted || obj->soft_del || obj->unlinked ||
+		    obj->variant.file_variant.top_level < 1 ||
+		    yaffs_obj_cache_dirty(obj))
+			continue;
+
+		yaffs_evict_file_map(obj);
+		dev->n_map_evictions++;
+	}
+	return YAFFS_OK;
+}
+
 /* alloc_empty_obj gets us a clean Object.*/
 static struct yaffs_obj *yaffs_alloc_empty_obj(struct yaffs_dev *dev)
 {
@@ -1871,6 +2255,7 @@ static struct yaffs_obj *yaffs_alloc_empty_obj(struct yaffs_dev *dev)
 	INIT_LIST_HEAD(&(obj->hard_links));
 	INIT_LIST_HEAD(&(obj->hash_link));
 	INIT_LIST_HEAD(&obj->siblings);
+	INIT_LIST_HEAD(&obj->map_lru);
 
 	/* Now make the directory sane */
 	if (dev->root_dir) {
@@ -2006,6 +2391,7 @@ static struct yaffs_obj *yaffs_new_obj(struct yaffs_dev *dev, int number,
 						yaffs_max_file_size(dev);
 		the_obj->variant.file_variant.top_level = 0;
 		the_obj->variant.file_variant.top = tn;
+		list_add_tail(&the_obj->map_lru, &dev->file_map_lru);
 		break;
 	case YAFFS_OBJECT_TYPE_DIRECTORY:
 		INIT_LIST_HEAD(&the_obj->variant.dir_variant.children);
@@ -2058,6 +2444,7 @@ static void yaffs_init_tnodes_and_objs(struct yaffs_dev *dev)
 		INIT_LIST_HEAD(&dev->obj_bucket[i].list);
 		dev->obj_bucket[i].count = 0;
 	}
+	INIT_LIST_HEAD(&dev->file_map_lru);
 }
 
 struct yaffs_obj *yaffs_find_or_create_by_number(struct yaffs_dev *dev,
@@ -2310,6 +2697,16 @@ static void yaffs_deinit_blocks(struct yaffs_dev *dev)
 		kfree(dev->chunk_bits);
 	dev->chunk_bits_alt = 0;
 	dev->chunk_bits = NULL;
+
+	if (dev->empty_bits_alt && dev->empty_bits)
+		vfree(dev->empty_bits);
+	else
+		kfree(dev->empty_bits);
+	dev->empty_bits_alt = 0;
+	dev->empty_bits = NULL;
+
+	yaffs_gc_index_deinit(dev);
+	yaffs_scrub_deinit(dev);
 }
 
 static int yaffs_init_blocks(struct yaffs_dev *dev)
@@ -2318,6 +2715,9 @@ static int yaffs_init_blocks(struct yaffs_dev *dev)
 
 	dev->block_info = NULL;
 	dev->chunk_bits = NULL;
+	dev->empty_bits = NULL;
+	dev->gc_idx = NULL;
+	dev->block_fixed = NULL;
 	dev->alloc_block = -1;	/* force it to get a new one */
 
 	/* If the first allocation strategy fails, thry the alternate one */
@@ -2348,9 +2748,30 @@ static int yaffs_init_blocks(struct yaffs_dev *dev)
 	if (!dev->chunk_bits)
 		goto alloc_error;
 
+	/* Empty block bitmap, one bit per block rounded up to whole words */
+	dev->empty_bit_words = (n_blocks + 31) / 32;
+	dev->empty_bits =
+		kmalloc(dev->empty_bit_words * sizeof(u32), GFP_NOFS);
+	if (!dev->empty_bits) {
+		dev->empty_bits =
+		    vmalloc(dev->empty_bit_words * sizeof(u32));
+		dev->empty_bits_alt = 1;
+	} else {
+		dev->empty_bits_alt = 0;
+	}
+	if (!dev->empty_bits)
+		goto alloc_error;
 
 	memset(dev->block_info, 0, n_blocks * sizeof(struct yaffs_block_info));
 	memset(dev->chunk_bits, 0, dev->chunk_bit_stride * n_blocks);
+	memset(dev->empty_bits, 0, dev->empty_bit_words * sizeof(u32));
+
+	if (dev->param.gc_cost_benefit && !yaffs_gc_index_init(dev))
+		goto alloc_error;
+
+	if (!yaffs_scrub_init(dev))
+		goto alloc_error;
+
 	return YAFFS_OK;
 
 alloc_error:
@@ -2377,6 +2798,7 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 	yaffs2_clear_oldest_dirty_seq(dev, bi);
 
 	bi->block_state = YAFFS_BLOCK_STATE_DIRTY;
+	yaffs_gc_index_update(dev, block_no);
 
 	/* If this is the block being garbage collected then stop gc'ing */
 	if (block_no == dev->gc_block)
@@ -2432,8 +2854,10 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 	bi->skip_erased_check = 1;	/* Clean, so no need to check */
 	bi->gc_prioritise = 0;
 	bi->has_summary = 0;
+	yaffs_scrub_block_erased(dev, block_no);
 
 	yaffs_clear_chunk_bits(dev, block_no);
+	yaffs_set_empty_bit(dev, block_no);
 
 	yaffs_trace(YAFFS_TRACE_ERASE, "Erased block %d", block_no);
 }
@@ -2463,7 +2887,7 @@ static inline int yaffs_gc_process_chunk(struct yaffs_dev *dev,
 		if (tags.chunk_id == 0)
 			matching_chunk =
 			    object->hdr_chunk;
-		else if (object->soft_del)
+		else if (object->soft_del || object->map_evicted)
 			/* Defeat the test */
 			matching_chunk = old_chunk;
 		else
@@ -2570,10 +2994,15 @@ static inline int yaffs_gc_process_chunk(struct yaffs_dev *dev,
 				/* It's a header */
 				object->hdr_chunk = new_chunk;
 				object->serial = tags.serial_number;
-			} else {
-				/* It's a data chunk */
+			} else if (!object->map_evicted) {
+				/* It's a data chunk. An evicted map will
+				 * pick up the new location when rebuilt.
+				 */
 				yaffs_put_chunk_in_file(object, tags.chunk_id,
 							new_chunk, 0);
+			} else {
+				yaffs_map_blk_add(object, new_chunk /
+						  dev->param.chunks_per_block);
 			}
 		}
 	}
@@ -2602,8 +3031,10 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 
 	/*yaffs_verify_free_chunks(dev); */
 
-	if (bi->block_state == YAFFS_BLOCK_STATE_FULL)
+	if (bi->block_state == YAFFS_BLOCK_STATE_FULL) {
 		bi->block_state = YAFFS_BLOCK_STATE_COLLECTING;
+		yaffs_gc_index_update(dev, block);
+	}
 
 	bi->has_shrink_hdr = 0;	/* clear the flag so that the block can erase */
 
@@ -2649,6 +3080,7 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 		 * because checkpointing does not restore gc.
 		 */
 		bi->block_state = YAFFS_BLOCK_STATE_FULL;
+		yaffs_gc_index_update(dev, block);
 	} else {
 		/* The gc completed. */
 		/* Do any required cleanups */
@@ -2683,6 +3115,38 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 	return ret_val;
 }
 
+/*
+ * The most pages in use a block may have to be picked for gc.
+ * Aggressive gc takes any block that is not completely full; passive gc
+ * only takes a block with few pages in use, and background gc accepts
+ * more of them the longer it has gone without collecting.
+ */
+static int yaffs_gc_threshold(struct yaffs_dev *dev, int aggressive,
+			      int background)
+{
+	int threshold;
+	int max_threshold;
+
+	if (aggressive)
+		return dev->param.chunks_per_block;
+
+	if (background)
+		max_threshold = dev->param.chunks_per_block / 2;
+	else
+		max_threshold = dev->param.chunks_per_block / 8;
+
+	if (max_threshold < YAFFS_GC_PASSIVE_THRESHOLD)
+		max_threshold = YAFFS_GC_PASSIVE_THRESHOLD;
+
+	threshold = background ? (dev->gc_not_done + 2) * 2 : 0;
+	if (threshold < YAFFS_GC_PASSIVE_THRESHOLD)
+		threshold = YAFFS_GC_PASSIVE_THRESHOLD;
+	if (threshold > max_threshold)
+		threshold = max_threshold;
+
+	return threshold;
+}
+
 /*
  * find_gc_block() selects the dirtiest block (or close enough)
  * for garbage collection.
@@ -2737,30 +3201,24 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 	 * block has only a few pages in use.
 	 */
 
-	if (!selected) {
+	threshold = yaffs_gc_threshold(dev, aggressive, background);
+
+	if (!selected && dev->gc_idx) {
+		/* Cost-benefit selection off the gc index */
+		int pages_used = 0;
+
+		selected = yaffs_gc_index_find(dev, threshold, &pages_used);
+		if (selected) {
+			dev->gc_dirtiest = selected;
+			dev->gc_pages_in_use = pages_used;
+		}
+	} else if (!selected) {
 		int pages_used;
 		int n_blocks =
 		    dev->internal_end_block - dev->internal_start_block + 1;
 		if (aggressive) {
-			threshold = dev->param.chunks_per_block;
 			iterations = n_blocks;
 		} else {
-			int max_threshold;
-
-			if (background)
-				max_threshold = dev->param.chunks_per_block / 2;
-			else
-				max_threshold = dev->param.chunks_per_block / 8;
-
-			if (max_threshold < YAFFS_GC_PASSIVE_THRESHOLD)
-				max_threshold = YAFFS_GC_PASSIVE_THRESHOLD;
-
-			threshold = background ? (dev->gc_not_done + 2) * 2 : 0;
-			if (threshold < YAFFS_GC_PASSIVE_THRESHOLD)
-				threshold = YAFFS_GC_PASSIVE_THRESHOLD;
-			if (threshold > max_threshold)
-				threshold = max_threshold;
-
 			iterations = n_blocks / 16 + 1;
 			if (iterations > 100)
 				iterations = 100;
@@ -2968,7 +3426,10 @@ static int yaffs_rd_data_obj(struct yaffs_obj *in, int inode_chunk, u8 * buffer)
 	if (nand_chunk >= 0)
 		return yaffs_rd_chunk_tags_nand(in->my_dev, nand_chunk,
 						buffer, NULL);
-	else {
+	else if (nand_chunk == -ENOMEM) {
+		/* Do not let an unloadable map read back as zeros */
+		return nand_chunk;
+	} else {
 		yaffs_trace(YAFFS_TRACE_NANDACCESS,
 			"Chunk %d not found zero instead",
 			nand_chunk);
@@ -3027,6 +3488,7 @@ void yaffs_chunk_del(struct yaffs_dev *dev, int chunk_id, int mark_flash,
 		dev->n_free_chunks++;
 		yaffs_clear_chunk_bit(dev, block, page);
 		bi->pages_in_use--;
+		yaffs_gc_index_update(dev, block);
 
 		if (bi->pages_in_use == 0 &&
 		    !bi->has_shrink_hdr &&
@@ -3226,7 +3688,6 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 		return;
 
 	dev = in->my_dev;
-	in->lazy_loaded = 0;
 	buf = yaffs_get_temp_buffer(dev);
 
 	result = yaffs_rd_chunk_tags_nand(dev, in->hdr_chunk, buf, &tags);
@@ -3243,6 +3704,12 @@ static void yaffs_check_obj_details_loaded(struct yaffs_obj *in)
 			alloc_failed = 1;	/* Not returned */
 	}
 	yaffs_release_temp_buffer(dev, buf);
+
+	/* readdir may look at the name without the gross lock, see
+	 * yaffs_get_cached_obj_name(). Publish it before the flag.
+	 */
+	smp_wmb();
+	in->lazy_loaded = 0;
 }
 
 /* UpdateObjectHeader updates the header on NAND for an object.
@@ -3415,6 +3882,9 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 
 	dev = in->my_dev;
 
+	if (yaffs_file_map_access(in) != YAFFS_OK)
+		return -ENOMEM;
+
 	while (n > 0) {
 		yaffs_addr_to_chunk(dev, offset, &chunk, &start);
 		chunk++;
@@ -3500,6 +3970,12 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 
 	dev = in->my_dev;
 
+	/* A partial chunk write merges in the old data, so the map
+	 * must be there to find it.
+	 */
+	if (yaffs_load_file_map(in) != YAFFS_OK)
+		return -ENOMEM;
+
 	while (n > 0 && chunk_written >= 0) {
 		yaffs_addr_to_chunk(dev, offset, &chunk, &start);
 
@@ -3658,6 +4134,8 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 int yaffs_wr_file(struct yaffs_obj *in, const u8 *buffer, loff_t offset,
 		  int n_bytes, int write_through)
 {
+	if (yaffs_file_map_access(in) != YAFFS_OK)
+		return -ENOMEM;
 	yaffs2_handle_hole(in, offset);
 	return yaffs_do_file_wr(in, buffer, offset, n_bytes, write_through);
 }
@@ -3760,6 +4238,9 @@ int yaffs_resize_file(struct yaffs_obj *in, loff_t new_size)
 	if (new_size == old_size)
 		return YAFFS_OK;
 
+	if (yaffs_load_file_map(in) != YAFFS_OK)
+		return YAFFS_FAIL;
+
 	if (new_size > old_size) {
 		yaffs2_handle_hole(in, new_size);
 		in->variant.file_variant.file_size = new_size;
@@ -3858,8 +4339,9 @@ static int yaffs_del_file(struct yaffs_obj *in)
 			in->deleted = 1;
 			deleted = 1;
 			in->my_dev->n_deleted_files++;
-			yaffs_soft_del_file(in);
 		}
+		if (deleted && yaffs_soft_del_file(in) != YAFFS_OK)
+			deleted = 0;
 		return deleted ? YAFFS_OK : YAFFS_FAIL;
 	} else {
 		/* The file has no data chunks so we toss it immediately */
@@ -3961,6 +4443,7 @@ struct yaffs_obj *yaffs_retype_obj(struct yaffs_obj *obj,
 		yaffs_resize_file(obj, 0);
 		yaffs_free_tnode(obj->my_dev, obj->variant.file_variant.top);
 		obj->variant.file_variant.top = NULL;
+		list_del_init(&obj->map_lru);
 		break;
 	case YAFFS_OBJECT_TYPE_DIRECTORY:
 		/* Put the children in lost and found. */
@@ -4507,6 +4990,30 @@ int yaffs_get_obj_name(struct yaffs_obj *obj, YCHAR *name, int buffer_size)
 	return strnlen(name, YAFFS_MAX_NAME_LENGTH);
 }
 
+/*
+ * yaffs_get_cached_obj_name()
+ * As yaffs_get_obj_name() but only for names already held in RAM, so it
+ * never reads flash. Returns 0 if the caller has to use yaffs_get_obj_name()
+ * instead.
+ */
+int yaffs_get_cached_obj_name(struct yaffs_obj *obj, YCHAR *name,
+			      int buffer_size)
+{
+	if (obj->lazy_loaded)
+		return 0;
+	smp_rmb();
+
+	memset(name, 0, buffer_size * sizeof(YCHAR));
+	if (obj->obj_id == YAFFS_OBJECTID_LOSTNFOUND)
+		strncpy(name, YAFFS_LOSTNFOUND_NAME, buffer_size - 1);
+	else if (obj->short_name[0])
+		strncpy(name, obj->short_name, buffer_size - 1);
+	else
+		return 0;
+
+	return strnlen(name, YAFFS_MAX_NAME_LENGTH);
+}
+
 loff_t yaffs_get_obj_length(struct yaffs_obj *obj)
 {
 	/* Dereference any hard linking */
@@ -4672,6 +5179,8 @@ int yaffs_guts_ll_init(struct yaffs_dev *dev)
 	dev->n_free_chunks = 0;
 
 	dev->gc_block = 0;
+	dev->scrub_block = 0;
+	dev->scrub_finder = 0;
 
 	if (dev->param.start_block == 0) {
 		dev->internal_start_block = dev->param.start_block + 1;
@@ -4920,9 +5429,19 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		init_failed = 1;
 
 	if (!init_failed) {
+		u32 start_ms = Y_TIME_MS();
+
+		dev->mount_checkpt_ms = 0;
+		dev->mount_scan_ms = 0;
+
 		/* Now scan the flash. */
 		if (dev->param.is_yaffs2) {
-			if (yaffs2_checkpt_restore(dev)) {
+			int restored = yaffs2_checkpt_restore(dev);
+
+			dev->mount_checkpt_ms = Y_TIME_MS() - start_ms;
+			start_ms = Y_TIME_MS();
+
+			if (restored) {
 				yaffs_check_obj_details_loaded(dev->root_dir);
 				yaffs_trace(YAFFS_TRACE_CHECKPOINT |
 					YAFFS_TRACE_MOUNT,
@@ -4961,6 +5480,14 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 			init_failed = 1;
 		}
 
+		dev->mount_scan_ms = Y_TIME_MS() - start_ms;
+
+		/* Block states were set up wholesale by the scan or the
+		 * checkpoint restore, so build the empty block index now.
+		 */
+		yaffs_rebuild_empty_bits(dev);
+		yaffs_gc_index_rebuild(dev);
+
 		yaffs_strip_deleted_objs(dev);
 		yaffs_fix_hanging_objs(dev);
 		if (dev->param.empty_lost_n_found)
@@ -5060,12 +5587,12 @@ int yaffs_count_free_chunks(struct yaffs_dev *dev)
 	return n_free;
 }
 
-int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
+static int yaffs_reported_free_chunks(struct yaffs_dev *dev,
+				      int blocks_for_checkpt)
 {
 	/* This is what we report to the outside world */
 	int n_free;
 	int n_dirty_caches;
-	int blocks_for_checkpt;
 	int i;
 
 	n_free = dev->n_free_chunks;
@@ -5084,8 +5611,6 @@ int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
 	    ((dev->param.n_reserved_blocks + 1) * dev->param.chunks_per_block);
 
 	/* Now figure checkpoint space and report that... */
-	blocks_for_checkpt = yaffs_calc_checkpt_blocks_required(dev);
-
 	n_free -= (blocks_for_checkpt * dev->param.chunks_per_block);
 
 	if (n_free < 0)
@@ -5094,6 +5619,21 @@ int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
 	return n_free;
 }
 
+int yaffs_get_n_free_chunks(struct yaffs_dev *dev)
+{
+	return yaffs_reported_free_chunks(dev,
+				yaffs_calc_checkpt_blocks_required(dev));
+}
+
+/* For statfs without the gross lock. Only reads the counters, so the
+ * result may be a little stale but it never changes the device.
+ */
+int yaffs_peek_n_free_chunks(struct yaffs_dev *dev)
+{
+	return yaffs_reported_free_chunks(dev,
+				yaffs2_peek_checkpt_blocks_required(dev));
+}
+
 
 
 /*
@@ -79,7 +79,7 @@
 
 /* Binary data version stamps */
 #define YAFFS_SUMMARY_VERSION		1
-#define YAFFS_CHECKPOINT_VERSION	7
+#define YAFFS_CHECKPOINT_VERSION	8
 
 #ifdef CONFIG_YAFFS_UNICODE
 #define YAFFS_MAX_NAME_LENGTH		127
@@ -428,6 +428,8 @@ struct yaffs_obj {
 				 * or not. */
 	u8 has_xattr:1;		/* This object has xattribs.
 				 * Only valid if xattr_known. */
+	u8 map_evicted:1;	/* File chunk map freed to stay under the
+				 * tnode budget. Rebuilt on next use. */
 
 	u8 serial;		/* serial number of chunk in NAND.*/
 	u16 sum;		/* sum of the name to speed searching */
@@ -438,6 +440,11 @@ struct yaffs_obj {
 
 	struct list_head hard_links;	/* hard linked object chain*/
 
+	struct list_head map_lru;	/* file map LRU, coldest first */
+	u32 map_seq;		/* dev->map_access_seq at last file access */
+	int map_blk_lo;		/* Blocks that can hold chunks of an */
+	int map_blk_hi;		/* evicted map. */
+
 	/* directory structure stuff */
 	/* also used for linking up the free list */
 	struct yaffs_obj *parent;
@@ -497,6 +504,7 @@ struct yaffs_checkpt_obj {
 	u8 fake:1;
 	u8 rename_allowed:1;
 	u8 unlink_allowed:1;
+	u8 map_evicted:1;
 	u8 serial;
 	int n_data_chunks;
 	loff_t size_or_equiv_obj;
@@ -594,6 +602,21 @@ struct yaffs_param {
 	int disable_summary;
 	int disable_bad_block_marking;
 
+	int gc_cost_benefit;	/* Select gc victims by cost-benefit using
+				 * the gc index rather than by scanning. */
+
+	u32 tnode_budget;	/* yaffs2 only: bytes of tnodes to keep before
+				 * evicting cold file maps. 0 means no limit.
+				 */
+
+	int checkpt_lzo;	/* Write lzo compressed checkpoints. Needs
+				 * CONFIG_YAFFS_CHECKPOINT_LZO. */
+
+	int scrub_threshold;	/* Refresh a block once this many of its
+				 * chunks needed ECC correction during
+				 * scrubbing. 0 disables the scrubber,
+				 * values below 2 are ignored. */
+
 };
 
 struct yaffs_driver {
@@ -604,6 +627,12 @@ struct yaffs_driver {
 				   u8 *data, int data_len,
 				   u8 *oob, int oob_len,
 				   enum yaffs_ecc_result *ecc_result);
+	/* Optional: read spare_bytes_per_chunk bytes of spare from each of
+	 * n_chunks consecutive chunks, packed back to back in oob.
+	 * Used to read tags ahead while scanning.
+	 */
+	int (*drv_read_oob_fn) (struct yaffs_dev *dev, int nand_chunk,
+				int n_chunks, u8 *oob);
 	int (*drv_erase_fn) (struct yaffs_dev *dev, int block_no);
 	int (*drv_mark_bad_fn) (struct yaffs_dev *dev, int block_no);
 	int (*drv_check_bad_fn) (struct yaffs_dev *dev, int block_no);
@@ -681,6 +710,14 @@ struct yaffs_dev {
 	int checkpt_max_blocks;
 	u32 checkpt_sum;
 	u32 checkpt_xor;
+	u8 checkpt_lzo;		/* Stream is lzo compressed */
+	u8 *checkpt_seg;	/* Uncompressed segment */
+	u8 *checkpt_cseg;	/* Compressed segment */
+	void *checkpt_lzo_wrk;	/* lzo compressor work memory */
+	int checkpt_seg_len;
+	int checkpt_seg_pos;
+	u32 checkpt_lsum;	/* Sums of the uncompressed stream */
+	u32 checkpt_lxor;
 
 	int checkpoint_blocks_required;	/* Number of blocks needed to store
 					 * current checkpoint set */
@@ -693,6 +730,9 @@ struct yaffs_dev {
 	int chunk_bit_stride;	/* Number of bytes of chunk_bits per block.
 				 * Must be consistent with chunks_per_block.
 				 */
+	u32 *empty_bits;	/* bitmap of blocks in the EMPTY state */
+	u8 empty_bits_alt:1;	/* allocated using alternative alloc */
+	int empty_bit_words;	/* Number of u32 words in empty_bits */
 
 	int n_erased_blocks;
 	int alloc_block;	/* Current block being allocated off */
@@ -727,6 +767,15 @@ struct yaffs_dev {
 	unsigned gc_skip;
 	struct yaffs_summary_tags *gc_sum_tags;
 
+	/* gc index: FULL blocks bucketed by live page count */
+	int *gc_idx;		/* backing store for the arrays below */
+	u8 gc_idx_alt:1;	/* allocated using alternative alloc */
+	int *gc_idx_next;	/* per block list links */
+	int *gc_idx_prev;
+	int *gc_idx_bucket;	/* per block bucket, -1 if not listed */
+	int *gc_idx_head;	/* per bucket list heads */
+	int *gc_idx_tail;	/* per bucket list tails */
+
 	/* Special directories */
 	struct yaffs_obj *root_dir;
 	struct yaffs_obj *lost_n_found;
@@ -737,6 +786,12 @@ struct yaffs_dev {
 	struct yaffs_cache *cache;
 	int cache_last_use;
 
+	/* Background cache writeback, see yaffs_cache_wb_start() */
+	int cache_wb_mark;	/* cache_last_use at the previous pass */
+	int cache_wb_limit;	/* only write chunks last used up to here */
+	u32 cache_wb_obj;	/* elevator position: last written chunk */
+	int cache_wb_chunk;
+
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted
 					 files live. */
@@ -765,13 +820,30 @@ struct yaffs_dev {
 	int refresh_skip;	/* A skip down counter.
 				 * Refresh happens when this gets to zero. */
 
+	/* Background scrubbing, see yaffs_scrub.c */
+	int scrub_block;	/* block being scrubbed, 0 if none */
+	int scrub_chunk;	/* next chunk to read in scrub_block */
+	unsigned scrub_seq;	/* seq_number of scrub_block when started */
+	int scrub_finder;	/* where to look for the next block */
+	u8 *block_fixed;	/* per block count of corrected chunk reads,
+				 * only kept while scrubbing is enabled */
+	int block_fixed_alt;	/* block_fixed was vmalloc'd */
+
 	/* Dirty directory handling */
 	struct list_head dirty_dirs;	/* List of dirty directories */
 
+	/* Files with resident chunk maps, for eviction */
+	struct list_head file_map_lru;
+	u32 map_access_seq;
+
 	/* Summary */
 	int chunks_per_summary;
 	struct yaffs_summary_tags *sum_tags;
 
+	/* Tags read ahead while scanning */
+	u8 *tags_ahead_buf;	/* spare of every chunk in the block */
+	int tags_ahead_chunk;	/* first flash chunk held, -1 if none */
+
 	/* Statistics */
 	u32 n_page_writes;
 	u32 n_page_reads;
@@ -797,6 +869,17 @@ struct yaffs_dev {
 	u32 cache_hits;
 	u32 tags_used;
 	u32 summary_used;
+	u32 gc_idx_probes;
+	u32 n_tags_ahead;	/* blocks of tags read ahead while scanning */
+	u32 mount_checkpt_ms;	/* time spent restoring the checkpoint */
+	u32 mount_scan_ms;	/* time spent scanning */
+	u32 n_map_evictions;	/* file maps freed to meet tnode_budget */
+	u32 n_map_rebuilds;	/* file maps rebuilt from NAND */
+	u32 n_cache_wb;		/* dirty cache chunks written in background */
+	u32 n_scrub_chunks;	/* chunks read by the scrubber */
+	u32 n_scrub_blocks;	/* blocks scrubbed through to the end */
+	u32 n_scrub_fixed;	/* corrected chunks found by the scrubber */
+	u32 n_scrub_refreshes;	/* blocks sent for refresh by the scrubber */
 
 };
 
@@ -849,6 +932,7 @@ int yaffs_guts_initialise(struct yaffs_dev *dev);
 void yaffs_deinitialise(struct yaffs_dev *dev);
 
 int yaffs_get_n_free_chunks(struct yaffs_dev *dev);
+int yaffs_peek_n_free_chunks(struct yaffs_dev *dev);
 
 int yaffs_rename_obj(struct yaffs_obj *old_dir, const YCHAR * old_name,
 		     struct yaffs_obj *new_dir, const YCHAR * new_name);
@@ -860,6 +944,8 @@ struct yaffs_obj *yaffs_retype_obj(struct yaffs_obj *obj,
 
 
 int yaffs_get_obj_name(struct yaffs_obj *obj, YCHAR * name, int buffer_size);
+int yaffs_get_cached_obj_name(struct yaffs_obj *obj, YCHAR *name,
+			      int buffer_size);
 loff_t yaffs_get_obj_length(struct yaffs_obj *obj);
 int yaffs_get_obj_inode(struct yaffs_obj *obj);
 unsigned yaffs_get_obj_type(struct yaffs_obj *obj);
@@ -883,6 +969,9 @@ int yaffs_flush_file(struct yaffs_obj *in,
 
 /* Flushing and checkpointing */
 void yaffs_flush_whole_cache(struct yaffs_dev *dev, int discard);
+int yaffs_cache_n_dirty(struct yaffs_dev *dev);
+int yaffs_cache_wb_start(struct yaffs_dev *dev);
+int yaffs_cache_wb_next(struct yaffs_dev *dev);
 
 int yaffs_checkpoint_save(struct yaffs_dev *dev);
 int yaffs_checkpoint_restore(struct yaffs_dev *dev);
@@ -1007,4 +1096,6 @@ void yaffs_count_blocks_by_state(struct yaffs_dev *dev, int bs[10]);
 int yaffs_find_chunk_in_file(struct yaffs_obj *in, int inode_chunk,
 				    struct yaffs_ext_tags *tags);
 
+void yaffs_evict_file_map(struct yaffs_obj *obj);
+
 #endif
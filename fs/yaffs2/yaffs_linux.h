@@ -18,20 +18,54 @@
 
 #include "yportenv.h"
 
+#define YAFFS_N_OBJ_LOCKS	32
+
 struct yaffs_linux_context {
 	struct list_head context_list;	/* List of these we have mounted */
 	struct yaffs_dev *dev;
 	struct super_block *super;
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
-	struct mutex gross_lock;	/* Gross locking mutex*/
+	struct mutex gross_lock;	/* Allocator, gc, chunk cache, flash
+					 * and object metadata. File data
+					 * paths hold it a chunk at a time.
+					 */
+	struct mutex dir_lock;	/* Directory lists and search contexts,
+				 * taken inside gross_lock.
+				 */
+	struct mutex obj_lock[YAFFS_N_OBJ_LOCKS]; /* File data, hashed by
+						   * object id, taken
+						   * outside gross_lock.
+						   */
 	u8 *spare_buffer;	/* For mtdif2 use. Don't know the buffer size
 				 * at compile time so we have to allocate it.
 				 */
 	struct list_head search_contexts;
-	struct task_struct *readdir_process;
 	unsigned mount_id;
 	int dirty;
+
+#ifdef CONFIG_YAFFS_LOCK_STATS
+	/* gross_lock contention statistics, updated with the lock held */
+	u32 lock_acquires;
+	u32 lock_contended;	/* acquires that had to sleep */
+	u64 lock_wait_us;
+	u32 lock_max_wait_us;
+	u64 lock_hold_us;
+	u32 lock_max_hold_us;
+	void *lock_max_hold_at;	/* caller of the longest hold */
+	void *lock_holder_at;
+	ktime_t lock_taken;
+#endif
+
+	/* Data read-ahead, see yaffs_mtdif.c */
+	u8 *ra_buf;		/* YAFFS_MTD_RA_CHUNKS of data, then their oob */
+	int ra_chunk;		/* first chunk held */
+	int ra_count;		/* chunks held, 0 if none */
+	int ra_last;		/* last chunk asked for */
+	unsigned long ra_fixed;	/* held chunks whose ECC correction is not
+				 * reported yet, one bit each */
+	u32 ra_batches;		/* read-aheads issued */
+	u32 ra_hits;		/* chunk reads served from read-ahead */
 };
 
 #define yaffs_dev_to_lc(dev) ((struct yaffs_linux_context *)((dev)->os_context))
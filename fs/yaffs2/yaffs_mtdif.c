@@ -43,6 +43,9 @@
 #define mtd_block_markbad(m, offs) (m)->block_markbad(m, offs)
 #endif
 
+/* Chunks fetched in one go once chunk reads are found to be sequential */
+#define YAFFS_MTD_RA_CHUNKS	8
+
 
 
 int nandmtd_erase_block(struct yaffs_dev *dev, int block_no)
@@ -71,6 +74,95 @@ int nandmtd_erase_block(struct yaffs_dev *dev, int block_no)
 }
 
 
+/*
+ * Data read-ahead. Reading a file front to back asks for the chunks of a
+ * block in order, so once a read follows on from the previous one the
+ * rest of the block (up to YAFFS_MTD_RA_CHUNKS) is fetched with a single
+ * mtd_read_pages() call, which nand_base can stream with a cache read.
+ * A batch that needed ECC correction is kept too. mtd_read_pages() marks
+ * the pages that were corrected, and each one is reported as fixed when
+ * its chunk is handed out, so per block correction counts see the same
+ * results as single chunk reads. A batch with an uncorrectable page is
+ * dropped and each chunk is read on its own.
+ */
+static void yaffs_mtd_ra_invalidate(struct yaffs_dev *dev, int nand_chunk,
+				    int n_chunks)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+
+	if (lc->ra_count &&
+	    nand_chunk < lc->ra_chunk + lc->ra_count &&
+	    nand_chunk + n_chunks > lc->ra_chunk)
+		lc->ra_count = 0;
+}
+
+static int yaffs_mtd_ra_read(struct yaffs_dev *dev, int nand_chunk,
+			     u8 *data, int data_len, u8 *oob, int oob_len,
+			     enum yaffs_ecc_result *ecc_result)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	int chunk_size = dev->param.total_bytes_per_chunk;
+	struct mtd_oob_ops ops;
+	int n_chunks, idx;
+	int retval;
+
+	if (!lc->ra_buf || data_len != chunk_size || oob_len > mtd->oobavail)
+		return 0;
+
+	if (nand_chunk < lc->ra_chunk ||
+	    nand_chunk >= lc->ra_chunk + lc->ra_count) {
+		int last = lc->ra_last;
+
+		lc->ra_last = nand_chunk;
+		if (nand_chunk != last + 1)
+			return 0;
+
+		n_chunks = dev->param.chunks_per_block -
+			   nand_chunk % dev->param.chunks_per_block;
+		if (n_chunks > YAFFS_MTD_RA_CHUNKS)
+			n_chunks = YAFFS_MTD_RA_CHUNKS;
+		if (n_chunks < 2)
+			return 0;
+
+		memset(&ops, 0, sizeof(ops));
+		ops.mode = MTD_OPS_AUTO_OOB;
+		ops.len = n_chunks * chunk_size;
+		ops.ooblen = n_chunks * mtd->oobavail;
+		ops.datbuf = lc->ra_buf;
+		ops.oobbuf = lc->ra_buf + YAFFS_MTD_RA_CHUNKS * chunk_size;
+
+		lc->ra_count = 0;
+		lc->ra_fixed = 0;
+		retval = mtd_read_pages(mtd, ((loff_t) nand_chunk) * chunk_size,
+					&ops, &lc->ra_fixed);
+		if ((retval && retval != -EUCLEAN) || ops.retlen != ops.len)
+			return 0;
+
+		lc->ra_chunk = nand_chunk;
+		lc->ra_count = n_chunks;
+		lc->ra_batches++;
+	} else {
+		lc->ra_last = nand_chunk;
+		lc->ra_hits++;
+	}
+
+	idx = nand_chunk - lc->ra_chunk;
+	memcpy(data, lc->ra_buf + idx * chunk_size, chunk_size);
+	if (oob)
+		memcpy(oob, lc->ra_buf + YAFFS_MTD_RA_CHUNKS * chunk_size +
+		       idx * mtd->oobavail, oob_len);
+
+	if (__test_and_clear_bit(idx, &lc->ra_fixed)) {
+		dev->n_ecc_fixed++;
+		if (ecc_result)
+			*ecc_result = YAFFS_ECC_RESULT_FIXED;
+	} else if (ecc_result) {
+		*ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+	}
+	return 1;
+}
+
 static 	int yaffs_mtd_write(struct yaffs_dev *dev, int nand_chunk,
 				   const u8 *data, int data_len,
 				   const u8 *oob, int oob_len)
@@ -94,6 +186,8 @@ static 	int yaffs_mtd_write(struct yaffs_dev *dev, int nand_chunk,
 		oob_len = 0;
 	}
 
+	yaffs_mtd_ra_invalidate(dev, nand_chunk, 1);
+
 	addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
 	memset(&ops, 0, sizeof(ops));
 	ops.mode = MTD_OPS_AUTO_OOB;
@@ -121,6 +215,10 @@ static int yaffs_mtd_read(struct yaffs_dev *dev, int nand_chunk,
 	struct mtd_oob_ops ops;
 	int retval;
 
+	if (data && yaffs_mtd_ra_read(dev, nand_chunk, data, data_len,
+				      oob, oob_len, ecc_result))
+		return YAFFS_OK;
+
 	addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
 	memset(&ops, 0, sizeof(ops));
 	ops.mode = MTD_OPS_AUTO_OOB;
@@ -170,6 +268,44 @@ static int yaffs_mtd_read(struct yaffs_dev *dev, int nand_chunk,
 	return YAFFS_OK;
 }
 
+/*
+ * Read the spare of a run of chunks in one go. MTD walks the pages itself,
+ * so the chip can stream them rather than taking a full command sequence
+ * and driver round trip per chunk.
+ */
+static int yaffs_mtd_read_oob(struct yaffs_dev *dev, int nand_chunk,
+			      int n_chunks, u8 *oob)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	loff_t addr;
+	struct mtd_oob_ops ops;
+	int retval;
+
+	if (dev->param.spare_bytes_per_chunk != mtd->oobavail)
+		return YAFFS_FAIL;
+
+	addr = ((loff_t) nand_chunk) * dev->param.total_bytes_per_chunk;
+	memset(&ops, 0, sizeof(ops));
+	ops.mode = MTD_OPS_AUTO_OOB;
+	ops.len = 0;
+	ops.ooblen = n_chunks * mtd->oobavail;
+	ops.datbuf = NULL;
+	ops.oobbuf = oob;
+
+#if (MTD_VERSION_CODE < MTD_VERSION(2, 6, 20))
+	ops.len = ops.ooblen;
+#endif
+	retval = mtd_read_oob(mtd, addr, &ops);
+	if (retval || ops.oobretlen != ops.ooblen) {
+		yaffs_trace(YAFFS_TRACE_MTD,
+			"read_oob of %d chunks failed, chunk %d, mtd error %d",
+			n_chunks, nand_chunk, retval);
+		return YAFFS_FAIL;
+	}
+
+	return YAFFS_OK;
+}
+
 static 	int yaffs_mtd_erase(struct yaffs_dev *dev, int block_no)
 {
 	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
@@ -183,6 +319,9 @@ static 	int yaffs_mtd_erase(struct yaffs_dev *dev, int block_no)
 		     dev->param.chunks_per_block;
 	addr = ((loff_t) block_no) * block_size;
 
+	yaffs_mtd_ra_invalidate(dev, block_no * dev->param.chunks_per_block,
+				dev->param.chunks_per_block);
+
 	ei.mtd = mtd;
 	ei.addr = addr;
 	ei.len = block_size;
@@ -225,11 +364,34 @@ static int yaffs_mtd_check_bad(struct yaffs_dev *dev, int block_no)
 
 static int yaffs_mtd_initialise(struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+
+	BUILD_BUG_ON(YAFFS_MTD_RA_CHUNKS > BITS_PER_LONG);
+
+	lc->ra_count = 0;
+	lc->ra_last = -1;
+	lc->ra_fixed = 0;
+
+	/* Read-ahead only pays off where the device streams the pages,
+	 * which MTD NAND offers only on chips with NAND_CACHE_READ */
+	if (!mtd->read_pages || dev->param.chunks_per_block < 2)
+		return YAFFS_OK;
+
+	/* Not fatal, reads just go a chunk at a time */
+	lc->ra_buf = kmalloc(YAFFS_MTD_RA_CHUNKS *
+			     (dev->param.total_bytes_per_chunk + mtd->oobavail),
+			     GFP_NOFS);
 	return YAFFS_OK;
 }
 
 static int yaffs_mtd_deinitialise(struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+
+	kfree(lc->ra_buf);
+	lc->ra_buf = NULL;
+	lc->ra_count = 0;
 	return YAFFS_OK;
 }
 
@@ -240,6 +402,7 @@ void yaffs_mtd_drv_install(struct yaffs_dev *dev)
 
 	drv->drv_write_chunk_fn = yaffs_mtd_write;
 	drv->drv_read_chunk_fn = yaffs_mtd_read;
+	drv->drv_read_oob_fn = yaffs_mtd_read_oob;
 	drv->drv_erase_fn = yaffs_mtd_erase;
 	drv->drv_mark_bad_fn = yaffs_mtd_mark_bad;
 	drv->drv_check_bad_fn = yaffs_mtd_check_bad;
@@ -16,6 +16,7 @@
 
 #include "yaffs_getblockinfo.h"
 #include "yaffs_summary.h"
+#include "yaffs_scrub.h"
 
 static int apply_chunk_offset(struct yaffs_dev *dev, int chunk)
 {
@@ -36,17 +37,35 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 		tags = &local_tags;
 
 	result = dev->tagger.read_chunk_tags_fn(dev, flash_chunk, buffer, tags);
-	if (tags && tags->ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
+	if (tags && tags->ecc_result == YAFFS_ECC_RESULT_UNFIXED) {
 
 		struct yaffs_block_info *bi;
 		bi = yaffs_get_block_info(dev,
 					  nand_chunk /
 					  dev->param.chunks_per_block);
 		yaffs_handle_chunk_error(dev, bi);
+	} else if (tags && tags->ecc_result == YAFFS_ECC_RESULT_FIXED) {
+		/* Only counted, see yaffs_scrub.c */
+		yaffs_scrub_note_fixed(dev,
+				       nand_chunk / dev->param.chunks_per_block);
 	}
 	return result;
 }
 
+/* As yaffs_rd_chunk_tags_nand(), but ECC results are left to the caller
+ * and the read is not added to n_page_reads. Used by the scrubber, which
+ * counts corrected chunks itself, so they are not counted twice, and whose
+ * own reads must not look like foreground io to the background thread's
+ * rate limiter.
+ */
+int yaffs_rd_chunk_tags_nand_raw(struct yaffs_dev *dev, int nand_chunk,
+				 u8 *buffer, struct yaffs_ext_tags *tags)
+{
+	int flash_chunk = apply_chunk_offset(dev, nand_chunk);
+
+	return dev->tagger.read_chunk_tags_fn(dev, flash_chunk, buffer, tags);
+}
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 				int nand_chunk,
 				const u8 *buffer, struct yaffs_ext_tags *tags)
@@ -55,6 +74,7 @@ int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 	int flash_chunk = apply_chunk_offset(dev, nand_chunk);
 
 	dev->n_page_writes++;
+	dev->tags_ahead_chunk = -1;
 
 	if (!tags) {
 		yaffs_trace(YAFFS_TRACE_ERROR, "Writing with no tags");
@@ -76,6 +96,56 @@ int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 	return result;
 }
 
+/*
+ * Tags read ahead.
+ * While scanning, the spare areas of a whole block can be pulled in with a
+ * single driver call before the chunks are looked at one by one. The tags
+ * handler then unpacks tags from this buffer instead of going to the driver
+ * for each chunk.
+ */
+int yaffs_tags_ahead_init(struct yaffs_dev *dev)
+{
+	dev->tags_ahead_chunk = -1;
+
+	if (!dev->drv.drv_read_oob_fn ||
+	    dev->param.inband_tags ||
+	    dev->param.spare_bytes_per_chunk <= 0)
+		return YAFFS_OK;
+
+	dev->tags_ahead_buf = kmalloc(dev->param.chunks_per_block *
+				      dev->param.spare_bytes_per_chunk,
+				      GFP_NOFS);
+
+	return dev->tags_ahead_buf ? YAFFS_OK : YAFFS_FAIL;
+}
+
+void yaffs_tags_ahead_deinit(struct yaffs_dev *dev)
+{
+	kfree(dev->tags_ahead_buf);
+	dev->tags_ahead_buf = NULL;
+	dev->tags_ahead_chunk = -1;
+}
+
+void yaffs_rd_tags_ahead(struct yaffs_dev *dev, int block_no)
+{
+	int flash_chunk;
+
+	if (!dev->tags_ahead_buf)
+		return;
+
+	flash_chunk = apply_chunk_offset(dev,
+				block_no * dev->param.chunks_per_block);
+
+	if (dev->drv.drv_read_oob_fn(dev, flash_chunk,
+				     dev->param.chunks_per_block,
+				     dev->tags_ahead_buf) == YAFFS_OK) {
+		dev->tags_ahead_chunk = flash_chunk;
+		dev->n_tags_ahead++;
+	} else {
+		dev->tags_ahead_chunk = -1;
+	}
+}
+
 int yaffs_mark_bad(struct yaffs_dev *dev, int block_no)
 {
 	block_no -= dev->block_offset;
@@ -103,6 +173,7 @@ int yaffs_erase_block(struct yaffs_dev *dev, int block_no)
 
 	block_no -= dev->block_offset;
 	dev->n_erasures++;
+	dev->tags_ahead_chunk = -1;
 	result = dev->drv.drv_erase_fn(dev, block_no);
 	return result;
 }
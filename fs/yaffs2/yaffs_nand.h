@@ -20,12 +20,19 @@
 int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 			     u8 *buffer, struct yaffs_ext_tags *tags);
 
+int yaffs_rd_chunk_tags_nand_raw(struct yaffs_dev *dev, int nand_chunk,
+				 u8 *buffer, struct yaffs_ext_tags *tags);
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 *buffer, struct yaffs_ext_tags *tags);
 
 int yaffs_mark_bad(struct yaffs_dev *dev, int block_no);
 
+int yaffs_tags_ahead_init(struct yaffs_dev *dev);
+void yaffs_tags_ahead_deinit(struct yaffs_dev *dev);
+void yaffs_rd_tags_ahead(struct yaffs_dev *dev, int block_no);
+
 int yaffs_query_init_block_state(struct yaffs_dev *dev,
 				 int block_no,
 				 enum yaffs_block_state *state,
@@ -0,0 +1,214 @@
+/*
+ * YAFFS: Yet Another Flash File System. A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2011 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+/* The scrubber reads cold data so that the ECC gets a look at it.
+ *
+ * NAND cells slowly leak charge, and every read of a block disturbs the
+ * pages around the one being read. Both show up as correctable bit errors
+ * long before data is lost, but yaffs only notices them when the data
+ * happens to be read. Data that is written once and rarely read can decay
+ * unseen until the ECC can no longer fix it.
+ *
+ * The scrubber is off by default and enabled per mount. It walks the
+ * FULL blocks round robin, a few live chunks per call. Corrected reads
+ * are counted per block, whether they came from the scrubber or from
+ * normal use. Once scrub_threshold chunks in a block have needed
+ * correction, the block is prioritised for gc, which copies the data
+ * somewhere fresh. Corrections never count as strikes against the block,
+ * so a healthy block is not retired for them. A block that reads cleanly
+ * is left alone. Uncorrectable errors are treated as they are on any
+ * other read.
+ *
+ * Rate limiting is left to the caller, see the background thread in
+ * yaffs_vfs.c.
+ */
+
+#include "yaffs_scrub.h"
+#include "yaffs_getblockinfo.h"
+#include "yaffs_bitmap.h"
+#include "yaffs_nand.h"
+#include "yaffs_trace.h"
+
+/* yaffs2: skip blocks written within this many block allocations. Fresh
+ * data has had no time to decay, and is likely to be rewritten soon anyway.
+ */
+#define YAFFS_SCRUB_MIN_AGE	16
+
+static int yaffs_scrub_block_ok(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+
+	if (bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+	    bi->gc_prioritise || bi->pages_in_use == 0 ||
+	    blk == (int)dev->gc_block)
+		return 0;
+
+	if (dev->param.is_yaffs2 &&
+	    bi->seq_number + YAFFS_SCRUB_MIN_AGE > dev->seq_number)
+		return 0;
+
+	return 1;
+}
+
+int yaffs_scrub_init(struct yaffs_dev *dev)
+{
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+
+	dev->block_fixed = NULL;
+	dev->block_fixed_alt = 0;
+
+	if (dev->param.scrub_threshold < YAFFS_SCRUB_MIN_THRESHOLD)
+		return YAFFS_OK;
+
+	dev->block_fixed = kmalloc(n_blocks, GFP_NOFS);
+	if (!dev->block_fixed) {
+		dev->block_fixed = vmalloc(n_blocks);
+		dev->block_fixed_alt = 1;
+	}
+
+	if (!dev->block_fixed)
+		return YAFFS_FAIL;
+
+	memset(dev->block_fixed, 0, n_blocks);
+	return YAFFS_OK;
+}
+
+void yaffs_scrub_deinit(struct yaffs_dev *dev)
+{
+	if (dev->block_fixed_alt && dev->block_fixed)
+		vfree(dev->block_fixed);
+	else
+		kfree(dev->block_fixed);
+
+	dev->block_fixed_alt = 0;
+	dev->block_fixed = NULL;
+}
+
+/* A read of a chunk in blk needed ECC correction. */
+void yaffs_scrub_note_fixed(struct yaffs_dev *dev, int blk)
+{
+	struct yaffs_block_info *bi = yaffs_get_block_info(dev, blk);
+	u8 *count;
+
+	if (!dev->block_fixed || bi->gc_prioritise)
+		return;
+
+	count = &dev->block_fixed[blk - dev->internal_start_block];
+	if (*count < 255)
+		(*count)++;
+	if (*count < dev->param.scrub_threshold)
+		return;
+
+	yaffs_trace(YAFFS_TRACE_GC,
+		"scrub: block %d has %d corrected chunks, refreshing",
+		blk, *count);
+
+	bi->gc_prioritise = 1;
+	dev->has_pending_prioritised_gc = 1;
+	dev->n_scrub_refreshes++;
+	if (blk == dev->scrub_block)
+		dev->scrub_block = 0;
+}
+
+void yaffs_scrub_block_erased(struct yaffs_dev *dev, int blk)
+{
+	if (dev->block_fixed)
+		dev->block_fixed[blk - dev->internal_start_block] = 0;
+}
+
+/* Pick the next block to scrub. Returns 0 if there is none. */
+static int yaffs_scrub_find_block(struct yaffs_dev *dev)
+{
+	int n_blocks = dev->internal_end_block - dev->internal_start_block + 1;
+	int blk = dev->scrub_finder;
+	int i;
+
+	for (i = 0; i < n_blocks; i++) {
+		blk++;
+		if (blk < dev->internal_start_block ||
+		    blk > dev->internal_end_block)
+			blk = dev->internal_start_block;
+
+		if (yaffs_scrub_block_ok(dev, blk)) {
+			dev->scrub_finder = blk;
+			dev->scrub_block = blk;
+			dev->scrub_chunk = 0;
+			dev->scrub_seq =
+			    yaffs_get_block_info(dev, blk)->seq_number;
+			return blk;
+		}
+	}
+
+	dev->scrub_finder = blk;
+	return 0;
+}
+
+/*
+ * Read up to n_chunks live chunks, carrying on from where the last call
+ * left off. Returns the number of chunks read, 0 if there was nothing to
+ * scrub. Called with the gross lock held.
+ */
+int yaffs_scrub_step(struct yaffs_dev *dev, int n_chunks)
+{
+	struct yaffs_block_info *bi;
+	struct yaffs_ext_tags tags;
+	u8 *buffer;
+	int n_read = 0;
+	int chunk;
+
+	if (!dev->block_fixed || n_chunks < 1)
+		return 0;
+
+	buffer = yaffs_get_temp_buffer(dev);
+
+	while (n_read < n_chunks) {
+		/* The block may have been gc'd and reused since last time. */
+		if (dev->scrub_block &&
+		    (!yaffs_scrub_block_ok(dev, dev->scrub_block) ||
+		     yaffs_get_block_info(dev, dev->scrub_block)->seq_number !=
+		     dev->scrub_seq))
+			dev->scrub_block = 0;
+
+		if (!dev->scrub_block && !yaffs_scrub_find_block(dev))
+			break;
+
+		if (dev->scrub_chunk >= dev->param.chunks_per_block) {
+			dev->n_scrub_blocks++;
+			dev->scrub_block = 0;
+			continue;
+		}
+
+		chunk = dev->scrub_chunk++;
+		if (!yaffs_check_chunk_bit(dev, dev->scrub_block, chunk))
+			continue;
+
+		chunk += dev->scrub_block * dev->param.chunks_per_block;
+		memset(&tags, 0, sizeof(tags));
+		yaffs_rd_chunk_tags_nand_raw(dev, chunk, buffer, &tags);
+		dev->n_scrub_chunks++;
+		n_read++;
+
+		bi = yaffs_get_block_info(dev, dev->scrub_block);
+		if (tags.ecc_result == YAFFS_ECC_RESULT_UNFIXED) {
+			yaffs_handle_chunk_error(dev, bi);
+			dev->scrub_block = 0;
+		} else if (tags.ecc_result == YAFFS_ECC_RESULT_FIXED) {
+			dev->n_scrub_fixed++;
+			yaffs_scrub_note_fixed(dev, dev->scrub_block);
+		}
+	}
+
+	yaffs_release_temp_buffer(dev, buffer);
+
+	return n_read;
+}
@@ -0,0 +1,34 @@
+/*
+ * YAFFS: Yet another Flash File System . A NAND-flash specific file system.
+ *
+ * Copyright (C) 2002-2011 Aleph One Ltd.
+ *   for Toby Churchill Ltd and Brightstar Engineering
+ *
+ * Created by Charles Manning <charles@aleph1.co.uk>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License version 2.1 as
+ * published by the Free Software Foundation.
+ *
+ * Note: Only YAFFS headers are LGPL, YAFFS C code is covered by GPL.
+ */
+
+#ifndef __YAFFS_SCRUB_H__
+#define __YAFFS_SCRUB_H__
+
+#include "yaffs_guts.h"
+
+/* Scrubbing is off unless a mount asks for it. A block goes for refresh
+ * once this many of its chunks needed correction; a single correction is
+ * too common to act on.
+ */
+#define YAFFS_SCRUB_MIN_THRESHOLD	2
+#define YAFFS_SCRUB_DEF_THRESHOLD	4
+
+int yaffs_scrub_init(struct yaffs_dev *dev);
+void yaffs_scrub_deinit(struct yaffs_dev *dev);
+void yaffs_scrub_note_fixed(struct yaffs_dev *dev, int blk);
+void yaffs_scrub_block_erased(struct yaffs_dev *dev, int blk);
+int yaffs_scrub_step(struct yaffs_dev *dev, int n_chunks);
+
+#endif
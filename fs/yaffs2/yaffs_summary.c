@@ -98,9 +98,10 @@ int yaffs_summary_init(struct yaffs_dev *dev)
 	return YAFFS_OK;
 }
 
-static unsigned yaffs_summary_sum(struct yaffs_dev *dev)
+static unsigned yaffs_summary_sum(struct yaffs_dev *dev,
+				  struct yaffs_summary_tags *st)
 {
-	u8 *sum_buffer = (u8 *)dev->sum_tags;
+	u8 *sum_buffer = (u8 *)st;
 	int i;
 	unsigned sum = 0;
 
@@ -141,7 +142,7 @@ static int yaffs_summary_write(struct yaffs_dev *dev, int blk)
 	hdr.version = YAFFS_SUMMARY_VERSION;
 	hdr.block = blk;
 	hdr.seq = bi->seq_number;
-	hdr.sum = yaffs_summary_sum(dev);
+	hdr.sum = yaffs_summary_sum(dev, dev->sum_tags);
 
 	do {
 		this_tx = n_bytes;
@@ -236,7 +237,7 @@ int yaffs_summary_read(struct yaffs_dev *dev,
 		/* Verify header */
 		if (hdr.version != YAFFS_SUMMARY_VERSION ||
 		    hdr.seq != bi->seq_number ||
-		    hdr.sum != yaffs_summary_sum(dev))
+		    hdr.sum != yaffs_summary_sum(dev, st))
 			result = YAFFS_FAIL;
 	}
 
@@ -278,11 +279,20 @@ int yaffs_summary_add(struct yaffs_dev *dev,
 int yaffs_summary_fetch(struct yaffs_dev *dev,
 			struct yaffs_ext_tags *tags,
 			int chunk_in_block)
+{
+	return yaffs_summary_fetch_from(dev, dev->sum_tags, tags,
+					chunk_in_block);
+}
+
+int yaffs_summary_fetch_from(struct yaffs_dev *dev,
+			     struct yaffs_summary_tags *st,
+			     struct yaffs_ext_tags *tags,
+			     int chunk_in_block)
 {
 	struct yaffs_packed_tags2_tags_only tags_only;
 	struct yaffs_summary_tags *sum_tags;
 	if (chunk_in_block >= 0 && chunk_in_block < dev->chunks_per_summary) {
-		sum_tags = &dev->sum_tags[chunk_in_block];
+		sum_tags = &st[chunk_in_block];
 		tags_only.chunk_id = sum_tags->chunk_id;
 		tags_only.n_bytes = sum_tags->n_bytes;
 		tags_only.obj_id = sum_tags->obj_id;
@@ -28,6 +28,10 @@ int yaffs_summary_add(struct yaffs_dev *dev,
 int yaffs_summary_fetch(struct yaffs_dev *dev,
 			struct yaffs_ext_tags *tags,
 			int chunk_in_block);
+int yaffs_summary_fetch_from(struct yaffs_dev *dev,
+			     struct yaffs_summary_tags *st,
+			     struct yaffs_ext_tags *tags,
+			     int chunk_in_block);
 int yaffs_summary_read(struct yaffs_dev *dev,
 			struct yaffs_summary_tags *st,
 			int blk);
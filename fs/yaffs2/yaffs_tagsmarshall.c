@@ -83,7 +83,18 @@ static int yaffs_tags_marshall_read(struct yaffs_dev *dev,
 		}
 	}
 
-	if (dev->param.inband_tags || (data && !tags))
+	if (!data && tags && dev->tags_ahead_buf &&
+	    dev->tags_ahead_chunk >= 0 &&
+	    nand_chunk >= dev->tags_ahead_chunk &&
+	    nand_chunk < dev->tags_ahead_chunk + dev->param.chunks_per_block) {
+		/* Tags were read ahead, no need to go to the driver. */
+		memcpy(spare_buffer, dev->tags_ahead_buf +
+			(nand_chunk - dev->tags_ahead_chunk) *
+			dev->param.spare_bytes_per_chunk,
+			packed_tags_size);
+		ecc_result = YAFFS_ECC_RESULT_NO_ERROR;
+		retval = YAFFS_OK;
+	} else if (dev->param.inband_tags || (data && !tags))
 		retval = dev->drv.drv_read_chunk_fn(dev, nand_chunk,
 					data, dev->param.total_bytes_per_chunk,
 					NULL, 0,
@@ -118,10 +129,10 @@ static int yaffs_tags_marshall_read(struct yaffs_dev *dev,
 		dev->n_ecc_unfixed++;
 	}
 
-	if (tags && ecc_result == -YAFFS_ECC_RESULT_FIXED) {
+	/* The driver has already counted the fix in n_ecc_fixed. */
+	if (tags && ecc_result == YAFFS_ECC_RESULT_FIXED) {
 		if (tags->ecc_result <= YAFFS_ECC_RESULT_NO_ERROR)
 			tags->ecc_result = YAFFS_ECC_RESULT_FIXED;
-		dev->n_ecc_fixed++;
 	}
 
 	if (ecc_result < YAFFS_ECC_RESULT_UNFIXED)
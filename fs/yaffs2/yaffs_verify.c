@@ -241,6 +241,9 @@ void yaffs_verify_file(struct yaffs_obj *obj)
 	if (yaffs_skip_verification(obj->my_dev))
 		return;
 
+	if (obj->map_evicted)
+		return;
+
 	dev = obj->my_dev;
 	obj_id = obj->obj_id;
 
@@ -81,6 +81,8 @@
 #include <linux/smp_lock.h>
 #endif
 #include <linux/pagemap.h>
+#include <linux/pagevec.h>
+#include <linux/writeback.h>
 #include <linux/mtd/mtd.h>
 #include <linux/interrupt.h>
 #include <linux/string.h>
@@ -149,6 +151,15 @@
 #define YAFFS_SUPER_HAS_DIRTY
 #endif
 
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 27))
+#define YAFFS_USE_READPAGES 1
+#else
+#define YAFFS_USE_READPAGES 0
+#endif
+
+/* Pages handled per gross lock hold by readpages and writepages */
+#define YAFFS_PAGE_BATCH 16
+
 
 #if (LINUX_VERSION_CODE < KERNEL_VERSION(3, 2, 0))
 #define set_nlink(inode, count)  do { (inode)->i_nlink = (count); } while(0)
@@ -178,6 +189,7 @@ static uint32_t YCALCBLOCKS(uint64_t partition_size, uint32_t block_size)
 #include "yaffs_mtdif.h"
 #include "yaffs_packedtags2.h"
 #include "yaffs_getblockinfo.h"
+#include "yaffs_scrub.h"
 
 unsigned int yaffs_trace_mask =
 		YAFFS_TRACE_BAD_BLOCKS |
@@ -188,6 +200,8 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+unsigned int yaffs_cache_wb = 1;
+unsigned int yaffs_scrub_chunks = 4;
 unsigned int yaffs_auto_select = 1;
 /* Module Parameters */
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
@@ -196,6 +210,8 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_cache_wb, uint, 0644);
+module_param(yaffs_scrub_chunks, uint, 0644);
 #else
 MODULE_PARM(yaffs_trace_mask, "i");
 MODULE_PARM(yaffs_wr_attempts, "i");
@@ -252,8 +268,51 @@ MODULE_PARM(yaffs_gc_control, "i");
 
 static void yaffs_fill_inode_from_obj(struct inode *inode,
 				      struct yaffs_obj *obj);
+static void yaffs_set_super_dirty(struct yaffs_dev *dev);
+
+
+#ifdef CONFIG_YAFFS_LOCK_STATS
+/* The gross lock keeps count of how often it is contended and how long
+ * it is waited for and held. The longest hold is tagged with its caller
+ * so the worst offender shows up in /proc/yaffs.
+ */
+static noinline void yaffs_gross_lock(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	ktime_t start;
+	u32 wait_us;
 
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
+	if (!mutex_trylock(&lc->gross_lock)) {
+		start = ktime_get();
+		mutex_lock(&lc->gross_lock);
+		wait_us = ktime_us_delta(ktime_get(), start);
+		lc->lock_contended++;
+		lc->lock_wait_us += wait_us;
+		if (wait_us > lc->lock_max_wait_us)
+			lc->lock_max_wait_us = wait_us;
+	}
+	lc->lock_acquires++;
+	lc->lock_holder_at = __builtin_return_address(0);
+	lc->lock_taken = ktime_get();
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked %p", current);
+}
+
+static void yaffs_gross_unlock(struct yaffs_dev *dev)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	u32 hold_us = ktime_us_delta(ktime_get(), lc->lock_taken);
+
+	lc->lock_hold_us += hold_us;
+	if (hold_us > lc->lock_max_hold_us) {
+		lc->lock_max_hold_us = hold_us;
+		lc->lock_max_hold_at = lc->lock_holder_at;
+	}
 
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
+	mutex_unlock(&lc->gross_lock);
+}
+#else
 static void yaffs_gross_lock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
@@ -266,42 +325,120 @@ static void yaffs_gross_unlock(struct yaffs_dev *dev)
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
 	mutex_unlock(&(yaffs_dev_to_lc(dev)->gross_lock));
 }
+#endif
 
+/* The dir lock covers the directory child lists, the object names and types
+ * readdir reports, and the search contexts. Anything that changes those
+ * takes it inside the gross lock. readdir takes it on its own, so listing a
+ * directory does not wait behind file writes and gc.
+ */
+static void yaffs_dir_lock(struct yaffs_dev *dev)
+{
+	mutex_lock(&(yaffs_dev_to_lc(dev)->dir_lock));
+}
 
-static int yaffs_readpage_nolock(struct file *f, struct page *pg)
+static void yaffs_dir_unlock(struct yaffs_dev *dev)
 {
-	/* Lifted from jffs2 */
+	mutex_unlock(&(yaffs_dev_to_lc(dev)->dir_lock));
+}
 
-	struct yaffs_obj *obj;
-	unsigned char *pg_buf;
+/* File data is serialised per object. A read or write holds its object's
+ * lock for the whole transfer, but the gross lock only for one chunk at a
+ * time, so gc steps, lookups and io on other files get in between. The
+ * object locks are hashed by object id and taken after the page locks and
+ * before the gross lock.
+ */
+static void yaffs_obj_lock(struct yaffs_obj *obj)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(obj->my_dev);
+
+	mutex_lock(&lc->obj_lock[obj->obj_id % YAFFS_N_OBJ_LOCKS]);
+}
+
+static void yaffs_obj_unlock(struct yaffs_obj *obj)
+{
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(obj->my_dev);
+
+	mutex_unlock(&lc->obj_lock[obj->obj_id % YAFFS_N_OBJ_LOCKS]);
+}
+
+/* Read file data a chunk per gross lock hold. Called with the object
+ * lock held.
+ */
+static int yaffs_file_rd_chunked(struct yaffs_obj *obj, u8 *buf,
+				 loff_t pos, int n)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+	int n_done = 0;
+	int n_copy;
+	int chunk;
+	u32 start;
 	int ret;
-	loff_t pos = ((loff_t) pg->index) << PAGE_CACHE_SHIFT;
-	struct yaffs_dev *dev;
 
-	yaffs_trace(YAFFS_TRACE_OS,
-		"yaffs_readpage_nolock at %lld, size %08x",
-		(long long)pos,
-		(unsigned)PAGE_CACHE_SIZE);
+	while (n > 0) {
+		yaffs_addr_to_chunk(dev, pos, &chunk, &start);
+		n_copy = min_t(int, n, dev->data_bytes_per_chunk - start);
 
-	obj = yaffs_dentry_to_obj(f->f_dentry);
+		yaffs_gross_lock(dev);
+		ret = yaffs_file_rd(obj, buf, pos, n_copy);
+		yaffs_gross_unlock(dev);
 
-	dev = obj->my_dev;
+		if (ret < 0)
+			return ret;
 
-#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
-	BUG_ON(!PageLocked(pg));
-#else
-	if (!PageLocked(pg))
-		PAGE_BUG(pg);
-#endif
+		n -= n_copy;
+		pos += n_copy;
+		buf += n_copy;
+		n_done += n_copy;
+	}
+	return n_done;
+}
 
-	pg_buf = kmap(pg);
-	/* FIXME: Can kmap fail? */
+/* Write file data a chunk per gross lock hold. Called with the object
+ * lock held. Stops at the first short write.
+ */
+static int yaffs_wr_file_chunked(struct yaffs_obj *obj, const u8 *buf,
+				 loff_t pos, int n)
+{
+	struct yaffs_dev *dev = obj->my_dev;
+	int n_done = 0;
+	int n_copy;
+	int chunk;
+	u32 start;
+	int ret;
 
-	yaffs_gross_lock(dev);
+	while (n > 0) {
+		yaffs_addr_to_chunk(dev, pos, &chunk, &start);
+		n_copy = min_t(int, n, dev->data_bytes_per_chunk - start);
 
-	ret = yaffs_file_rd(obj, pg_buf, pos, PAGE_CACHE_SIZE);
+		yaffs_gross_lock(dev);
+		ret = yaffs_wr_file(obj, buf, pos, n_copy, 0);
+		yaffs_set_super_dirty(dev);
+		yaffs_gross_unlock(dev);
 
-	yaffs_gross_unlock(dev);
+		if (ret > 0)
+			n_done += ret;
+		if (ret != n_copy)
+			return n_done ? n_done : ret;
+
+		n -= n_copy;
+		pos += n_copy;
+		buf += n_copy;
+	}
+	return n_done;
+}
+
+/* Read one locked page from the file. Called with the object lock held. */
+static int yaffs_readpage_fill(struct yaffs_obj *obj, struct page *pg)
+{
+	unsigned char *pg_buf;
+	int ret;
+	loff_t pos = ((loff_t) pg->index) << PAGE_CACHE_SHIFT;
+
+	pg_buf = kmap(pg);
+	/* FIXME: Can kmap fail? */
+
+	ret = yaffs_file_rd_chunked(obj, pg_buf, pos, PAGE_CACHE_SIZE);
 
 	if (ret >= 0)
 		ret = 0;
@@ -317,6 +454,37 @@ static int yaffs_readpage_nolock(struct file *f, struct page *pg)
 	flush_dcache_page(pg);
 	kunmap(pg);
 
+	return ret;
+}
+
+static int yaffs_readpage_nolock(struct file *f, struct page *pg)
+{
+	/* Lifted from jffs2 */
+
+	struct yaffs_obj *obj;
+	int ret;
+	loff_t pos = ((loff_t) pg->index) << PAGE_CACHE_SHIFT;
+
+	yaffs_trace(YAFFS_TRACE_OS,
+		"yaffs_readpage_nolock at %lld, size %08x",
+		(long long)pos,
+		(unsigned)PAGE_CACHE_SIZE);
+
+	obj = yaffs_dentry_to_obj(f->f_dentry);
+
+#if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 5, 0))
+	BUG_ON(!PageLocked(pg));
+#else
+	if (!PageLocked(pg))
+		PAGE_BUG(pg);
+#endif
+
+	yaffs_obj_lock(obj);
+
+	ret = yaffs_readpage_fill(obj, pg);
+
+	yaffs_obj_unlock(obj);
+
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_readpage_nolock done");
 	return ret;
 }
@@ -338,6 +506,66 @@ static int yaffs_readpage(struct file *f, struct page *pg)
 	return ret;
 }
 
+#if (YAFFS_USE_READPAGES > 0)
+/* Read a batch of new, locked pages in one object lock hold, then unlock
+ * them. The page locks are always taken before the object lock, the same
+ * order as readpage.
+ */
+static void yaffs_readpages_batch(struct yaffs_obj *obj,
+				  struct page **pages, int n)
+{
+	int i;
+
+	yaffs_obj_lock(obj);
+	for (i = 0; i < n; i++)
+		yaffs_readpage_fill(obj, pages[i]);
+	yaffs_obj_unlock(obj);
+
+	for (i = 0; i < n; i++)
+		unlock_page(pages[i]);
+}
+
+/* The readahead window arrives highest index first. Take it from the tail
+ * so that the chunks are read in file order.
+ */
+static int yaffs_readpages(struct file *f, struct address_space *mapping,
+			   struct list_head *pages, unsigned nr_pages)
+{
+	struct yaffs_obj *obj = yaffs_dentry_to_obj(f->f_dentry);
+	struct page *batch[YAFFS_PAGE_BATCH];
+	struct page *pg;
+	int n = 0;
+	int i;
+
+	yaffs_trace(YAFFS_TRACE_OS, "yaffs_readpages %u pages", nr_pages);
+
+	while (!list_empty(pages)) {
+		pg = list_entry(pages->prev, struct page, lru);
+		list_del(&pg->lru);
+
+		if (add_to_page_cache_lru(pg, mapping, pg->index,
+					  GFP_KERNEL)) {
+			page_cache_release(pg);
+			continue;
+		}
+
+		batch[n++] = pg;
+		if (n == YAFFS_PAGE_BATCH) {
+			yaffs_readpages_batch(obj, batch, n);
+			for (i = 0; i < n; i++)
+				page_cache_release(batch[i]);
+			n = 0;
+		}
+	}
+
+	yaffs_readpages_batch(obj, batch, n);
+	for (i = 0; i < n; i++)
+		page_cache_release(batch[i]);
+
+	return 0;
+}
+#endif
+
 
 static void yaffs_set_super_dirty_val(struct yaffs_dev *dev, int val)
 {
@@ -388,7 +616,6 @@ static int yaffs_check_super_dirty(struct yaffs_dev *dev)
 
 static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 {
-	struct yaffs_dev *dev;
 	struct address_space *mapping = page->mapping;
 	struct inode *inode;
 	unsigned long end_index;
@@ -436,8 +663,7 @@ static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 	buffer = kmap(page);
 
 	obj = yaffs_inode_to_obj(inode);
-	dev = obj->my_dev;
-	yaffs_gross_lock(dev);
+	yaffs_obj_lock(obj);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_writepage at %lld, size %08x",
@@ -446,16 +672,14 @@ static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 		"writepag0: obj = %lld, ino = %lld",
 		obj->variant.file_variant.file_size, inode->i_size);
 
-	n_written = yaffs_wr_file(obj, buffer,
-				  ((loff_t)page->index) << PAGE_CACHE_SHIFT, n_bytes, 0);
-
-	yaffs_set_super_dirty(dev);
+	n_written = yaffs_wr_file_chunked(obj, buffer,
+				  ((loff_t)page->index) << PAGE_CACHE_SHIFT, n_bytes);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"writepag1: obj = %lld, ino = %lld",
 		obj->variant.file_variant.file_size, inode->i_size);
 
-	yaffs_gross_unlock(dev);
+	yaffs_obj_unlock(obj);
 
 	kunmap(page);
 	set_page_writeback(page);
@@ -466,6 +690,160 @@ static int yaffs_writepage(struct page *page, struct writeback_control *wbc)
 	return (n_written == n_bytes) ? 0 : -ENOSPC;
 }
 
+#if (YAFFS_USE_READPAGES > 0)
+/* Write a batch of locked pages, already cleared for io, in one object
+ * lock hold.
+ */
+static int yaffs_writepages_batch(struct inode *inode,
+				  struct page **pages, int n)
+{
+	struct yaffs_obj *obj = yaffs_inode_to_obj(inode);
+	loff_t i_size = i_size_read(inode);
+	struct page *page;
+	char *buffer;
+	loff_t pos;
+	unsigned n_bytes;
+	int n_written;
+	int ret = 0;
+	int i;
+
+	if (n < 1)
+		return 0;
+
+	yaffs_obj_lock(obj);
+
+	for (i = 0; i < n; i++) {
+		page = pages[i];
+		pos = ((loff_t)page->index) << PAGE_CACHE_SHIFT;
+
+		if (pos >= i_size)
+			n_bytes = 0;
+		else if (i_size - pos < PAGE_CACHE_SIZE)
+			n_bytes = i_size - pos;
+		else
+			n_bytes = PAGE_CACHE_SIZE;
+
+		if (n_bytes != PAGE_CACHE_SIZE)
+			zero_user_segment(page, n_bytes, PAGE_CACHE_SIZE);
+
+		if (!n_bytes)
+			continue;
+
+		buffer = kmap(page);
+		n_written = yaffs_wr_file_chunked(obj, buffer, pos, n_bytes);
+		kunmap(page);
+
+		if (n_written != n_bytes) {
+			SetPageError(page);
+			ret = -ENOSPC;
+		}
+	}
+
+	yaffs_obj_unlock(obj);
+
+	for (i = 0; i < n; i++) {
+		set_page_writeback(pages[i]);
+		unlock_page(pages[i]);
+		end_page_writeback(pages[i]);
+	}
+
+	return ret;
+}
+
+/* Gather the dirty pages of a range in index order and write them in
+ * batches, so a dirty range costs one object lock hold per batch rather
+ * than per page. Cyclic writeback resumes at mapping->writeback_index and
+ * wraps, as write_cache_pages() does.
+ */
+static int yaffs_writepages(struct address_space *mapping,
+			    struct writeback_control *wbc)
+{
+	struct inode *inode = mapping->host;
+	struct pagevec pvec;
+	struct page *batch[YAFFS_PAGE_BATCH];
+	struct page *page;
+	pgoff_t writeback_index = 0;
+	pgoff_t index;
+	pgoff_t end;
+	pgoff_t done_index;
+	unsigned nr_pages;
+	int n;
+	int i;
+	int ret = 0;
+	int done = 0;
+	int cycled;
+	int range_whole = 0;
+
+	if (wbc->range_cyclic) {
+		writeback_index = mapping->writeback_index;
+		index = writeback_index;
+		cycled = (index == 0);
+		end = -1;
+	} else {
+		index = wbc->range_start >> PAGE_CACHE_SHIFT;
+		end = wbc->range_end >> PAGE_CACHE_SHIFT;
+		if (wbc->range_start == 0 && wbc->range_end == LLONG_MAX)
+			range_whole = 1;
+		cycled = 1;
+	}
+
+	pagevec_init(&pvec, 0);
+
+retry:
+	done_index = index;
+	while (!done && index <= end) {
+		nr_pages = pagevec_lookup_tag(&pvec, mapping, &index,
+				PAGECACHE_TAG_DIRTY,
+				min(end - index,
+				    (pgoff_t)YAFFS_PAGE_BATCH - 1) + 1);
+		if (!nr_pages)
+			break;
+
+		n = 0;
+		for (i = 0; i < nr_pages; i++) {
+			page = pvec.pages[i];
+			if (page->index > end) {
+				done = 1;
+				break;
+			}
+			done_index = page->index + 1;
+
+			lock_page(page);
+			if (page->mapping != mapping ||
+			    PageWriteback(page) ||
+			    !clear_page_dirty_for_io(page)) {
+				unlock_page(page);
+				continue;
+			}
+			batch[n++] = page;
+		}
+
+		ret = yaffs_writepages_batch(inode, batch, n);
+		pagevec_release(&pvec);
+
+		wbc->nr_to_write -= n;
+		if (ret ||
+		    (wbc->nr_to_write <= 0 && wbc->sync_mode == WB_SYNC_NONE))
+			done = 1;
+
+		cond_resched();
+	}
+
+	if (!cycled && !done) {
+		/* Hit the end of the file: wrap back to the start */
+		cycled = 1;
+		index = 0;
+		end = writeback_index - 1;
+		goto retry;
+	}
+
+	if (wbc->range_cyclic || (range_whole && wbc->nr_to_write > 0))
+		mapping->writeback_index = done_index;
+
+	return ret;
+}
+#endif
+
 /* Space holding and freeing is done to ensure we have space available for write_begin/end */
 /* For now we just assume few parallel writes and check against a small number. */
 /* Todo: need to do this with a counter to handle parallel reads better */
@@ -585,7 +963,6 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 	int n_written;
 	loff_t ipos;
 	struct inode *inode;
-	struct yaffs_dev *dev;
 
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 
@@ -595,9 +972,7 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
                 return -EINVAL;
         }
 
-	dev = obj->my_dev;
-
-	yaffs_gross_lock(dev);
+	yaffs_obj_lock(obj);
 
 	inode = f->f_dentry->d_inode;
 
@@ -610,9 +985,7 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 		"yaffs_file_write about to write writing %u(%x) bytes to object %d at %lld",
 		(unsigned)n, (unsigned)n, obj->obj_id, ipos);
 
-	n_written = yaffs_wr_file(obj, buf, ipos, n, 0);
-
-	yaffs_set_super_dirty(dev);
+	n_written = yaffs_wr_file_chunked(obj, buf, ipos, n);
 
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_file_write: %d(%x) bytes written",
@@ -631,7 +1004,7 @@ static ssize_t yaffs_file_write(struct file *f, const char *buf, size_t n,
 		}
 
 	}
-	yaffs_gross_unlock(dev);
+	yaffs_obj_unlock(obj);
 	return (n_written == 0) && (n > 0) ? -ENOSPC : n_written;
 }
 
@@ -707,6 +1080,10 @@ static int yaffs_commit_write(struct file *f, struct page *pg, unsigned offset,
 static struct address_space_operations yaffs_file_address_operations = {
 	.readpage = yaffs_readpage,
 	.writepage = yaffs_writepage,
+#if (YAFFS_USE_READPAGES > 0)
+	.readpages = yaffs_readpages,
+	.writepages = yaffs_writepages,
+#endif
 #if (YAFFS_USE_WRITE_BEGIN_END > 0)
 	.write_begin = yaffs_write_begin,
 	.write_end = yaffs_write_end,
@@ -732,11 +1109,13 @@ static int yaffs_file_flush(struct file *file)
 		obj->obj_id,
 		obj->dirty ? "dirty" : "clean");
 
+	yaffs_obj_lock(obj);
 	yaffs_gross_lock(dev);
 
 	yaffs_flush_file(obj, 1, 0, 0);
 
 	yaffs_gross_unlock(dev);
+	yaffs_obj_unlock(obj);
 
 	return 0;
 }
@@ -763,9 +1142,11 @@ static int yaffs_sync_object(struct file *file, struct dentry *dentry,
 
 	yaffs_trace(YAFFS_TRACE_OS | YAFFS_TRACE_SYNC,
 		"yaffs_sync_object");
+	yaffs_obj_lock(obj);
 	yaffs_gross_lock(dev);
 	yaffs_flush_file(obj, 1, datasync, 0);
 	yaffs_gross_unlock(dev);
+	yaffs_obj_unlock(obj);
 	return 0;
 }
 
@@ -847,6 +1228,8 @@ static int yaffs_setattr(struct dentry *dentry, struct iattr *attr)
 				(int)(attr->ia_size),
 				(int)(attr->ia_size));
 		}
+		/* A resize changes the file data too */
+		yaffs_obj_lock(yaffs_inode_to_obj(inode));
 		yaffs_gross_lock(dev);
 		result = yaffs_set_attribs(yaffs_inode_to_obj(inode), attr);
 		if (result == YAFFS_OK) {
@@ -855,6 +1238,7 @@ static int yaffs_setattr(struct dentry *dentry, struct iattr *attr)
 			error = -EPERM;
 		}
 		yaffs_gross_unlock(dev);
+		yaffs_obj_unlock(yaffs_inode_to_obj(inode));
 
 	}
 
@@ -1123,15 +1507,13 @@ static void yaffs_read_inode(struct inode *inode)
 	yaffs_trace(YAFFS_TRACE_OS,
 		"yaffs_read_inode for %d", (int)inode->i_ino);
 
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_lock(dev);
+	yaffs_gross_lock(dev);
 
 	obj = yaffs_find_by_number(dev, inode->i_ino);
 
 	yaffs_fill_inode_from_obj(inode, obj);
 
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_unlock(dev);
+	yaffs_gross_unlock(dev);
 }
 
 #endif
@@ -1239,6 +1621,7 @@ static int yaffs_mknod(struct inode *dir, struct dentry *dentry, int mode,
 	dev = parent->my_dev;
 
 	yaffs_gross_lock(dev);
+	yaffs_dir_lock(dev);
 
 	switch (mode & S_IFMT) {
 	default:
@@ -1271,6 +1654,7 @@ static int yaffs_mknod(struct inode *dir, struct dentry *dentry, int mode,
 	}
 
 	/* Can not call yaffs_get_inode() with gross lock held */
+	yaffs_dir_unlock(dev);
 	yaffs_gross_unlock(dev);
 
 	if (obj) {
@@ -1335,8 +1719,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 
 	struct yaffs_dev *dev = yaffs_inode_to_obj(dir)->my_dev;
 
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_lock(dev);
+	yaffs_gross_lock(dev);
 
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_lookup for %d:%s",
 		yaffs_inode_to_obj(dir)->obj_id, dentry->d_name.name);
@@ -1346,8 +1729,7 @@ static struct dentry *yaffs_lookup(struct inode *dir, struct dentry *dentry)
 	obj = yaffs_get_equivalent_obj(obj);	/* in case it was a hardlink */
 
 	/* Can't hold gross lock when calling yaffs_get_inode() */
-	if (current != yaffs_dev_to_lc(dev)->readdir_process)
-		yaffs_gross_unlock(dev);
+	yaffs_gross_unlock(dev);
 
 	if (obj) {
 		yaffs_trace(YAFFS_TRACE_OS,
@@ -1384,10 +1766,13 @@ static int yaffs_link(struct dentry *old_dentry, struct inode *dir,
 
 	yaffs_gross_lock(dev);
 
-	if (!S_ISDIR(inode->i_mode))	/* Don't link directories */
+	if (!S_ISDIR(inode->i_mode)) {	/* Don't link directories */
+		yaffs_dir_lock(dev);
 		link =
 		    yaffs_link_obj(yaffs_inode_to_obj(dir), dentry->d_name.name,
 				   obj);
+		yaffs_dir_unlock(dev);
+	}
 
 	if (link) {
 		set_nlink(old_dentry->d_inode, yaffs_get_obj_link_count(obj));
@@ -1430,8 +1815,10 @@ static int yaffs_symlink(struct inode *dir, struct dentry *dentry,
 
 	dev = yaffs_inode_to_obj(dir)->my_dev;
 	yaffs_gross_lock(dev);
+	yaffs_dir_lock(dev);
 	obj = yaffs_create_symlink(yaffs_inode_to_obj(dir), dentry->d_name.name,
 				   S_IFLNK | S_IRWXUGO, uid, gid, symname);
+	yaffs_dir_unlock(dev);
 	yaffs_gross_unlock(dev);
 
 	if (obj) {
@@ -1480,10 +1867,12 @@ static int yaffs_rename(struct inode *old_dir, struct dentry *old_dentry,
 		/* Now does unlinking internally using shadowing mechanism */
 		yaffs_trace(YAFFS_TRACE_OS, "calling yaffs_rename_obj");
 
+		yaffs_dir_lock(dev);
 		ret_val = yaffs_rename_obj(yaffs_inode_to_obj(old_dir),
 					   old_dentry->d_name.name,
 					   yaffs_inode_to_obj(new_dir),
 					   new_dentry->d_name.name);
+		yaffs_dir_unlock(dev);
 	}
 	yaffs_gross_unlock(dev);
 
@@ -1517,7 +1906,9 @@ static int yaffs_unlink(struct inode *dir, struct dentry *dentry)
 
 	yaffs_gross_lock(dev);
 
+	yaffs_dir_lock(dev);
 	ret_val = yaffs_unlinker(obj, dentry->d_name.name);
+	yaffs_dir_unlock(dev);
 
 	if (ret_val == YAFFS_OK) {
 		inode_dec_link_count(dentry->d_inode);
@@ -1565,7 +1956,7 @@ static const struct inode_operations yaffs_dir_inode_operations = {
  *
  * A seach context lives for the duration of a readdir.
  *
- * All these functions must be called while yaffs is locked.
+ * All these functions must be called with the dir lock held.
  */
 
 struct yaffs_search_context {
@@ -1646,8 +2037,16 @@ static void yaffs_remove_obj_callback(struct yaffs_obj *obj)
 
 	struct list_head *i;
 	struct yaffs_search_context *sc;
+	struct yaffs_dev *dev = obj->my_dev;
 	struct list_head *search_contexts =
-	    &(yaffs_dev_to_lc(obj->my_dev)->search_contexts);
+	    &(yaffs_dev_to_lc(dev)->search_contexts);
+
+	/* Nobody can readdir the unlinked and deleted directories. gc
+	 * finishes off deleted files without the dir lock, so stay away from
+	 * the search contexts for those.
+	 */
+	if (obj->parent == dev->unlinked_dir || obj->parent == dev->del_dir)
+		return;
 
 	/* Iterate through the directory search contexts.
 	 * If any are currently on the object being removed, then advance
@@ -1662,6 +2061,44 @@ static void yaffs_remove_obj_callback(struct yaffs_obj *obj)
 }
 
 
+/*
+ * yaffs_readdir_entry() gets the name, inode number and type of the object
+ * the search context is on. Called with the dir lock held.
+ *
+ * Most names are held in RAM. Longer ones, and objects that are still lazy
+ * loaded, have to be read from flash under the gross lock. That has to be
+ * taken before the dir lock, so the search may move on meanwhile.
+ *
+ * Returns 0 if the search has run out of objects.
+ */
+static int yaffs_readdir_entry(struct yaffs_search_context *sc, char *name,
+			       int *this_inode, int *this_type)
+{
+	struct yaffs_dev *dev = sc->dev;
+	struct yaffs_obj *l = sc->next_return;
+
+	if (l &&
+	    yaffs_get_cached_obj_name(l, name, YAFFS_MAX_NAME_LENGTH + 1) < 1) {
+		yaffs_dir_unlock(dev);
+		yaffs_gross_lock(dev);
+		yaffs_dir_lock(dev);
+		l = sc->next_return;
+		if (l)
+			yaffs_get_obj_name(l, name, YAFFS_MAX_NAME_LENGTH + 1);
+		yaffs_gross_unlock(dev);
+	}
+
+	if (!l)
+		return 0;
+
+	*this_inode = yaffs_get_obj_inode(l);
+	*this_type = yaffs_get_obj_type(l);
+
+	yaffs_trace(YAFFS_TRACE_OS,
+		"yaffs_readdir: %s inode %d", name, *this_inode);
+	return 1;
+}
+
 /*-----------------------------------------------------------------*/
 
 #ifdef YAFFS_USE_DIR_ITERATE
@@ -1671,7 +2108,6 @@ static int yaffs_iterate(struct file *f, struct dir_context *dc)
 	struct yaffs_dev *dev;
 	struct yaffs_search_context *sc;
 	unsigned long curoffs;
-	struct yaffs_obj *l;
 	int ret_val = 0;
 
 	char name[YAFFS_MAX_NAME_LENGTH + 1];
@@ -1679,9 +2115,7 @@ static int yaffs_iterate(struct file *f, struct dir_context *dc)
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
-
-	yaffs_dev_to_lc(dev)->readdir_process = current;
+	yaffs_dir_lock(dev);
 
 	sc = yaffs_new_search(obj);
 	if (!sc) {
@@ -1689,35 +2123,37 @@ static int yaffs_iterate(struct file *f, struct dir_context *dc)
 		goto out;
 	}
 
-	if (!dir_emit_dots(f, dc))
-		return 0;
+	yaffs_dir_unlock(dev);
+	if (!dir_emit_dots(f, dc)) {
+		yaffs_dir_lock(dev);
+		goto out;
+	}
+	yaffs_dir_lock(dev);
 
 	curoffs = 1;
 
 	while (sc->next_return) {
 		curoffs++;
-		l = sc->next_return;
 		if (curoffs >= dc->pos) {
-			int this_inode = yaffs_get_obj_inode(l);
-			int this_type = yaffs_get_obj_type(l);
+			int this_inode;
+			int this_type;
 
-			yaffs_get_obj_name(l, name, YAFFS_MAX_NAME_LENGTH + 1);
-			yaffs_trace(YAFFS_TRACE_OS,
-				"yaffs_readdir: %s inode %d",
-				name, yaffs_get_obj_inode(l));
+			if (!yaffs_readdir_entry(sc, name,
+						 &this_inode, &this_type))
+				break;
 
-			yaffs_gross_unlock(dev);
+			yaffs_dir_unlock(dev);
 
 			if (!dir_emit(dc,
 				      name,
 				      strlen(name),
 				      this_inode,
 				      this_type)) {
-				yaffs_gross_lock(dev);
+				yaffs_dir_lock(dev);
 				goto out;
 			}
 
-			yaffs_gross_lock(dev);
+			yaffs_dir_lock(dev);
 
 			dc->pos++;
 			f->f_pos++;
@@ -1727,8 +2163,7 @@ static int yaffs_iterate(struct file *f, struct dir_context *dc)
 
 out:
 	yaffs_search_end(sc);
-	yaffs_dev_to_lc(dev)->readdir_process = NULL;
-	yaffs_gross_unlock(dev);
+	yaffs_dir_unlock(dev);
 
 	return ret_val;
 }
@@ -1742,7 +2177,6 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	struct yaffs_search_context *sc;
 	struct inode *inode = f->f_dentry->d_inode;
 	unsigned long offset, curoffs;
-	struct yaffs_obj *l;
 	int ret_val = 0;
 
 	char name[YAFFS_MAX_NAME_LENGTH + 1];
@@ -1750,9 +2184,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 	obj = yaffs_dentry_to_obj(f->f_dentry);
 	dev = obj->my_dev;
 
-	yaffs_gross_lock(dev);
-
-	yaffs_dev_to_lc(dev)->readdir_process = current;
+	yaffs_dir_lock(dev);
 
 	offset = f->f_pos;
 
@@ -1769,12 +2201,12 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry . ino %d",
 			(int)inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_dir_unlock(dev);
 		if (filldir(dirent, ".", 1, offset, inode->i_ino, DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_dir_lock(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_dir_lock(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -1782,14 +2214,14 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 		yaffs_trace(YAFFS_TRACE_OS,
 			"yaffs_readdir: entry .. ino %d",
 			(int)f->f_dentry->d_parent->d_inode->i_ino);
-		yaffs_gross_unlock(dev);
+		yaffs_dir_unlock(dev);
 		if (filldir(dirent, "..", 2, offset,
 			    f->f_dentry->d_parent->d_inode->i_ino,
 			    DT_DIR) < 0) {
-			yaffs_gross_lock(dev);
+			yaffs_dir_lock(dev);
 			goto out;
 		}
-		yaffs_gross_lock(dev);
+		yaffs_dir_lock(dev);
 		offset++;
 		f->f_pos++;
 	}
@@ -1806,27 +2238,25 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 	while (sc->next_return) {
 		curoffs++;
-		l = sc->next_return;
 		if (curoffs >= offset) {
-			int this_inode = yaffs_get_obj_inode(l);
-			int this_type = yaffs_get_obj_type(l);
+			int this_inode;
+			int this_type;
 
-			yaffs_get_obj_name(l, name, YAFFS_MAX_NAME_LENGTH + 1);
-			yaffs_trace(YAFFS_TRACE_OS,
-				"yaffs_readdir: %s inode %d",
-				name, yaffs_get_obj_inode(l));
+			if (!yaffs_readdir_entry(sc, name,
+						 &this_inode, &this_type))
+				break;
 
-			yaffs_gross_unlock(dev);
+			yaffs_dir_unlock(dev);
 
 			if (filldir(dirent,
 				    name,
 				    strlen(name),
 				    offset, this_inode, this_type) < 0) {
-				yaffs_gross_lock(dev);
+				yaffs_dir_lock(dev);
 				goto out;
 			}
 
-			yaffs_gross_lock(dev);
+			yaffs_dir_lock(dev);
 
 			offset++;
 			f->f_pos++;
@@ -1836,8 +2266,7 @@ static int yaffs_readdir(struct file *f, void *dirent, filldir_t filldir)
 
 out:
 	yaffs_search_end(sc);
-	yaffs_dev_to_lc(dev)->readdir_process = NULL;
-	yaffs_gross_unlock(dev);
+	yaffs_dir_unlock(dev);
 
 	return ret_val;
 }
@@ -2005,6 +2434,53 @@ void yaffs_background_waker(unsigned long data)
 	wake_up_process((struct task_struct *)data);
 }
 
+/* Write back cold dirty cache chunks. The gross lock is dropped between
+ * chunks so that readers are not stalled for a whole flush. If free space
+ * runs low, gc runs first, so the foreground writers do not have to.
+ * Called with the gross lock held. Returns nonzero if dirty chunks are
+ * still waiting for a later pass.
+ */
+static int yaffs_bg_writeback(struct yaffs_dev *dev)
+{
+	int n;
+
+	n = yaffs_cache_wb_start(dev);
+
+	while (n > 0 && yaffs_cache_wb_next(dev)) {
+		n--;
+		yaffs_gross_unlock(dev);
+		cond_resched();
+		yaffs_gross_lock(dev);
+
+		if (yaffs_bg_gc_urgency(dev) > 1)
+			yaffs_bg_gc(dev, 2);
+	}
+
+	return yaffs_cache_n_dirty(dev) > 0;
+}
+
+/* Scrubbing is the lowest priority background job. A pass only runs if
+ * there has been no flash io, foreground or background, since the one
+ * before, so a busy device is never slowed down by it.
+ */
+#define YAFFS_SCRUB_INTERVAL	(HZ / 2)
+#define YAFFS_SCRUB_QUIET	(HZ * 2)
+#define YAFFS_SCRUB_IDLE	(HZ * 30)
+
+static unsigned long yaffs_bg_scrub(struct yaffs_dev *dev, u32 *last_io)
+{
+	u32 io = dev->n_page_reads + dev->n_page_writes + dev->n_erasures;
+	int busy = (io != *last_io || yaffs_bg_gc_urgency(dev) > 0);
+
+	*last_io = io;
+
+	if (busy)
+		return YAFFS_SCRUB_QUIET;
+	if (!yaffs_scrub_step(dev, yaffs_scrub_chunks))
+		return YAFFS_SCRUB_IDLE;
+	return YAFFS_SCRUB_INTERVAL;
+}
+
 static int yaffs_bg_thread_fn(void *data)
 {
 	struct yaffs_dev *dev = (struct yaffs_dev *)data;
@@ -2012,6 +2488,10 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long now = jiffies;
 	unsigned long next_dir_update = now;
 	unsigned long next_gc = now;
+	unsigned long next_wb = now;
+	unsigned long next_scrub = now + YAFFS_SCRUB_QUIET;
+	u32 scrub_io = 0;
+	int wb_pending = 0;
 	unsigned long expires;
 	unsigned int urgency;
 
@@ -2034,16 +2514,19 @@ static int yaffs_bg_thread_fn(void *data)
 		if (try_to_freeze())
 			continue;
 #endif
-		yaffs_gross_lock(dev);
-
+		/* Each job takes the gross lock on its own, so that file io
+		 * gets in between them. */
 		now = jiffies;
 
 		if (time_after(now, next_dir_update) && yaffs_bg_enable) {
+			yaffs_gross_lock(dev);
 			yaffs_update_dirty_dirs(dev);
+			yaffs_gross_unlock(dev);
 			next_dir_update = now + HZ;
 		}
 
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
+			yaffs_gross_lock(dev);
 			if (!dev->is_checkpointed) {
 				urgency = yaffs_bg_gc_urgency(dev);
 				gc_result = yaffs_bg_gc(dev, urgency);
@@ -2060,12 +2543,31 @@ static int yaffs_bg_thread_fn(void *data)
 				 */
 				next_gc = next_dir_update;
                         }
+			yaffs_gross_unlock(dev);
+		}
+
+		if (time_after(now, next_wb) && yaffs_bg_enable &&
+		    yaffs_cache_wb) {
+			yaffs_gross_lock(dev);
+			wb_pending = yaffs_bg_writeback(dev);
+			yaffs_gross_unlock(dev);
+			next_wb = now + HZ / 5 + 1;
+		}
+
+		if (time_after(now, next_scrub) && yaffs_bg_enable &&
+		    yaffs_scrub_chunks && dev->param.scrub_threshold) {
+			yaffs_gross_lock(dev);
+			next_scrub = now + yaffs_bg_scrub(dev, &scrub_io);
+			yaffs_gross_unlock(dev);
 		}
-		yaffs_gross_unlock(dev);
 #if 1
 		expires = next_dir_update;
 		if (time_before(next_gc, expires))
 			expires = next_gc;
+		if (wb_pending && time_before(next_wb, expires))
+			expires = next_wb;
+		if (time_before(next_scrub, expires))
+			expires = next_scrub;
 		if (time_before(expires, now))
 			expires = now + HZ;
 
@@ -2324,7 +2826,9 @@ static void yaffs_evict_inode(struct inode *inode)
 	if (deleteme && obj) {
 		dev = obj->my_dev;
 		yaffs_gross_lock(dev);
+		yaffs_dir_lock(dev);
 		yaffs_del_obj(obj);
+		yaffs_dir_unlock(dev);
 		yaffs_gross_unlock(dev);
 	}
 	if (obj) {
@@ -2382,7 +2886,9 @@ static void yaffs_delete_inode(struct inode *inode)
 	if (obj) {
 		dev = obj->my_dev;
 		yaffs_gross_lock(dev);
+		yaffs_dir_lock(dev);
 		yaffs_del_obj(obj);
+		yaffs_dir_unlock(dev);
 		yaffs_gross_unlock(dev);
 	}
 #if (LINUX_VERSION_CODE > KERNEL_VERSION(2, 6, 13))
@@ -2410,10 +2916,12 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 	struct yaffs_dev *dev = yaffs_super_to_dev(sb);
 #endif
 
+	/* Everything here is either fixed at mount or a counter, so the
+	 * gross lock is not taken and statfs never waits behind gc or
+	 * writeback.
+	 */
 	yaffs_trace(YAFFS_TRACE_OS, "yaffs_statfs");
 
-	yaffs_gross_lock(dev);
-
 	buf->f_type = YAFFS_MAGIC;
 	buf->f_bsize = sb->s_blocksize;
 	buf->f_namelen = 255;
@@ -2433,7 +2941,7 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 		do_div(bytes_in_dev, sb->s_blocksize);	/* bytes_in_dev becomes the number of blocks */
 		buf->f_blocks = bytes_in_dev;
 
-		bytes_free = ((uint64_t) (yaffs_get_n_free_chunks(dev))) *
+		bytes_free = ((uint64_t) (yaffs_peek_n_free_chunks(dev))) *
 		    ((uint64_t) (dev->data_bytes_per_chunk));
 
 		do_div(bytes_free, sb->s_blocksize);
@@ -2447,7 +2955,7 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 		    dev->param.chunks_per_block /
 		    (sb->s_blocksize / dev->data_bytes_per_chunk);
 		buf->f_bfree =
-		    yaffs_get_n_free_chunks(dev) /
+		    yaffs_peek_n_free_chunks(dev) /
 		    (sb->s_blocksize / dev->data_bytes_per_chunk);
 	} else {
 		buf->f_blocks =
@@ -2456,7 +2964,7 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 		    (dev->data_bytes_per_chunk / sb->s_blocksize);
 
 		buf->f_bfree =
-		    yaffs_get_n_free_chunks(dev) *
+		    yaffs_peek_n_free_chunks(dev) *
 		    (dev->data_bytes_per_chunk / sb->s_blocksize);
 	}
 
@@ -2464,7 +2972,6 @@ static int yaffs_statfs(struct super_block *sb, struct statfs *buf)
 	buf->f_ffree = 0;
 	buf->f_bavail = buf->f_bfree;
 
-	yaffs_gross_unlock(dev);
 	return 0;
 }
 
@@ -2614,6 +3121,10 @@ struct yaffs_options {
 	int empty_lost_and_found;
 	int empty_lost_and_found_overridden;
 	int disable_summary;
+	int gc_cost_benefit;
+	unsigned long tnode_budget_kb;
+	int checkpt_lzo;
+	int scrub_threshold;
 };
 
 #define MAX_OPT_LEN 30
@@ -2657,6 +3168,40 @@ static int yaffs_parse_options(struct yaffs_options *options,
 			options->lazy_loading_overridden = 1;
 		} else if (!strcmp(cur_opt, "disable-summary")) {
 			options->disable_summary = 1;
+		} else if (!strcmp(cur_opt, "gc-cost-benefit")) {
+			options->gc_cost_benefit = 1;
+		} else if (!strcmp(cur_opt, "checkpoint-lzo")) {
+			options->checkpt_lzo = 1;
+		} else if (!strncmp(cur_opt, "tnode-budget=", 13)) {
+			char *end;
+
+			options->tnode_budget_kb =
+				simple_strtoul(cur_opt + 13, &end, 0);
+			if (end == cur_opt + 13 || *end) {
+				printk(KERN_INFO
+				       "yaffs: Bad mount option \"%s\"\n",
+				       cur_opt);
+				error = 1;
+			}
+		} else if (!strcmp(cur_opt, "scrub")) {
+			if (!options->scrub_threshold)
+				options->scrub_threshold =
+					YAFFS_SCRUB_DEF_THRESHOLD;
+		} else if (!strncmp(cur_opt, "scrub-threshold=", 16)) {
+			char *end;
+
+			options->scrub_threshold =
+				simple_strtoul(cur_opt + 16, &end, 0);
+			/* One corrected bit is normal wear on most parts */
+			if (end == cur_opt + 16 || *end ||
+			    (options->scrub_threshold &&
+			     options->scrub_threshold <
+			     YAFFS_SCRUB_MIN_THRESHOLD)) {
+				printk(KERN_INFO
+				       "yaffs: Bad mount option \"%s\"\n",
+				       cur_opt);
+				error = 1;
+			}
 		} else if (!strcmp(cur_opt, "empty-lost-and-found-off")) {
 			options->empty_lost_and_found = 0;
 			options->empty_lost_and_found_overridden = 1;
@@ -2711,6 +3256,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	char devname_buf[BDEVNAME_SIZE + 1];
 	struct mtd_info *mtd;
 	int err;
+	int i;
 	char *data_str = (char *)data;
 	struct yaffs_linux_context *context = NULL;
 	struct yaffs_param *param;
@@ -2870,6 +3416,10 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->empty_lost_n_found = 1;
 	param->refresh_period = 500;
 	param->disable_summary = options.disable_summary;
+	param->gc_cost_benefit = options.gc_cost_benefit;
+	param->tnode_budget = options.tnode_budget_kb * 1024;
+	param->checkpt_lzo = options.checkpt_lzo;
+	param->scrub_threshold = options.scrub_threshold;
 
 
 #ifdef CONFIG_YAFFS_DISABLE_BAD_BLOCK_MARKING
@@ -2888,6 +3438,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 		param->total_bytes_per_chunk = mtd->oobblock;
 		param->chunks_per_block = mtd->erasesize / mtd->oobblock;
 #endif
+		param->spare_bytes_per_chunk = mtd->oobavail;
 		n_blocks = YCALCBLOCKS(mtd->size, mtd->erasesize);
 
 		param->start_block = 0;
@@ -2940,6 +3491,9 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->remove_obj_fn = yaffs_remove_obj_callback;
 
 	mutex_init(&(yaffs_dev_to_lc(dev)->gross_lock));
+	mutex_init(&(yaffs_dev_to_lc(dev)->dir_lock));
+	for (i = 0; i < YAFFS_N_OBJ_LOCKS; i++)
+		mutex_init(&(yaffs_dev_to_lc(dev)->obj_lock[i]));
 
 	yaffs_gross_lock(dev);
 
@@ -3089,6 +3643,19 @@ static DECLARE_FSTYPE(yaffs2_fs_type, "yaffs2", yaffs2_read_super,
 
 static struct proc_dir_entry *my_proc_entry;
 
+/* NAND page writes per page written on behalf of the user, times 100. */
+static unsigned yaffs_write_amp_x100(struct yaffs_dev *dev)
+{
+	u32 user_writes = dev->n_page_writes - dev->n_gc_copies;
+	u64 amp = (u64) dev->n_page_writes * 100;
+
+	if (!user_writes)
+		return 100;
+
+	do_div(amp, user_writes);
+	return (unsigned) amp;
+}
+
 static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 {
 	struct yaffs_param *param = &dev->param;
@@ -3117,6 +3684,13 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 				param->n_reserved_blocks);
 	buf += sprintf(buf, "always_check_erased.. %d\n",
 				param->always_check_erased);
+	buf += sprintf(buf, "gc_cost_benefit...... %d\n",
+				param->gc_cost_benefit);
+	buf += sprintf(buf, "tnode_budget......... %u\n",
+				param->tnode_budget);
+	buf += sprintf(buf, "checkpt_lzo.......... %d\n", param->checkpt_lzo);
+	buf += sprintf(buf, "scrub_threshold...... %d\n",
+				param->scrub_threshold);
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "block count by state\n");
 	buf += sprintf(buf, "0:%d 1:%d 2:%d 3:%d 4:%d\n",
@@ -3129,6 +3703,8 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 
 static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+
 	buf += sprintf(buf, "max file size....... %lld\n",
 				(long long) yaffs_max_file_size(dev));
 	buf += sprintf(buf, "data_bytes_per_chunk. %d\n",
@@ -3140,6 +3716,9 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 				dev->blocks_in_checkpt);
 	buf += sprintf(buf, "\n");
 	buf += sprintf(buf, "n_tnodes............. %d\n", dev->n_tnodes);
+	buf += sprintf(buf, "n_map_evictions...... %u\n",
+				dev->n_map_evictions);
+	buf += sprintf(buf, "n_map_rebuilds....... %u\n", dev->n_map_rebuilds);
 	buf += sprintf(buf, "n_obj................ %d\n", dev->n_obj);
 	buf += sprintf(buf, "n_free_chunks........ %d\n", dev->n_free_chunks);
 	buf += sprintf(buf, "\n");
@@ -3147,6 +3726,12 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "n_page_reads......... %u\n", dev->n_page_reads);
 	buf += sprintf(buf, "n_erasures........... %u\n", dev->n_erasures);
 	buf += sprintf(buf, "n_gc_copies.......... %u\n", dev->n_gc_copies);
+	buf += sprintf(buf, "gc_copy_bytes........ %llu\n",
+				(unsigned long long) dev->n_gc_copies *
+				dev->data_bytes_per_chunk);
+	buf += sprintf(buf, "write_amp_x100....... %u\n",
+				yaffs_write_amp_x100(dev));
+	buf += sprintf(buf, "gc_idx_probes........ %u\n", dev->gc_idx_probes);
 	buf += sprintf(buf, "all_gcs.............. %u\n", dev->all_gcs);
 	buf += sprintf(buf, "passive_gc_count..... %u\n",
 				dev->passive_gc_count);
@@ -3165,13 +3750,39 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "n_tags_ecc_unfixed... %u\n",
 				dev->n_tags_ecc_unfixed);
 	buf += sprintf(buf, "cache_hits........... %u\n", dev->cache_hits);
+	buf += sprintf(buf, "n_cache_wb........... %u\n", dev->n_cache_wb);
 	buf += sprintf(buf, "n_deleted_files...... %u\n", dev->n_deleted_files);
 	buf += sprintf(buf, "n_unlinked_files..... %u\n",
 				dev->n_unlinked_files);
 	buf += sprintf(buf, "refresh_count........ %u\n", dev->refresh_count);
+	buf += sprintf(buf, "n_scrub_chunks....... %u\n", dev->n_scrub_chunks);
+	buf += sprintf(buf, "n_scrub_blocks....... %u\n", dev->n_scrub_blocks);
+	buf += sprintf(buf, "n_scrub_fixed........ %u\n", dev->n_scrub_fixed);
+	buf += sprintf(buf, "n_scrub_refreshes.... %u\n",
+				dev->n_scrub_refreshes);
 	buf += sprintf(buf, "n_bg_deletions....... %u\n", dev->n_bg_deletions);
 	buf += sprintf(buf, "tags_used............ %u\n", dev->tags_used);
 	buf += sprintf(buf, "summary_used......... %u\n", dev->summary_used);
+	buf += sprintf(buf, "n_tags_ahead......... %u\n", dev->n_tags_ahead);
+	buf += sprintf(buf, "ra_batches........... %u\n", lc->ra_batches);
+	buf += sprintf(buf, "ra_hits.............. %u\n", lc->ra_hits);
+	buf += sprintf(buf, "mount_checkpt_ms..... %u\n",
+				dev->mount_checkpt_ms);
+	buf += sprintf(buf, "mount_scan_ms........ %u\n", dev->mount_scan_ms);
+#ifdef CONFIG_YAFFS_LOCK_STATS
+	buf += sprintf(buf, "lock_acquires........ %u\n", lc->lock_acquires);
+	buf += sprintf(buf, "lock_contended....... %u\n", lc->lock_contended);
+	buf += sprintf(buf, "lock_wait_us......... %llu\n",
+				(unsigned long long) lc->lock_wait_us);
+	buf += sprintf(buf, "lock_max_wait_us..... %u\n",
+				lc->lock_max_wait_us);
+	buf += sprintf(buf, "lock_hold_us......... %llu\n",
+				(unsigned long long) lc->lock_hold_us);
+	buf += sprintf(buf, "lock_max_hold_us..... %u\n",
+				lc->lock_max_hold_us);
+	buf += sprintf(buf, "lock_max_hold_at..... %pS\n",
+				lc->lock_max_hold_at);
+#endif
 
 	return buf;
 }
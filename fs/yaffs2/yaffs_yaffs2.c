@@ -205,40 +205,42 @@ int yaffs2_checkpt_required(struct yaffs_dev *dev)
 	    !dev->read_only && (nblocks >= YAFFS_CHECKPOINT_MIN_BLOCKS);
 }
 
-int yaffs_calc_checkpt_blocks_required(struct yaffs_dev *dev)
+static int yaffs2_checkpt_blocks_needed(struct yaffs_dev *dev)
 {
-	int retval;
 	int n_bytes = 0;
-	int n_blocks;
 	int dev_blocks;
 
+	dev_blocks = dev->param.end_block - dev->param.start_block + 1;
+	n_bytes += sizeof(struct yaffs_checkpt_validity);
+	n_bytes += sizeof(struct yaffs_checkpt_dev);
+	n_bytes += dev_blocks * sizeof(struct yaffs_block_info);
+	n_bytes += dev_blocks * dev->chunk_bit_stride;
+	n_bytes +=
+	    (sizeof(struct yaffs_checkpt_obj) + sizeof(u32)) *
+	    dev->n_obj;
+	n_bytes += (dev->tnode_size + sizeof(u32)) * dev->n_tnodes;
+	n_bytes += sizeof(struct yaffs_checkpt_validity);
+	n_bytes += sizeof(u32);	/* checksum */
+
+	/* Round up and add 2 blocks to allow for some bad blocks,
+	 * so add 3 */
+
+	return (n_bytes /
+		(dev->data_bytes_per_chunk *
+		 dev->param.chunks_per_block)) + 3;
+}
+
+int yaffs_calc_checkpt_blocks_required(struct yaffs_dev *dev)
+{
+	int retval;
+
 	if (!dev->param.is_yaffs2)
 		return 0;
 
-	if (!dev->checkpoint_blocks_required && yaffs2_checkpt_required(dev)) {
+	if (!dev->checkpoint_blocks_required && yaffs2_checkpt_required(dev))
 		/* Not a valid value so recalculate */
-		dev_blocks = dev->param.end_block - dev->param.start_block + 1;
-		n_bytes += sizeof(struct yaffs_checkpt_validity);
-		n_bytes += sizeof(struct yaffs_checkpt_dev);
-		n_bytes += dev_blocks * sizeof(struct yaffs_block_info);
-		n_bytes += dev_blocks * dev->chunk_bit_stride;
-		n_bytes +=
-		    (sizeof(struct yaffs_checkpt_obj) + sizeof(u32)) *
-		    dev->n_obj;
-		n_bytes += (dev->tnode_size + sizeof(u32)) * dev->n_tnodes;
-		n_bytes += sizeof(struct yaffs_checkpt_validity);
-		n_bytes += sizeof(u32);	/* checksum */
-
-		/* Round up and add 2 blocks to allow for some bad blocks,
-		 * so add 3 */
-
-		n_blocks =
-		    (n_bytes /
-		     (dev->data_bytes_per_chunk *
-		      dev->param.chunks_per_block)) + 3;
-
-		dev->checkpoint_blocks_required = n_blocks;
-	}
+		dev->checkpoint_blocks_required =
+		    yaffs2_checkpt_blocks_needed(dev);
 
 	retval = dev->checkpoint_blocks_required - dev->blocks_in_checkpt;
 	if (retval < 0)
@@ -246,6 +248,26 @@ int yaffs_calc_checkpt_blocks_required(struct yaffs_dev *dev)
 	return retval;
 }
 
+/* As above, but without caching the result, for callers that do not hold
+ * the gross lock. The answer is only an estimate.
+ */
+int yaffs2_peek_checkpt_blocks_required(struct yaffs_dev *dev)
+{
+	int retval;
+
+	if (!dev->param.is_yaffs2)
+		return 0;
+
+	retval = dev->checkpoint_blocks_required;
+	if (!retval && yaffs2_checkpt_required(dev))
+		retval = yaffs2_checkpt_blocks_needed(dev);
+
+	retval -= dev->blocks_in_checkpt;
+	if (retval < 0)
+		retval = 0;
+	return retval;
+}
+
 /*--------------------- Checkpointing --------------------*/
 
 static int yaffs2_wr_checkpt_validity_marker(struct yaffs_dev *dev, int head)
@@ -378,6 +400,7 @@ static void yaffs2_obj_checkpt_obj(struct yaffs_checkpt_obj *cp,
 	cp->fake = obj->fake;
 	cp->rename_allowed = obj->rename_allowed;
 	cp->unlink_allowed = obj->unlink_allowed;
+	cp->map_evicted = obj->map_evicted;
 	cp->serial = obj->serial;
 	cp->n_data_chunks = obj->n_data_chunks;
 
@@ -619,6 +642,9 @@ static int yaffs2_rd_checkpt_objs(struct yaffs_dev *dev)
 				if (obj->variant_type ==
 					YAFFS_OBJECT_TYPE_FILE) {
 					ok = yaffs2_rd_checkpt_tnodes(obj);
+					/* Evicted maps were saved empty */
+					if (ok && cp.map_evicted)
+						yaffs_evict_file_map(obj);
 				} else if (obj->variant_type ==
 					YAFFS_OBJECT_TYPE_HARDLINK) {
 					list_add(&obj->hard_links, &hard_list);
@@ -1388,6 +1414,9 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	chunk_data = yaffs_get_temp_buffer(dev);
 
+	/* Not fatal if this fails, we just read tags a chunk at a time. */
+	yaffs_tags_ahead_init(dev);
+
 	/* Scan all the blocks to determine their state */
 	bi = dev->block_info;
 	for (blk = dev->internal_start_block; blk <= dev->internal_end_block;
@@ -1473,10 +1502,13 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 		/* For each chunk in each block that needs scanning.... */
 		found_chunks = 0;
-		if (summary_available)
+		if (summary_available) {
 			c = dev->chunks_per_summary - 1;
-		else
+		} else {
 			c = dev->param.chunks_per_block - 1;
+			/* Pull in the tags for the whole block up front. */
+			yaffs_rd_tags_ahead(dev, blk);
+		}
 
 		for (/* c is already initialised */;
 		     !alloc_failed && c >= 0 &&
@@ -1509,6 +1541,8 @@ int yaffs2_scan_backwards(struct yaffs_dev *dev)
 
 	yaffs_skip_rest_of_block(dev);
 
+	yaffs_tags_ahead_deinit(dev);
+
 	if (alt_block_index)
 		vfree(block_index);
 	else
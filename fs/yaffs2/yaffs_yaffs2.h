@@ -28,6 +28,7 @@ int yaffs_block_ok_for_gc(struct yaffs_dev *dev, struct yaffs_block_info *bi);
 u32 yaffs2_find_refresh_block(struct yaffs_dev *dev);
 int yaffs2_checkpt_required(struct yaffs_dev *dev);
 int yaffs_calc_checkpt_blocks_required(struct yaffs_dev *dev);
+int yaffs2_peek_checkpt_blocks_required(struct yaffs_dev *dev);
 
 void yaffs2_checkpt_invalidate(struct yaffs_dev *dev);
 int yaffs2_checkpt_save(struct yaffs_dev *dev);
@@ -69,6 +69,8 @@
 #define Y_TIME_CONVERT(x) (x)
 #endif
 
+#define Y_TIME_MS() jiffies_to_msecs(jiffies)
+
 #define compile_time_assertion(assertion) \
 	({ int x = __builtin_choose_expr(assertion, 0, (void)0); (void) x; })
 
@@ -35,18 +35,40 @@
 
 /* struct mmu_gather is an opaque type used by the mm code for passing around
  * any data needed by arch specific code for tlb_remove_page.
+ *
+ * start and end cover what was unmapped since the last flush, at the
+ * granularity of what was removed: a page for a pte, the area mapped by
+ * a page table when the table itself is freed. An architecture's
+ * tlb_flush() may use them to flush less than the whole mm.
  */
 struct mmu_gather {
 	struct mm_struct	*mm;
 	unsigned int		nr;	/* set to ~0U means fast mode */
 	unsigned int		need_flush;/* Really unmapped some ptes? */
 	unsigned int		fullmm; /* non-zero means full mm flush */
+	unsigned long		start;	/* range to flush */
+	unsigned long		end;
 	struct page *		pages[FREE_PTE_NR];
 };
 
 /* Users of the generic TLB shootdown code must declare this storage space. */
 DECLARE_PER_CPU(struct mmu_gather, mmu_gathers);
 
+static inline void __tlb_reset_range(struct mmu_gather *tlb)
+{
+	tlb->start = ~0UL;
+	tlb->end = 0;
+}
+
+static inline void __tlb_adjust_range(struct mmu_gather *tlb,
+				      unsigned long address, unsigned long size)
+{
+	if (address < tlb->start)
+		tlb->start = address;
+	if (address + size > tlb->end)
+		tlb->end = address + size;
+}
+
 /* tlb_gather_mmu
  *	Return a pointer to an initialized struct mmu_gather.
  */
@@ -61,6 +83,7 @@ tlb_gather_mmu(struct mm_struct *mm, unsigned int full_mm_flush)
 	tlb->nr = num_online_cpus() > 1 ? 0U : ~0U;
 
 	tlb->fullmm = full_mm_flush;
+	__tlb_reset_range(tlb);
 
 	return tlb;
 }
@@ -72,6 +95,7 @@ tlb_flush_mmu(struct mmu_gather *tlb, unsigned long start, unsigned long end)
 		return;
 	tlb->need_flush = 0;
 	tlb_flush(tlb);
+	__tlb_reset_range(tlb);
 	if (!tlb_fast_mode(tlb)) {
 		free_pages_and_swap_cache(tlb->pages, tlb->nr);
 		tlb->nr = 0;
@@ -120,12 +144,14 @@ static inline void tlb_remove_page(struct mmu_gather *tlb, struct page *page)
 #define tlb_remove_tlb_entry(tlb, ptep, address)		\
 	do {							\
 		tlb->need_flush = 1;				\
+		__tlb_adjust_range(tlb, address, PAGE_SIZE);	\
 		__tlb_remove_tlb_entry(tlb, ptep, address);	\
 	} while (0)
 
 #define pte_free_tlb(tlb, ptep, address)			\
 	do {							\
 		tlb->need_flush = 1;				\
+		__tlb_adjust_range(tlb, address, PMD_SIZE);	\
 		__pte_free_tlb(tlb, ptep, address);		\
 	} while (0)
 
@@ -133,6 +159,7 @@ static inline void tlb_remove_page(struct mmu_gather *tlb, struct page *page)
 #define pud_free_tlb(tlb, pudp, address)			\
 	do {							\
 		tlb->need_flush = 1;				\
+		__tlb_adjust_range(tlb, address, PGDIR_SIZE);	\
 		__pud_free_tlb(tlb, pudp, address);		\
 	} while (0)
 #endif
@@ -140,6 +167,7 @@ static inline void tlb_remove_page(struct mmu_gather *tlb, struct page *page)
 #define pmd_free_tlb(tlb, pmdp, address)			\
 	do {							\
 		tlb->need_flush = 1;				\
+		__tlb_adjust_range(tlb, address, PUD_SIZE);	\
 		__pmd_free_tlb(tlb, pmdp, address);		\
 	} while (0)
 
@@ -0,0 +1,70 @@
+/*
+ * include/linux/bch.h
+ *
+ * Overview:
+ *   Generic binary BCH encoder / decoder library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _BCH_H_
+#define _BCH_H_
+
+#include <linux/types.h>
+
+/**
+ * struct bch_control - BCH control structure
+ *
+ * @m:		Galois field order, codes are defined over GF(2^m)
+ * @n:		maximum codeword length in bits (= 2^m-1)
+ * @t:		number of correctable bit errors
+ * @ecc_bits:	number of ecc bits (degree of the generator polynomial)
+ * @ecc_bytes:	number of ecc bytes (= ceil(ecc_bits/8))
+ * @ecc_words:	number of 32-bit words holding the ecc bits
+ * @a_pow_tab:	exponent lookup table, a_pow_tab[i] = alpha^i
+ * @a_log_tab:	logarithm lookup table, a_log_tab[alpha^i] = i
+ * @mod8_tab:	remainder of every byte value times x^ecc_bits, used by the
+ *		encoder to process a byte per step
+ * @ecc_buf:	ecc scratch buffer
+ * @ecc_buf2:	ecc scratch buffer
+ * @syn:	syndrome scratch buffer, 2t entries
+ * @elp:	error locator polynomial scratch buffers, 3 x (2t+1) entries
+ * @chien:	root search scratch buffers, 2 x (t+1) entries
+ *
+ * The scratch buffers make a control structure usable by one caller at a
+ * time; users serialise access (NAND does so with the chip lock).
+ */
+struct bch_control {
+	unsigned int	m;
+	unsigned int	n;
+	unsigned int	t;
+	unsigned int	ecc_bits;
+	unsigned int	ecc_bytes;
+	unsigned int	ecc_words;
+	uint16_t	*a_pow_tab;
+	uint16_t	*a_log_tab;
+	uint32_t	*mod8_tab;
+	uint32_t	*ecc_buf;
+	uint32_t	*ecc_buf2;
+	unsigned int	*syn;
+	unsigned int	*elp;
+	unsigned int	*chien;
+};
+
+/* Create a BCH code over GF(2^m) correcting t bits, prim_poly 0: default */
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly);
+
+void free_bch(struct bch_control *bch);
+
+/* Compute (or continue computing) the ecc of len data bytes */
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc);
+
+/* Locate up to t bit errors, returns count or -EBADMSG/-EINVAL */
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       unsigned int *errloc);
+
+#endif /* _BCH_H_ */
@@ -167,6 +167,21 @@ enum zone_watermarks {
 #define low_wmark_pages(z) (z->watermark[WMARK_LOW])
 #define high_wmark_pages(z) (z->watermark[WMARK_HIGH])
 
+/*
+ * Orders 1 to PCP_MAX_ORDER are also cached per cpu, so that slab pages,
+ * kernel stacks and jumbo frame buffers do not take zone->lock every time.
+ */
+#define PCP_MAX_ORDER		3
+
+struct per_cpu_order_pages {
+	int count;		/* number of blocks in the lists */
+	int high;		/* high watermark, adapts to the usage */
+	int batch;		/* blocks per buddy add/remove, adapts too */
+	unsigned long hit;	/* allocations served from the lists */
+	unsigned long miss;	/* allocations that refilled the lists */
+	struct list_head lists[MIGRATE_PCPTYPES];
+};
+
 struct per_cpu_pages {
 	int count;		/* number of pages in the list */
 	int high;		/* high watermark, emptying needed */
@@ -175,8 +190,20 @@ struct per_cpu_pages {
 	/* Lists of pages, one per migrate type stored on the pcp-lists
 	 * 用于管理3中不同类型的链表*/
 	struct list_head lists[MIGRATE_PCPTYPES];
+
+	/* orders[0] holds the order 1 blocks and so on */
+	struct per_cpu_order_pages orders[PCP_MAX_ORDER];
 };
 
+static inline int pcp_order_blocks(struct per_cpu_pages *pcp)
+{
+	int i, n = 0;
+
+	for (i = 0; i < PCP_MAX_ORDER; i++)
+		n += pcp->orders[i].count;
+	return n;
+}
+
 struct per_cpu_pageset {
 	struct per_cpu_pages pcp;
 #ifdef CONFIG_NUMA
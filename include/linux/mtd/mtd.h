@@ -195,6 +195,22 @@ struct mtd_info {
 	int (*write_oob) (struct mtd_info *mtd, loff_t to,
 			 struct mtd_oob_ops *ops);
 
+	/*
+	 * Multi-page transfers. ops->len covers whole pages starting on a
+	 * page boundary, ops->ooblen is zero or the same oob length for
+	 * every page, packed back to back in ops->oobbuf. Optional, users
+	 * go through mtd_read_pages()/mtd_write_pages() which fall back
+	 * to one read_oob/write_oob call per page. A device only provides
+	 * read_pages when it can stream the pages faster than that.
+	 * A read that returns -EUCLEAN also sets bit n of the caller's
+	 * zeroed fixed bitmap, if one is passed, for each page n that
+	 * needed correction.
+	 */
+	int (*read_pages) (struct mtd_info *mtd, loff_t from,
+			 struct mtd_oob_ops *ops, unsigned long *fixed);
+	int (*write_pages) (struct mtd_info *mtd, loff_t to,
+			 struct mtd_oob_ops *ops);
+
 	/*
 	 * Methods to access the protection register area, present in some
 	 * flash devices. The user data is one time programmable but the
@@ -311,6 +327,10 @@ int default_mtd_writev(struct mtd_info *mtd, const struct kvec *vecs,
 int default_mtd_readv(struct mtd_info *mtd, struct kvec *vecs,
 		      unsigned long count, loff_t from, size_t *retlen);
 
+int mtd_read_pages(struct mtd_info *mtd, loff_t from, struct mtd_oob_ops *ops,
+		   unsigned long *fixed);
+int mtd_write_pages(struct mtd_info *mtd, loff_t to, struct mtd_oob_ops *ops);
+
 #ifdef CONFIG_MTD_PARTITIONS
 void mtd_erase_callback(struct erase_info *instr);
 #else
@@ -84,6 +84,8 @@ extern void nand_wait_ready(struct mtd_info *mtd);
 #define NAND_CMD_READSTART	0x30
 #define NAND_CMD_RNDOUTSTART	0xE0
 #define NAND_CMD_CACHEDPROG	0x15
+#define NAND_CMD_READCACHESEQ	0x31
+#define NAND_CMD_READCACHEEND	0x3F
 
 /* Extended commands for AG-AND device */
 /*
@@ -122,6 +124,7 @@ typedef enum {
 	NAND_ECC_HW,
 	NAND_ECC_HW_SYNDROME,
 	NAND_ECC_HW_OOB_FIRST,
+	NAND_ECC_SOFT_BCH,
 } nand_ecc_modes_t;
 
 /*
@@ -177,9 +180,13 @@ typedef enum {
 #define NAND_CANAUTOINCR(chip) (!(chip->options & NAND_NO_AUTOINCR))
 #define NAND_MUST_PAD(chip) (!(chip->options & NAND_NO_PADDING))
 #define NAND_HAS_CACHEPROG(chip) ((chip->options & NAND_CACHEPRG))
+#define NAND_USE_CACHEPROG(chip) (NAND_HAS_CACHEPROG(chip) && \
+				  (chip->options & NAND_CACHEPRG_ENABLE))
+#define NAND_HAS_CACHEREAD(chip) ((chip->options & NAND_CACHE_READ))
 #define NAND_HAS_COPYBACK(chip) ((chip->options & NAND_COPYBACK))
 /* Large page NAND with SOFT_ECC should support subpage reads */
-#define NAND_SUBPAGE_READ(chip) ((chip->ecc.mode == NAND_ECC_SOFT) \
+#define NAND_SUBPAGE_READ(chip) ((chip->ecc.mode == NAND_ECC_SOFT || \
+				  chip->ecc.mode == NAND_ECC_SOFT_BCH) \
 					&& (chip->page_shift > 9))
 
 /* Mask to zero out the chip options, which come from the id table */
@@ -194,6 +201,13 @@ typedef enum {
 /* This option is defined if the board driver allocates its own buffers
    (e.g. because it needs them DMA-coherent */
 #define NAND_OWN_BUFFERS	0x00040000
+/* Chip supports the 31h/3Fh cache read sequence. Not derived from the
+ * id table, the board driver sets this before nand_scan_tail() when the
+ * part is known to have it */
+#define NAND_CACHE_READ		0x00080000
+/* Use cache programming on chips with NAND_CACHEPRG. A failed program is
+ * then only reported with the next page, so the board driver opts in */
+#define NAND_CACHEPRG_ENABLE	0x00100000
 /* Options set by nand scan */
 /* Nand scan has allocated controller struct */
 #define NAND_CONTROLLER_ALLOC	0x80000000
@@ -253,6 +267,7 @@ struct nand_hw_control {
  * @write_page:	function to write a page according to the ecc generator requirements
  * @read_oob:	function to read chip OOB data
  * @write_oob:	function to write chip OOB data
+ * @priv:	pointer to private ecc control data
  */
 struct nand_ecc_ctrl {
 	nand_ecc_modes_t	mode;
@@ -293,6 +308,7 @@ struct nand_ecc_ctrl {
 	int			(*write_oob)(struct mtd_info *mtd,
 					     struct nand_chip *chip,
 					     int page);
+	void			*priv;
 };
 
 /**
@@ -15,11 +15,23 @@
 
 struct mtd_info;
 
+/*
+ * Calculate 3 byte ECC code for eccsize byte block
+ */
+void __nand_calculate_ecc(const u_char *dat, unsigned int eccsize,
+			  u_char *ecc_code);
+
 /*
  * Calculate 3 byte ECC code for 256 byte block
  */
 int nand_calculate_ecc(struct mtd_info *mtd, const u_char *dat, u_char *ecc_code);
 
+/*
+ * Calculate 3 byte ECC codes for a run of blocks
+ */
+void nand_calculate_ecc_steps(struct mtd_info *mtd, const u_char *dat,
+			      int steps, u_char *ecc_code);
+
 /*
  * Detect and correct a 1 bit error for eccsize byte block
  */
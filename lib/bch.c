@@ -0,0 +1,521 @@
+/*
+ * lib/bch.c
+ *
+ * Overview:
+ *   Generic binary BCH encoder / decoder library
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Description:
+ *
+ * A binary BCH code over GF(2^m) protects up to 2^m-1-m*t data bits with
+ * at most m*t ecc bits and corrects any t bit errors in data and ecc.
+ * The codeword is the data, most significant bit of the first byte first,
+ * followed by the ecc bits; codes shorter than 2^m-1 bits are simply
+ * shortened.
+ *
+ * Each user calls init_bch() once to build the tables for its (m, t)
+ * pair. Building takes some time, so do it at driver init and not in a
+ * time critical path.
+ *
+ * Encoding divides the data by the generator polynomial with an LFSR that
+ * consumes a byte per step through a 256 entry remainder table.
+ *
+ * Decoding never touches the data: the xor of the received and the
+ * recalculated ecc is the error polynomial modulo the generator, so the
+ * 2t syndromes are evaluated over at most ecc_bits set bits with the
+ * exponent table (and the even ones are squares of the odd ones). The
+ * error locator polynomial comes from Berlekamp-Massey and its roots from
+ * a Chien search in logarithm form, restricted to the shortened codeword
+ * and stopped as soon as all roots are found.
+ */
+
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bitops.h>
+#include <linux/bch.h>
+
+#define BCH_MIN_M	5
+#define BCH_MAX_M	15
+
+/* Default primitive polynomials for GF(2^5) to GF(2^15) */
+static const unsigned int prim_poly_tab[] = {
+	0x25, 0x43, 0x83, 0x11d, 0x211, 0x409, 0x805, 0x1053, 0x201b,
+	0x402b, 0x8003,
+};
+
+static inline unsigned int mod_n(struct bch_control *bch, unsigned int v)
+{
+	while (v >= bch->n)
+		v -= bch->n;
+	return v;
+}
+
+static inline unsigned int gf_mul(struct bch_control *bch, unsigned int a,
+				  unsigned int b)
+{
+	if (!a || !b)
+		return 0;
+	return bch->a_pow_tab[mod_n(bch, bch->a_log_tab[a] +
+				    bch->a_log_tab[b])];
+}
+
+static inline unsigned int gf_sqr(struct bch_control *bch, unsigned int a)
+{
+	return a ? bch->a_pow_tab[mod_n(bch, 2 * bch->a_log_tab[a])] : 0;
+}
+
+static inline unsigned int gf_div(struct bch_control *bch, unsigned int a,
+				  unsigned int b)
+{
+	if (!a)
+		return 0;
+	return bch->a_pow_tab[mod_n(bch, bch->a_log_tab[a] + bch->n -
+				    bch->a_log_tab[b])];
+}
+
+/*
+ * The ecc bits are kept left aligned in ecc_words 32-bit words: bit 31 of
+ * word 0 is the coefficient of x^(ecc_bits-1). The byte form is the same
+ * bit string, most significant bit first.
+ */
+static void load_ecc(struct bch_control *bch, uint32_t *dst,
+		     const uint8_t *src)
+{
+	unsigned int i, rem = bch->ecc_bits & 31;
+
+	memset(dst, 0, bch->ecc_words * sizeof(*dst));
+	for (i = 0; i < bch->ecc_bytes; i++)
+		dst[i >> 2] |= (uint32_t)src[i] << (24 - 8 * (i & 3));
+	/* drop the padding bits of the last byte */
+	if (rem)
+		dst[bch->ecc_words - 1] &= ~0u << (32 - rem);
+}
+
+static void store_ecc(struct bch_control *bch, uint8_t *dst,
+		      const uint32_t *src)
+{
+	unsigned int i;
+
+	for (i = 0; i < bch->ecc_bytes; i++)
+		dst[i] = src[i >> 2] >> (24 - 8 * (i & 3));
+}
+
+static void encode_words(struct bch_control *bch, const uint8_t *data,
+			 unsigned int len, uint32_t *r)
+{
+	const unsigned int l = bch->ecc_words;
+	const uint32_t *p;
+	unsigned int i;
+
+	if (l == 2) {
+		/* the common 4 to 8 bit correcting NAND configurations */
+		uint32_t r0 = r[0], r1 = r[1];
+
+		while (len--) {
+			p = bch->mod8_tab + 2 * ((r0 >> 24) ^ *data++);
+			r0 = ((r0 << 8) | (r1 >> 24)) ^ p[0];
+			r1 = (r1 << 8) ^ p[1];
+		}
+		r[0] = r0;
+		r[1] = r1;
+		return;
+	}
+
+	while (len--) {
+		p = bch->mod8_tab + l * ((r[0] >> 24) ^ *data++);
+		for (i = 0; i < l - 1; i++)
+			r[i] = ((r[i] << 8) | (r[i + 1] >> 24)) ^ p[i];
+		r[l - 1] = (r[l - 1] << 8) ^ p[l - 1];
+	}
+}
+
+/**
+ * encode_bch - calculate the BCH ecc of a data buffer
+ * @bch:	BCH control structure
+ * @data:	data to encode
+ * @len:	data length in bytes
+ * @ecc:	ecc buffer, ecc_bytes long
+ *
+ * @ecc must be zeroed before the first call; it then holds the running
+ * remainder, so a block may be encoded in several chunks.
+ */
+void encode_bch(struct bch_control *bch, const uint8_t *data,
+		unsigned int len, uint8_t *ecc)
+{
+	load_ecc(bch, bch->ecc_buf, ecc);
+	encode_words(bch, data, len, bch->ecc_buf);
+	store_ecc(bch, ecc, bch->ecc_buf);
+}
+EXPORT_SYMBOL_GPL(encode_bch);
+
+/*
+ * Syndromes S(j) = e(alpha^j), j = 1..2t, from the left aligned remainder
+ * of the error polynomial. syn[j-1] holds S(j).
+ */
+static void compute_syndromes(struct bch_control *bch, const uint32_t *r,
+			      unsigned int *syn)
+{
+	const unsigned int t = bch->t;
+	unsigned int w, b, k, deg, idx, step;
+	uint32_t v;
+
+	memset(syn, 0, 2 * t * sizeof(*syn));
+	for (w = 0; w < bch->ecc_words; w++) {
+		v = r[w];
+		while (v) {
+			b = fls(v) - 1;
+			v &= ~(1u << b);
+			deg = bch->ecc_bits - 1 - (32 * w + 31 - b);
+			idx = deg;
+			step = mod_n(bch, 2 * deg);
+			for (k = 0; k < t; k++) {
+				syn[2 * k] ^= bch->a_pow_tab[idx];
+				idx = mod_n(bch, idx + step);
+			}
+		}
+	}
+	/* S(2k) = S(k)^2 over GF(2^m) */
+	for (k = 1; k <= t; k++)
+		syn[2 * k - 1] = gf_sqr(bch, syn[k - 1]);
+}
+
+/*
+ * Berlekamp-Massey: returns the number of errors L and leaves the locator
+ * polynomial Lambda(x) = 1 + l1 x + ... + lL x^L in elp[0..L], or -1 if
+ * the syndromes do not describe up to t errors.
+ */
+static int compute_elp(struct bch_control *bch, const unsigned int *syn)
+{
+	const unsigned int nt = 2 * bch->t;
+	unsigned int *c = bch->elp, *b = c + nt + 1, *tmp = b + nt + 1;
+	unsigned int i, r, d, coef, shift = 1, bd = 1, len = 0;
+
+	memset(c, 0, (nt + 1) * sizeof(*c));
+	memset(b, 0, (nt + 1) * sizeof(*b));
+	c[0] = b[0] = 1;
+
+	for (r = 0; r < nt; r++) {
+		d = syn[r];
+		for (i = 1; i <= len; i++)
+			d ^= gf_mul(bch, c[i], syn[r - i]);
+		if (!d) {
+			shift++;
+			continue;
+		}
+		coef = gf_div(bch, d, bd);
+		if (2 * len <= r) {
+			memcpy(tmp, c, (nt + 1) * sizeof(*c));
+			for (i = 0; i + shift <= nt; i++)
+				c[i + shift] ^= gf_mul(bch, coef, b[i]);
+			len = r + 1 - len;
+			memcpy(b, tmp, (nt + 1) * sizeof(*b));
+			bd = d;
+			shift = 1;
+		} else {
+			for (i = 0; i + shift <= nt; i++)
+				c[i + shift] ^= gf_mul(bch, coef, b[i]);
+			shift++;
+		}
+	}
+
+	if (len > bch->t || !c[len])
+		return -1;
+	for (i = len + 1; i <= nt; i++)
+		if (c[i])
+			return -1;
+	return len;
+}
+
+/*
+ * Chien search for the roots alpha^-d of the locator, d in [0, nbits).
+ * Each error position d is stored in pos[]. Returns the number found.
+ */
+static int find_roots(struct bch_control *bch, unsigned int nerr,
+		      unsigned int nbits, unsigned int *pos)
+{
+	const unsigned int *elp = bch->elp;
+	unsigned int *lg = bch->chien, *dec = lg + bch->t + 1;
+	unsigned int i, k, d, v, nz = 0, found = 0;
+
+	if (nerr == 1) {
+		d = bch->a_log_tab[elp[1]];
+		if (d >= nbits)
+			return 0;
+		pos[0] = d;
+		return 1;
+	}
+
+	/* logarithms of the non-zero coefficients and their per step decrement */
+	for (i = 1; i <= nerr; i++) {
+		if (!elp[i])
+			continue;
+		lg[nz] = bch->a_log_tab[elp[i]];
+		dec[nz] = bch->n - i % bch->n;
+		nz++;
+	}
+
+	for (d = 0; d < nbits; d++) {
+		v = 1;
+		for (k = 0; k < nz; k++) {
+			v ^= bch->a_pow_tab[lg[k]];
+			lg[k] = mod_n(bch, lg[k] + dec[k]);
+		}
+		if (!v) {
+			pos[found++] = d;
+			if (found == nerr)
+				break;
+		}
+	}
+	return found;
+}
+
+/**
+ * decode_bch - locate bit errors in a BCH protected block
+ * @bch:	BCH control structure
+ * @data:	received data, only used when @calc_ecc is NULL
+ * @len:	data length in bytes
+ * @recv_ecc:	ecc read along with the data
+ * @calc_ecc:	ecc calculated over the received data, or NULL
+ * @errloc:	error locations, t entries
+ *
+ * Returns the number of bit errors, 0 if none, -EBADMSG if the block is
+ * not correctable and -EINVAL for a bad length. A location below 8*len is
+ * data bit errloc & 7 (lsb 0) of byte errloc >> 3, anything above is the
+ * same numbering of a bit in the ecc, offset by 8*len.
+ */
+int decode_bch(struct bch_control *bch, const uint8_t *data, unsigned int len,
+	       const uint8_t *recv_ecc, const uint8_t *calc_ecc,
+	       unsigned int *errloc)
+{
+	const unsigned int nbits = 8 * len + bch->ecc_bits;
+	uint32_t *r = bch->ecc_buf, *r2 = bch->ecc_buf2;
+	unsigned int i, d, p, acc = 0;
+	int nerr;
+
+	if (8 * len > bch->n - bch->ecc_bits)
+		return -EINVAL;
+
+	if (calc_ecc) {
+		load_ecc(bch, r, calc_ecc);
+	} else {
+		if (!data)
+			return -EINVAL;
+		memset(r, 0, bch->ecc_words * sizeof(*r));
+		encode_words(bch, data, len, r);
+	}
+	load_ecc(bch, r2, recv_ecc);
+	for (i = 0; i < bch->ecc_words; i++) {
+		r[i] ^= r2[i];
+		acc |= r[i];
+	}
+	if (!acc)
+		return 0;
+
+	compute_syndromes(bch, r, bch->syn);
+	nerr = compute_elp(bch, bch->syn);
+	if (nerr <= 0 || find_roots(bch, nerr, nbits, errloc) != nerr)
+		return -EBADMSG;
+
+	/* polynomial degree to byte/bit location */
+	for (i = 0; i < nerr; i++) {
+		d = errloc[i];
+		if (d >= bch->ecc_bits) {
+			d -= bch->ecc_bits;
+			errloc[i] = 8 * (len - 1 - (d >> 3)) + (d & 7);
+		} else {
+			p = bch->ecc_bits - 1 - d;
+			errloc[i] = 8 * len + (p & ~7) + 7 - (p & 7);
+		}
+	}
+	return nerr;
+}
+EXPORT_SYMBOL_GPL(decode_bch);
+
+static int build_gf_tables(struct bch_control *bch, unsigned int poly)
+{
+	unsigned int i, x = 1;
+	const unsigned int k = 1 << bch->m;
+
+	for (i = 0; i < bch->n; i++) {
+		/* alpha^i repeating early means poly is not primitive */
+		if (x == 1 && i)
+			return -EINVAL;
+		bch->a_pow_tab[i] = x;
+		bch->a_log_tab[x] = i;
+		x <<= 1;
+		if (x & k)
+			x ^= poly;
+	}
+	bch->a_pow_tab[bch->n] = 1;
+	bch->a_log_tab[0] = 0;
+	return 0;
+}
+
+/*
+ * Generator polynomial: product of (x - alpha^r) over the cyclotomic
+ * cosets of alpha^1, alpha^3, ..., alpha^(2t-1). Coefficients end up in
+ * GF(2); returns the degree, or -1 on failure.
+ */
+static int build_generator(struct bch_control *bch, unsigned int *g)
+{
+	unsigned long *roots;
+	unsigned int i, j, r, a, deg = 0;
+
+	roots = kzalloc(BITS_TO_LONGS(bch->n) * sizeof(long), GFP_KERNEL);
+	if (!roots)
+		return -1;
+
+	for (i = 0; i < bch->t; i++) {
+		r = 2 * i + 1;
+		for (j = 0; j < bch->m; j++) {
+			__set_bit(r, roots);
+			r = mod_n(bch, 2 * r);
+		}
+	}
+
+	g[0] = 1;
+	for (r = 0; r < bch->n; r++) {
+		if (!test_bit(r, roots))
+			continue;
+		a = bch->a_pow_tab[r];
+		g[deg + 1] = 0;
+		for (j = deg + 1; j > 0; j--)
+			g[j] = g[j - 1] ^ gf_mul(bch, g[j], a);
+		g[0] = gf_mul(bch, g[0], a);
+		deg++;
+	}
+	kfree(roots);
+
+	for (i = 0; i <= deg; i++)
+		if (g[i] > 1)
+			return -1;
+	return deg;
+}
+
+static void build_mod8_tab(struct bch_control *bch, const uint32_t *gen)
+{
+	const unsigned int l = bch->ecc_words;
+	uint32_t *r;
+	unsigned int v, b, i, fb;
+
+	for (v = 0; v < 256; v++) {
+		r = bch->mod8_tab + l * v;
+		memset(r, 0, l * sizeof(*r));
+		for (b = 8; b-- > 0;) {
+			fb = (r[0] >> 31) ^ ((v >> b) & 1);
+			for (i = 0; i < l - 1; i++)
+				r[i] = (r[i] << 1) | (r[i + 1] >> 31);
+			r[l - 1] <<= 1;
+			if (fb)
+				for (i = 0; i < l; i++)
+					r[i] ^= gen[i];
+		}
+	}
+}
+
+/**
+ * init_bch - build a BCH control structure
+ * @m:		Galois field order, 5..15
+ * @t:		number of correctable bit errors
+ * @prim_poly:	primitive polynomial of GF(2^m), 0 for the default
+ *
+ * Returns NULL if the parameters are invalid or memory is short. The
+ * largest protected data block is 2^m-1-m*t bits.
+ */
+struct bch_control *init_bch(int m, int t, unsigned int prim_poly)
+{
+	struct bch_control *bch;
+	unsigned int *g = NULL, i, p;
+	uint32_t *gen = NULL;
+	int deg;
+
+	if (m < BCH_MIN_M || m > BCH_MAX_M || t < 1 || m * t >= (1 << m) - 1)
+		return NULL;
+	if (!prim_poly)
+		prim_poly = prim_poly_tab[m - BCH_MIN_M];
+
+	bch = kzalloc(sizeof(*bch), GFP_KERNEL);
+	if (!bch)
+		return NULL;
+
+	bch->m = m;
+	bch->t = t;
+	bch->n = (1 << m) - 1;
+	bch->a_pow_tab = kmalloc((bch->n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	bch->a_log_tab = kmalloc((bch->n + 1) * sizeof(uint16_t), GFP_KERNEL);
+	g = kmalloc((m * t + 1) * sizeof(*g), GFP_KERNEL);
+	if (!bch->a_pow_tab || !bch->a_log_tab || !g)
+		goto fail;
+	if (build_gf_tables(bch, prim_poly))
+		goto fail;
+
+	deg = build_generator(bch, g);
+	/* the byte wise encoder shifts 8 remainder bits per step */
+	if (deg < 8)
+		goto fail;
+	bch->ecc_bits = deg;
+	bch->ecc_bytes = DIV_ROUND_UP(deg, 8);
+	bch->ecc_words = DIV_ROUND_UP(deg, 32);
+
+	gen = kzalloc(bch->ecc_words * sizeof(*gen), GFP_KERNEL);
+	bch->mod8_tab = kmalloc(256 * bch->ecc_words * sizeof(uint32_t),
+				GFP_KERNEL);
+	bch->ecc_buf = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->ecc_buf2 = kmalloc(bch->ecc_words * sizeof(uint32_t), GFP_KERNEL);
+	bch->syn = kmalloc(2 * t * sizeof(unsigned int), GFP_KERNEL);
+	bch->elp = kmalloc(3 * (2 * t + 1) * sizeof(unsigned int), GFP_KERNEL);
+	bch->chien = kmalloc(2 * (t + 1) * sizeof(unsigned int), GFP_KERNEL);
+	if (!gen || !bch->mod8_tab || !bch->ecc_buf || !bch->ecc_buf2 ||
+	    !bch->syn || !bch->elp || !bch->chien)
+		goto fail;
+
+	/* generator without its x^deg term, left aligned like the ecc */
+	for (i = 0; i < deg; i++) {
+		if (!g[i])
+			continue;
+		p = deg - 1 - i;
+		gen[p >> 5] |= 1u << (31 - (p & 31));
+	}
+	build_mod8_tab(bch, gen);
+
+	kfree(gen);
+	kfree(g);
+	return bch;
+
+fail:
+	kfree(gen);
+	kfree(g);
+	free_bch(bch);
+	return NULL;
+}
+EXPORT_SYMBOL_GPL(init_bch);
+
+/**
+ * free_bch - free a BCH control structure
+ * @bch:	BCH control structure, may be NULL
+ */
+void free_bch(struct bch_control *bch)
+{
+	if (!bch)
+		return;
+	kfree(bch->chien);
+	kfree(bch->elp);
+	kfree(bch->syn);
+	kfree(bch->ecc_buf2);
+	kfree(bch->ecc_buf);
+	kfree(bch->mod8_tab);
+	kfree(bch->a_log_tab);
+	kfree(bch->a_pow_tab);
+	kfree(bch);
+}
+EXPORT_SYMBOL_GPL(free_bch);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Binary BCH encoder/decoder");
@@ -0,0 +1,141 @@
+/*
+ * lib/slab_bulk_test.c
+ *
+ * Measure the cost per object of kmem_cache_alloc_bulk() and
+ * kmem_cache_free_bulk() against single object kmem_cache_alloc() and
+ * kmem_cache_free() for batch sizes from 1 to 256. The cost of a
+ * local_irq_save()/local_irq_restore() pair is printed as a reference
+ * for the SLUB fastpath; boot with slub_nocmpxchg to compare the
+ * lockless fastpath with the interrupt disabling one.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/slab.h>
+#include <linux/sched.h>
+#include <linux/ktime.h>
+
+#define PRINT_PREF KERN_INFO "slab_bulk_test: "
+
+#define MAX_BATCH	256
+
+static int obj_size = 256;
+module_param(obj_size, int, S_IRUGO);
+MODULE_PARM_DESC(obj_size, "Size of the test objects");
+
+static int nr_objs = 1 << 18;
+module_param(nr_objs, int, S_IRUGO);
+MODULE_PARM_DESC(nr_objs, "Objects allocated and freed per measurement");
+
+static struct kmem_cache *cache;
+static void *objs[MAX_BATCH];
+
+static s64 ns_since(ktime_t start)
+{
+	return ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+
+/* Returns the time in ns per pair */
+static s64 run_irq_pair(void)
+{
+	unsigned long flags;
+	ktime_t start;
+	int n;
+
+	start = ktime_get();
+	for (n = 0; n < nr_objs; n++) {
+		local_irq_save(flags);
+		barrier();
+		local_irq_restore(flags);
+	}
+	return div_s64(ns_since(start), n);
+}
+
+/* Returns the time in ns per object, or a negative error */
+static s64 run_single(int batch)
+{
+	ktime_t start;
+	int n, i;
+
+	start = ktime_get();
+	for (n = 0; n < nr_objs; n += batch) {
+		for (i = 0; i < batch; i++) {
+			objs[i] = kmem_cache_alloc(cache, GFP_KERNEL);
+			if (!objs[i]) {
+				while (i--)
+					kmem_cache_free(cache, objs[i]);
+				return -ENOMEM;
+			}
+		}
+		for (i = 0; i < batch; i++)
+			kmem_cache_free(cache, objs[i]);
+		cond_resched();
+	}
+	return div_s64(ns_since(start), n);
+}
+
+static s64 run_bulk(int batch)
+{
+	ktime_t start;
+	int n;
+
+	start = ktime_get();
+	for (n = 0; n < nr_objs; n += batch) {
+		if (!kmem_cache_alloc_bulk(cache, GFP_KERNEL, batch, objs))
+			return -ENOMEM;
+		kmem_cache_free_bulk(cache, batch, objs);
+		cond_resched();
+	}
+	return div_s64(ns_since(start), n);
+}
+
+static int __init slab_bulk_test_init(void)
+{
+	s64 single, bulk;
+	int batch;
+
+	if (obj_size <= 0 || nr_objs < MAX_BATCH) {
+		printk(PRINT_PREF "bad parameters\n");
+		return -EINVAL;
+	}
+
+	cache = kmem_cache_create("slab_bulk_test", obj_size, 0, 0, NULL);
+	if (!cache)
+		return -ENOMEM;
+
+	printk(PRINT_PREF "%d byte objects, %d per measurement\n",
+	       obj_size, nr_objs);
+	printk(PRINT_PREF "local_irq_save/restore pair: %lld ns\n",
+	       (long long)run_irq_pair());
+	printk(PRINT_PREF "batch  single ns/obj  bulk ns/obj\n");
+
+	for (batch = 1; batch <= MAX_BATCH; batch <<= 1) {
+		single = run_single(batch);
+		bulk = run_bulk(batch);
+		if (single < 0 || bulk < 0) {
+			printk(PRINT_PREF "error: out of memory\n");
+			kmem_cache_destroy(cache);
+			return -ENOMEM;
+		}
+		printk(PRINT_PREF "%5d  %13lld  %11lld\n", batch,
+		       (long long)single, (long long)bulk);
+	}
+
+	kmem_cache_destroy(cache);
+	return 0;
+}
+module_init(slab_bulk_test_init);
+
+static void __exit slab_bulk_test_exit(void)
+{
+}
+module_exit(slab_bulk_test_exit);
+
+MODULE_DESCRIPTION("Slab bulk allocation benchmark");
+MODULE_LICENSE("GPL");
@@ -36,9 +36,18 @@ static inline pgprot_t pgprot_modify(pgprot_t oldprot, pgprot_t newprot)
 }
 #endif
 
+/*
+ * The part of the range whose present ptes were changed, and so may be
+ * cached in the TLB. end stays 0 if there is none.
+ */
+struct prot_flush_range {
+	unsigned long start;
+	unsigned long end;
+};
+
 static void change_pte_range(struct mm_struct *mm, pmd_t *pmd,
 		unsigned long addr, unsigned long end, pgprot_t newprot,
-		int dirty_accountable)
+		int dirty_accountable, struct prot_flush_range *flush)
 {
 	pte_t *pte, oldpte;
 	spinlock_t *ptl;
@@ -61,6 +70,10 @@ static void change_pte_range(struct mm_struct *mm, pmd_t *pmd,
 				ptent = pte_mkwrite(ptent);
 
 			ptep_modify_prot_commit(mm, addr, pte, ptent);
+
+			if (!flush->end)
+				flush->start = addr;
+			flush->end = addr + PAGE_SIZE;
 		} else if (PAGE_MIGRATION && !pte_file(oldpte)) {
 			swp_entry_t entry = pte_to_swp_entry(oldpte);
 
@@ -81,7 +94,7 @@ static void change_pte_range(struct mm_struct *mm, pmd_t *pmd,
 
 static inline void change_pmd_range(struct mm_struct *mm, pud_t *pud,
 		unsigned long addr, unsigned long end, pgprot_t newprot,
-		int dirty_accountable)
+		int dirty_accountable, struct prot_flush_range *flush)
 {
 	pmd_t *pmd;
 	unsigned long next;
@@ -91,13 +104,14 @@ static inline void change_pmd_range(struct mm_struct *mm, pud_t *pud,
 		next = pmd_addr_end(addr, end);
 		if (pmd_none_or_clear_bad(pmd))
 			continue;
-		change_pte_range(mm, pmd, addr, next, newprot, dirty_accountable);
+		change_pte_range(mm, pmd, addr, next, newprot,
+				 dirty_accountable, flush);
 	} while (pmd++, addr = next, addr != end);
 }
 
 static inline void change_pud_range(struct mm_struct *mm, pgd_t *pgd,
 		unsigned long addr, unsigned long end, pgprot_t newprot,
-		int dirty_accountable)
+		int dirty_accountable, struct prot_flush_range *flush)
 {
 	pud_t *pud;
 	unsigned long next;
@@ -107,7 +121,8 @@ static inline void change_pud_range(struct mm_struct *mm, pgd_t *pgd,
 		next = pud_addr_end(addr, end);
 		if (pud_none_or_clear_bad(pud))
 			continue;
-		change_pmd_range(mm, pud, addr, next, newprot, dirty_accountable);
+		change_pmd_range(mm, pud, addr, next, newprot,
+				 dirty_accountable, flush);
 	} while (pud++, addr = next, addr != end);
 }
 
@@ -116,9 +131,9 @@ static void change_protection(struct vm_area_struct *vma,
 		int dirty_accountable)
 {
 	struct mm_struct *mm = vma->vm_mm;
+	struct prot_flush_range flush = { 0, 0 };
 	pgd_t *pgd;
 	unsigned long next;
-	unsigned long start = addr;
 
 	BUG_ON(addr >= end);
 	pgd = pgd_offset(mm, addr);
@@ -127,9 +142,12 @@ static void change_protection(struct vm_area_struct *vma,
 		next = pgd_addr_end(addr, end);
 		if (pgd_none_or_clear_bad(pgd))
 			continue;
-		change_pud_range(mm, pgd, addr, next, newprot, dirty_accountable);
+		change_pud_range(mm, pgd, addr, next, newprot,
+				 dirty_accountable, &flush);
 	} while (pgd++, addr = next, addr != end);
-	flush_tlb_range(vma, start, end);
+	/* nothing was mapped, nothing can be in the TLB */
+	if (flush.end)
+		flush_tlb_range(vma, flush.start, flush.end);
 }
 
 int
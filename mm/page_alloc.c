@@ -549,23 +549,30 @@ static inline int free_pages_check(struct page *page)
 	return 0;
 }
 
-/**
- * free_pcppages_bulk:释放count个per-cpu页高速缓存到伙伴伙伴系统中
- * @ count:释放页框的个数
+/*
+ * zone->lock is offered to other cpus every FREE_MERGE_BATCH blocks
+ * merged, so that draining a large pageset does not stall them.
  */
-static void free_pcppages_bulk(struct zone *zone, int count,
-					struct per_cpu_pages *pcp)
+#define FREE_MERGE_BATCH	32
+
+/*
+ * Free count blocks of 2^order pages from the per migrate type lists of a
+ * per cpu pageset back to the buddy allocator.
+ *
+ * The per cpu lists already sort the blocks by zone and order. They are
+ * taken off the lists before zone->lock is taken, so that only the buddy
+ * merging runs under the lock.
+ */
+static void free_pcp_lists_bulk(struct zone *zone, int count,
+				struct list_head *lists, int order)
 {
 	int migratetype = 0;
 	int batch_free = 0;
+	int nr = count, merged = 0, counted = 0;
+	struct page *page, *next;
+	LIST_HEAD(head);
 
-	spin_lock(&zone->lock);
-	zone_clear_flag(zone, ZONE_ALL_UNRECLAIMABLE);
-	zone->pages_scanned = 0;
-
-	__mod_zone_page_state(zone, NR_FREE_PAGES, count);
 	while (count) {
-		struct page *page;
 		struct list_head *list;
 
 		/*
@@ -579,20 +586,136 @@ static void free_pcppages_bulk(struct zone *zone, int count,
 			batch_free++;
 			if (++migratetype == MIGRATE_PCPTYPES)
 				migratetype = 0;
-			list = &pcp->lists[migratetype];
+			list = &lists[migratetype];
 		} while (list_empty(list));
 
 		do {
 			page = list_entry(list->prev, struct page, lru);
-			/* must delete as __free_one_page list manipulates */
-			list_del(&page->lru);
-			__free_one_page(page, zone, 0, migratetype);
-			trace_mm_page_pcpu_drain(page, 0, migratetype);
+			list_move_tail(&page->lru, &head);
+			/* the list it came from, MIGRATE_RESERVE included */
+			set_page_private(page, migratetype);
+			trace_mm_page_pcpu_drain(page, order, migratetype);
 		} while (--count && --batch_free && !list_empty(list));
 	}
+
+	spin_lock(&zone->lock);
+	zone_clear_flag(zone, ZONE_ALL_UNRECLAIMABLE);
+	zone->pages_scanned = 0;
+
+	list_for_each_entry_safe(page, next, &head, lru) {
+		migratetype = page_private(page);
+		/* must delete as __free_one_page list manipulates */
+		list_del(&page->lru);
+		__free_one_page(page, zone, order, migratetype);
+
+		/*
+		 * Only pages already on the free lists are counted as free
+		 * before the lock is let go, or a watermark check could
+		 * pass on pages __rmqueue() cannot find yet.
+		 */
+		if (++merged % FREE_MERGE_BATCH == 0 &&
+		    spin_is_contended(&zone->lock)) {
+			__mod_zone_page_state(zone, NR_FREE_PAGES,
+					      (merged - counted) << order);
+			counted = merged;
+			spin_unlock(&zone->lock);
+			spin_lock(&zone->lock);
+		}
+	}
+	__mod_zone_page_state(zone, NR_FREE_PAGES, (nr - counted) << order);
 	spin_unlock(&zone->lock);
 }
 
+/**
+ * free_pcppages_bulk:释放count个per-cpu页高速缓存到伙伴伙伴系统中
+ * @ count:释放页框的个数
+ */
+static void free_pcppages_bulk(struct zone *zone, int count,
+					struct per_cpu_pages *pcp)
+{
+	free_pcp_lists_bulk(zone, count, pcp->lists, 0);
+}
+
+/*
+ * The order 1 to PCP_MAX_ORDER lists. Their batch starts at one block and
+ * doubles every time the lists run dry, up to the order 0 batch scaled
+ * down by the order, so that a cpu allocating an order a lot refills it
+ * in large chunks. It halves every time a free overflows the high
+ * watermark, so that a cpu which mostly frees an order holds few blocks
+ * of it back from merging. The high watermark follows the batch.
+ *
+ * A pageset whose order 0 high watermark leaves less than two blocks of
+ * an order (boot pagesets, NOMMU) does not cache that order at all.
+ */
+static inline int pcp_order_cached(struct per_cpu_pages *pcp, int order)
+{
+	return (pcp->high >> order) >= 2;
+}
+
+static void pcp_order_set_batch(struct per_cpu_pages *pcp, int order,
+				int batch)
+{
+	struct per_cpu_order_pages *po = &pcp->orders[order - 1];
+
+	po->batch = clamp(batch, 1, max(1, pcp->batch >> order));
+	po->high = min(4 * po->batch, pcp->high >> order);
+}
+
+/* Free all blocks on the order lists, interrupts must be disabled */
+static void drain_pcp_orders(struct zone *zone, struct per_cpu_pages *pcp)
+{
+	int order;
+
+	for (order = 1; order <= PCP_MAX_ORDER; order++) {
+		struct per_cpu_order_pages *po = &pcp->orders[order - 1];
+
+		if (po->count) {
+			free_pcp_lists_bulk(zone, po->count, po->lists, order);
+			po->count = 0;
+		}
+	}
+}
+
+/*
+ * Put a block of order 1 to PCP_MAX_ORDER on the lists of this cpu.
+ * Returns 0 if the block has to go to the buddy allocator instead.
+ * Interrupts must be disabled.
+ */
+static int free_pcp_order_page(struct zone *zone, struct page *page,
+			       int order, int migratetype)
+{
+	struct per_cpu_pages *pcp;
+	struct per_cpu_order_pages *po;
+
+	if (!order || order > PCP_MAX_ORDER || migratetype == MIGRATE_ISOLATE)
+		return 0;
+	pcp = &zone_pcp(zone, smp_processor_id())->pcp;
+	if (!pcp_order_cached(pcp, order))
+		return 0;
+
+	/* the block is handed out again through prep_new_page() */
+	if (unlikely(PageCompound(page)))
+		if (unlikely(destroy_compound_page(page, order)))
+			return 1;
+
+	/* see free_hot_cold_page() */
+	if (migratetype >= MIGRATE_PCPTYPES)
+		migratetype = MIGRATE_MOVABLE;
+
+	po = &pcp->orders[order - 1];
+	set_page_private(page, migratetype);
+	list_add(&page->lru, &po->lists[migratetype]);
+	po->count++;
+	if (po->count >= po->high) {
+		int to_free = min(po->batch, po->count);
+
+		free_pcp_lists_bulk(zone, to_free, po->lists, order);
+		po->count -= to_free;
+		pcp_order_set_batch(pcp, order, po->batch / 2);
+	}
+	return 1;
+}
+
 /**
  * free_one_page:释放2^order个连续页框
  * @ zone:page所在的区
@@ -619,7 +742,9 @@ static void free_one_page(struct zone *zone, struct page *page, int order,
  */
 static void __free_pages_ok(struct page *page, unsigned int order)
 {
+	struct zone *zone = page_zone(page);
 	unsigned long flags;
+	int migratetype;
 	int i;
 	int bad = 0;
 	int wasMlocked = __TestClearPageMlocked(page);
@@ -643,8 +768,9 @@ static void __free_pages_ok(struct page *page, unsigned int order)
 	if (unlikely(wasMlocked))
 		free_page_mlock(page);
 	__count_vm_events(PGFREE, 1 << order);
-	free_one_page(page_zone(page), page, order,
-					get_pageblock_migratetype(page));
+	migratetype = get_pageblock_migratetype(page);
+	if (!free_pcp_order_page(zone, page, order, migratetype))
+		free_one_page(zone, page, order, migratetype);
 	local_irq_restore(flags);
 }
 
@@ -1083,8 +1209,11 @@ void drain_zone_pages(struct zone *zone, struct per_cpu_pages *pcp)
 		to_drain = pcp->batch;
 	else
 		to_drain = pcp->count;
-	free_pcppages_bulk(zone, to_drain, pcp);
-	pcp->count -= to_drain;
+	if (to_drain) {
+		free_pcppages_bulk(zone, to_drain, pcp);
+		pcp->count -= to_drain;
+	}
+	drain_pcp_orders(zone, pcp);
 	local_irq_restore(flags);
 }
 #endif
@@ -1111,6 +1240,7 @@ static void drain_pages(unsigned int cpu)
 		/*Per-CPU的zone页框集合中的页加入到伙伴系统中*/
 		free_pcppages_bulk(zone, pcp->count, pcp);
 		pcp->count = 0;
+		drain_pcp_orders(zone, pcp);
 		local_irq_restore(flags);
 	}
 }
@@ -1167,26 +1297,18 @@ void mark_free_pages(struct zone *zone)
 }
 #endif /* CONFIG_PM */
 
-/**
- * free_hot_cold_page: 释放单个页,并加入到Per-CPU pageset管理结构中
- * @ page: 页数据结构
- * @ cold: 0: 加入到空闲块管理结构的链表头部(热缓存)
- *         1：加入到空闲块管理结构的链表尾部(冷缓存)
-*/
-static void free_hot_cold_page(struct page *page, int cold)
+/*
+ * The part of freeing an order 0 page that needs no per cpu data: the
+ * checks and debug hooks. Returns 0 if the page must not be freed.
+ */
+static int free_hot_cold_page_prepare(struct page *page)
 {
-	struct zone *zone = page_zone(page);
-	struct per_cpu_pages *pcp;
-	unsigned long flags;
-	int migratetype;
-	int wasMlocked = __TestClearPageMlocked(page);
-
 	kmemcheck_free_shadow(page, 0);
 
 	if (PageAnon(page))
 		page->mapping = NULL;
 	if (free_pages_check(page))
-		return;
+		return 0;
 
 	if (!PageHighMem(page)) {
 		debug_check_no_locks_freed(page_address(page), PAGE_SIZE);
@@ -1194,14 +1316,23 @@ static void free_hot_cold_page(struct page *page, int cold)
 	}
 	arch_free_page(page, 0);
 	kernel_map_pages(page, 1, 0);
+	return 1;
+}
+
+/*
+ * Put a prepared order 0 page on the per cpu lists of its zone.
+ * Interrupts must be disabled.
+ */
+static void free_hot_cold_page_pcp(struct page *page, int cold)
+{
+	struct zone *zone = page_zone(page);
+	struct per_cpu_pages *pcp;
+	int migratetype;
 
 	/*per-CPU pageset变量*/
-	pcp = &zone_pcp(zone, get_cpu())->pcp;
+	pcp = &zone_pcp(zone, smp_processor_id())->pcp;
 	migratetype = get_pageblock_migratetype(page);
 	set_page_private(page, migratetype);
-	local_irq_save(flags);
-	if (unlikely(wasMlocked))
-		free_page_mlock(page);
 	__count_vm_event(PGFREE);
 
 	/*
@@ -1214,7 +1345,7 @@ static void free_hot_cold_page(struct page *page, int cold)
 	if (migratetype >= MIGRATE_PCPTYPES) {
 		if (unlikely(migratetype == MIGRATE_ISOLATE)) {
 			free_one_page(zone, page, 0, migratetype);
-			goto out;
+			return;
 		}
 		migratetype = MIGRATE_MOVABLE;
 	}
@@ -1232,10 +1363,55 @@ static void free_hot_cold_page(struct page *page, int cold)
 		free_pcppages_bulk(zone, pcp->batch, pcp);
 		pcp->count -= pcp->batch;
 	}
+}
 
-out:
+/**
+ * free_hot_cold_page: 释放单个页,并加入到Per-CPU pageset管理结构中
+ * @ page: 页数据结构
+ * @ cold: 0: 加入到空闲块管理结构的链表头部(热缓存)
+ *         1：加入到空闲块管理结构的链表尾部(冷缓存)
+*/
+static void free_hot_cold_page(struct page *page, int cold)
+{
+	unsigned long flags;
+	int wasMlocked = __TestClearPageMlocked(page);
+
+	if (!free_hot_cold_page_prepare(page))
+		return;
+
+	local_irq_save(flags);
+	if (unlikely(wasMlocked))
+		free_page_mlock(page);
+	free_hot_cold_page_pcp(page, cold);
 	local_irq_restore(flags);
-	put_cpu();
+}
+
+/*
+ * Free a list of order 0 pages linked through page->lru, as gathered by
+ * release_pages() when a process unmaps memory or exits. The checks run
+ * with interrupts enabled, then all pages go to the per cpu lists in one
+ * interrupt disabled section. What overflows the per cpu lists reaches
+ * the buddy allocator pcp->batch pages per zone->lock hold.
+ */
+void free_hot_cold_page_list(struct list_head *list, int cold)
+{
+	struct page *page, *next;
+	unsigned long flags;
+
+	list_for_each_entry_safe(page, next, list, lru) {
+		trace_mm_pagevec_free(page, cold);
+		if (unlikely(PageMlocked(page))) {
+			list_del(&page->lru);
+			free_hot_cold_page(page, cold);
+		} else if (!free_hot_cold_page_prepare(page))
+			list_del(&page->lru);
+	}
+
+	local_irq_save(flags);
+	list_for_each_entry_safe(page, next, list, lru)
+		free_hot_cold_page_pcp(page, cold);
+	local_irq_restore(flags);
+	INIT_LIST_HEAD(list);
 }
 
 /**
@@ -1293,6 +1469,21 @@ struct page *buffered_rmqueue(struct zone *preferred_zone,
 	int cold = !!(gfp_flags & __GFP_COLD);
 	int cpu;
 
+	if (unlikely(gfp_flags & __GFP_NOFAIL)) {
+		/*
+		 * __GFP_NOFAIL is not to be used in new code.
+		 *
+		 * All __GFP_NOFAIL callers should be fixed so that they
+		 * properly detect and handle allocation failures.
+		 *
+		 * We most definitely don't want callers attempting to
+		 * allocate greater than order-1 page units with
+		 * __GFP_NOFAIL, whether or not the per cpu lists serve
+		 * them.
+		 */
+		WARN_ON_ONCE(order > 1);
+	}
+
 again:
 	cpu  = get_cpu();
 	/*如果是获得一个页框，则从per-cpu pagesets中获得空闲页框*/
@@ -1322,20 +1513,34 @@ again:
 
 		list_del(&page->lru);
 		pcp->count--;
+	} else if (order <= PCP_MAX_ORDER &&
+		   pcp_order_cached(&zone_pcp(zone, cpu)->pcp, order)) {
+		struct per_cpu_pages *pcp;
+		struct per_cpu_order_pages *po;
+		struct list_head *list;
+
+		pcp = &zone_pcp(zone, cpu)->pcp;
+		po = &pcp->orders[order - 1];
+		list = &po->lists[migratetype];
+		local_irq_save(flags);
+		if (list_empty(list)) {
+			po->miss++;
+			po->count += rmqueue_bulk(zone, order, po->batch, list,
+						  migratetype, cold);
+			if (unlikely(list_empty(list)))
+				goto failed;
+			pcp_order_set_batch(pcp, order, po->batch * 2);
+		} else
+			po->hit++;
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+
+		list_del(&page->lru);
+		po->count--;
 	} else {
-		if (unlikely(gfp_flags & __GFP_NOFAIL)) {
-			/*
-			 * __GFP_NOFAIL is not to be used in new code.
-			 *
-			 * All __GFP_NOFAIL callers should be fixed so that they
-			 * properly detect and handle allocation failures.
-			 *
-			 * We most definitely don't want callers attempting to
-			 * allocate greater than order-1 page units with
-			 * __GFP_NOFAIL.
-			 */
-			WARN_ON_ONCE(order > 1);
-		}
 		spin_lock_irqsave(&zone->lock, flags);
 		page = __rmqueue(zone, order, migratetype);
 		__mod_zone_page_state(zone, NR_FREE_PAGES, -(1 << order));
@@ -1825,10 +2030,15 @@ __alloc_pages_direct_reclaim(gfp_t gfp_mask, unsigned int order,
 
 	cond_resched();
 
-	if (order != 0)
+	/*
+	 * Blocks on the order 1 to PCP_MAX_ORDER per cpu lists are not
+	 * counted as free, yet an order 0 allocation could split them, so
+	 * they go back to the buddy lists before reclaim is given up on.
+	 */
+	if (order != 0 || !*did_some_progress)
 		drain_all_pages();
 
-	if (likely(*did_some_progress))
+	if (likely(*did_some_progress) || order == 0)
 		page = get_page_from_freelist(gfp_mask, nodemask, order,
 					zonelist, high_zoneidx,
 					alloc_flags, preferred_zone,
@@ -3240,7 +3450,7 @@ static int zone_batchsize(struct zone *zone)
 static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 {
 	struct per_cpu_pages *pcp;
-	int migratetype;
+	int migratetype, order;
 
 	memset(p, 0, sizeof(*p));
 
@@ -3250,6 +3460,13 @@ static void setup_pageset(struct per_cpu_pageset *p, unsigned long batch)
 	pcp->batch = max(1UL, 1 * batch);
 	for (migratetype = 0; migratetype < MIGRATE_PCPTYPES; migratetype++)
 		INIT_LIST_HEAD(&pcp->lists[migratetype]);
+
+	for (order = 1; order <= PCP_MAX_ORDER; order++) {
+		for (migratetype = 0; migratetype < MIGRATE_PCPTYPES;
+		     migratetype++)
+			INIT_LIST_HEAD(&pcp->orders[order - 1].lists[migratetype]);
+		pcp_order_set_batch(pcp, order, 1);
+	}
 }
 
 /*
@@ -3261,12 +3478,17 @@ static void setup_pagelist_highmark(struct per_cpu_pageset *p,
 				unsigned long high)
 {
 	struct per_cpu_pages *pcp;
+	int order;
 
 	pcp = &p->pcp;
 	pcp->high = high;
 	pcp->batch = max(1UL, high/4);
 	if ((high/4) > (PAGE_SHIFT * 8))
 		pcp->batch = PAGE_SHIFT * 8;
+
+	/* blocks already on the order lists are spilled by the next frees */
+	for (order = 1; order <= PCP_MAX_ORDER; order++)
+		pcp_order_set_batch(pcp, order, 1);
 }
 
 
@@ -3449,6 +3671,7 @@ static int __zone_pcp_update(void *data)
 
 		local_irq_save(flags);
 		free_pcppages_bulk(zone, pcp->count, pcp);
+		drain_pcp_orders(zone, pcp);
 		setup_pageset(pset, batch);
 		local_irq_restore(flags);
 	}
@@ -28,6 +28,7 @@
 #include <linux/memory.h>
 #include <linux/math64.h>
 #include <linux/fault-inject.h>
+#include <linux/uaccess.h>
 
 /*
  * Lock order:
@@ -171,6 +172,7 @@
 /* Internal SLUB flags */
 #define __OBJECT_POISON		0x80000000 /* Poison object */
 #define __SYSFS_ADD_DEFERRED	0x40000000 /* Not yet visible via sysfs */
+#define __CMPXCHG_DOUBLE	0x20000000 /* Use the lockless fastpaths */
 
 static int kmem_size = sizeof(struct kmem_cache);
 
@@ -251,6 +253,16 @@ static inline struct kmem_cache_cpu *get_cpu_slab(struct kmem_cache *s, int cpu)
 #endif
 }
 
+/*
+ * Every change of a cpu slab's freelist or page bumps its transaction id,
+ * so that a lockless fastpath interrupted half way notices the change and
+ * retries instead of acting on stale state.
+ */
+static inline unsigned long next_tid(unsigned long tid)
+{
+	return tid + 1;
+}
+
 /* Verify that a pointer has an address that is valid within a slab page */
 static inline int check_valid_pointer(struct kmem_cache *s,
 				struct page *page, const void *object)
@@ -1490,6 +1502,7 @@ static void deactivate_slab(struct kmem_cache *s, struct kmem_cache_cpu *c)
 		page->inuse--;
 	}
 	c->page = NULL;
+	c->tid = next_tid(c->tid);
 	unfreeze_slab(s, page, tail);
 }
 
@@ -1649,6 +1662,7 @@ load_freelist:
 	c->page->freelist = NULL;
 	c->node = page_to_nid(c->page);
 unlock_out:
+	c->tid = next_tid(c->tid);
 	slab_unlock(c->page);
 	stat(c, ALLOC_SLOWPATH);
 	return object;
@@ -1695,6 +1709,114 @@ debug:
 	goto unlock_out;
 }
 
+static inline void slab_post_alloc_hook(struct kmem_cache *s, gfp_t flags,
+					void *object)
+{
+	if (unlikely((flags & __GFP_ZERO) && object))
+		memset(object, 0, s->objsize);
+
+	kmemcheck_slab_alloc(s, flags, object, s->objsize);
+	kmemleak_alloc_recursive(object, s->objsize, 1, s->flags, flags);
+}
+
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
+/*
+ * Lockless fastpaths. Instead of disabling interrupts, pin the task to
+ * the cpu and replace the freelist and the transaction id together with
+ * a cpu local double word cmpxchg. Everything else that changes the cpu
+ * slab runs with interrupts disabled and bumps the tid, so if an
+ * interrupt got in between the cmpxchg fails and the fastpath retries.
+ *
+ * Return NULL or 0 if the fastpath cannot be used, the caller then takes
+ * the interrupt disabled path.
+ */
+
+/*
+ * The object may be handed out and even its slab freed by an interrupt
+ * before the cmpxchg fails, read its free pointer carefully.
+ */
+static inline void *get_freepointer_safe(struct kmem_cache_cpu *c,
+					 void **object)
+{
+#ifdef CONFIG_DEBUG_PAGEALLOC
+	void *p;
+
+	probe_kernel_read(&p, object + c->offset, sizeof(p));
+	return p;
+#else
+	return object[c->offset];
+#endif
+}
+
+static __always_inline void *slab_alloc_lockless(struct kmem_cache *s,
+						 int node)
+{
+	struct kmem_cache_cpu *c;
+	void **object;
+	unsigned long tid;
+
+	if (!(s->flags & __CMPXCHG_DOUBLE))
+		return NULL;
+
+	preempt_disable();
+	c = get_cpu_slab(s, smp_processor_id());
+	do {
+		tid = c->tid;
+		barrier();
+		object = c->freelist;
+		if (unlikely(!object || !node_match(c, node))) {
+			preempt_enable();
+			return NULL;
+		}
+	} while (unlikely(!cmpxchg_double_local(&c->freelist, object, tid,
+			get_freepointer_safe(c, object), next_tid(tid))));
+	stat(c, ALLOC_FASTPATH);
+	preempt_enable();
+
+	return object;
+}
+
+static __always_inline int slab_free_lockless(struct kmem_cache *s,
+					      struct page *page, void **object)
+{
+	struct kmem_cache_cpu *c;
+	void **prior;
+	unsigned long tid;
+
+	if (!(s->flags & __CMPXCHG_DOUBLE))
+		return 0;
+
+	preempt_disable();
+	c = get_cpu_slab(s, smp_processor_id());
+	do {
+		tid = c->tid;
+		barrier();
+		if (unlikely(page != c->page || c->node < 0)) {
+			preempt_enable();
+			return 0;
+		}
+		prior = c->freelist;
+		object[c->offset] = prior;
+	} while (unlikely(!cmpxchg_double_local(&c->freelist, prior, tid,
+						object, next_tid(tid))));
+	stat(c, FREE_FASTPATH);
+	preempt_enable();
+
+	return 1;
+}
+#else
+static inline void *slab_alloc_lockless(struct kmem_cache *s, int node)
+{
+	return NULL;
+}
+
+static inline int slab_free_lockless(struct kmem_cache *s,
+				     struct page *page, void **object)
+{
+	return 0;
+}
+#endif
+
 /*
  * Inlined fastpath so that allocation functions (kmalloc, kmem_cache_alloc)
  * have the fastpath folded into their functions. So no function call
@@ -1703,7 +1825,8 @@ debug:
  * The fastpath works by first checking if the lockless freelist can be used.
  * If not then __slab_alloc is called for slow processing.
  *
- * Otherwise we can simply pick the next object from the lockless free list.
+ * Otherwise we can simply pick the next object from the lockless free list,
+ * without disabling interrupts where the architecture allows.
  */
 static __always_inline void *slab_alloc(struct kmem_cache *s,
 		gfp_t gfpflags, int node, unsigned long addr)
@@ -1711,7 +1834,6 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	void **object;
 	struct kmem_cache_cpu *c;
 	unsigned long flags;
-	unsigned int objsize;
 
 	gfpflags &= gfp_allowed_mask;
 
@@ -1721,25 +1843,24 @@ static __always_inline void *slab_alloc(struct kmem_cache *s,
 	if (should_failslab(s->objsize, gfpflags))
 		return NULL;
 
-	local_irq_save(flags);
-	c = get_cpu_slab(s, smp_processor_id());
-	objsize = c->objsize;
-	if (unlikely(!c->freelist || !node_match(c, node)))
+	object = slab_alloc_lockless(s, node);
+	if (unlikely(!object)) {
+		local_irq_save(flags);
+		c = get_cpu_slab(s, smp_processor_id());
+		if (unlikely(!c->freelist || !node_match(c, node)))
 
-		object = __slab_alloc(s, gfpflags, node, addr, c);
+			object = __slab_alloc(s, gfpflags, node, addr, c);
 
-	else {
-		object = c->freelist;
-		c->freelist = object[c->offset];
-		stat(c, ALLOC_FASTPATH);
+		else {
+			object = c->freelist;
+			c->freelist = object[c->offset];
+			c->tid = next_tid(c->tid);
+			stat(c, ALLOC_FASTPATH);
+		}
+		local_irq_restore(flags);
 	}
-	local_irq_restore(flags);
-
-	if (unlikely((gfpflags & __GFP_ZERO) && object))
-		memset(object, 0, objsize);
 
-	kmemcheck_slab_alloc(s, gfpflags, object, c->objsize);
-	kmemleak_alloc_recursive(object, objsize, 1, s->flags, gfpflags);
+	slab_post_alloc_hook(s, gfpflags, object);
 
 	return object;
 }
@@ -1792,12 +1913,18 @@ EXPORT_SYMBOL(kmem_cache_alloc_node_notrace);
  * So we still attempt to reduce cache line usage. Just take the slab
  * lock and free the item. If there is no additional partial page
  * handling required then we can return immediately.
+ *
+ * kmem_cache_free_bulk() passes a chain of cnt objects of the same slab,
+ * linked through their free pointers from head to tail, so that the slab
+ * lock is taken once for all of them. Slabs being debugged are always
+ * freed one object at a time.
  */
 static void __slab_free(struct kmem_cache *s, struct page *page,
-			void *x, unsigned long addr, unsigned int offset)
+			void *head, void *tail, int cnt,
+			unsigned long addr, unsigned int offset)
 {
 	void *prior;
-	void **object = (void *)x;
+	void **object = (void *)tail;
 	struct kmem_cache_cpu *c;
 
 	c = get_cpu_slab(s, raw_smp_processor_id());
@@ -1809,8 +1936,8 @@ static void __slab_free(struct kmem_cache *s, struct page *page,
 
 checks_ok:
 	prior = object[offset] = page->freelist;
-	page->freelist = object;
-	page->inuse--;
+	page->freelist = head;
+	page->inuse -= cnt;
 
 	if (unlikely(PageSlubFrozen(page))) {
 		stat(c, FREE_FROZEN);
@@ -1847,11 +1974,36 @@ slab_empty:
 	return;
 
 debug:
-	if (!free_debug_processing(s, page, x, addr))
+	if (!free_debug_processing(s, page, head, addr))
 		goto out_unlock;
 	goto checks_ok;
 }
 
+/* Debug checks for an object being freed, called with interrupts off */
+static inline void slab_free_hook_irq(struct kmem_cache *s, void *object)
+{
+	kmemcheck_slab_free(s, object, s->objsize);
+	debug_check_no_locks_freed(object, s->objsize);
+	if (!(s->flags & SLAB_DEBUG_OBJECTS))
+		debug_check_no_obj_freed(object, s->objsize);
+}
+
+/* The same for the lockless fastpath, which runs with interrupts on */
+static inline void slab_free_hook(struct kmem_cache *s, void *object)
+{
+	kmemleak_free_recursive(object, s->flags);
+#if defined(CONFIG_KMEMCHECK) || defined(CONFIG_LOCKDEP) || \
+	defined(CONFIG_DEBUG_OBJECTS_FREE)
+	{
+		unsigned long flags;
+
+		local_irq_save(flags);
+		slab_free_hook_irq(s, object);
+		local_irq_restore(flags);
+	}
+#endif
+}
+
 /*
  * Fastpath with forced inlining to produce a kfree and kmem_cache_free that
  * can perform fastpath freeing without additional function calls.
@@ -1870,19 +2022,19 @@ static __always_inline void slab_free(struct kmem_cache *s,
 	struct kmem_cache_cpu *c;
 	unsigned long flags;
 
-	kmemleak_free_recursive(x, s->flags);
+	slab_free_hook(s, object);
+	if (slab_free_lockless(s, page, object))
+		return;
+
 	local_irq_save(flags);
 	c = get_cpu_slab(s, smp_processor_id());
-	kmemcheck_slab_free(s, object, c->objsize);
-	debug_check_no_locks_freed(object, c->objsize);
-	if (!(s->flags & SLAB_DEBUG_OBJECTS))
-		debug_check_no_obj_freed(object, c->objsize);
 	if (likely(page == c->page && c->node >= 0)) {
 		object[c->offset] = c->freelist;
 		c->freelist = object;
+		c->tid = next_tid(c->tid);
 		stat(c, FREE_FASTPATH);
 	} else
-		__slab_free(s, page, x, addr, c->offset);
+		__slab_free(s, page, x, x, 1, addr, c->offset);
 
 	local_irq_restore(flags);
 }
@@ -1899,6 +2051,141 @@ void kmem_cache_free(struct kmem_cache *s, void *x)
 }
 EXPORT_SYMBOL(kmem_cache_free);
 
+/*
+ * Bulk allocation and freeing. The cpu slab's lockless freelist acts as a
+ * per cpu magazine: a batch is taken from and returned to it with
+ * interrupts disabled once, instead of once per object. When it runs dry
+ * __slab_alloc() refills it with the whole freelist of the next slab.
+ */
+
+/**
+ * kmem_cache_free_bulk - free an array of objects
+ * @s: the cache the objects were allocated from
+ * @size: the number of objects
+ * @p: the objects, NULL entries are skipped
+ *
+ * Objects of the cpu slab go back to its freelist. Runs of objects from
+ * another slab are chained and freed to that slab under one lock.
+ */
+void kmem_cache_free_bulk(struct kmem_cache *s, size_t size, void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long flags;
+	size_t i, j;
+
+	for (i = 0; i < size; i++) {
+		if (!p[i])
+			continue;
+		kmemleak_free_recursive(p[i], s->flags);
+		trace_kmem_cache_free(_RET_IP_, p[i]);
+	}
+
+	local_irq_save(flags);
+	c = get_cpu_slab(s, smp_processor_id());
+
+	for (i = 0; i < size; i++) {
+		void **object = p[i];
+		void *head;
+		struct page *page;
+		int cnt;
+
+		if (!object)
+			continue;
+
+		page = virt_to_head_page(object);
+		slab_free_hook_irq(s, object);
+
+		if (likely(page == c->page && c->node >= 0)) {
+			object[c->offset] = c->freelist;
+			c->freelist = object;
+			c->tid = next_tid(c->tid);
+			stat(c, FREE_FASTPATH);
+			continue;
+		}
+
+		head = object;
+		cnt = 1;
+		if (!(SLABDEBUG && PageSlubDebug(page))) {
+			for (j = i + 1; j < size && p[j]; j++) {
+				void **next = p[j];
+
+				if (virt_to_head_page(next) != page)
+					break;
+				slab_free_hook_irq(s, next);
+				next[c->offset] = head;
+				head = next;
+				cnt++;
+			}
+			i = j - 1;
+		}
+		__slab_free(s, page, head, object, cnt, _RET_IP_, c->offset);
+	}
+
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(kmem_cache_free_bulk);
+
+/**
+ * kmem_cache_alloc_bulk - allocate an array of objects
+ * @s: the cache to allocate from
+ * @flags: the gfp flags, as for kmem_cache_alloc()
+ * @size: the number of objects
+ * @p: the array to fill
+ *
+ * Returns @size, or 0 if not all objects could be allocated, in which
+ * case nothing is left allocated.
+ */
+int kmem_cache_alloc_bulk(struct kmem_cache *s, gfp_t flags, size_t size,
+			  void **p)
+{
+	struct kmem_cache_cpu *c;
+	unsigned long irqflags;
+	size_t i, j;
+
+	flags &= gfp_allowed_mask;
+
+	lockdep_trace_alloc(flags);
+	might_sleep_if(flags & __GFP_WAIT);
+
+	if (should_failslab(s->objsize, flags))
+		return 0;
+
+	local_irq_save(irqflags);
+	c = get_cpu_slab(s, smp_processor_id());
+
+	for (i = 0; i < size; i++) {
+		void **object = c->freelist;
+
+		if (unlikely(!object)) {
+			object = __slab_alloc(s, flags, -1, _RET_IP_, c);
+			if (unlikely(!object))
+				break;
+			/* __slab_alloc may have enabled interrupts */
+			c = get_cpu_slab(s, smp_processor_id());
+		} else {
+			c->freelist = object[c->offset];
+			c->tid = next_tid(c->tid);
+			stat(c, ALLOC_FASTPATH);
+		}
+		p[i] = object;
+	}
+
+	local_irq_restore(irqflags);
+
+	for (j = 0; j < i; j++) {
+		slab_post_alloc_hook(s, flags, p[j]);
+		trace_kmem_cache_alloc(_RET_IP_, p[j], s->objsize, s->size,
+				       flags);
+	}
+
+	if (unlikely(i < size)) {
+		kmem_cache_free_bulk(s, i, p);
+		return 0;
+	}
+	return size;
+}
+EXPORT_SYMBOL(kmem_cache_alloc_bulk);
+
 /* Figure out on which slab page the object resides */
 static struct page *get_object_page(const void *x)
 {
@@ -1939,6 +2226,12 @@ static int slub_min_objects;
  */
 static int slub_nomerge;
 
+/*
+ * Use the interrupt disabled fastpaths even where the lockless ones are
+ * available, for comparing the two.
+ */
+static int slub_nocmpxchg;
+
 /*
  * Calculate the order of allocation given an slab object size.
  *
@@ -2074,12 +2367,16 @@ static void init_kmem_cache_cpu(struct kmem_cache *s,
 {
 	c->page = NULL;
 	c->freelist = NULL;
+	c->tid = 0;
 	c->node = 0;
 	c->offset = s->offset / sizeof(void *);
 	c->objsize = s->objsize;
 #ifdef CONFIG_SLUB_STATS
 	memset(c->stat, 0, NR_SLUB_STAT_ITEMS * sizeof(unsigned));
 #endif
+	/* cmpxchg_double_local() needs the pair naturally aligned */
+	if (!IS_ALIGNED((unsigned long)&c->freelist, 2 * sizeof(void *)))
+		s->flags &= ~__CMPXCHG_DOUBLE;
 }
 
 static void
@@ -2472,6 +2769,10 @@ static int kmem_cache_open(struct kmem_cache *s, gfp_t gfpflags,
 	s->objsize = size;
 	s->align = align;
 	s->flags = kmem_cache_flags(size, flags, name, ctor);
+#ifdef CONFIG_HAVE_CMPXCHG_DOUBLE
+	if (system_has_cmpxchg_double() && !slub_nocmpxchg)
+		s->flags |= __CMPXCHG_DOUBLE;
+#endif
 
 	if (!calculate_sizes(s, -1))
 		goto error;
@@ -2690,6 +2991,14 @@ static int __init setup_slub_nomerge(char *str)
 
 __setup("slub_nomerge", setup_slub_nomerge);
 
+static int __init setup_slub_nocmpxchg(char *str)
+{
+	slub_nocmpxchg = 1;
+	return 1;
+}
+
+__setup("slub_nocmpxchg", setup_slub_nocmpxchg);
+
 static struct kmem_cache *create_kmalloc_cache(struct kmem_cache *s,
 		const char *name, int size, gfp_t gfp_flags)
 {
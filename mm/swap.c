@@ -323,15 +323,19 @@ int lru_add_drain_all(void)
 
 /**
  * release_pages:释放pages页框数组(只有count = 0时,才正真的被回收)
+ *
+ * The freed pages are chained through page->lru and handed to the page
+ * allocator SWAP_CLUSTER_MAX at a time, which also bounds how long
+ * zone->lru_lock is held.
  */
 void release_pages(struct page **pages, int nr, int cold)
 {
 	int i;
-	struct pagevec pages_to_free;
+	LIST_HEAD(pages_to_free);
+	int nr_to_free = 0;
 	struct zone *zone = NULL;
 	unsigned long uninitialized_var(flags);
 
-	pagevec_init(&pages_to_free, cold);
 	for (i = 0; i < nr; i++) {
 		struct page *page = pages[i];
 
@@ -365,20 +369,22 @@ void release_pages(struct page **pages, int nr, int cold)
 			del_page_from_lru(zone, page);
 		}
 
-		/*page加入到pages_to_free页缓存中*/
-		if (!pagevec_add(&pages_to_free, page)) {
+		/*page加入到pages_to_free链表中*/
+		list_add(&page->lru, &pages_to_free);
+		if (++nr_to_free == SWAP_CLUSTER_MAX) {
 			if (zone) {
 				spin_unlock_irqrestore(&zone->lru_lock, flags);
 				zone = NULL;
 			}
-			__pagevec_free(&pages_to_free);
-			pagevec_reinit(&pages_to_free);
-  		}
+			free_hot_cold_page_list(&pages_to_free, cold);
+			nr_to_free = 0;
+		}
 	}
 	if (zone)
 		spin_unlock_irqrestore(&zone->lru_lock, flags);
 
-	pagevec_free(&pages_to_free);
+	if (nr_to_free)
+		free_hot_cold_page_list(&pages_to_free, cold);
 }
 
 /**
@@ -236,7 +236,7 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 
 	lru_add_drain();
 	while (nr) {
-		int todo = min(nr, PAGEVEC_SIZE);
+		int todo = min_t(int, nr, SWAP_CLUSTER_MAX);
 		int i;
 
 		for (i = 0; i < todo; i++)
@@ -327,7 +327,8 @@ void refresh_cpu_vm_stats(int cpu)
 		 * Check if there are pages remaining in this pageset
 		 * if not then there is nothing to expire.
 		 */
-		if (!p->expire || !p->pcp.count)
+		if (!p->expire ||
+		    (!p->pcp.count && !pcp_order_blocks(&p->pcp)))
 			continue;
 
 		/*
@@ -342,8 +343,7 @@ void refresh_cpu_vm_stats(int cpu)
 		if (p->expire)
 			continue;
 
-		if (p->pcp.count)
-			drain_zone_pages(zone, &p->pcp);
+		drain_zone_pages(zone, &p->pcp);
 #endif
 	}
 
@@ -705,7 +705,7 @@ static const char * const vmstat_text[] = {
 static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 							struct zone *zone)
 {
-	int i;
+	int i, j;
 	seq_printf(m, "Node %d, zone %8s", pgdat->node_id, zone->name);
 	seq_printf(m,
 		   "\n  pages free     %lu"
@@ -748,6 +748,16 @@ static void zoneinfo_show_print(struct seq_file *m, pg_data_t *pgdat,
 			   pageset->pcp.count,
 			   pageset->pcp.high,
 			   pageset->pcp.batch);
+		for (j = 1; j <= PCP_MAX_ORDER; j++) {
+			struct per_cpu_order_pages *po;
+
+			po = &pageset->pcp.orders[j - 1];
+			seq_printf(m,
+				   "\n            order %d: count: %i high: %i"
+				   " batch: %i hit: %lu miss: %lu",
+				   j, po->count, po->high, po->batch,
+				   po->hit, po->miss);
+		}
 #ifdef CONFIG_SMP
 		seq_printf(m, "\n  vm stats threshold: %d",
 				pageset->stat_threshold);